@@ -10,6 +10,7 @@
 #include "Tethys/API/Unit.h"
 #include "Tethys/API/Location.h"
 #include "Tethys/Game/GameImpl.h"
+#include "Tethys/Game/MapObjectIndex.h"
 #include <iterator>
 
 namespace Tethys {
@@ -149,6 +150,7 @@ public:
 };
 
 /// Enumerates all units within a given distance of a given location.
+/// If a MapObjectIndex is provided (defaults to MapObjectIndex::GetActive()), it is used instead of the game's function.
 class InRangeEnumerator : public OP2Class<InRangeEnumerator> {
 public:
   class Iterator : public TethysImpl::AreaIteratorBase<Iterator> {
@@ -156,37 +158,65 @@ public:
     using AreaIteratorBase::AreaIteratorBase;
     Iterator(const Location& centerPoint, int maxTileDistance)
       { InternalCtor<0x47A740, const Location&, int>(centerPoint, maxTileDistance);  ++(*this); }
-    ibool GetNext(Unit& currentUnit) { return Thunk<0x47A780, &$::GetNext>(currentUnit); };
+    Iterator(const Location& centerPoint, int maxTileDistance, const MapObjectIndex* pIndex) : pIndex_(pIndex)
+      { pIndex_->BeginRange(&query_, centerPoint, maxTileDistance);  ++(*this); }
+    ibool GetNext(Unit& currentUnit)
+      { return (pIndex_ != nullptr) ? GetNextNative(currentUnit) : Thunk<0x47A780, &$::GetNext>(currentUnit); }
+
+  private:
+    ibool GetNextNative(Unit& currentUnit)
+      { const int index = pIndex_->GetNext(&query_);  currentUnit = Unit((index > 0) ? index : 0);  return (index > 0); }
+
+    const MapObjectIndex*  pIndex_ = nullptr;
+    MapObjectIndex::Query  query_  = { };
   };
 
-  InRangeEnumerator(const Location& centerPoint, int maxTileDistance)
-    : centerPoint_(centerPoint), maxTileDistance_(maxTileDistance) { }
+  InRangeEnumerator(
+    const Location& centerPoint, int maxTileDistance, const MapObjectIndex* pIndex = MapObjectIndex::GetActive())
+    : centerPoint_(centerPoint), maxTileDistance_(maxTileDistance), pIndex_(pIndex) { }
 
-  Iterator begin() { return Iterator(centerPoint_, maxTileDistance_); }
-  Iterator end()   { return Iterator();                               }
+  Iterator begin() {
+    return (pIndex_ != nullptr) ? Iterator(centerPoint_, maxTileDistance_, pIndex_)
+                                : Iterator(centerPoint_, maxTileDistance_);
+  }
+  Iterator end()   { return Iterator(); }
 
 private:
-  Location centerPoint_;
-  int      maxTileDistance_;
+  Location              centerPoint_;
+  int                   maxTileDistance_;
+  const MapObjectIndex* pIndex_;
 };
 
 /// Eenumerates all units within a given rectangle.
+/// If a MapObjectIndex is provided (defaults to MapObjectIndex::GetActive()), it is used instead of the game's function.
 class InRectEnumerator : public OP2Class<InRectEnumerator> {
 public:
   class Iterator : public TethysImpl::AreaIteratorBase<Iterator> {
   public:
     using AreaIteratorBase::AreaIteratorBase;
     explicit Iterator(const MapRect& rect) { InternalCtor<0x47A610, const MapRect&>(rect);  ++(*this); }
-    ibool GetNext(Unit& currentUnit) { return Thunk<0x47A6A0, &$::GetNext>(currentUnit); }
+    Iterator(const MapRect& rect, const MapObjectIndex* pIndex) : pIndex_(pIndex)
+      { pIndex_->BeginRect(&query_, rect);  ++(*this); }
+    ibool GetNext(Unit& currentUnit)
+      { return (pIndex_ != nullptr) ? GetNextNative(currentUnit) : Thunk<0x47A6A0, &$::GetNext>(currentUnit); }
+
+  private:
+    ibool GetNextNative(Unit& currentUnit)
+      { const int index = pIndex_->GetNext(&query_);  currentUnit = Unit((index > 0) ? index : 0);  return (index > 0); }
+
+    const MapObjectIndex*  pIndex_ = nullptr;
+    MapObjectIndex::Query  query_  = { };
   };
 
-  explicit InRectEnumerator(const MapRect& rect) : rect_(rect) { }
+  explicit InRectEnumerator(const MapRect& rect, const MapObjectIndex* pIndex = MapObjectIndex::GetActive())
+    : rect_(rect), pIndex_(pIndex) { }
 
-  Iterator begin() { return Iterator(rect_); }
-  Iterator end()   { return Iterator();      }
+  Iterator begin() { return (pIndex_ != nullptr) ? Iterator(rect_, pIndex_) : Iterator(rect_); }
+  Iterator end()   { return Iterator(); }
 
 private:
-  MapRect rect_;
+  MapRect               rect_;
+  const MapObjectIndex* pIndex_;
 };
 
 /// Enumerates all units at a given location.
@@ -9,6 +9,7 @@
 
 #include "Tethys/Common/Memory.h"
 #include "Tethys/Game/GameImpl.h"
+#include "Tethys/Game/MapImpl.h"
 #include "Tethys/Game/Random.h"
 #include "Tethys/Game/BlightLavaManager.h"
 #include "Tethys/Resource/SoundManager.h"
@@ -145,8 +146,10 @@ public:
     { Unit u; OP2Thunk<0x478BB0, int FASTCALL(Unit&, int, int, int)>(u, location.x, location.y, int(type)); return u; }
 
   /// Creates a wall on the given tile.
-  static void CreateWall(MapID type, Location location)
-    { OP2Thunk<0x478AA0, ibool FASTCALL(int, int, int, MapID)>(location.x, location.y, 0, type); }
+  static void CreateWall(MapID type, Location location) {
+    OP2Thunk<0x478AA0, ibool FASTCALL(int, int, int, MapID)>(location.x, location.y, 0, type);
+    MapImpl::NotifyTilesChanged(MapRect(location, location));
+  }
 
   /// Creates a block of walls over the given area.
   static void CreateWall(MapID type, const MapRect& area) {
@@ -32,15 +32,16 @@ public:
 
   static void InitialSetTile(Location   where, int tileIndex) { return GetImpl()->InitialSetTile(where, tileIndex); }
   static void FASTCALL SetTile(Location where, int tileIndex)
-    { return OP2Thunk<0x476D80, &$::SetTile>(where, tileIndex); }
+    { OP2Thunk<0x476D80, &$::SetTile>(where, tileIndex);  TilesChanged(where); }
   static void FASTCALL SetLavaPossible(Location where, ibool lavaPossible)
     { return OP2Thunk<0x476F20, &$::SetLavaPossible>(where, lavaPossible); }
 
-  static void SetCellType(Location       where, CellType type) { GetImpl()->Tile(where).cellType  = uint32(type); }
+  static void SetCellType(Location       where, CellType type)
+    { GetImpl()->Tile(where).cellType  = uint32(type);  TilesChanged(where); }
   static void SetUnitOnTile(Location     where, Unit     unit) { GetImpl()->Tile(where).unitIndex = unit.id_;     }
   static void SetLavaPresent(Location    where, bool     lava) { GetImpl()->Tile(where).lava      = lava;         }
   static void SetWallOrBuilding(Location where, bool     wallOrBuilding)
-    { GetImpl()->Tile(where).wallOrBuilding = wallOrBuilding; }
+    { GetImpl()->Tile(where).wallOrBuilding = wallOrBuilding;  TilesChanged(where); }
   ///@}
 
   /// Sets the daylight position on the map.
@@ -102,6 +103,8 @@ public:
   ///@}
 
 private:
+  static void TilesChanged(Location where) { MapImpl::NotifyTilesChanged(MapRect(where, where)); }
+
   static void SetLavaFlowHelper(Location where, int topLeft, int topRight, int bottomLeft, int bottomRight) {
     SetTile(where,                  topLeft);
     SetTile(where + Location(0, 1), topRight);
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+
+#include <utility>
+
+#if !defined(_WIN32)
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace Tethys {
+
+/// Portable read-only memory mapping of a whole file (POSIX mmap or Win32 file mappings), for native file parsers that
+/// run outside of the game.
+class FileMapping {
+public:
+   FileMapping() = default;
+  ~FileMapping() { Close(); }
+
+  FileMapping(const FileMapping&)            = delete;
+  FileMapping& operator=(const FileMapping&) = delete;
+
+  FileMapping(FileMapping&& other) noexcept { *this = std::move(other); }
+  FileMapping& operator=(FileMapping&& other) noexcept {
+    if (this != &other) {
+      Close();
+      std::swap(pData_, other.pData_);
+      std::swap(size_,  other.size_);
+    }
+    return *this;
+  }
+
+  /// Maps the given file.  Returns false if the file can't be opened or is empty.
+  bool Open(const char* pFilename);
+
+  /// Unmaps the file.
+  void Close();
+
+  bool        IsOpen() const { return (pData_ != nullptr); }
+  const void* Data()   const { return pData_;              }
+  size_t      Size()   const { return size_;               }
+
+private:
+  const void* pData_ = nullptr;
+  size_t      size_  = 0;
+};
+
+// =====================================================================================================================
+inline bool FileMapping::Open(
+  const char* pFilename)
+{
+  Close();
+
+  void*  pMapping = nullptr;
+  size_t size     = 0;
+
+#if defined(_WIN32)
+  const HANDLE hFile = CreateFileA(
+    pFilename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (hFile != INVALID_HANDLE_VALUE) {
+    LARGE_INTEGER fileSize = { };
+    if (GetFileSizeEx(hFile, &fileSize) && (fileSize.QuadPart > 0) && (uint64(fileSize.QuadPart) <= SIZE_MAX)) {
+      // The view keeps the mapping object alive, so both handles can be closed right away.
+      const HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (hMapping != NULL) {
+        pMapping = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        size     = size_t(fileSize.QuadPart);
+        CloseHandle(hMapping);
+      }
+    }
+    CloseHandle(hFile);
+  }
+#else
+  const int fd = open(pFilename, O_RDONLY);
+  if (fd != -1) {
+    struct stat info = { };
+    if ((fstat(fd, &info) == 0) && (info.st_size > 0)) {
+      // The mapping holds its own reference to the file, so the descriptor can be closed right away.
+      size     = size_t(info.st_size);
+      pMapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (pMapping == MAP_FAILED) {
+        pMapping = nullptr;
+      }
+    }
+    close(fd);
+  }
+#endif
+
+  if (pMapping != nullptr) {
+    pData_ = pMapping;
+    size_  = size;
+  }
+
+  return IsOpen();
+}
+
+// =====================================================================================================================
+inline void FileMapping::Close() {
+  if (pData_ != nullptr) {
+#if defined(_WIN32)
+    UnmapViewOfFile(pData_);
+#else
+    munmap(const_cast<void*>(pData_), size_);
+#endif
+  }
+
+  pData_ = nullptr;
+  size_  = 0;
+}
+
+} // Tethys
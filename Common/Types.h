@@ -6,10 +6,10 @@
 
 #include <cstdint>
 
-// Pull in windows headers (or fakes for CLIF)
-#ifndef SWIG
+// Pull in windows headers (or fakes for CLIF).  Portable headers (e.g. VolArchive.h) can be used on other platforms.
+#if !defined(SWIG) && (defined(_WIN32) || defined(CLIF))
 # include "Tethys/Common/WinTypes.h"
-#endif  // !SWIG
+#endif  // !SWIG && (_WIN32 || CLIF)
 
 namespace Tethys::TethysAPI{};
 
@@ -113,19 +113,23 @@ using uintptr = uintptr_t;
 #endif  // PACKED
 
 #ifndef BEGIN_PACKED
-# if defined(SWIG) || !defined(_MSC_VER)
+# if defined(SWIG)
 #  define BEGIN_PACKED
-# else
+# elif defined(_MSC_VER)
 #  define BEGIN_PACKED __pragma(pack(push, 1))
-# endif  // SWIG || !_MSC_VER
+# else
+#  define BEGIN_PACKED _Pragma("pack(push, 1)")
+# endif  // SWIG
 #endif  // BEGIN_PACKED
 
 #ifndef END_PACKED
-# if defined(SWIG) || !defined(_MSC_VER)
+# if defined(SWIG)
 #  define END_PACKED
-# else
+# elif defined(_MSC_VER)
 #  define END_PACKED __pragma(pack(pop))
-# endif  // SWIG || !_MSC_VER
+# else
+#  define END_PACKED _Pragma("pack(pop)")
+# endif  // SWIG
 #endif  // END_PACKED
 
 } // Tethys
@@ -4,6 +4,7 @@
 #include "Tethys/Common/Types.h"
 
 #include <initializer_list>
+#include <type_traits>
 #include <cstdlib>
 #include <cstdio>
 
@@ -37,7 +38,7 @@ inline bool GetNextBit(
 #elif defined(_WIN32)
   _BitScanForward(reinterpret_cast<unsigned long*>(pIndex), mask);
 #elif defined(__GNUC__)
-  *pIndex = __builtin_ctz(mask);
+  *pIndex = (mask != 0) ? __builtin_ctz(mask) : *pIndex;  // __builtin_ctz(0) is undefined.
 #else
   if (mask != 0) {
     uint32 index = 0;
@@ -53,6 +54,38 @@ inline bool GetNextBit(
   return result;
 }
 
+/// Returns the number of set bits in mask.
+inline uint32 PopCount(
+  uint32 mask)
+{
+#if defined(__GNUC__)
+  return __builtin_popcount(mask);
+#else
+  // MSVC's __popcnt requires the POPCNT instruction, which older CPUs that can run OP2 lack;  use a SWAR count instead.
+  mask = mask - ((mask >> 1) & 0x55555555);
+  mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+  return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+#endif
+}
+
+/// Computes the FNV-1a hash of a byte range, as a uint32 or uint64.  To hash several ranges as one, pass the previous
+/// result as hash.
+template <typename T = uint64>
+T Fnv1a(
+  const void*  pData,
+  size_t       size,
+  T            hash = (sizeof(T) == sizeof(uint64)) ? T(0xCBF29CE484222325ull) : T(0x811C9DC5u))
+{
+  static_assert(std::is_same<T, uint32>::value || std::is_same<T, uint64>::value, "FNV-1a is 32 or 64 bits wide.");
+  constexpr T Prime = (sizeof(T) == sizeof(uint64)) ? T(0x00000100000001B3ull) : T(0x01000193u);
+
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ static_cast<const uint8*>(pData)[i]) * Prime;
+  }
+
+  return hash;
+}
+
 /// Type erasure reference accessor class for immutable, possibly temporary, array-like types.
 template <typename T>
 class Span {
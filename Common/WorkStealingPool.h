@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+
+namespace Tethys {
+
+/// Runs a batch of independent tasks across threads with work stealing.
+///
+/// Each worker starts with an equal contiguous range of task indices, and runs them in order from the front.  A worker
+/// that runs out steals the back half of another worker's remaining range, so a few slow tasks don't leave threads
+/// idle, while workers still mostly run neighbouring tasks.
+class WorkStealingPool {
+public:
+  /// Calls fn(size_t index, int worker) for each index in [0, count), using up to numThreads threads (0 = one per
+  /// hardware thread).  worker is in [0, numThreads) and can be used to index per-thread scratch data.  The calling
+  /// thread runs worker 0.  Returns the number of threads used.
+  template <typename Fn>  static int ParallelFor(size_t count, int numThreads, Fn&& fn);
+
+  /// Gets the number of threads ParallelFor() uses for the given requested thread count and task count.
+  static int NumThreads(size_t count, int numThreads) {
+    if (numThreads <= 0) {
+      numThreads = (std::max)(int(std::thread::hardware_concurrency()), 1);
+    }
+    return int((std::max)((std::min)(size_t(numThreads), count), size_t(1)));
+  }
+
+private:
+  /// Remaining task range of one worker.  Padded to a cache line to avoid false sharing between workers.
+  struct alignas(64) Range {
+    std::mutex lock;
+    size_t     begin = 0;
+    size_t     end   = 0;
+  };
+
+  /// Takes the next index from the front of a range.
+  static bool Pop(Range* pRange, size_t* pIndex) {
+    std::lock_guard<std::mutex> guard(pRange->lock);
+    const bool result = (pRange->begin < pRange->end);
+    if (result) {
+      *pIndex = pRange->begin++;
+    }
+    return result;
+  }
+
+  /// Moves the back half of the victim's range to the thief's (empty) range.
+  static bool Steal(Range* pVictim, Range* pThief);
+};
+
+// =====================================================================================================================
+inline bool WorkStealingPool::Steal(
+  Range*  pVictim,
+  Range*  pThief)
+{
+  size_t begin = 0;
+  size_t end   = 0;
+  {
+    std::lock_guard<std::mutex> guard(pVictim->lock);
+    end   = pVictim->end;
+    begin = pVictim->begin + ((pVictim->end - pVictim->begin) / 2);
+    pVictim->end = begin;
+  }
+
+  const bool result = (begin < end);
+  if (result) {
+    std::lock_guard<std::mutex> guard(pThief->lock);
+    pThief->begin = begin;
+    pThief->end   = end;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+template <typename Fn>
+int WorkStealingPool::ParallelFor(
+  size_t  count,
+  int     numThreads,
+  Fn&&    fn)
+{
+  numThreads = NumThreads(count, numThreads);
+
+  std::vector<Range> ranges(numThreads);
+  for (int i = 0; i < numThreads; ++i) {
+    ranges[i].begin = (count * i)       / numThreads;
+    ranges[i].end   = (count * (i + 1)) / numThreads;
+  }
+
+  auto worker = [&ranges, numThreads, &fn](int self) {
+    for (bool found = true; found;) {
+      for (size_t index; Pop(&ranges[self], &index); fn(index, self));
+
+      // Out of work;  steal from the others, starting with the next worker.  Tasks are never added, so if every range
+      // is empty, the remaining tasks are all being run (or were just stolen by a worker that will run them).
+      found = false;
+      for (int i = 1; (found == false) && (i < numThreads); ++i) {
+        found = Steal(&ranges[(self + i) % numThreads], &ranges[self]);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads - 1);
+  for (int i = 1; i < numThreads; ++i) {
+    threads.emplace_back(worker, i);
+  }
+
+  worker(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  return numThreads;
+}
+
+} // Tethys
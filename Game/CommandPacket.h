@@ -4,6 +4,12 @@
 #include "Tethys/Common/Util.h"
 #include "Tethys/API/Location.h"
 
+#include <type_traits>
+#include <utility>
+#include <array>
+#include <algorithm>
+#include <cstring>
+
 namespace Tethys {
 
 // ** TODO This interface will change substantially when a CmdPacketBuilder/Parser is made.
@@ -451,17 +457,457 @@ OP2_CMD_PACKET_DATA_FOR_DEF(CommandType::InvalidCommand,  void);
 template <CommandType Command>  using CmdPacketDataFor = typename TethysImpl::CmdPacketDataForImpl<Command>::Type;
 
 
+/// Builds a CommandPacket in place from typed command data, with variable-length unit ID and waypoint arrays.
+///
+/// Command data structs derived from SimpleCommand/MoveCommand only describe the layout for 1 unit and 1 waypoint; the
+/// writer serializes the actual arrays and then the command-specific fields that follow them.  No heap is used.
+///
+/// @code
+///   CmdPacketWriter writer;
+///   AttackCommand fields = { };
+///   fields.target = { uint16(where.x), uint16(where.y) };
+///   writer.Begin<CommandType::Attack>(fields);
+///   for (Unit u : units) { writer.AddUnit(u.id_); }
+///   player.ProcessCommandPacket(writer.Finish());
+/// @endcode
 class CmdPacketWriter {
 public:
-  // ** TODO
+  static constexpr size_t MaxUnits     = 32;
+  static constexpr size_t MaxWaypoints = 8;
+
+  /// How the packet data is laid out.
+  enum class Layout : uint8 {
+    Raw = 0,     ///< Fixed struct with no unit array (or no data).
+    SingleUnit,  ///< SingleUnitSimpleCommand header.
+    Simple,      ///< SimpleCommand header (unit array).
+    Move,        ///< MoveCommand header (unit array, waypoint array).
+  };
+
+  CmdPacketWriter() { Reset(CommandType::Nop); }
+
+  /// Begins a new packet with no data.
+  void Reset(CommandType type);
+
+  /// Begins a new packet of the given type.  Any unit ID or waypoint arrays in fields are ignored; all other fields are
+  /// copied into the packet.
+  template <CommandType Command, typename T = CmdPacketDataFor<Command>>
+  void Begin(const T& fields);
+  template <CommandType Command>
+  void Begin() { BeginDefault<Command>(std::is_void<CmdPacketDataFor<Command>>{ }); }
+
+  /// Parses a serialized packet of the given type into this writer's unit, waypoint, and field arrays, and optionally
+  /// into a typed struct (which holds at most the first unit and waypoint).  Returns false if the packet is malformed.
+  /// Commands with no data struct (e.g. Nop, ChatText) keep their data as raw fields, so Finish() reproduces them.
+  template <CommandType Command, typename T = CmdPacketDataFor<Command>>
+  bool Decode(const CommandPacket& packet, T* pFields = nullptr)
+    { return DecodeDefault<Command>(packet, pFields, std::is_void<T>{ }); }
+
+  /// Adds a unit to the packet.  Returns false if the packet is full.
+  bool AddUnit(uint16 unitID);
+
+  /// Removes a unit from the packet.  Returns false if it was not in the packet.
+  bool RemoveUnit(uint16 unitID);
+
+  /// Returns the index of the unit in the packet, or NumUnits() if it is not in the packet.
+  size_t FindUnit(uint16 unitID) const
+    { return size_t(std::find(&units_[0], &units_[numUnits_], unitID) - &units_[0]); }
+
+  /// Adds a waypoint to the packet (Move layout only).  Returns false if the packet is full.
+  bool AddWaypoint(Waypoint waypoint);
+
+  /// Returns true if other has the same command type, fields, and waypoints, such that their units can be issued as
+  /// one packet.
+  bool CanMerge(const CmdPacketWriter& other) const;
+
+  /// Serializes the packet and returns it.  The writer can continue to be added to afterwards.
+  const CommandPacket& Finish();
+
+  CommandType Type()         const { return packet_.type;  }
+  Layout      GetLayout()    const { return layout_;        }
+  size_t      NumUnits()     const { return numUnits_;      }
+  size_t      NumWaypoints() const { return numWaypoints_;  }
+  bool        IsEmpty()      const { return (layout_ != Layout::Raw) && (numUnits_ == 0); }
+
+  /// Gets the serialized data length of the packet in its current state.
+  size_t DataLength() const;
+
+  /// Gets the data layout used by the given command type.
+  static Layout LayoutFor(CommandType type);
+
+private:
+  template <CommandType Command>  void BeginDefault(std::true_type)  { Reset(Command);                                }
+  template <CommandType Command>  void BeginDefault(std::false_type) { Begin<Command>(CmdPacketDataFor<Command>{ }); }
+
+  template <CommandType Command>
+  bool DecodeDefault(const CommandPacket& packet, void* pFields, std::true_type);
+  template <CommandType Command, typename T>
+  bool DecodeDefault(const CommandPacket& packet, T*    pFields, std::false_type);
+
+  /// Gets the size of the unit/waypoint header for the given layout, excluding the arrays.
+  static constexpr size_t HeaderSize(Layout layout) {
+    return (layout == Layout::Move)   ? (sizeof(uint8) + sizeof(uint16)) :
+           (layout == Layout::Simple) ?  sizeof(uint8)                    : 0;
+  }
+
+  /// Gets the layout and the size of the header struct that precedes the command-specific fields of T.
+  template <typename T>  static constexpr Layout LayoutOf() {
+    return std::is_base_of<MoveCommand,             T>::value ? Layout::Move       :
+           std::is_base_of<SimpleCommand,           T>::value ? Layout::Simple     :
+           std::is_base_of<SingleUnitSimpleCommand, T>::value ? Layout::SingleUnit : Layout::Raw;
+  }
+  template <typename T>  static constexpr size_t BaseSizeOf() {
+    constexpr Layout layout = LayoutOf<T>();
+    return (layout == Layout::Move)       ? sizeof(MoveCommand)             :
+           (layout == Layout::Simple)     ? sizeof(SimpleCommand)           :
+           (layout == Layout::SingleUnit) ? sizeof(SingleUnitSimpleCommand) : 0;
+  }
+
+  template <size_t... Is>
+  static constexpr std::array<Layout, sizeof...(Is)> MakeLayoutTable(std::index_sequence<Is...>)
+    { return {{ LayoutOf<CmdPacketDataFor<CommandType(Is)>>()... }}; }
 
 public:
   CommandPacket packet_;
   uint8*        pDataWriter_;
-  uint16        units_[32];
+  uint16        units_[MaxUnits];
   size_t        numUnits_;
-  Waypoint      waypoints_[8];
+  Waypoint      waypoints_[MaxWaypoints];
   size_t        numWaypoints_;
-};
+  uint8         fields_[CommandPacketDataSize];  ///< Command-specific fields that follow the unit/waypoint arrays.
+  size_t        fieldsSize_;
+  Layout        layout_;
+};
+
+
+/// Coalesces identical commands issued to different units into multi-unit packets, up to CmdPacketWriter::MaxUnits per
+/// packet.  Intended to collect an AI's per-tick orders (e.g. Unit::DoMove/DoAttack equivalents) for one player, and
+/// then issue them with Flush().  Each unit's last order wins:  adding a unit removes it from any other pending packet,
+/// and a unit is never listed twice in one packet.  No heap is used.
+///
+/// @code
+///   CmdPacketBatcher batch;
+///   for (Unit u : attackers) {
+///     if (batch.Add<CommandType::Attack>(u.id_, fields) == false) { batch.Flush(issue);  batch.Add<...>(...); }
+///   }
+///   batch.Flush([&player](const CommandPacket& packet) { player.ProcessCommandPacket(packet); });
+/// @endcode
+class CmdPacketBatcher {
+public:
+  static constexpr size_t MaxPending = 16;  ///< Max number of distinct pending packets.
+
+  /// Adds a unit to a pending packet with the same command type, fields, and waypoints, or starts a new one, replacing
+  /// any order the unit already has pending.  Returns false if there is no room, in which case Flush() should be called
+  /// first;  the unit's previous order is then left as it was.
+  template <CommandType Command, typename T = CmdPacketDataFor<Command>>
+  bool Add(uint16 unitID, const T& fields, const Waypoint* pWaypoints = nullptr, size_t numWaypoints = 0);
+  template <CommandType Command>
+  bool Add(uint16 unitID) { return Add<Command>(unitID, CmdPacketDataFor<Command>{ }); }
+
+  /// Calls sink(const CommandPacket&) for each pending packet in the order they were started, then clears them.
+  /// Returns the number of packets issued.
+  template <typename Fn>  size_t Flush(Fn&& sink);
+
+  void   Clear()             { numPending_ = 0;    }
+  size_t NumPending()  const { return numPending_; }
+
+private:
+  CmdPacketWriter pending_[MaxPending + 1];  ///< The last entry is scratch space for Add().
+  size_t          numPending_ = 0;
+};
+
+// =====================================================================================================================
+inline void CmdPacketWriter::Reset(
+  CommandType type)
+{
+  packet_       = { type, 0 };
+  pDataWriter_  = &packet_.data.buffer[0];
+  numUnits_     = 0;
+  numWaypoints_ = 0;
+  fieldsSize_   = 0;
+  layout_       = Layout::Raw;
+}
+
+// =====================================================================================================================
+template <CommandType Command, typename T>
+void CmdPacketWriter::Begin(
+  const T& fields)
+{
+  static_assert(std::is_same<T, CmdPacketDataFor<Command>>::value, "Data type does not match the command type.");
+  static_assert(std::is_trivially_copyable<T>::value,              "Command data must be trivially copyable.");
+  static_assert(sizeof(T) <= CommandPacketDataSize,                "Command data does not fit in a CommandPacket.");
+  static_assert((LayoutOf<T>() != Layout::Move) || ((HeaderSize(Layout::Move) + (sizeof(uint16) * MaxUnits) +
+                                                     (sizeof(Waypoint) * MaxWaypoints)) <= CommandPacketDataSize),
+                "Move command header does not fit in a CommandPacket.");
+
+  constexpr size_t FieldsOffset = BaseSizeOf<T>();
+
+  Reset(Command);
+  layout_     = LayoutOf<T>();
+  fieldsSize_ = sizeof(T) - FieldsOffset;
+  memcpy(&fields_[0], reinterpret_cast<const uint8*>(&fields) + FieldsOffset, fieldsSize_);
+}
+
+// =====================================================================================================================
+template <CommandType Command>
+bool CmdPacketWriter::DecodeDefault(
+  const CommandPacket&  packet,
+  void*                 pFields,
+  std::true_type)
+{
+  Reset(Command);
+  fieldsSize_ = (std::min)(size_t(packet.dataLength), CommandPacketDataSize);
+
+  const bool result = (packet.type == Command) && (packet.dataLength <= CommandPacketDataSize);
+  if (result) {
+    memcpy(&fields_[0], &packet.data.buffer[0], fieldsSize_);
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+template <CommandType Command, typename T>
+bool CmdPacketWriter::DecodeDefault(
+  const CommandPacket&  packet,
+  T*                    pFields,
+  std::false_type)
+{
+  static_assert(std::is_same<T, CmdPacketDataFor<Command>>::value, "Data type does not match the command type.");
+  static_assert(std::is_trivially_copyable<T>::value,              "Command data must be trivially copyable.");
+
+  constexpr size_t FieldsOffset = BaseSizeOf<T>();
+
+  Reset(Command);
+  layout_     = LayoutOf<T>();
+  fieldsSize_ = sizeof(T) - FieldsOffset;
+
+  const uint8*       p      = &packet.data.buffer[0];
+  const uint8*const  pEnd   = p + (std::min)(size_t(packet.dataLength), CommandPacketDataSize);
+  bool               result = (packet.type == Command);
+
+  if (result && (layout_ == Layout::SingleUnit)) {
+    result = (size_t(pEnd - p) >= sizeof(uint16));
+    if (result) {
+      memcpy(&units_[0], p, sizeof(uint16));
+      numUnits_ = 1;
+      p        += sizeof(uint16);
+    }
+  }
+  else if (result && ((layout_ == Layout::Simple) || (layout_ == Layout::Move))) {
+    numUnits_ = (p < pEnd) ? *(p++) : 0;
+    result    = (numUnits_ <= MaxUnits) && ((sizeof(uint16) * numUnits_) <= size_t(pEnd - p));
+    if (result) {
+      memcpy(&units_[0], p, sizeof(uint16) * numUnits_);
+      p += sizeof(uint16) * numUnits_;
+    }
+
+    if (result && (layout_ == Layout::Move)) {
+      uint16 numWaypoints = 0;
+      result = (size_t(pEnd - p) >= sizeof(numWaypoints));
+      if (result) {
+        memcpy(&numWaypoints, p, sizeof(numWaypoints));
+        p     += sizeof(numWaypoints);
+        result = (numWaypoints <= MaxWaypoints) && ((sizeof(Waypoint) * numWaypoints) <= size_t(pEnd - p));
+      }
+
+      if (result) {
+        numWaypoints_ = numWaypoints;
+        memcpy(&waypoints_[0], p, sizeof(Waypoint) * numWaypoints_);
+        p += sizeof(Waypoint) * numWaypoints_;
+      }
+    }
+  }
+
+  result = result && (fieldsSize_ <= size_t(pEnd - p));
+  if (result) {
+    memcpy(&fields_[0], p, fieldsSize_);
+
+    if (pFields != nullptr) {
+      // Rebuild the fixed-size struct, which has room for the first unit ID and waypoint.
+      uint8*const pOut = reinterpret_cast<uint8*>(pFields);
+      memset(pOut, 0, sizeof(T));
+
+      if (layout_ == Layout::SingleUnit) {
+        memcpy(pOut, &units_[0], sizeof(uint16));
+      }
+      else if ((layout_ == Layout::Simple) || (layout_ == Layout::Move)) {
+        pOut[0] = uint8(numUnits_);
+        memcpy(pOut + sizeof(uint8), &units_[0], sizeof(uint16) * (std::min)(numUnits_, size_t(1)));
+
+        if (layout_ == Layout::Move) {
+          const uint16 numWaypoints = uint16(numWaypoints_);
+          memcpy(pOut + sizeof(SimpleCommand), &numWaypoints, sizeof(numWaypoints));
+          memcpy(pOut + sizeof(SimpleCommand) + sizeof(numWaypoints),
+                 &waypoints_[0],
+                 sizeof(Waypoint) * (std::min)(numWaypoints_, size_t(1)));
+        }
+      }
+
+      memcpy(pOut + FieldsOffset, &fields_[0], fieldsSize_);
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline size_t CmdPacketWriter::DataLength() const {
+  return ((layout_ == Layout::SingleUnit) ? sizeof(uint16) * numUnits_ : 0) + HeaderSize(layout_) +
+         (((layout_ == Layout::Simple) || (layout_ == Layout::Move)) ? (sizeof(uint16) * numUnits_) : 0) +
+         (sizeof(Waypoint) * numWaypoints_) + fieldsSize_;
+}
+
+// =====================================================================================================================
+inline CmdPacketWriter::Layout CmdPacketWriter::LayoutFor(
+  CommandType type)
+{
+  static constexpr auto Table = MakeLayoutTable(std::make_index_sequence<size_t(CommandType::Count)>());
+  return (size_t(type) < Table.size()) ? Table[size_t(type)] : Layout::Raw;
+}
+
+// =====================================================================================================================
+inline bool CmdPacketWriter::AddUnit(
+  uint16 unitID)
+{
+  const size_t maxUnits = (layout_ == Layout::Raw) ? 0 : (layout_ == Layout::SingleUnit) ? 1 : MaxUnits;
+  const bool   result   = (numUnits_ < maxUnits) && ((DataLength() + sizeof(uint16)) <= CommandPacketDataSize);
+
+  if (result) {
+    units_[numUnits_++] = unitID;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool CmdPacketWriter::AddWaypoint(
+  Waypoint waypoint)
+{
+  const bool result = (layout_ == Layout::Move) && (numWaypoints_ < MaxWaypoints) &&
+                      ((DataLength() + sizeof(Waypoint)) <= CommandPacketDataSize);
+
+  if (result) {
+    waypoints_[numWaypoints_++] = waypoint;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool CmdPacketWriter::RemoveUnit(
+  uint16 unitID)
+{
+  const size_t index  = FindUnit(unitID);
+  const bool   result = (index < numUnits_);
+
+  if (result) {
+    memmove(&units_[index], &units_[index + 1], sizeof(uint16) * (numUnits_ - index - 1));
+    --numUnits_;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool CmdPacketWriter::CanMerge(
+  const CmdPacketWriter& other
+  ) const
+{
+  bool result = (packet_.type  == other.packet_.type) && (layout_ == other.layout_) &&
+                (numWaypoints_ == other.numWaypoints_) && (fieldsSize_ == other.fieldsSize_) &&
+                ((layout_ == Layout::Simple) || (layout_ == Layout::Move));
+
+  for (size_t i = 0; result && (i < numWaypoints_); ++i) {
+    result = (waypoints_[i].u32All == other.waypoints_[i].u32All);
+  }
+
+  return result && (memcmp(&fields_[0], &other.fields_[0], fieldsSize_) == 0);
+}
+
+// =====================================================================================================================
+inline const CommandPacket& CmdPacketWriter::Finish() {
+  uint8* p = &packet_.data.buffer[0];
+
+  if (layout_ == Layout::SingleUnit) {
+    const uint16 unitID = (numUnits_ != 0) ? units_[0] : 0;
+    memcpy(p, &unitID, sizeof(unitID));
+    p += sizeof(unitID);
+  }
+  else if ((layout_ == Layout::Simple) || (layout_ == Layout::Move)) {
+    *(p++) = uint8(numUnits_);
+    memcpy(p, &units_[0], sizeof(uint16) * numUnits_);
+    p += sizeof(uint16) * numUnits_;
+
+    if (layout_ == Layout::Move) {
+      const uint16 numWaypoints = uint16(numWaypoints_);
+      memcpy(p, &numWaypoints, sizeof(numWaypoints));
+      memcpy(p + sizeof(numWaypoints), &waypoints_[0], sizeof(Waypoint) * numWaypoints_);
+      p += sizeof(numWaypoints) + (sizeof(Waypoint) * numWaypoints_);
+    }
+  }
+
+  memcpy(p, &fields_[0], fieldsSize_);
+  pDataWriter_       = p + fieldsSize_;
+  packet_.dataLength = uint16(pDataWriter_ - &packet_.data.buffer[0]);
+  return packet_;
+}
+
+// =====================================================================================================================
+template <CommandType Command, typename T>
+bool CmdPacketBatcher::Add(
+  uint16           unitID,
+  const T&         fields,
+  const Waypoint*  pWaypoints,
+  size_t           numWaypoints)
+{
+  // Build the candidate in the next free slot, so it doesn't need to be copied if it starts a new packet.
+  CmdPacketWriter& candidate = pending_[numPending_];
+  candidate.Begin<Command>(fields);
+
+  bool result = true;
+  for (size_t i = 0; result && (i < numWaypoints); result = candidate.AddWaypoint(pWaypoints[i++]));
+
+  if (result) {
+    // Add the unit to the first matching packet with room (or that already has it), else to the candidate.  The unit is
+    // only removed from its other pending packets once that succeeds, so a failed Add() changes nothing.
+    size_t target = MaxPending + 1;
+    for (size_t i = 0; (target > MaxPending) && (i <= numPending_); ++i) {
+      CmdPacketWriter& packet = pending_[i];
+      if ((i < numPending_) ? packet.CanMerge(candidate) : (numPending_ < MaxPending)) {
+        target = ((packet.FindUnit(unitID) < packet.NumUnits()) || packet.AddUnit(unitID)) ? i : target;
+      }
+    }
+
+    result = (target <= MaxPending);
+    if (result) {
+      for (size_t i = 0; i < numPending_; ++i) {
+        if (i != target) {
+          pending_[i].RemoveUnit(unitID);
+        }
+      }
+      numPending_ += (target == numPending_);
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+template <typename Fn>
+size_t CmdPacketBatcher::Flush(
+  Fn&& sink)
+{
+  size_t numIssued = 0;
+
+  for (size_t i = 0; i < numPending_; ++i) {
+    if (pending_[i].IsEmpty() == false) {
+      sink(pending_[i].Finish());
+      ++numIssued;
+    }
+  }
+
+  numPending_ = 0;
+  return numIssued;
+}
 
 } // Tethys
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "Tethys/Game/CommandPacket.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+namespace Tethys {
+
+/// Bounded lock-free multi-producer, single-consumer queue of pre-built CommandPackets, for issuing commands planned on
+/// background threads.
+///
+/// Planner threads Push() packets tagged with the tick they're meant for and a planner ID.  At the tick boundary, the
+/// game thread calls Drain(), which releases due packets in (tick, planner ID, per-planner push order) order, so the
+/// order packets are issued in doesn't depend on thread timing.  Each planner ID must push from one thread at a time,
+/// and packets must be pushed before the Drain() of their tick (a late packet is released by the next Drain()).
+///
+/// Drain() never allocates.  Packets collected for later ticks are held in a pending list of at most Capacity()
+/// packets;  once it is full, packets are left in the ring, and Push() fails when the ring is full as well.  Producers
+/// should treat a failed Push() as backpressure and retry later.  Size the queue to hold all packets planned ahead.
+///
+/// @code
+///   // Planner thread:
+///   queue.Push(Game::Tick() + latency, plannerID, writer.Finish());
+///
+///   // Game thread, e.g. in the mission's per-tick callback:
+///   queue.Drain(Game::Tick(), 1, [&](const CommandPacket& packet) { *pPlayer->GetNextCommandPacket() = packet; });
+/// @endcode
+class CommandPacketQueue {
+public:
+  static constexpr size_t MaxPlanners = 64;
+
+  /// Creates a queue that holds capacity packets in flight (rounded up to a power of 2).
+  explicit CommandPacketQueue(size_t capacity = 1024);
+
+  CommandPacketQueue(const CommandPacketQueue&)            = delete;
+  CommandPacketQueue& operator=(const CommandPacketQueue&) = delete;
+
+  /// Queues a packet for the given tick.  Thread-safe.  Returns false if the queue is full or plannerID is invalid.
+  bool Push(int32 tick, uint32 plannerID, const CommandPacket& packet);
+
+  /// Releases up to maxPackets due packets (tick <= currentTick) in deterministic order, calling
+  /// sink(const CommandPacket&) for each.  Packets that are not yet due, or past maxPackets, stay queued.  Game thread
+  /// (single consumer) only.  Returns the number of packets released.
+  template <typename Fn>  size_t Drain(int32 currentTick, size_t maxPackets, Fn&& sink);
+  template <typename Fn>  size_t Drain(int32 currentTick, Fn&& sink) { return Drain(currentTick, SIZE_MAX, sink); }
+
+  /// Gets the number of packets collected by Drain() that are waiting for a later tick (at most Capacity()).  Game
+  /// thread only.
+  size_t NumPending() const { return pending_.size(); }
+
+  size_t Capacity() const { return mask_ + 1; }
+
+private:
+  struct Entry {
+    bool operator<(const Entry& other) const {
+      return (tick      != other.tick)      ? (tick      < other.tick)      :
+             (plannerID != other.plannerID) ? (plannerID < other.plannerID) : ((sequence - other.sequence) >> 31) != 0;
+    }
+
+    int32         tick;
+    uint32        plannerID;
+    uint32        sequence;  ///< Per-planner push counter.
+    CommandPacket packet;
+  };
+
+  /// Ring slot.  sequence == index when the slot is free for the push at position index, and index + 1 when it holds
+  /// that push's entry.
+  struct Slot {
+    std::atomic<size_t> sequence;
+    Entry               entry;
+  };
+
+  /// Moves published entries from the ring to pending_, keeping it sorted, until pending_ holds Capacity() entries.
+  void Collect();
+
+  std::unique_ptr<Slot[]>  slots_;
+  size_t                   mask_;
+
+  alignas(64) std::atomic<size_t> pushPos_;  ///< Shared by producers.
+  alignas(64) size_t              popPos_;   ///< Consumer only.
+
+  std::atomic<uint32> plannerSequence_[MaxPlanners];
+
+  std::vector<Entry> pending_;  ///< Collected entries, sorted.  Capacity() reserved, never exceeded.  Consumer only.
+  std::vector<Entry> incoming_; ///< Scratch for Collect().  Capacity() reserved, never exceeded.  Consumer only.
+};
+
+// =====================================================================================================================
+inline CommandPacketQueue::CommandPacketQueue(
+  size_t capacity)
+  :
+  mask_(1),
+  pushPos_(0),
+  popPos_(0)
+{
+  for (; mask_ < capacity; mask_ <<= 1);
+  slots_.reset(new Slot[mask_]);
+  for (size_t i = 0; i < mask_; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  for (auto& sequence : plannerSequence_) {
+    sequence.store(0, std::memory_order_relaxed);
+  }
+
+  --mask_;
+  pending_.reserve(Capacity());
+  incoming_.reserve(Capacity());
+}
+
+// =====================================================================================================================
+inline bool CommandPacketQueue::Push(
+  int32                 tick,
+  uint32                plannerID,
+  const CommandPacket&  packet)
+{
+  bool result = (plannerID < MaxPlanners);
+
+  // Claim a slot by advancing pushPos_ (Vyukov's bounded queue).
+  size_t pos   = pushPos_.load(std::memory_order_relaxed);
+  Slot*  pSlot = nullptr;
+  while (result) {
+    pSlot = &slots_[pos & mask_];
+    const size_t   sequence = pSlot->sequence.load(std::memory_order_acquire);
+    const intptr_t diff     = intptr_t(sequence) - intptr_t(pos);
+
+    if (diff == 0) {
+      if (pushPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    else if (diff < 0) {
+      result = false;  // Full.
+    }
+    else {
+      pos = pushPos_.load(std::memory_order_relaxed);
+    }
+  }
+
+  if (result) {
+    // Only the planner's own thread pushes with its ID, so the sequence is deterministic.
+    pSlot->entry.tick      = tick;
+    pSlot->entry.plannerID = plannerID;
+    pSlot->entry.sequence  = plannerSequence_[plannerID].fetch_add(1, std::memory_order_relaxed);
+    memcpy(&pSlot->entry.packet, &packet, sizeof(packet));
+    pSlot->sequence.store(pos + 1, std::memory_order_release);
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline void CommandPacketQueue::Collect() {
+  incoming_.clear();
+
+  for (size_t room = Capacity() - pending_.size(); incoming_.size() < room;) {
+    Slot& slot = slots_[popPos_ & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != (popPos_ + 1)) {
+      break;  // Empty, or the next push has not been published yet.
+    }
+
+    incoming_.push_back(slot.entry);
+    slot.sequence.store(popPos_ + mask_ + 1, std::memory_order_release);
+    ++popPos_;
+  }
+
+  if (incoming_.empty() == false) {
+    // Merge from the back, in place;  unlike std::inplace_merge, this doesn't allocate a temporary buffer.
+    std::sort(incoming_.begin(), incoming_.end());
+    size_t src = pending_.size();
+    size_t in  = incoming_.size();
+    pending_.resize(src + in);
+    for (size_t dst = pending_.size(); in != 0;) {
+      pending_[--dst] = ((src != 0) && (incoming_[in - 1] < pending_[src - 1])) ? pending_[--src] : incoming_[--in];
+    }
+  }
+
+  assert(pending_.size() <= Capacity());
+}
+
+// =====================================================================================================================
+template <typename Fn>
+size_t CommandPacketQueue::Drain(
+  int32   currentTick,
+  size_t  maxPackets,
+  Fn&&    sink)
+{
+  Collect();
+
+  size_t count = 0;
+  for (; (count < pending_.size()) && (count < maxPackets) && (pending_[count].tick <= currentTick); ++count) {
+    sink(static_cast<const CommandPacket&>(pending_[count].packet));
+  }
+  pending_.erase(pending_.begin(), pending_.begin() + count);
+
+  return count;
+}
+
+} // Tethys
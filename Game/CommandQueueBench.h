@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Tethys/Game/CommandQueue.h"
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+namespace Tethys {
+
+/// CommandPacketQueue stress test result.
+struct CommandQueueStressResult {
+  size_t  numPushed;          ///< Packets pushed by all producers.
+  size_t  numReleased;        ///< Packets released by Drain().
+  size_t  numPushRetries;     ///< Failed Push() calls (backpressure) that were retried.
+  size_t  maxPending;         ///< Highest NumPending() seen.
+  size_t  numOrderErrors;     ///< Releases out of (tick, planner ID, push order) order within a Drain() call.
+  size_t  numLate;            ///< Packets released after their tick (pushed after that tick's Drain()).
+  bool    allReleasedOnce;    ///< Every pushed packet was released exactly once.
+  double  milliseconds;
+};
+
+/// Stress tests CommandPacketQueue with numProducers simulated planner threads, each pushing packetsPerProducer packets
+/// targeted 1 to 8 ticks ahead of the game thread's current tick, while the calling thread plays the game thread and
+/// drains one tick at a time.  A small queue capacity exercises the backpressure path.
+inline CommandQueueStressResult RunCommandQueueStressTest(
+  int     numProducers       = 6,
+  size_t  packetsPerProducer = 20000,
+  size_t  capacity           = 256)
+{
+  using Clock = std::chrono::steady_clock;
+
+  CommandPacketQueue       queue(capacity);
+  CommandQueueStressResult result = { };
+  std::atomic<int32>       currentTick(0);
+  std::atomic<int>         numDone(0);
+  std::atomic<size_t>      numRetries(0);
+
+  // Packets carry their planner ID and per-planner index in the network fields, which the queue doesn't use, and their
+  // target tick in the data buffer.
+  const auto producer = [&](int plannerID) {
+    uint32 seed = 0x9E3779B9u * uint32(plannerID + 1);
+    for (size_t i = 0; i < packetsPerProducer; ++i) {
+      seed = (seed * 1103515245) + 12345;
+
+      CommandPacket packet = { };
+      packet.type      = CommandType::Nop;
+      packet.netID     = plannerID;
+      packet.timeStamp = int(i);
+
+      const int32 tick = currentTick.load(std::memory_order_relaxed) + 1 + int32((seed >> 8) % 8);
+      memcpy(&packet.data.buffer[0], &tick, sizeof(tick));
+      while (queue.Push(tick, uint32(plannerID), packet) == false) {
+        numRetries.fetch_add(1, std::memory_order_relaxed);
+        std::this_thread::yield();
+      }
+    }
+    numDone.fetch_add(1, std::memory_order_release);
+  };
+
+  const auto start = Clock::now();
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numProducers; ++i) {
+    threads.emplace_back(producer, i);
+  }
+
+  std::vector<uint32> released(size_t(numProducers) * packetsPerProducer, 0);
+  const size_t        total = released.size();
+
+  for (int32 tick = 0; (numDone.load(std::memory_order_acquire) < numProducers) || (result.numReleased < total);) {
+    int32 lastTick    = INT32_MIN;
+    int   lastPlanner = -1;
+    int   lastIndex   = -1;
+
+    queue.Drain(tick, [&](const CommandPacket& packet) {
+      const int planner = packet.netID;
+      const int index   = packet.timeStamp;
+      int32     due     = 0;
+      memcpy(&due, &packet.data.buffer[0], sizeof(due));
+
+      const bool inOrder = (due != lastTick) ? (due > lastTick) :
+                           (planner != lastPlanner) ? (planner > lastPlanner) : (index > lastIndex);
+      result.numOrderErrors += (inOrder == false);
+      result.numLate        += (due < tick);
+      lastTick               = due;
+      lastPlanner            = planner;
+      lastIndex              = index;
+
+      ++released[(size_t(planner) * packetsPerProducer) + size_t(index)];
+      ++result.numReleased;
+    });
+
+    result.maxPending = (std::max)(result.maxPending, queue.NumPending());
+    currentTick.store(++tick, std::memory_order_relaxed);
+    std::this_thread::yield();
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  result.milliseconds    = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  result.numPushed       = total;
+  result.numPushRetries  = numRetries.load();
+  result.allReleasedOnce = std::all_of(released.begin(), released.end(), [](uint32 n) { return n == 1; });
+
+  return result;
+}
+
+} // Tethys
@@ -0,0 +1,576 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+#include "Tethys/Common/WorkStealingPool.h"
+
+#include <vector>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+
+namespace Tethys {
+
+/// Headless, deterministic model of a colony's ore, food, population, and morale, for tuning missions without running
+/// the game.  Many colonies with different build orders can be run in parallel with RunBatch().
+///
+/// Mine output follows the MineManager yield curves (mines.txt), and morale is the sum of the morale.txt condition and
+/// event modifiers on top of a base value.  Everything else (truck trip times, food, population growth, capacities) is
+/// a simplified model driven by Params.  The model is not a replica of the game's internal economy update;  mine output
+/// can be checked against the game's own MineManager::CalculateMineYield() with ValidateMineYields().
+///
+/// The simulation advances in updates of Params::ticksPerUpdate ticks, and uses integer arithmetic with fractional
+/// accumulators only, so results are exactly reproducible.
+///
+/// @code
+///   EconomySim::Params params;
+///   params.LoadMines(*MineManager::GetInstance());          // Or SetMineCurve() from a parsed mines.txt.
+///   params.SetMoraleModifier("FOOD_SURPLUS", 5);            // From a parsed morale.txt.
+///
+///   std::vector<EconomySim::Scenario> scenarios(1000);
+///   // ... fill in scenarios[i].buildOrder ...
+///   for (const auto& result : EconomySim::RunBatch(params, scenarios)) {
+///     // result.samples holds the ore/food/population/morale time series.
+///   }
+/// @endcode
+class EconomySim {
+public:
+  static constexpr size_t NumYields   = 3;  ///< Indexed by OreYield (Bar3 = 0, Bar2 = 1, Bar1 = 2).
+  static constexpr size_t NumVariants = 3;  ///< Indexed by internal variant number (see MineManager::GetVariantNum()).
+
+  /// Mine yield curve for one OreYield and variant number, in the units of MineManager's tables.
+  struct MineCurve {
+    int initialYield;  ///< 'INITIAL_YIELD_%' (= sheet value x10)
+    int peakYield;     ///< 'PEAK_YIELD_%'    (= sheet value x10)
+    int minYield;      ///< 'MIN_YIELD_%'     (= sheet value x10)
+    int peakTruck;     ///< 'PEAK_TRUCK':  truck loads until peak yield.
+    int minTruck;      ///< 'MIN_TRUCK':   truck loads until minimum yield.
+  };
+
+  /// Morale modifiers used by the model, named as in morale.txt.
+  enum class MoraleFactor : uint8 {
+    KidDies = 0,             ///< 'KID_DIES'
+    AdultDies,               ///< 'ADULT_DIES'
+    KidBorn,                 ///< 'KID_BORN'
+    ResearchCompleted,       ///< 'NEW_TECH_BONUS'
+    CommandCenterCompleted,  ///< 'CC_BORN'
+    WorkerTrained,           ///< 'TECH_SCHOOL'
+    ScientistTrained,        ///< 'PHD_TRAINED'
+    EventDeclineRate,        ///< 'EVENT_DEC_RATE'
+    CrowdedNot,              ///< 'CROWDED_NOT'
+    CrowdedLow,              ///< 'CROWDED_LOW'
+    CrowdedMed,              ///< 'CROWDED_MED'
+    CrowdedHigh,             ///< 'CROWDED_HIGH'
+    CrowdedMax,              ///< 'CROWDED_MAX'
+    FoodSurplus,             ///< 'FOOD_SURPLUS'
+    FoodStoresPlentiful,     ///< 'FOOD_DEFICIT_BIGSUPPLY'
+    FoodDeficit,             ///< 'FOOD_DEFICIT'
+    FoodStarving,            ///< 'FOOD_STARVING'
+    RecCenterLow,            ///< 'REC_UT_LOW'
+    RecCenterMed,            ///< 'REC_UT_MED'
+    RecCenterHigh,           ///< 'REC_UT_HIGH'
+    RecCenterMax,            ///< 'REC_UT_MAX'
+    ForumLow,                ///< 'FORUM_UT_LOW'
+    ForumMed,                ///< 'FORUM_UT_MED'
+    ForumHigh,               ///< 'FORUM_UT_HIGH'
+    ForumMax,                ///< 'FORUM_UT_MAX'
+    MedCenterLow,            ///< 'MED_UT_LOW'
+    MedCenterMed,            ///< 'MED_UT_MED'
+    MedCenterHigh,           ///< 'MED_UT_HIGH'
+    MedCenterMax,            ///< 'MED_UT_MAX'
+    NurseryActive,           ///< 'NURSERY_ON'
+    UniversityActive,        ///< 'UNIV_ON'
+    Count
+  };
+
+  /// Buildings that affect the model.
+  enum class Building : uint8 {
+    CommandCenter = 0,
+    Agridome,
+    Residence,
+    MedicalCenter,
+    RecreationFacility,
+    Forum,
+    Nursery,
+    University,
+    Count
+  };
+
+  /// Model parameters, shared by all colonies in a batch.  Rates are per update, in 1/1000ths unless noted.
+  struct Params {
+    Params();
+
+    /// Sets a mine yield curve, e.g. from a parsed mines.txt (variantNum is rooted at 0).
+    bool SetMineCurve(int yield, int variantNum, const MineCurve& curve);
+
+    /// Copies the yield curves from a MineManager (or anything with the same yieldPctInfo_/truckLoadInfo_ tables).
+    template <typename MineManagerType>  void LoadMines(const MineManagerType& mineManager);
+
+    /// Sets a morale modifier by its morale.txt field name.  Returns false if the name is not used by the model.
+    bool SetMoraleModifier(const char* pSheetName, int value);
+
+    /// Gets the morale.txt field name of a morale modifier.
+    static const char* GetMoraleFactorName(MoraleFactor factor);
+
+    int Modifier(MoraleFactor factor) const { return moraleModifiers[size_t(factor)]; }
+
+    MineCurve mines[NumYields][NumVariants];
+    int       moraleModifiers[size_t(MoraleFactor::Count)];  ///< Defaults to 0;  set from morale.txt.
+
+    int ticksPerUpdate       = 100;
+    int oreLoadSize          = 1000;  ///< Ore in a truck load at 100% yield.
+    int foodPerAgridome      = 250;
+    int foodPer100Colonists  = 100;   ///< Food eaten per update by 100 colonists.
+    int plentifulFood        = 5000;  ///< Food stores above which a deficit counts as FoodStoresPlentiful.
+    int birthRate            = 8;     ///< Kids born per adult (workers + scientists).
+    int nurseryBirthRate     = 16;    ///< Kids born per adult with an active Nursery.
+    int growUpRate           = 20;    ///< Kids that become adults, per kid.
+    int universityRate       = 250;   ///< Of kids that grow up, those that become scientists with a University.
+    int starveRate           = 50;    ///< Colonists that die while starving, per colonist.
+    int kidsPerStarvedAdult  = 1000;  ///< Of starving deaths, kids per adult (1000 = even split by headcount).
+
+    int residenceCapacity    = 25;    ///< Colonists housed per Residence.
+    int medCenterCapacity    = 75;    ///< Colonists served per Medical Center.
+    int recFacilityCapacity  = 50;    ///< Colonists served per Recreation Facility.
+    int forumCapacity        = 100;   ///< Colonists served per Forum.
+
+    int baseMorale           = 50;                     ///< Morale with no modifiers.
+    int crowdedThresholds[4] = { 50, 80, 100, 125 };   ///< Percent of housing for Crowded Low/Med/High/Max.
+    int serviceThresholds[3] = { 50, 90, 125 };        ///< Percent demand for service Med/High/Max (else Low).
+    int moraleLevels[4]      = { 80, 60, 40, 20 };     ///< Minimum morale for Excellent/Good/Fair/Poor.
+  };
+
+  /// A build order step.  Steps run in order;  each waits until its tick has been reached and it can be afforded.
+  struct BuildStep {
+    enum class Kind : uint8 {
+      Mine = 0,  ///< Adds a mine worked by numTrucks trucks with round trips of tripTicks.
+      Trucks,    ///< Adds numTrucks trucks to the last mine.
+      Building,  ///< Adds a building.
+      Research,  ///< Completes a research topic.
+      Colonists, ///< Adds numWorkers workers and numScientists scientists (e.g. from a starship module).
+    };
+
+    static BuildStep MakeMine(int tick, int yield, int variantNum, bool rare, int numTrucks, int tripTicks) {
+      BuildStep s = { };
+      s.kind = Kind::Mine;  s.tick = tick;  s.yield = uint8(yield);  s.variantNum = uint8(variantNum);  s.rare = rare;
+      s.numTrucks = numTrucks;  s.tripTicks = tripTicks;
+      return s;
+    }
+    static BuildStep MakeBuilding(int tick, Building type, int commonOreCost = 0, int rareOreCost = 0) {
+      BuildStep s = { };
+      s.kind = Kind::Building;  s.tick = tick;  s.building = type;
+      s.commonOreCost = commonOreCost;  s.rareOreCost = rareOreCost;
+      return s;
+    }
+
+    Kind     kind;
+    bool     rare;           ///< Mine:  rare ore.
+    uint8    yield;          ///< Mine:  OreYield.
+    uint8    variantNum;     ///< Mine:  variant number.
+    Building building;       ///< Building:  type.
+    int      tick;           ///< Earliest tick to run the step.
+    int      commonOreCost;
+    int      rareOreCost;
+    int      numTrucks;      ///< Mine, Trucks.
+    int      tripTicks;      ///< Mine:  ticks per truck round trip.
+    int      numWorkers;     ///< Colonists.
+    int      numScientists;  ///< Colonists.
+  };
+
+  /// Colony state.
+  struct State {
+    int Population() const { return workers + scientists + kids; }
+
+    int32 tick        = 0;
+    int   commonOre   = 0;
+    int   rareOre     = 0;
+    int   food        = 0;
+    int   workers     = 0;
+    int   scientists  = 0;
+    int   kids        = 0;
+    int   morale      = 0;
+    int   eventMorale = 0;  ///< Sum of event modifiers, declining by EventDeclineRate each update.
+    int   moraleLevel = 0;  ///< MoraleLevel (0 = Excellent ... 4 = Terrible).
+    int   foodStatus  = 0;  ///< FoodStatus (0 = Rising, 1 = NoChange, 2 = Falling, 3 = Shortage).
+    int   buildings[size_t(Building::Count)] = { };
+  };
+
+  /// One point of a colony's time series.
+  struct Sample {
+    int32 tick;
+    int   commonOre;
+    int   rareOre;
+    int   food;
+    int   population;
+    int   morale;
+    int   moraleLevel;
+  };
+
+  /// A colony to simulate.
+  struct Scenario {
+    State                  initial;
+    std::vector<BuildStep> buildOrder;
+    int32                  numTicks       = 20000;
+    int32                  sampleInterval = 100;  ///< Ticks between samples (rounded up to whole updates).
+  };
+
+  /// Result of simulating a colony.
+  struct Result {
+    State               final;
+    size_t              numStepsDone = 0;  ///< Build order steps that ran before the end.
+    std::vector<Sample> samples;
+  };
+
+  /// Gets a mine's output for its next truck load (as MineManager::CalculateMineYield()).
+  static int CalculateMineYield(const MineCurve& curve, int numTruckLoadsSoFar, int oreLoadSize);
+
+  /// Compares the model's mine output to the game's for every yield, variant, and up to maxLoads truck loads, using
+  /// calculate(int yield, int variantNum, int numTruckLoadsSoFar) -> int.  E.g.:
+  ///   [](int y, int v, int n) { return MineManager::GetInstance()->CalculateMineYield(OreYield(y), v, n); }
+  template <typename Fn>  static bool ValidateMineYields(const Params& params, Fn&& calculate, int maxLoads = 100);
+
+  /// Simulates one colony.
+  static void Run(const Params& params, const Scenario& scenario, Result* pResult);
+
+  /// Simulates colonies in parallel with up to numThreads threads (0 = one per hardware thread).  Results are in input
+  /// order, and do not depend on the number of threads.
+  static std::vector<Result> RunBatch(const Params& params, const std::vector<Scenario>& scenarios, int numThreads = 0);
+
+private:
+  struct Mine {
+    const MineCurve* pCurve;
+    bool             rare;
+    int              numTrucks;
+    int              tripTicks;
+    int              numLoads;
+    int              progress;  ///< Truck-ticks towards the next load.
+  };
+
+  /// Runs a build step if it can be afforded.
+  static bool TryStep(const Params& params, const BuildStep& step, State* pState, std::vector<Mine>* pMines);
+
+  /// Advances one update of ticksPerUpdate (> 0) ticks, which Run() clamps from params.ticksPerUpdate.
+  static void Update(
+    const Params& params, int32 ticksPerUpdate, State* pState, std::vector<Mine>* pMines, uint32 (&remainders)[4]);
+
+  /// Gets the modifier for a level of use of a capacity (Low/Med/High/Max), given the thresholds in percent.
+  template <size_t N>
+  static int Bucket(int used, int capacity, const int (&thresholds)[N]);
+};
+
+// =====================================================================================================================
+inline EconomySim::Params::Params() {
+  // Defaults from the stock mines.txt (see OreYield).
+  static constexpr MineCurve DefaultMines[NumYields][NumVariants] = {
+    { { 500, 600, 300, 14, 50 }, { 500, 550, 300, 20, 60 }, { 500, 550, 350, 10, 50 } },  // Bar3
+    { { 300, 400, 200, 10, 40 }, { 300, 400, 200, 12, 35 }, { 300, 350, 250, 20, 40 } },  // Bar2
+    { { 100, 250, 150, 10, 40 }, { 100, 300, 100, 14, 45 }, { 100, 200, 100, 20, 50 } },  // Bar1
+  };
+
+  memcpy(&mines[0][0], &DefaultMines[0][0], sizeof(mines));
+  memset(&moraleModifiers[0], 0, sizeof(moraleModifiers));
+}
+
+// =====================================================================================================================
+inline bool EconomySim::Params::SetMineCurve(
+  int               yield,
+  int               variantNum,
+  const MineCurve&  curve)
+{
+  const bool result =
+    (yield >= 0) && (size_t(yield) < NumYields) && (variantNum >= 0) && (size_t(variantNum) < NumVariants);
+  if (result) {
+    mines[yield][variantNum] = curve;
+  }
+  return result;
+}
+
+// =====================================================================================================================
+template <typename MineManagerType>
+void EconomySim::Params::LoadMines(
+  const MineManagerType& mineManager)
+{
+  for (size_t v = 0; v < NumVariants; ++v) {
+    for (size_t y = 0; y < NumYields; ++y) {
+      const auto& yields = mineManager.yieldPctInfo_[(v * NumVariants) + y];
+      const auto& trucks = mineManager.truckLoadInfo_[(v * NumVariants) + y];
+      mines[y][v] = { yields.initialYield, yields.peakYield, yields.minYield, trucks.peakTruck, trucks.minTruck };
+    }
+  }
+}
+
+// =====================================================================================================================
+inline const char* EconomySim::Params::GetMoraleFactorName(
+  MoraleFactor factor)
+{
+  static constexpr const char* Names[] = {
+    "KID_DIES",     "ADULT_DIES",   "KID_BORN",     "NEW_TECH_BONUS",         "CC_BORN",
+    "TECH_SCHOOL",  "PHD_TRAINED",  "EVENT_DEC_RATE",
+    "CROWDED_NOT",  "CROWDED_LOW",  "CROWDED_MED",  "CROWDED_HIGH",           "CROWDED_MAX",
+    "FOOD_SURPLUS", "FOOD_DEFICIT_BIGSUPPLY",       "FOOD_DEFICIT",           "FOOD_STARVING",
+    "REC_UT_LOW",   "REC_UT_MED",   "REC_UT_HIGH",  "REC_UT_MAX",
+    "FORUM_UT_LOW", "FORUM_UT_MED", "FORUM_UT_HIGH", "FORUM_UT_MAX",
+    "MED_UT_LOW",   "MED_UT_MED",   "MED_UT_HIGH",  "MED_UT_MAX",
+    "NURSERY_ON",   "UNIV_ON",
+  };
+  static_assert(sizeof(Names) / sizeof(Names[0]) == size_t(MoraleFactor::Count), "Morale factor names out of sync.");
+
+  return (size_t(factor) < size_t(MoraleFactor::Count)) ? Names[size_t(factor)] : nullptr;
+}
+
+// =====================================================================================================================
+inline bool EconomySim::Params::SetMoraleModifier(
+  const char*  pSheetName,
+  int          value)
+{
+  size_t i = 0;
+  for (; (i < size_t(MoraleFactor::Count)) && (strcmp(GetMoraleFactorName(MoraleFactor(i)), pSheetName) != 0); ++i);
+
+  const bool result = (i < size_t(MoraleFactor::Count));
+  if (result) {
+    moraleModifiers[i] = value;
+  }
+  return result;
+}
+
+// =====================================================================================================================
+inline int EconomySim::CalculateMineYield(
+  const MineCurve&  curve,
+  int               numTruckLoadsSoFar,
+  int               oreLoadSize)
+{
+  // Ramp linearly from the initial to peak yield over peakTruck loads, then down to the minimum yield at minTruck loads
+  // (MIN_TRUCK counts from the first load).
+  const int n = (std::max)(numTruckLoadsSoFar, 0);
+  int yield   = curve.minYield;
+  if (n < curve.peakTruck) {
+    yield = curve.initialYield + (((curve.peakYield - curve.initialYield) * n) / curve.peakTruck);
+  }
+  else if (n < curve.minTruck) {
+    const int span = curve.minTruck - curve.peakTruck;
+    yield = curve.peakYield + (((curve.minYield - curve.peakYield) * (n - curve.peakTruck)) / span);
+  }
+
+  return int((int64(oreLoadSize) * yield) / 1000);
+}
+
+// =====================================================================================================================
+template <typename Fn>
+bool EconomySim::ValidateMineYields(
+  const Params&  params,
+  Fn&&           calculate,
+  int            maxLoads)
+{
+  bool result = true;
+  for (int y = 0; result && (y < int(NumYields)); ++y) {
+    for (int v = 0; result && (v < int(NumVariants)); ++v) {
+      for (int n = 0; result && (n <= maxLoads); ++n) {
+        result = (calculate(y, v, n) == CalculateMineYield(params.mines[y][v], n, params.oreLoadSize));
+      }
+    }
+  }
+  return result;
+}
+
+// =====================================================================================================================
+template <size_t N>
+int EconomySim::Bucket(
+  int               used,
+  int               capacity,
+  const int (&thresholds)[N])
+{
+  const int percent = (capacity > 0) ? int((int64(used) * 100) / capacity) : ((used > 0) ? INT_MAX : 0);
+
+  int level = 0;
+  for (; (level < int(N)) && (percent >= thresholds[level]); ++level);
+  return level;
+}
+
+// =====================================================================================================================
+inline bool EconomySim::TryStep(
+  const Params&       params,
+  const BuildStep&    step,
+  State*              pState,
+  std::vector<Mine>*  pMines)
+{
+  const bool result = (pState->tick >= step.tick) &&
+                      (pState->commonOre >= step.commonOreCost) && (pState->rareOre >= step.rareOreCost) &&
+                      ((step.kind != BuildStep::Kind::Trucks) || (pMines->empty() == false));
+
+  if (result) {
+    pState->commonOre -= step.commonOreCost;
+    pState->rareOre   -= step.rareOreCost;
+
+    switch (step.kind) {
+    case BuildStep::Kind::Mine:
+      pMines->push_back({ &params.mines[step.yield % NumYields][step.variantNum % NumVariants], step.rare,
+                          step.numTrucks, (std::max)(step.tripTicks, 1), 0, 0 });
+      break;
+
+    case BuildStep::Kind::Trucks:
+      pMines->back().numTrucks += step.numTrucks;
+      break;
+
+    case BuildStep::Kind::Building:
+      if (step.building < Building::Count) {
+        ++pState->buildings[size_t(step.building)];
+        if (step.building == Building::CommandCenter) {
+          pState->eventMorale += params.Modifier(MoraleFactor::CommandCenterCompleted);
+        }
+      }
+      break;
+
+    case BuildStep::Kind::Research:
+      pState->eventMorale += params.Modifier(MoraleFactor::ResearchCompleted);
+      break;
+
+    case BuildStep::Kind::Colonists:
+      pState->workers    += step.numWorkers;
+      pState->scientists += step.numScientists;
+      break;
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline void EconomySim::Update(
+  const Params&       params,
+  int32               ticksPerUpdate,
+  State*              pState,
+  std::vector<Mine>*  pMines,
+  uint32            (&remainders)[4])
+{
+  State&       s           = *pState;
+  const int*   pBuildings  = &s.buildings[0];
+  const auto   Has         = [pBuildings](Building type) { return pBuildings[size_t(type)] > 0; };
+  const auto   Count       = [pBuildings](Building type) { return pBuildings[size_t(type)]; };
+  const auto   Rate        = [&remainders](int count, int rate, size_t accumulator) {
+    // Fractional rate with carry, so small colonies still see growth.
+    const uint64 total = uint64(remainders[accumulator]) + (uint64((std::max)(count, 0)) * uint64((std::max)(rate, 0)));
+    remainders[accumulator] = uint32(total % 1000);
+    return int(total / 1000);
+  };
+
+  // Mining.
+  for (Mine& mine : *pMines) {
+    for (mine.progress += mine.numTrucks * ticksPerUpdate; mine.progress >= mine.tripTicks;) {
+      mine.progress -= mine.tripTicks;
+      (mine.rare ? s.rareOre : s.commonOre) += CalculateMineYield(*mine.pCurve, mine.numLoads++, params.oreLoadSize);
+    }
+  }
+
+  // Food.
+  const int adults     = s.workers + s.scientists;
+  const int production = Count(Building::Agridome) * params.foodPerAgridome;
+  const int eaten      = int((int64(s.Population()) * params.foodPer100Colonists) / 100);
+  const int net        = production - eaten;
+  s.food = (std::max)(s.food + net, 0);
+
+  MoraleFactor foodFactor = MoraleFactor::FoodSurplus;
+  s.foodStatus = (net > 0) ? 0 : (net == 0) ? 1 : 2;
+  if (net < 0) {
+    foodFactor = (s.food > params.plentifulFood) ? MoraleFactor::FoodStoresPlentiful :
+                 (s.food > 0)                    ? MoraleFactor::FoodDeficit         : MoraleFactor::FoodStarving;
+  }
+
+  // Population.
+  int numBorn = 0, numKidsDied = 0, numAdultsDied = 0, numGrownUp = 0;
+  if (foodFactor == MoraleFactor::FoodStarving) {
+    s.foodStatus = 3;
+    const int numDied   = (std::min)(Rate(s.Population(), params.starveRate, 0), s.Population());
+    const int weight    = (std::max)(params.kidsPerStarvedAdult, 0);
+    const int64 divisor = (int64(s.kids) * weight) + (int64(adults) * 1000);
+    numKidsDied         = (divisor > 0) ? (std::min)(int((int64(numDied) * s.kids * weight) / divisor), s.kids) : 0;
+    numAdultsDied       = (std::min)(numDied - numKidsDied, adults);
+
+    const int numScientistsDied = (adults > 0) ? int((int64(numAdultsDied) * s.scientists) / adults) : 0;
+    s.kids       -= numKidsDied;
+    s.scientists -= numScientistsDied;
+    s.workers    -= (numAdultsDied - numScientistsDied);
+  }
+  else {
+    numBorn    = Rate(adults, Has(Building::Nursery) ? params.nurseryBirthRate : params.birthRate, 1);
+    numGrownUp = (std::min)(Rate(s.kids, params.growUpRate, 2), s.kids);
+    const int numScientists = Has(Building::University) ? Rate(numGrownUp, params.universityRate, 3) : 0;
+
+    s.kids       += numBorn - numGrownUp;
+    s.scientists += numScientists;
+    s.workers    += numGrownUp - numScientists;
+  }
+
+  // Morale:  events accumulate and decline over time;  conditions apply while they last.
+  const int decline = (std::max)(params.Modifier(MoraleFactor::EventDeclineRate), 0);
+  s.eventMorale = (s.eventMorale > 0) ? (std::max)(s.eventMorale - decline, 0) : (std::min)(s.eventMorale + decline, 0);
+  s.eventMorale += (numBorn       * params.Modifier(MoraleFactor::KidBorn))   +
+                   (numKidsDied   * params.Modifier(MoraleFactor::KidDies))   +
+                   (numAdultsDied * params.Modifier(MoraleFactor::AdultDies));
+
+  const int population = s.Population();
+  const int crowded    = Bucket(population, Count(Building::Residence)          * params.residenceCapacity,
+                                params.crowdedThresholds);
+  const int med        = Bucket(population, Count(Building::MedicalCenter)      * params.medCenterCapacity,
+                                params.serviceThresholds);
+  const int rec        = Bucket(population, Count(Building::RecreationFacility) * params.recFacilityCapacity,
+                                params.serviceThresholds);
+  const int forum      = Bucket(population, Count(Building::Forum)              * params.forumCapacity,
+                                params.serviceThresholds);
+
+  int morale = params.baseMorale + s.eventMorale + params.Modifier(foodFactor) +
+               params.Modifier(MoraleFactor(int(MoraleFactor::CrowdedNot)   + crowded)) +
+               params.Modifier(MoraleFactor(int(MoraleFactor::MedCenterLow) + med))     +
+               params.Modifier(MoraleFactor(int(MoraleFactor::RecCenterLow) + rec))     +
+               params.Modifier(MoraleFactor(int(MoraleFactor::ForumLow)     + forum));
+  morale += Has(Building::Nursery)    ? params.Modifier(MoraleFactor::NurseryActive)    : 0;
+  morale += Has(Building::University) ? params.Modifier(MoraleFactor::UniversityActive) : 0;
+
+  s.morale      = (std::min)((std::max)(morale, 0), 100);
+  s.moraleLevel = 0;
+  for (; (s.moraleLevel < 4) && (s.morale < params.moraleLevels[s.moraleLevel]); ++s.moraleLevel);
+
+  s.tick += ticksPerUpdate;
+}
+
+// =====================================================================================================================
+inline void EconomySim::Run(
+  const Params&    params,
+  const Scenario&  scenario,
+  Result*          pResult)
+{
+  std::vector<Mine> mines;
+  uint32            remainders[4] = { };
+  State&            state         = pResult->final;
+  size_t&           step          = pResult->numStepsDone;
+  const int32       ticksPerUpdate = (std::max)(params.ticksPerUpdate, 1);
+  const int32       sampleUpdates  = (std::max)((scenario.sampleInterval + ticksPerUpdate - 1) / ticksPerUpdate, 1);
+
+  state = scenario.initial;
+  step  = 0;
+  pResult->samples.clear();
+  pResult->samples.reserve((size_t(scenario.numTicks / ticksPerUpdate) / sampleUpdates) + 1);
+
+  for (int32 update = 0; state.tick < (scenario.initial.tick + scenario.numTicks); ++update) {
+    for (; (step < scenario.buildOrder.size()) && TryStep(params, scenario.buildOrder[step], &state, &mines); ++step);
+
+    Update(params, ticksPerUpdate, &state, &mines, remainders);
+
+    if ((update % sampleUpdates) == 0) {
+      const State& s = state;
+      pResult->samples.push_back({ s.tick, s.commonOre, s.rareOre, s.food, s.Population(), s.morale, s.moraleLevel });
+    }
+  }
+}
+
+// =====================================================================================================================
+inline std::vector<EconomySim::Result> EconomySim::RunBatch(
+  const Params&                 params,
+  const std::vector<Scenario>&  scenarios,
+  int                           numThreads)
+{
+  std::vector<Result> results(scenarios.size());
+  WorkStealingPool::ParallelFor(
+    scenarios.size(), numThreads, [&](size_t i, int) { Run(params, scenarios[i], &results[i]); });
+  return results;
+}
+
+} // Tethys
@@ -0,0 +1,598 @@
+#pragma once
+
+#include "Tethys/Game/MapImpl.h"
+#include "Tethys/Game/PathFinder.h"
+#include "Tethys/Game/TileGridView.h"
+#include "Tethys/API/Location.h"
+#include <algorithm>
+#include <vector>
+
+namespace Tethys {
+
+/// Native grid pathfinder over TileData::cellType and CellTypeInfo::trackSpeed, for precomputing unit paths without the
+/// game's PathFinder (@see PathFinder, PathContext).
+///
+/// Prepare() builds a per-tile step cost grid for one track type;  FindPath() then runs jump point search (or plain
+/// A* / Dijkstra) over it and emits the path as one UnitDirection per tile step, as used by PathContext::direction.
+/// All search buffers are reused between calls, so repeated searches on the same map do not allocate.
+///
+/// Movement is 8-way, and diagonal steps may not cut corners of impassable tiles.  Entering a tile costs
+/// (CostScale / trackSpeed), times ~sqrt(2) for diagonal steps.  Jump point search assumes uniform step costs, so
+/// jumps also stop at tiles that border a tile of different cost;  within uniform-cost areas it prunes the same way as
+/// standard JPS, and paths are as short as those found by A*.
+///
+/// @note  Coordinates are tile array coordinates, as with MapImpl::Tile().  Paths do not wrap around world maps.
+class GridPathFinder {
+public:
+  /// Cost of one straight step onto a tile with a track speed of 1.
+  static constexpr uint32 CostScale = 1u << 16;
+
+  /// Search algorithm used by FindPath().
+  enum class Algorithm : int {
+    Dijkstra = 0,  ///< Uniform cost search with no heuristic.
+    AStar,         ///< A* with an octile distance heuristic.
+    JumpPoint,     ///< A* with jump point pruning.
+  };
+
+  /// Statistics of the last FindPath() call.
+  struct Stats {
+    size_t nodesExpanded;  ///< Number of nodes popped from the open list and expanded.
+    size_t nodesPushed;    ///< Number of nodes pushed onto the open list.
+    size_t pathLength;     ///< Number of tile steps in the path.
+    uint32 pathCost;       ///< Total step cost of the path.
+  };
+
+  GridPathFinder() = default;
+
+  /// Builds the step cost grid from a tile grid and per-cell type track speeds (speeds <= 0 are impassable).  If
+  /// blockWallsAndBuildings is set, tiles with TileData::wallOrBuilding set are impassable.
+  void Prepare(
+    const TileGridView& tiles, const int (&trackSpeeds)[size_t(CellType::Count)], bool blockWallsAndBuildings = true);
+  /// Builds the step cost grid from a tile grid, using the game's cell type info for the given track type.
+  void Prepare(const TileGridView& tiles, TrackType trackType, bool blockWallsAndBuildings = true);
+
+  /// Updates the step cost grid from the tile grid in the given tile rect, e.g. after tiles have changed.
+  void UpdateRect(const TileGridView& tiles, const MapRect& rect);
+
+  /// Finds a path from start to goal.  On success, *pDirections is set to one UnitDirection per tile step.
+  bool FindPath(
+    const Location& start, const Location& goal, std::vector<uint8>* pDirections,
+    Algorithm algorithm = Algorithm::JumpPoint);
+  /// Finds a path from start to goal that stays within the given tile rect.
+  bool FindPathInRect(
+    const MapRect& bounds, const Location& start, const Location& goal, std::vector<uint8>* pDirections,
+    Algorithm algorithm = Algorithm::JumpPoint);
+
+  /// Computes the cheapest paths from origin to every reachable tile within the given tile rect, or from every such
+  /// tile to origin if reverse is set.  Use GetFloodPath() to get the results, which are valid until the next search.
+  void FloodInRect(const MapRect& bounds, const Location& origin, bool reverse = false);
+  /// Gets the path between the last flood's origin and target, and optionally its cost.  Returns false if unreachable.
+  bool GetFloodPath(const Location& target, std::vector<uint8>* pDirections, uint32* pCost = nullptr) const;
+
+  const Stats& GetStats()   const { return stats_;   }
+  uint32       GetMinCost() const { return minCost_; }  ///< Lowest straight step cost of any passable cell type.
+
+  /// Gets the number of bytes allocated for the cost grid and search buffers.
+  size_t GetMemoryUsage() const {
+    return (cost_.capacity() * sizeof(uint32)) + boundary_.capacity() + (g_.capacity() * sizeof(uint32)) +
+           (parent_.capacity() * sizeof(int)) + ((seen_.capacity() + closed_.capacity()) * sizeof(uint32)) +
+           (open_.capacity() * sizeof(OpenEntry));
+  }
+
+  static uint32 DiagonalCost(uint32 cost) { return (cost * 181) >> 7; }  ///< ~cost * sqrt(2)
+
+  int    Width()                  const { return width_;                                                       }
+  int    Height()                 const { return height_;                                                      }
+  bool   InBounds(int x, int y)   const
+    { return (uint32(x - boundsX_) < uint32(boundsWidth_)) && (uint32(y - boundsY_) < uint32(boundsHeight_)); }
+  uint32 GetCost(int x, int y)    const { return InBounds(x, y) ? cost_[Node(x, y)] : 0;  }  ///< 0 if impassable.
+  bool   IsPassable(int x, int y) const { return GetCost(x, y) != 0;                      }
+
+  /// Copies up to 64 directions to a PathContext's direction list, starting at pDirections[0].  Returns the number of
+  /// directions copied;  if less than count, the caller should inject the rest as the next path fragment.
+  static size_t FillPathContext(PathContext* pContext, const uint8* pDirections, size_t count);
+
+private:
+  struct OpenEntry {
+    uint32 f;
+    int    node;
+    bool operator<(const OpenEntry& other) const { return f > other.f; }  // Min-heap
+  };
+
+  int Node(int x, int y) const { return (y * width_) + x; }
+
+  uint32 Heuristic(int node, Algorithm algorithm) const;
+  void   UpdateCosts(const TileGridView& tiles, const MapRect& rect);
+  void   UpdateBoundaries(const MapRect& rect);
+  void   Push(int node, int parent, uint32 g, Algorithm algorithm);
+  void   Expand(int node, Algorithm algorithm);
+  int    JumpStraight(int x, int y, int dx, int dy) const;
+  int    JumpDiagonal(int x, int y, int dx, int dy) const;
+  void   SetBounds(const MapRect& bounds);
+  void   ResetBounds() { SetBounds(MapRect(0, 0, width_ - 1, height_ - 1)); }
+  void   BeginSearch();
+  void   BuildPath(int end, bool reverse, std::vector<uint8>* pDirections) const;
+
+  int    width_    = 0;
+  int    height_   = 0;
+  int    boundsX_      = 0;  ///< Left edge of the search area.
+  int    boundsY_      = 0;  ///< Top edge of the search area.
+  int    boundsWidth_  = 0;  ///< Width of the search area;  tiles outside of it are treated as impassable.
+  int    boundsHeight_ = 0;  ///< Height of the search area.
+  int    goal_     = -1;
+  int    goalX_    = 0;
+  int    goalY_    = 0;
+  uint32 minCost_  = 0;
+  uint32 searchId_ = 0;
+  bool   blockWallsAndBuildings_ = true;
+  bool   reverse_  = false;  ///< If set, step costs are those of the tile being left (for reverse floods).
+  int    trackSpeeds_[size_t(CellType::Count)] = { };
+  Stats  stats_    = { };
+
+  std::vector<uint32>    cost_;      ///< Step cost onto each tile, or 0 if impassable.
+  std::vector<uint8>     boundary_;  ///< Nonzero if a tile borders a passable tile of a different cost.
+  std::vector<uint32>    g_;         ///< Best known cost from start to each node.
+  std::vector<int>       parent_;    ///< Parent node (jump point) of each node.
+  std::vector<uint32>    seen_;      ///< searchId_ if g_ and parent_ are valid for this search.
+  std::vector<uint32>    closed_;    ///< searchId_ if the node has been expanded in this search.
+  std::vector<OpenEntry> open_;      ///< Binary heap.
+};
+
+// =====================================================================================================================
+inline void GridPathFinder::Prepare(
+  const TileGridView&  tiles,
+  const int           (&trackSpeeds)[size_t(CellType::Count)],
+  bool                 blockWallsAndBuildings)
+{
+  width_        = tiles.Width();
+  height_       = tiles.Height();
+  boundsX_      = 0;
+  boundsY_      = 0;
+  boundsWidth_  = width_;
+  boundsHeight_ = height_;
+  blockWallsAndBuildings_ = blockWallsAndBuildings;
+  std::copy(std::begin(trackSpeeds), std::end(trackSpeeds), std::begin(trackSpeeds_));
+
+  const size_t numTiles = size_t(width_) * height_;
+  cost_.assign(numTiles, 0);
+  boundary_.assign(numTiles, 0);
+  g_.assign(numTiles, 0);
+  parent_.assign(numTiles, -1);
+  seen_.assign(numTiles, 0);
+  closed_.assign(numTiles, 0);
+  searchId_ = 0;
+
+  int maxSpeed = 0;
+  for (const int speed : trackSpeeds_) {
+    maxSpeed = (std::max)(maxSpeed, speed);
+  }
+  minCost_ = (maxSpeed > 0) ? (CostScale / uint32(maxSpeed)) : CostScale;
+
+  UpdateRect(tiles, MapRect(0, 0, width_ - 1, height_ - 1));
+}
+
+// =====================================================================================================================
+inline void GridPathFinder::Prepare(
+  const TileGridView&  tiles,
+  TrackType            trackType,
+  bool                 blockWallsAndBuildings)
+{
+  int trackSpeeds[size_t(CellType::Count)] = { };
+  for (size_t i = 0; i < size_t(CellType::Count); ++i) {
+    trackSpeeds[i] = MapImpl::GetCellTypeInfo(CellType(i))->trackSpeed[size_t(trackType)];
+  }
+  Prepare(tiles, trackSpeeds, blockWallsAndBuildings);
+}
+
+// =====================================================================================================================
+inline void GridPathFinder::UpdateRect(
+  const TileGridView&  tiles,
+  const MapRect&       rect)
+{
+  const MapRect clipped(
+    (std::max)(rect.x1, 0), (std::max)(rect.y1, 0), (std::min)(rect.x2, width_ - 1), (std::min)(rect.y2, height_ - 1));
+
+  if ((clipped.x2 >= clipped.x1) && (clipped.y2 >= clipped.y1)) {
+    UpdateCosts(tiles, clipped);
+    // Boundary flags depend on neighbors, so tiles just outside the rect may have changed too.
+    UpdateBoundaries(MapRect(clipped.x1 - 1, clipped.y1 - 1, clipped.x2 + 1, clipped.y2 + 1));
+  }
+}
+
+// =====================================================================================================================
+inline void GridPathFinder::UpdateCosts(
+  const TileGridView&  tiles,
+  const MapRect&       rect)
+{
+  const uint32 blockMask = blockWallsAndBuildings_ ? uint32(TileMaskWallOrBuilding) : 0u;
+
+  tiles.ForEachSpanInRect(rect, [this, blockMask](TileData* p, int length, int x, int y) {
+    uint32* pCost = &cost_[Node(x, y)];
+    for (int i = 0; i < length; ++i) {
+      const uint32 cellType = p[i].u32All & TileMaskCellType;
+      const int    speed    = (cellType < uint32(CellType::Count)) ? trackSpeeds_[cellType] : 0;
+      pCost[i] = ((speed <= 0) || (p[i].u32All & blockMask)) ? 0 : (std::max)(CostScale / uint32(speed), 1u);
+    }
+  });
+}
+
+// =====================================================================================================================
+inline void GridPathFinder::UpdateBoundaries(
+  const MapRect& rect)
+{
+  const int x1 = (std::max)(rect.x1, 0);
+  const int y1 = (std::max)(rect.y1, 0);
+  const int x2 = (std::min)(rect.x2, width_  - 1);
+  const int y2 = (std::min)(rect.y2, height_ - 1);
+
+  for (int y = y1; y <= y2; ++y) {
+    for (int x = x1; x <= x2; ++x) {
+      const uint32 cost     = cost_[Node(x, y)];
+      bool         boundary = false;
+
+      for (int dy = -1; (dy <= 1) && (boundary == false); ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          const uint32 neighbor = GetCost(x + dx, y + dy);
+          boundary |= (neighbor != 0) && (neighbor != cost);
+        }
+      }
+
+      boundary_[Node(x, y)] = boundary;
+    }
+  }
+}
+
+// =====================================================================================================================
+inline uint32 GridPathFinder::Heuristic(
+  int        node,
+  Algorithm  algorithm
+  ) const
+{
+  uint32 h = 0;
+
+  if (algorithm != Algorithm::Dijkstra) {
+    const int dx = std::abs((node % width_) - goalX_);
+    const int dy = std::abs((node / width_) - goalY_);
+    const int diagonal = (std::min)(dx, dy);
+    h = (uint32((std::max)(dx, dy) - diagonal) * minCost_) + (uint32(diagonal) * DiagonalCost(minCost_));
+  }
+
+  return h;
+}
+
+// =====================================================================================================================
+inline void GridPathFinder::Push(
+  int        node,
+  int        parent,
+  uint32     g,
+  Algorithm  algorithm)
+{
+  if ((closed_[node] != searchId_) && ((seen_[node] != searchId_) || (g < g_[node]))) {
+    seen_[node]   = searchId_;
+    g_[node]      = g;
+    parent_[node] = parent;
+    open_.push_back({ g + Heuristic(node, algorithm), node });
+    std::push_heap(open_.begin(), open_.end());
+    ++stats_.nodesPushed;
+  }
+}
+
+// =====================================================================================================================
+inline int GridPathFinder::JumpStraight(
+  int  x,
+  int  y,
+  int  dx,
+  int  dy
+  ) const
+{
+  for (;;) {
+    x += dx;
+    y += dy;
+
+    if (IsPassable(x, y) == false) {
+      return -1;
+    }
+
+    const int node = Node(x, y);
+    if ((node == goal_) || boundary_[node]) {
+      return node;
+    }
+
+    // Forced neighbors:  a perpendicular tile that is open here but was blocked beside the previous tile.
+    const bool forced = (dx != 0) ?
+      ((IsPassable(x, y - 1) && (IsPassable(x - dx, y - 1) == false)) ||
+       (IsPassable(x, y + 1) && (IsPassable(x - dx, y + 1) == false))) :
+      ((IsPassable(x - 1, y) && (IsPassable(x - 1, y - dy) == false)) ||
+       (IsPassable(x + 1, y) && (IsPassable(x + 1, y - dy) == false)));
+
+    if (forced) {
+      return node;
+    }
+  }
+}
+
+// =====================================================================================================================
+inline int GridPathFinder::JumpDiagonal(
+  int  x,
+  int  y,
+  int  dx,
+  int  dy
+  ) const
+{
+  for (;;) {
+    x += dx;
+    y += dy;
+
+    if (IsPassable(x, y) == false) {
+      return -1;
+    }
+
+    const int node = Node(x, y);
+    if ((node == goal_) || boundary_[node] || (JumpStraight(x, y, dx, 0) >= 0) || (JumpStraight(x, y, 0, dy) >= 0)) {
+      return node;
+    }
+
+    // Diagonal steps may not cut corners.
+    if ((IsPassable(x + dx, y) == false) || (IsPassable(x, y + dy) == false)) {
+      return -1;
+    }
+  }
+}
+
+// =====================================================================================================================
+inline void GridPathFinder::Expand(
+  int        node,
+  Algorithm  algorithm)
+{
+  const int x = node % width_;
+  const int y = node / width_;
+
+  // Pushes the successor reached by stepping (dx, dy) from this node, jumping ahead if using jump point search.
+  auto visit = [this, node, x, y, algorithm](int dx, int dy) {
+    const bool diagonal = (dx != 0) && (dy != 0);
+    int        next     = -1;
+
+    if (algorithm != Algorithm::JumpPoint) {
+      next = IsPassable(x + dx, y + dy) ? Node(x + dx, y + dy) : -1;
+    }
+    else {
+      next = diagonal ? JumpDiagonal(x, y, dx, dy) : JumpStraight(x, y, dx, dy);
+    }
+
+    if (next >= 0) {
+      // Every tile along a jump has the same cost as the jump point (otherwise the jump would have stopped earlier).
+      const int    steps = (std::max)(std::abs((next % width_) - x), std::abs((next / width_) - y));
+      const uint32 step  = reverse_ ? cost_[node] : cost_[next];
+      const uint32 cost  = diagonal ? DiagonalCost(step) : step;
+      Push(next, node, g_[node] + (uint32(steps) * cost), algorithm);
+    }
+  };
+
+  const int parent = parent_[node];
+
+  // Pruning assumes uniform step costs around the node, so expand all neighbors of the start node and boundary nodes.
+  if ((algorithm != Algorithm::JumpPoint) || (parent < 0) || boundary_[node]) {
+    for (const auto& offset : PathFinder::DirOffsetLut) {
+      if ((offset.dx == 0) || (offset.dy == 0) || (IsPassable(x + offset.dx, y) && IsPassable(x, y + offset.dy))) {
+        visit(offset.dx, offset.dy);
+      }
+    }
+  }
+  else {
+    // Prune neighbors based on the direction of travel from the parent.
+    const int px = parent % width_;
+    const int py = parent / width_;
+    const int dx = (x > px) - (x < px);
+    const int dy = (y > py) - (y < py);
+
+    if ((dx != 0) && (dy != 0)) {
+      const bool canX = IsPassable(x + dx, y);
+      const bool canY = IsPassable(x, y + dy);
+      if (canY)           { visit(0,  dy); }
+      if (canX)           { visit(dx, 0);  }
+      if (canX && canY)   { visit(dx, dy); }
+    }
+    else if (dx != 0) {
+      const bool canX    = IsPassable(x + dx, y);
+      const bool canUp   = IsPassable(x, y - 1);
+      const bool canDown = IsPassable(x, y + 1);
+      if (canX)            { visit(dx, 0);  }
+      if (canX && canUp)   { visit(dx, -1); }
+      if (canX && canDown) { visit(dx, 1);  }
+      if (canUp)           { visit(0,  -1); }
+      if (canDown)         { visit(0,  1);  }
+    }
+    else {
+      const bool canY     = IsPassable(x, y + dy);
+      const bool canLeft  = IsPassable(x - 1, y);
+      const bool canRight = IsPassable(x + 1, y);
+      if (canY)             { visit(0,  dy); }
+      if (canY && canLeft)  { visit(-1, dy); }
+      if (canY && canRight) { visit(1,  dy); }
+      if (canLeft)          { visit(-1, 0);  }
+      if (canRight)         { visit(1,  0);  }
+    }
+  }
+}
+
+// =====================================================================================================================
+inline bool GridPathFinder::FindPath(
+  const Location&      start,
+  const Location&      goal,
+  std::vector<uint8>*  pDirections,
+  Algorithm            algorithm)
+{
+  stats_ = { };
+  pDirections->clear();
+
+  bool found = false;
+
+  if (IsPassable(start.x, start.y) && IsPassable(goal.x, goal.y)) {
+    BeginSearch();
+    goal_    = Node(goal.x, goal.y);
+    goalX_   = goal.x;
+    goalY_   = goal.y;
+    reverse_ = false;
+    Push(Node(start.x, start.y), -1, 0, algorithm);
+
+    while ((found == false) && (open_.empty() == false)) {
+      std::pop_heap(open_.begin(), open_.end());
+      const OpenEntry entry = open_.back();
+      open_.pop_back();
+
+      // Skip stale entries for nodes that were already expanded via a cheaper path.
+      if (closed_[entry.node] != searchId_) {
+        closed_[entry.node] = searchId_;
+        found = (entry.node == goal_);
+
+        if (found == false) {
+          ++stats_.nodesExpanded;
+          Expand(entry.node, algorithm);
+        }
+      }
+    }
+
+    if (found) {
+      stats_.pathCost = g_[goal_];
+      BuildPath(goal_, false, pDirections);
+      stats_.pathLength = pDirections->size();
+    }
+  }
+
+  return found;
+}
+
+// =====================================================================================================================
+inline void GridPathFinder::SetBounds(
+  const MapRect& bounds)
+{
+  boundsX_      = (std::max)(bounds.x1, 0);
+  boundsY_      = (std::max)(bounds.y1, 0);
+  boundsWidth_  = (std::max)((std::min)(bounds.x2, width_  - 1) - boundsX_ + 1, 0);
+  boundsHeight_ = (std::max)((std::min)(bounds.y2, height_ - 1) - boundsY_ + 1, 0);
+}
+
+// =====================================================================================================================
+inline void GridPathFinder::BeginSearch() {
+  if (++searchId_ == 0) {
+    // Search ID wrapped around;  reset the stamps so stale entries can't match.
+    std::fill(seen_.begin(),   seen_.end(),   0);
+    std::fill(closed_.begin(), closed_.end(), 0);
+    searchId_ = 1;
+  }
+
+  open_.clear();
+}
+
+// =====================================================================================================================
+inline bool GridPathFinder::FindPathInRect(
+  const MapRect&       bounds,
+  const Location&      start,
+  const Location&      goal,
+  std::vector<uint8>*  pDirections,
+  Algorithm            algorithm)
+{
+  SetBounds(bounds);
+  const bool result = FindPath(start, goal, pDirections, algorithm);
+  ResetBounds();
+
+  return result;
+}
+
+// =====================================================================================================================
+inline void GridPathFinder::FloodInRect(
+  const MapRect&   bounds,
+  const Location&  origin,
+  bool             reverse)
+{
+  stats_ = { };
+  SetBounds(bounds);
+  BeginSearch();
+  goal_    = -1;
+  reverse_ = reverse;
+
+  if (IsPassable(origin.x, origin.y)) {
+    Push(Node(origin.x, origin.y), -1, 0, Algorithm::Dijkstra);
+
+    while (open_.empty() == false) {
+      std::pop_heap(open_.begin(), open_.end());
+      const OpenEntry entry = open_.back();
+      open_.pop_back();
+
+      if (closed_[entry.node] != searchId_) {
+        closed_[entry.node] = searchId_;
+        ++stats_.nodesExpanded;
+        Expand(entry.node, Algorithm::Dijkstra);
+      }
+    }
+  }
+
+  ResetBounds();
+}
+
+// =====================================================================================================================
+inline bool GridPathFinder::GetFloodPath(
+  const Location&      target,
+  std::vector<uint8>*  pDirections,
+  uint32*              pCost
+  ) const
+{
+  const int  node  = Node(target.x, target.y);
+  const bool found = (target.x >= 0) && (target.x < width_) && (target.y >= 0) && (target.y < height_) &&
+                     (searchId_ != 0) && (closed_[node] == searchId_) && (goal_ < 0);
+
+  pDirections->clear();
+
+  if (found) {
+    BuildPath(node, reverse_, pDirections);
+    if (pCost != nullptr) {
+      *pCost = g_[node];
+    }
+  }
+
+  return found;
+}
+
+// =====================================================================================================================
+inline void GridPathFinder::BuildPath(
+  int                  end,
+  bool                 reverse,
+  std::vector<uint8>*  pDirections
+  ) const
+{
+  // Walk the parent chain from the end node, emitting each jump as a run of single steps.  For forward searches, this
+  // walks backwards along the path, so the steps are then put in forward order.
+  for (int node = end; parent_[node] >= 0; node = parent_[node]) {
+    const int parent = parent_[node];
+    const int dx     = reverse ? ((parent % width_) - (node % width_)) : ((node % width_) - (parent % width_));
+    const int dy     = reverse ? ((parent / width_) - (node / width_)) : ((node / width_) - (parent / width_));
+    const int sx     = (dx > 0) - (dx < 0);
+    const int sy     = (dy > 0) - (dy < 0);
+
+    uint8 direction = 0;
+    for (const auto* p = &PathFinder::DirOffsetLut[0]; (p->dx != sx) || (p->dy != sy); ++p, ++direction);
+
+    pDirections->insert(pDirections->end(), size_t((std::max)(std::abs(dx), std::abs(dy))), direction);
+  }
+
+  if (reverse == false) {
+    std::reverse(pDirections->begin(), pDirections->end());
+  }
+}
+
+// =====================================================================================================================
+inline size_t GridPathFinder::FillPathContext(
+  PathContext*  pContext,
+  const uint8*  pDirections,
+  size_t        count)
+{
+  const size_t numCopied = (std::min)(count, sizeof(pContext->direction));
+
+  std::copy(pDirections, pDirections + numCopied, &pContext->direction[0]);
+  pContext->numPathfinderPoints    = int(numCopied);
+  pContext->currentPathfinderPoint = 0;
+
+  return numCopied;
+}
+
+} // Tethys
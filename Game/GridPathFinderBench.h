@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Tethys/Game/GridPathFinder.h"
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+namespace Tethys {
+
+/// GridPathFinder benchmark result for one search algorithm.
+struct GridPathBenchmarkResult {
+  GridPathFinder::Algorithm  algorithm;
+  size_t  numPaths;          ///< Number of start/goal pairs for which a path was found.
+  size_t  nodesExpanded;     ///< Total over all searches.
+  size_t  nodesPushed;       ///< Total over all searches.
+  double  milliseconds;      ///< Total wall time over all searches.
+  size_t  numOptimal;        ///< Number of paths whose cost equals the Dijkstra baseline's.
+};
+
+/// Compares jump point search and A* against a plain Dijkstra baseline, on a synthetic width x height map (uniform
+/// terrain with scattered patches of slower terrain and impassable obstacles) over numQueries random start/goal pairs.
+/// The Dijkstra result is always first.
+inline std::vector<GridPathBenchmarkResult> RunGridPathBenchmark(
+  int  width      = 512,
+  int  height     = 256,
+  int  numQueries = 200)
+{
+  using Clock     = std::chrono::steady_clock;
+  using Algorithm = GridPathFinder::Algorithm;
+
+  uint32 seed = 0x51F15EED;
+  const auto Next = [&seed](int range) { seed = (seed * 1103515245) + 12345;  return int((seed >> 8) % range); };
+
+  std::vector<TileData> tiles(size_t(width) * height);
+  TileGridView grid(tiles.data(), width, height);
+  for (auto& tile : tiles) {
+    tile.u32All = uint32(CellType::FastPassible1);
+  }
+
+  // Patches of slower terrain and impassable obstacles, 3 to 12 tiles on a side.
+  static constexpr CellType Patches[] =
+    { CellType::MediumPassible1, CellType::SlowPassible1, CellType::Impassible1, CellType::Impassible2 };
+  const int numPatches = (width * height) / 256;
+  for (int i = 0; i < numPatches; ++i) {
+    const CellType type = Patches[Next(4)];
+    const int      x    = Next(width);
+    const int      y    = Next(height);
+    const int      w    = 3 + Next(10);
+    const int      h    = 3 + Next(10);
+    grid.ForEachInRect(MapRect(x, y, x + w - 1, y + h - 1), [type](TileData& tile, int, int)
+      { tile.cellType = uint32(type); });
+  }
+
+  int trackSpeeds[size_t(CellType::Count)] = { };
+  trackSpeeds[size_t(CellType::FastPassible1)]   = 4;
+  trackSpeeds[size_t(CellType::MediumPassible1)] = 2;
+  trackSpeeds[size_t(CellType::SlowPassible1)]   = 1;
+
+  GridPathFinder finder;
+  finder.Prepare(grid, trackSpeeds);
+
+  std::vector<std::pair<Location, Location>> queries;
+  while (queries.size() < size_t(numQueries)) {
+    Location start, goal;
+    start.x = Next(width);
+    start.y = Next(height);
+    goal.x  = Next(width);
+    goal.y  = Next(height);
+    if (finder.IsPassable(start.x, start.y) && finder.IsPassable(goal.x, goal.y)) {
+      queries.emplace_back(start, goal);
+    }
+  }
+
+  std::vector<GridPathBenchmarkResult> results;
+  std::vector<uint32>                  baseline(queries.size(), 0);
+  std::vector<uint8>                   directions;
+
+  for (const Algorithm algorithm : { Algorithm::Dijkstra, Algorithm::AStar, Algorithm::JumpPoint }) {
+    GridPathBenchmarkResult result = { };
+    result.algorithm = algorithm;
+
+    for (size_t i = 0; i < queries.size(); ++i) {
+      const auto start = Clock::now();
+      const bool found = finder.FindPath(queries[i].first, queries[i].second, &directions, algorithm);
+      result.milliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+      const GridPathFinder::Stats& stats = finder.GetStats();
+      result.nodesExpanded += stats.nodesExpanded;
+      result.nodesPushed   += stats.nodesPushed;
+
+      if (found) {
+        ++result.numPaths;
+        if (algorithm == Algorithm::Dijkstra) {
+          baseline[i] = stats.pathCost;
+        }
+        result.numOptimal += (stats.pathCost == baseline[i]);
+      }
+    }
+
+    results.push_back(result);
+  }
+
+  return results;
+}
+
+} // Tethys
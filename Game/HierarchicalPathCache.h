@@ -0,0 +1,670 @@
+#pragma once
+
+#include "Tethys/Game/MapImpl.h"
+#include "Tethys/Game/GridPathFinder.h"
+#include "Tethys/Game/TileGridView.h"
+#include "Tethys/API/Location.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+namespace Tethys {
+
+/// Hierarchical pathfinding (HPA*) cache over 32x32 tile clusters, for repeated long-distance path queries.
+///
+/// Clusters line up with the 32-tile column chunks of the tile array (@see TileGridView) and are numbered in the same
+/// column-chunk order.  Each pair of adjacent clusters is connected by entrances placed along runs of passable tiles on
+/// their shared border.  Entrance-to-entrance costs and paths within a cluster are computed on first use and cached
+/// per TrackType, so after warmup a query costs a search within the start and goal clusters plus an A* search over the
+/// small abstract graph of entrances.
+///
+/// When tiles change, Invalidate() refreshes the cost grids and drops cached edges of only the touched clusters;
+/// entrances are only rebuilt for borders whose tiles were touched.  The active cache (@see SetActive()) is invalidated
+/// automatically by TethysAPI helpers that change tiles (GameMap::SetTile(), GameMap::SetCellType(),
+/// Game::CreateWall(), MapImpl::CreateWallOrTube(), etc.), via MapImpl::pfnOnTilesChanged.
+///
+/// @note  Paths are near-optimal rather than optimal, as with any HPA* implementation.  Paths do not wrap around world
+///        maps.  @see GridPathFinder for the cost model.
+class HierarchicalPathCache {
+public:
+  static constexpr int Log2ClusterSize       = TileGridView::Log2ChunkWidth;
+  static constexpr int ClusterSize           = 1 << Log2ClusterSize;  ///< Width and height in tiles of a cluster.
+  static constexpr int MaxEntrancesPerBorder = ClusterSize / 2;
+  static constexpr int MaxNodesPerCluster    = MaxEntrancesPerBorder * 4;
+
+  /// Track speeds per TrackType per CellType, as in CellTypeInfo::trackSpeed.
+  using TrackSpeedTable = int[size_t(TrackType::Count)][size_t(CellType::Count)];
+
+  /// Query and cache statistics.
+  struct Counters {
+    size_t queries;            ///< Number of FindPath() calls.
+    size_t localQueries;       ///< Queries answered by a search within a single cluster.
+    size_t edgeHits;           ///< Intra-cluster edge lookups served from the cache.
+    size_t edgeMisses;         ///< Intra-cluster edge lookups that required a search.
+    size_t bordersRebuilt;     ///< Number of cluster borders whose entrances were (re)built.
+    size_t clustersRebuilt;    ///< Number of clusters whose edge cache was (re)built.
+
+    /// Gets the fraction of intra-cluster edge lookups served from the cache.
+    double GetHitRate() const
+      { return ((edgeHits + edgeMisses) != 0) ? (double(edgeHits) / double(edgeHits + edgeMisses)) : 0.0; }
+  };
+
+  HierarchicalPathCache() = default;
+  HierarchicalPathCache(const TileGridView& tiles, const TrackSpeedTable& trackSpeeds, bool blockWalls = true)
+    { Init(tiles, trackSpeeds, blockWalls); }
+  explicit HierarchicalPathCache(const TileGridView& tiles, bool blockWallsAndBuildings = true)
+    { Init(tiles, blockWallsAndBuildings); }
+
+  ~HierarchicalPathCache() { if (pActive_ == this) { SetActive(nullptr); } }
+
+  HierarchicalPathCache(const HierarchicalPathCache&)            = delete;
+  HierarchicalPathCache& operator=(const HierarchicalPathCache&) = delete;
+
+  /// Initializes the cache for a tile grid with the given track speeds.  Per-TrackType data is built on first use.
+  void Init(const TileGridView& tiles, const TrackSpeedTable& trackSpeeds, bool blockWallsAndBuildings = true);
+  /// Initializes the cache for a tile grid, using the game's cell type info.
+  void Init(const TileGridView& tiles, bool blockWallsAndBuildings = true);
+
+  /// Drops all cached data, keeping the tile grid and track speeds.
+  void Clear();
+
+  /// Notifies the cache that tiles in the given area have changed.
+  void Invalidate(const MapRect& area);
+
+  /// Finds a path from start to goal for the given track type.  On success, *pDirections is set to one UnitDirection
+  /// per tile step (@see GridPathFinder::FillPathContext()).
+  bool FindPath(TrackType trackType, const Location& start, const Location& goal, std::vector<uint8>* pDirections);
+
+  const Counters& GetCounters() const { return counters_;     }
+  void            ResetCounters()     { counters_ = { };      }
+
+  /// Gets the number of bytes allocated for cost grids, entrances, cached edges and search buffers.
+  size_t GetMemoryUsage() const;
+
+  /// Gets the cache that is invalidated by TethysAPI tile-modifying helpers, or nullptr.
+  static HierarchicalPathCache* GetActive() { return pActive_; }
+  /// Sets the cache that is invalidated by TethysAPI tile-modifying helpers.  Pass nullptr to disable.
+  static void SetActive(HierarchicalPathCache* pCache) {
+    pActive_ = pCache;
+    MapImpl::pfnOnTilesChanged = (pCache != nullptr) ? &InvalidateActive : nullptr;
+  }
+
+private:
+  /// Cluster border sides, in the order their entrances are numbered within a cluster.
+  enum Side : int { West = 0, East, North, South, NumSides };
+
+  static constexpr uint32 EdgeUnknown = UINT32_MAX;      ///< Edge has not been computed.
+  static constexpr uint32 EdgeNone    = UINT32_MAX - 1;  ///< No path between the edge's nodes within the cluster.
+
+  /// Entrance between two adjacent clusters.  (x, y) is the tile on the west/north side;  the tile on the east/south
+  /// side is (x + 1, y) for vertical borders and (x, y + 1) for horizontal borders.
+  struct Entrance {
+    uint16 x;
+    uint16 y;
+  };
+
+  struct Border {
+    std::vector<Entrance> entrances;
+    bool                  dirty;
+  };
+
+  /// Cached path between two nodes (or a node and a query endpoint).
+  struct Edge {
+    uint32             cost;
+    std::vector<uint8> path;
+  };
+
+  /// Abstract graph node:  an entrance tile within a cluster.
+  struct Node {
+    Location pos;
+    Side     side;      ///< Side of the cluster the entrance is on.
+    int      entrance;  ///< Index of the entrance in its border.
+  };
+
+  struct Cluster {
+    int               firstNode[NumSides + 1];  ///< Local index of each side's first node;  [NumSides] = count.
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;                    ///< (from * count) + to.
+    bool              dirty;
+  };
+
+  /// Per-TrackType cost grid, entrances and edge cache.
+  struct Layer {
+    GridPathFinder       finder;
+    std::vector<Border>  vBorders;   ///< Border between clusters (cx, cy) and (cx + 1, cy), at ClusterIndex(cx, cy).
+    std::vector<Border>  hBorders;   ///< Border between clusters (cx, cy) and (cx, cy + 1), at ClusterIndex(cx, cy).
+    std::vector<Cluster> clusters;
+    bool                 initialized;
+    bool                 dirty;
+  };
+
+  struct OpenEntry {
+    uint32 f;
+    int    key;
+    bool operator<(const OpenEntry& other) const { return f > other.f; }  // Min-heap
+  };
+
+  int NumClusters()                 const { return clustersWide_ * clustersHigh_;                                   }
+  int ClusterIndex(int cx, int cy)  const { return (cx * clustersHigh_) + cy;                                       }
+  int ClusterOf(const Location& at) const { return ClusterIndex(at.x >> Log2ClusterSize, at.y >> Log2ClusterSize); }
+
+  MapRect ClusterRect(int cluster) const {
+    const int x = (cluster / clustersHigh_) << Log2ClusterSize;
+    const int y = (cluster % clustersHigh_) << Log2ClusterSize;
+    return MapRect(
+      x, y, (std::min)(x + ClusterSize, tiles_.Width()) - 1, (std::min)(y + ClusterSize, tiles_.Height()) - 1);
+  }
+
+  int  NumNodes(const Layer& layer, int cluster) const { return layer.clusters[cluster].firstNode[NumSides]; }
+  const Node& GetNode(const Layer& layer, int cluster, int node) const { return layer.clusters[cluster].nodes[node]; }
+  void GetPeer(const Layer& layer, int cluster, int node, int* pPeerCluster, int* pPeerNode, Location* pPeerPos) const;
+
+  Layer&      GetLayer(TrackType trackType);
+  void        Refresh(Layer* pLayer);
+  void        BuildNodes(Layer* pLayer, int cluster);
+  void        BuildBorder(Layer* pLayer, Border* pBorder, const Location& first, int length, bool vertical);
+  const Edge& GetEdge(Layer* pLayer, int cluster, int from, int to);
+  uint32      Heuristic(const Layer& layer, const Location& from, const Location& goal) const;
+
+  static uint8 GetDirection(int dx, int dy);
+  static void  InvalidateActive(const MapRect& area) { pActive_->Invalidate(area); }
+
+  static inline HierarchicalPathCache* pActive_ = nullptr;
+
+  TileGridView    tiles_;
+  TrackSpeedTable trackSpeeds_  = { };
+  bool            blockWallsAndBuildings_ = true;
+  int             clustersWide_ = 0;
+  int             clustersHigh_ = 0;
+  Layer           layers_[size_t(TrackType::Count)];
+  Counters        counters_     = { };
+
+  // Abstract search buffers, keyed by (cluster * MaxNodesPerCluster) + node.  The last two keys are start and goal.
+  std::vector<uint32>    g_;
+  std::vector<int>       parent_;
+  std::vector<uint32>    seen_;
+  std::vector<uint32>    closed_;
+  std::vector<OpenEntry> open_;
+  uint32                 searchId_ = 0;
+  std::vector<Edge>      startEdges_;  ///< Start to each node of the start cluster.
+  std::vector<Edge>      goalEdges_;   ///< Each node of the goal cluster to goal.
+  std::vector<uint8>     segment_;
+};
+
+// =====================================================================================================================
+inline void HierarchicalPathCache::Init(
+  const TileGridView&     tiles,
+  const TrackSpeedTable&  trackSpeeds,
+  bool                    blockWallsAndBuildings)
+{
+  tiles_                  = tiles;
+  blockWallsAndBuildings_ = blockWallsAndBuildings;
+  clustersWide_           = (tiles.Width()  + ClusterSize - 1) >> Log2ClusterSize;
+  clustersHigh_           = (tiles.Height() + ClusterSize - 1) >> Log2ClusterSize;
+  std::copy(&trackSpeeds[0][0], &trackSpeeds[0][0] + (sizeof(trackSpeeds) / sizeof(int)), &trackSpeeds_[0][0]);
+
+  const size_t numKeys = (size_t(NumClusters()) * MaxNodesPerCluster) + 2;
+  g_.assign(numKeys, 0);
+  parent_.assign(numKeys, -1);
+  seen_.assign(numKeys, 0);
+  closed_.assign(numKeys, 0);
+  searchId_ = 0;
+
+  Clear();
+}
+
+// =====================================================================================================================
+inline void HierarchicalPathCache::Init(
+  const TileGridView&  tiles,
+  bool                 blockWallsAndBuildings)
+{
+  TrackSpeedTable trackSpeeds = { };
+  for (size_t track = 0; track < size_t(TrackType::Count); ++track) {
+    for (size_t cellType = 0; cellType < size_t(CellType::Count); ++cellType) {
+      trackSpeeds[track][cellType] = MapImpl::GetCellTypeInfo(CellType(cellType))->trackSpeed[track];
+    }
+  }
+  Init(tiles, trackSpeeds, blockWallsAndBuildings);
+}
+
+// =====================================================================================================================
+inline void HierarchicalPathCache::Clear() {
+  for (Layer& layer : layers_) {
+    layer = Layer{};
+  }
+}
+
+// =====================================================================================================================
+inline void HierarchicalPathCache::Invalidate(
+  const MapRect& area)
+{
+  const int x1 = (std::max)(area.x1, 0);
+  const int y1 = (std::max)(area.y1, 0);
+  const int x2 = (std::min)(area.x2, tiles_.Width()  - 1);
+  const int y2 = (std::min)(area.y2, tiles_.Height() - 1);
+
+  if ((x2 >= x1) && (y2 >= y1)) {
+    const MapRect clipped(x1, y1, x2, y2);
+    const int     cx1 = (x1 >> Log2ClusterSize);
+    const int     cx2 = (x2 >> Log2ClusterSize);
+    const int     cy1 = (y1 >> Log2ClusterSize);
+    const int     cy2 = (y2 >> Log2ClusterSize);
+
+    // Borders touching the area are those just left of (or above) a tile in (x1 .. x2 + 1) that starts a cluster.
+    const int borderX1 = (std::max)(((x1 + 1) >> Log2ClusterSize), 1);
+    const int borderX2 = (std::min)(((x2 + 1) >> Log2ClusterSize), clustersWide_ - 1);
+    const int borderY1 = (std::max)(((y1 + 1) >> Log2ClusterSize), 1);
+    const int borderY2 = (std::min)(((y2 + 1) >> Log2ClusterSize), clustersHigh_ - 1);
+
+    for (Layer& layer : layers_) {
+      if (layer.initialized) {
+        layer.finder.UpdateRect(tiles_, clipped);
+        layer.dirty = true;
+
+        // Edges of a cluster only depend on tiles within it.
+        for (int cx = cx1; cx <= cx2; ++cx) {
+          for (int cy = cy1; cy <= cy2; ++cy) {
+            layer.clusters[ClusterIndex(cx, cy)].dirty = true;
+          }
+        }
+
+        // Entrances of a border only depend on the tiles on either side of it.
+        for (int cx = borderX1; cx <= borderX2; ++cx) {
+          for (int cy = cy1; cy <= cy2; ++cy) {
+            layer.vBorders[ClusterIndex(cx - 1, cy)].dirty = true;
+          }
+        }
+        for (int cy = borderY1; cy <= borderY2; ++cy) {
+          for (int cx = cx1; cx <= cx2; ++cx) {
+            layer.hBorders[ClusterIndex(cx, cy - 1)].dirty = true;
+          }
+        }
+      }
+    }
+  }
+}
+
+// =====================================================================================================================
+inline HierarchicalPathCache::Layer& HierarchicalPathCache::GetLayer(
+  TrackType trackType)
+{
+  Layer& layer = layers_[size_t(trackType)];
+
+  if (layer.initialized == false) {
+    layer.finder.Prepare(tiles_, trackSpeeds_[size_t(trackType)], blockWallsAndBuildings_);
+    layer.vBorders.assign(NumClusters(), Border{ { }, true });
+    layer.hBorders.assign(NumClusters(), Border{ { }, true });
+    layer.clusters.assign(NumClusters(), Cluster{ { }, { }, { }, true });
+    layer.initialized = true;
+    layer.dirty       = true;
+  }
+
+  Refresh(&layer);
+  return layer;
+}
+
+// =====================================================================================================================
+inline void HierarchicalPathCache::BuildBorder(
+  Layer*           pLayer,
+  Border*          pBorder,
+  const Location&  first,
+  int              length,
+  bool             vertical)
+{
+  const int dx = vertical ? 1 : 0;
+  const int dy = vertical ? 0 : 1;
+  const GridPathFinder& finder = pLayer->finder;
+
+  pBorder->entrances.clear();
+  pBorder->dirty = false;
+  ++counters_.bordersRebuilt;
+
+  // Place one entrance in the middle of each short run of tiles that are passable on both sides, or one at each end of
+  // long runs.
+  for (int i = 0, runStart = 0; i <= length; ++i) {
+    const int  x    = first.x + (vertical ? 0 : i);
+    const int  y    = first.y + (vertical ? i : 0);
+    const bool open = (i < length) && finder.IsPassable(x, y) && finder.IsPassable(x + dx, y + dy);
+
+    if (open == false) {
+      const int runLength = i - runStart;
+      auto add = [&](int offset) {
+        pBorder->entrances.push_back(
+          { uint16(first.x + (vertical ? 0 : offset)), uint16(first.y + (vertical ? offset : 0)) });
+      };
+
+      if (runLength >= 6) {
+        add(runStart);
+        add(i - 1);
+      }
+      else if (runLength > 0) {
+        add(runStart + (runLength / 2));
+      }
+
+      runStart = i + 1;
+    }
+  }
+}
+
+// =====================================================================================================================
+inline void HierarchicalPathCache::Refresh(
+  Layer* pLayer)
+{
+  if (pLayer->dirty) {
+    for (int cx = 0; cx < clustersWide_; ++cx) {
+      for (int cy = 0; cy < clustersHigh_; ++cy) {
+        const int     index = ClusterIndex(cx, cy);
+        const MapRect rect  = ClusterRect(index);
+
+        if ((cx + 1 < clustersWide_) && pLayer->vBorders[index].dirty) {
+          BuildBorder(pLayer, &pLayer->vBorders[index], Location(rect.x2, rect.y1), rect.y2 - rect.y1 + 1, true);
+          pLayer->clusters[index].dirty                    = true;
+          pLayer->clusters[ClusterIndex(cx + 1, cy)].dirty = true;
+        }
+        if ((cy + 1 < clustersHigh_) && pLayer->hBorders[index].dirty) {
+          BuildBorder(pLayer, &pLayer->hBorders[index], Location(rect.x1, rect.y2), rect.x2 - rect.x1 + 1, false);
+          pLayer->clusters[index].dirty                    = true;
+          pLayer->clusters[ClusterIndex(cx, cy + 1)].dirty = true;
+        }
+      }
+    }
+
+    for (int cluster = 0; cluster < NumClusters(); ++cluster) {
+      if (pLayer->clusters[cluster].dirty) {
+        BuildNodes(pLayer, cluster);
+      }
+    }
+
+    pLayer->dirty = false;
+  }
+}
+
+// =====================================================================================================================
+inline void HierarchicalPathCache::BuildNodes(
+  Layer*  pLayer,
+  int     cluster)
+{
+  Cluster&  c  = pLayer->clusters[cluster];
+  const int cx = cluster / clustersHigh_;
+  const int cy = cluster % clustersHigh_;
+
+  // West and north entrances are stored by the neighboring cluster's border, on the neighbor's side.
+  const Border* pBorders[NumSides] = {
+    (cx > 0)                 ? &pLayer->vBorders[ClusterIndex(cx - 1, cy)] : nullptr,
+    (cx + 1 < clustersWide_) ? &pLayer->vBorders[ClusterIndex(cx,     cy)] : nullptr,
+    (cy > 0)                 ? &pLayer->hBorders[ClusterIndex(cx, cy - 1)] : nullptr,
+    (cy + 1 < clustersHigh_) ? &pLayer->hBorders[ClusterIndex(cx, cy)]     : nullptr,
+  };
+
+  c.nodes.clear();
+  for (int side = 0; side < NumSides; ++side) {
+    c.firstNode[side] = int(c.nodes.size());
+
+    for (size_t i = 0; (pBorders[side] != nullptr) && (i < pBorders[side]->entrances.size()); ++i) {
+      const Entrance& e = pBorders[side]->entrances[i];
+      c.nodes.push_back(
+        { Location(e.x + ((side == West) ? 1 : 0), e.y + ((side == North) ? 1 : 0)), Side(side), int(i) });
+    }
+  }
+  c.firstNode[NumSides] = int(c.nodes.size());
+
+  c.edges.assign(c.nodes.size() * c.nodes.size(), Edge{ EdgeUnknown, { } });
+  c.dirty = false;
+  ++counters_.clustersRebuilt;
+}
+
+// =====================================================================================================================
+inline void HierarchicalPathCache::GetPeer(
+  const Layer&  layer,
+  int           cluster,
+  int           node,
+  int*          pPeerCluster,
+  int*          pPeerNode,
+  Location*     pPeerPos
+  ) const
+{
+  static constexpr Side Opposite[NumSides] = { East, West, South, North };
+  static constexpr int  OffsetX[NumSides]  = { -1, 1,  0, 0 };
+  static constexpr int  OffsetY[NumSides]  = {  0, 0, -1, 1 };
+
+  const Node& n    = GetNode(layer, cluster, node);
+  const Side  side = n.side;
+
+  const int peerCluster =
+    ClusterIndex((cluster / clustersHigh_) + OffsetX[side], (cluster % clustersHigh_) + OffsetY[side]);
+
+  *pPeerCluster = peerCluster;
+  *pPeerNode    = layer.clusters[peerCluster].firstNode[Opposite[side]] + n.entrance;
+  *pPeerPos     = Location(n.pos.x + OffsetX[side], n.pos.y + OffsetY[side]);
+}
+
+// =====================================================================================================================
+inline const HierarchicalPathCache::Edge& HierarchicalPathCache::GetEdge(
+  Layer*  pLayer,
+  int     cluster,
+  int     from,
+  int     to)
+{
+  Cluster& c    = pLayer->clusters[cluster];
+  Edge&    edge = c.edges[(size_t(from) * c.firstNode[NumSides]) + to];
+
+  if (edge.cost != EdgeUnknown) {
+    ++counters_.edgeHits;
+  }
+  else {
+    ++counters_.edgeMisses;
+
+    // One flood from the source node gives the edges to every other node in the cluster, so fill in all of them.
+    pLayer->finder.FloodInRect(ClusterRect(cluster), c.nodes[from].pos);
+
+    for (int node = 0; node < c.firstNode[NumSides]; ++node) {
+      Edge& e = c.edges[(size_t(from) * c.firstNode[NumSides]) + node];
+      if ((node != from) && (e.cost == EdgeUnknown)) {
+        if (pLayer->finder.GetFloodPath(c.nodes[node].pos, &e.path, &e.cost) == false) {
+          e.cost = EdgeNone;
+        }
+        e.path.shrink_to_fit();
+      }
+    }
+  }
+
+  return edge;
+}
+
+// =====================================================================================================================
+inline uint32 HierarchicalPathCache::Heuristic(
+  const Layer&     layer,
+  const Location&  from,
+  const Location&  goal
+  ) const
+{
+  const int    dx       = std::abs(from.x - goal.x);
+  const int    dy       = std::abs(from.y - goal.y);
+  const int    diagonal = (std::min)(dx, dy);
+  const uint32 minCost  = layer.finder.GetMinCost();
+  return (uint32((std::max)(dx, dy) - diagonal) * minCost) + (uint32(diagonal) * GridPathFinder::DiagonalCost(minCost));
+}
+
+// =====================================================================================================================
+inline uint8 HierarchicalPathCache::GetDirection(
+  int  dx,
+  int  dy)
+{
+  uint8 direction = 0;
+  for (; (PathFinder::DirOffsetLut[direction].dx != dx) || (PathFinder::DirOffsetLut[direction].dy != dy); ++direction);
+  return direction;
+}
+
+// =====================================================================================================================
+inline bool HierarchicalPathCache::FindPath(
+  TrackType            trackType,
+  const Location&      start,
+  const Location&      goal,
+  std::vector<uint8>*  pDirections)
+{
+  ++counters_.queries;
+  pDirections->clear();
+
+  Layer& layer = GetLayer(trackType);
+  GridPathFinder& finder = layer.finder;
+
+  if ((finder.IsPassable(start.x, start.y) == false) || (finder.IsPassable(goal.x, goal.y) == false)) {
+    return false;
+  }
+
+  const int startCluster = ClusterOf(start);
+  const int goalCluster  = ClusterOf(goal);
+
+  if ((startCluster == goalCluster) && finder.FindPathInRect(ClusterRect(startCluster), start, goal, pDirections)) {
+    ++counters_.localQueries;
+    return true;
+  }
+
+  // Connect the query endpoints to the entrances of their clusters, with a forward flood from the start and a reverse
+  // flood from the goal.
+  for (const bool isGoal : { false, true }) {
+    const int          cluster = isGoal ? goalCluster : startCluster;
+    std::vector<Edge>& edges   = isGoal ? goalEdges_  : startEdges_;
+
+    finder.FloodInRect(ClusterRect(cluster), isGoal ? goal : start, isGoal);
+    edges.resize(NumNodes(layer, cluster));
+
+    for (int node = 0; node < int(edges.size()); ++node) {
+      if (finder.GetFloodPath(GetNode(layer, cluster, node).pos, &edges[node].path, &edges[node].cost) == false) {
+        edges[node].cost = EdgeNone;
+      }
+    }
+  }
+
+  // A* over the abstract graph.
+  const int startKey = NumClusters() * MaxNodesPerCluster;
+  const int goalKey  = startKey + 1;
+
+  if (++searchId_ == 0) {
+    std::fill(seen_.begin(),   seen_.end(),   0);
+    std::fill(closed_.begin(), closed_.end(), 0);
+    searchId_ = 1;
+  }
+  open_.clear();
+
+  auto push = [this, &layer, &goal, goalKey](int key, int parent, uint32 g, const Location& at) {
+    if ((closed_[key] != searchId_) && ((seen_[key] != searchId_) || (g < g_[key]))) {
+      seen_[key]   = searchId_;
+      g_[key]      = g;
+      parent_[key] = parent;
+      open_.push_back({ g + ((key == goalKey) ? 0 : Heuristic(layer, at, goal)), key });
+      std::push_heap(open_.begin(), open_.end());
+    }
+  };
+
+  push(startKey, -1, 0, start);
+
+  bool found = false;
+  while ((found == false) && (open_.empty() == false)) {
+    std::pop_heap(open_.begin(), open_.end());
+    const int key = open_.back().key;
+    open_.pop_back();
+
+    if (closed_[key] == searchId_) {
+      continue;
+    }
+    closed_[key] = searchId_;
+    found        = (key == goalKey);
+
+    const uint32 g = g_[key];
+
+    if (key == startKey) {
+      for (int node = 0; node < int(startEdges_.size()); ++node) {
+        if (startEdges_[node].cost != EdgeNone) {
+          const Location& pos = GetNode(layer, startCluster, node).pos;
+          push((startCluster * MaxNodesPerCluster) + node, key, g + startEdges_[node].cost, pos);
+        }
+      }
+    }
+    else if (found == false) {
+      const int cluster = key / MaxNodesPerCluster;
+      const int node    = key % MaxNodesPerCluster;
+
+      if ((cluster == goalCluster) && (goalEdges_[node].cost != EdgeNone)) {
+        push(goalKey, key, g + goalEdges_[node].cost, goal);
+      }
+
+      int      peerCluster;
+      int      peerNode;
+      Location peerPos;
+      GetPeer(layer, cluster, node, &peerCluster, &peerNode, &peerPos);
+      push((peerCluster * MaxNodesPerCluster) + peerNode, key, g + finder.GetCost(peerPos.x, peerPos.y), peerPos);
+
+      for (int to = 0; to < NumNodes(layer, cluster); ++to) {
+        if (to != node) {
+          const Edge& edge = GetEdge(&layer, cluster, node, to);
+          if (edge.cost != EdgeNone) {
+            push((cluster * MaxNodesPerCluster) + to, key, g + edge.cost, GetNode(layer, cluster, to).pos);
+          }
+        }
+      }
+    }
+  }
+
+  if (found) {
+    // Walk back from the goal collecting segments, then put them in forward order.
+    for (int key = goalKey; parent_[key] >= 0; key = parent_[key]) {
+      const int parent = parent_[key];
+
+      if (parent == startKey) {
+        segment_ = startEdges_[key % MaxNodesPerCluster].path;
+      }
+      else if (key == goalKey) {
+        segment_ = goalEdges_[parent % MaxNodesPerCluster].path;
+      }
+      else if ((key / MaxNodesPerCluster) == (parent / MaxNodesPerCluster)) {
+        const int cluster = key / MaxNodesPerCluster;
+        segment_ = GetEdge(&layer, cluster, parent % MaxNodesPerCluster, key % MaxNodesPerCluster).path;
+      }
+      else {
+        const Location& from = GetNode(layer, parent / MaxNodesPerCluster, parent % MaxNodesPerCluster).pos;
+        const Location& to   = GetNode(layer, key    / MaxNodesPerCluster, key    % MaxNodesPerCluster).pos;
+        segment_.assign(1, GetDirection(to.x - from.x, to.y - from.y));
+      }
+
+      pDirections->insert(pDirections->end(), segment_.rbegin(), segment_.rend());
+    }
+
+    std::reverse(pDirections->begin(), pDirections->end());
+  }
+
+  return found;
+}
+
+// =====================================================================================================================
+inline size_t HierarchicalPathCache::GetMemoryUsage() const {
+  size_t bytes = (g_.capacity() + seen_.capacity() + closed_.capacity()) * sizeof(uint32);
+  bytes += (parent_.capacity() * sizeof(int)) + (open_.capacity() * sizeof(OpenEntry)) + segment_.capacity();
+
+  for (const auto* pEdges : { &startEdges_, &goalEdges_ }) {
+    for (const Edge& edge : *pEdges) {
+      bytes += sizeof(Edge) + edge.path.capacity();
+    }
+  }
+
+  for (const Layer& layer : layers_) {
+    bytes += layer.finder.GetMemoryUsage();
+
+    for (const auto* pBorders : { &layer.vBorders, &layer.hBorders }) {
+      for (const Border& border : *pBorders) {
+        bytes += sizeof(Border) + (border.entrances.capacity() * sizeof(Entrance));
+      }
+    }
+
+    for (const Cluster& cluster : layer.clusters) {
+      bytes += sizeof(Cluster);
+      for (const Edge& edge : cluster.edges) {
+        bytes += sizeof(Edge) + edge.path.capacity();
+      }
+    }
+  }
+
+  return bytes;
+}
+
+} // Tethys
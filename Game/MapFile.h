@@ -0,0 +1,362 @@
+#pragma once
+
+#include "Tethys/Game/MapTypes.h"
+#include "Tethys/Common/FileMapping.h"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+namespace Tethys {
+
+BEGIN_PACKED
+
+/// Header of .map files (and the map section of saved games).
+struct MapFileHeader {
+  uint32 versionTag;     ///< MapFile::VersionTag for maps written by the game.
+  ibool  isSavedGame;
+  uint32 log2TileWidth;
+  uint32 tileHeight;
+  uint32 numTilesets;    ///< Number of tileset slots that follow the tile array (used or not).
+};
+static_assert(sizeof(MapFileHeader) == 20, "Incorrect MapFileHeader size.");
+
+END_PACKED
+
+/// Native, portable .map file reader and writer, so maps can be loaded and validated without running the game.
+///
+/// The file is memory-mapped, and the tile array is decoded in bulk (one copy per column chunk, or a single copy when
+/// the map height is a power of 2) into the same swizzled layout as MapImpl::pTileArray_, so MapImpl's offset math and
+/// TileGridView can be used on it.
+///
+/// File layout:  MapFileHeader, TileData[width * height] (column chunks of 32 tiles), clip rect, tileset sources,
+/// "TILE SET\x1A" tag, TilesetMapping table, TerrainType table, 2 version tags, then tile groups.
+///
+/// @note  Saved games are not supported.
+class MapFile {
+public:
+  static constexpr uint32 VersionTag             = 0x1011;
+  static constexpr char   TilesetTag[10]         = "TILE SET\x1A";
+  static constexpr int    Log2ChunkWidth         = 5;
+  static constexpr int    MaxLog2TileWidth       = 10;
+  static constexpr int    MaxTileHeight          = 1024;
+  static constexpr size_t MaxTilesetFilenameSize = 8;
+
+  /// Map clip rect, as stored in the file (same layout as MapRect).
+  struct ClipRect {
+    int32 x1;
+    int32 y1;
+    int32 x2;
+    int32 y2;
+  };
+
+  /// Tileset slot.  Unused slots have an empty filename.
+  struct TilesetSource {
+    std::string filename;  ///< Tileset file name, without extension (e.g. "well0000").
+    uint32      numTiles;
+  };
+
+  /// Named group of tile mappings (e.g. a prefab shown in the map editor).
+  struct TileGroup {
+    uint32              width;
+    uint32              height;
+    std::vector<uint32> mappingIndices;  ///< Row-major, width * height.
+    std::string         name;
+  };
+
+  /// Loads a map file.  Returns false if it can't be read or is malformed.
+  bool Load(const char* pFilename);
+
+  /// Loads a map file image from memory.
+  bool LoadMemory(const void* pData, size_t size);
+
+  /// Saves to a map file.
+  bool Save(const char* pFilename) const;
+
+  /// Saves a map file image to pOut.
+  void SaveToMemory(std::vector<uint8>* pOut) const;
+
+  /// Returns true if all tiles have valid cell types and tile mappings, and all tile mappings refer to tiles within
+  /// loaded tilesets.
+  bool Validate() const;
+
+  int    Width()         const { return tileWidth_;                       }
+  int    Height()        const { return tileHeight_;                      }
+  int    Log2Width()     const { return log2TileWidth_;                   }
+  int    Log2Height()    const { return log2TileHeight_;                  }
+  size_t NumTiles()      const { return size_t(tileWidth_) * tileHeight_; }
+  bool   IsInitialized() const { return (tiles_.empty() == false);        }
+
+  /// Helper function for indexing into Tiles(), equivalent to MapImpl::GetTileArrayOffset().
+  size_t GetTileArrayOffset(int x, int y) const {
+    x &= (tileWidth_ - 1);
+    return (x & 31) + ((size_t((x >> Log2ChunkWidth) << log2TileHeight_) + y) << Log2ChunkWidth);
+  }
+
+  ///@{ Gets the tile data at the given location for read/write access.
+  TileData&       Tile(int x, int y)       { return tiles_[GetTileArrayOffset(x, y)]; }
+  const TileData& Tile(int x, int y) const { return tiles_[GetTileArrayOffset(x, y)]; }
+  ///@}
+
+  /// Gets the swizzled tile array, laid out like MapImpl::pTileArray_ (column chunks of 2^Log2Height() rows).
+  TileData*       Tiles()       { return tiles_.data(); }
+  const TileData* Tiles() const { return tiles_.data(); }
+
+public:
+  uint32                      versionTag_      = VersionTag;
+  int                         log2TileWidth_   = 0;
+  int                         tileWidth_       = 0;
+  int                         tileHeight_      = 0;
+  int                         log2TileHeight_  = 0;
+  ClipRect                    clipRect_        = { };
+  std::vector<TileData>       tiles_;
+  std::vector<TilesetSource>  tilesets_;
+  std::vector<TilesetMapping> tilesetMappings_;
+  std::vector<TerrainType>    terrainTypes_;
+  uint32                      footerTags_[2]   = { VersionTag, VersionTag };  ///< Version tags after the tables.
+  uint32                      tileGroupsField_ = 0;  ///< Unknown value stored after the tile group count.
+  std::vector<TileGroup>      tileGroups_;
+
+private:
+  /// Bounds-checked reader over the file image.
+  class Reader {
+  public:
+    Reader(const void* pData, size_t size)
+      : p_(static_cast<const uint8*>(pData)), pEnd_(static_cast<const uint8*>(pData) + size) { }
+
+    bool Read(void* pDst, size_t size) {
+      ok_ = ok_ && (size <= size_t(pEnd_ - p_));
+      if (ok_) {
+        memcpy(pDst, p_, size);
+        p_ += size;
+      }
+      return ok_;
+    }
+    template <typename T>  bool Read(T* pValue) { return Read(pValue, sizeof(T)); }
+
+    /// Reads a uint32 count followed by count elements.
+    template <typename T>  bool ReadArray(std::vector<T>* pOut, size_t maxCount = SIZE_MAX) {
+      uint32 count = 0;
+      ok_ = Read(&count) && (count <= maxCount) && ((size_t(count) * sizeof(T)) <= size_t(pEnd_ - p_));
+      if (ok_) {
+        pOut->resize(count);
+        Read(pOut->data(), count * sizeof(T));
+      }
+      return ok_;
+    }
+
+    /// Reads a uint32 length followed by that many characters.
+    bool ReadString(std::string* pOut, size_t maxLength = SIZE_MAX) {
+      uint32 length = 0;
+      ok_ = Read(&length) && (length <= maxLength) && (length <= size_t(pEnd_ - p_));
+      if (ok_) {
+        pOut->assign(reinterpret_cast<const char*>(p_), length);
+        p_ += length;
+      }
+      return ok_;
+    }
+
+    /// Gets the number of bytes left to read.
+    size_t Remaining() const { return size_t(pEnd_ - p_); }
+
+    const uint8* Get(size_t size) {
+      ok_ = ok_ && (size <= size_t(pEnd_ - p_));
+      const uint8*const p = ok_ ? p_ : nullptr;
+      p_ += ok_ ? size : 0;
+      return p;
+    }
+
+  private:
+    const uint8* p_;
+    const uint8* pEnd_;
+    bool         ok_ = true;
+  };
+
+  /// Appends a value or array to a byte vector.
+  static void Append(std::vector<uint8>* pOut, const void* pData, size_t size)
+    { pOut->insert(pOut->end(), static_cast<const uint8*>(pData), static_cast<const uint8*>(pData) + size); }
+  template <typename T>
+  static void Append(std::vector<uint8>* pOut, const T& value) { Append(pOut, &value, sizeof(T)); }
+};
+
+// =====================================================================================================================
+inline bool MapFile::Load(
+  const char* pFilename)
+{
+  FileMapping file;
+  return file.Open(pFilename) && LoadMemory(file.Data(), file.Size());
+}
+
+// =====================================================================================================================
+inline bool MapFile::LoadMemory(
+  const void*  pData,
+  size_t       size)
+{
+  Reader        reader(pData, size);
+  MapFileHeader header;
+
+  bool result = reader.Read(&header)                                                                  &&
+                (header.isSavedGame == 0)                                                             &&
+                (header.log2TileWidth >= Log2ChunkWidth) && (header.log2TileWidth <= MaxLog2TileWidth) &&
+                (header.tileHeight > 0) && (header.tileHeight <= MaxTileHeight);
+
+  if (result) {
+    versionTag_    = header.versionTag;
+    log2TileWidth_ = int(header.log2TileWidth);
+    tileWidth_     = 1 << log2TileWidth_;
+    tileHeight_    = int(header.tileHeight);
+    for (log2TileHeight_ = 0; (1 << log2TileHeight_) < tileHeight_; ++log2TileHeight_);
+
+    // The file stores column chunks of tileHeight rows, while the in-memory array pads each chunk to a power of 2 rows.
+    const size_t      fileChunkSize = size_t(tileHeight_) << Log2ChunkWidth;
+    const size_t      numChunks     = size_t(tileWidth_) >> Log2ChunkWidth;
+    const uint8*const pFileTiles    = reader.Get(fileChunkSize * numChunks * sizeof(TileData));
+
+    result = (pFileTiles != nullptr);
+    if (result) {
+      const size_t chunkStride = size_t(1) << (log2TileHeight_ + Log2ChunkWidth);
+      tiles_.assign(numChunks * chunkStride, TileData{ });
+      if (chunkStride == fileChunkSize) {
+        memcpy(tiles_.data(), pFileTiles, numChunks * fileChunkSize * sizeof(TileData));
+      }
+      else {
+        for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+          memcpy(&tiles_[chunk * chunkStride],
+                 pFileTiles + (chunk * fileChunkSize * sizeof(TileData)),
+                 fileChunkSize * sizeof(TileData));
+        }
+      }
+    }
+  }
+
+  result = result && reader.Read(&clipRect_);
+
+  // Each tileset entry starts with a uint32 filename length, so the count can be checked before allocating.
+  result = result && (header.numTilesets <= (reader.Remaining() / sizeof(uint32)));
+  if (result) {
+    tilesets_.resize(header.numTilesets);
+    for (size_t i = 0; result && (i < tilesets_.size()); ++i) {
+      TilesetSource& tileset = tilesets_[i];
+      tileset.numTiles = 0;
+      result = reader.ReadString(&tileset.filename, MaxTilesetFilenameSize) &&
+               (tileset.filename.empty() || reader.Read(&tileset.numTiles));
+    }
+  }
+
+  char tag[sizeof(TilesetTag)];
+  result = result && reader.Read(&tag) && (memcmp(tag, TilesetTag, sizeof(tag)) == 0) &&
+           reader.ReadArray(&tilesetMappings_) && reader.ReadArray(&terrainTypes_) && reader.Read(&footerTags_);
+
+  uint32 numTileGroups = 0;
+  result = result && reader.Read(&numTileGroups) && reader.Read(&tileGroupsField_);
+  if (result) {
+    tileGroups_.clear();
+    for (uint32 i = 0; result && (i < numTileGroups); ++i) {
+      TileGroup group;
+      result = reader.Read(&group.width) && reader.Read(&group.height) &&
+               ((uint64(group.width) * group.height) <= (size / sizeof(uint32)));
+      if (result) {
+        group.mappingIndices.resize(size_t(group.width) * group.height);
+        result = reader.Read(group.mappingIndices.data(), group.mappingIndices.size() * sizeof(uint32)) &&
+                 reader.ReadString(&group.name);
+        tileGroups_.emplace_back(std::move(group));
+      }
+    }
+  }
+
+  if (result == false) {
+    *this = MapFile();
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline void MapFile::SaveToMemory(
+  std::vector<uint8>* pOut) const
+{
+  pOut->clear();
+
+  const MapFileHeader header =
+    { versionTag_, 0, uint32(log2TileWidth_), uint32(tileHeight_), uint32(tilesets_.size()) };
+  Append(pOut, header);
+
+  const size_t fileChunkSize = size_t(tileHeight_) << Log2ChunkWidth;
+  const size_t numChunks     = size_t(tileWidth_) >> Log2ChunkWidth;
+  const size_t chunkStride   = size_t(1) << (log2TileHeight_ + Log2ChunkWidth);
+  pOut->reserve(pOut->size() + (numChunks * fileChunkSize * sizeof(TileData)));
+  for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+    Append(pOut, &tiles_[chunk * chunkStride], fileChunkSize * sizeof(TileData));
+  }
+
+  Append(pOut, clipRect_);
+
+  for (const TilesetSource& tileset : tilesets_) {
+    Append(pOut, uint32(tileset.filename.size()));
+    Append(pOut, tileset.filename.data(), tileset.filename.size());
+    if (tileset.filename.empty() == false) {
+      Append(pOut, tileset.numTiles);
+    }
+  }
+
+  Append(pOut, TilesetTag);
+  Append(pOut, uint32(tilesetMappings_.size()));
+  Append(pOut, tilesetMappings_.data(), tilesetMappings_.size() * sizeof(TilesetMapping));
+  Append(pOut, uint32(terrainTypes_.size()));
+  Append(pOut, terrainTypes_.data(),    terrainTypes_.size()    * sizeof(TerrainType));
+  Append(pOut, footerTags_);
+
+  Append(pOut, uint32(tileGroups_.size()));
+  Append(pOut, tileGroupsField_);
+  for (const TileGroup& group : tileGroups_) {
+    Append(pOut, group.width);
+    Append(pOut, group.height);
+    Append(pOut, group.mappingIndices.data(), group.mappingIndices.size() * sizeof(uint32));
+    Append(pOut, uint32(group.name.size()));
+    Append(pOut, group.name.data(), group.name.size());
+  }
+}
+
+// =====================================================================================================================
+inline bool MapFile::Save(
+  const char* pFilename
+  ) const
+{
+  std::vector<uint8> image;
+  SaveToMemory(&image);
+
+  FILE*const pFile  = fopen(pFilename, "wb");
+  bool       result = (pFile != nullptr) && (fwrite(image.data(), 1, image.size(), pFile) == image.size());
+  if (pFile != nullptr) {
+    result = (fclose(pFile) == 0) && result;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool MapFile::Validate() const {
+  bool result = IsInitialized();
+
+  for (size_t i = 0; result && (i < tilesetMappings_.size()); ++i) {
+    const TilesetMapping& mapping = tilesetMappings_[i];
+    result = (mapping.tilesetIndex < tilesets_.size())                   &&
+             (tilesets_[mapping.tilesetIndex].filename.empty() == false) &&
+             ((uint32(mapping.tileIndex) + mapping.numAnimation) < tilesets_[mapping.tilesetIndex].numTiles);
+  }
+
+  // Check each column chunk's rows in memory order, skipping the padding rows.
+  const size_t rowsSize    = size_t(tileHeight_) << Log2ChunkWidth;
+  const size_t chunkStride = size_t(1) << (log2TileHeight_ + Log2ChunkWidth);
+  for (size_t chunk = 0; result && (chunk < (size_t(tileWidth_) >> Log2ChunkWidth)); ++chunk) {
+    const TileData*const pChunk = &tiles_[chunk * chunkStride];
+    for (size_t i = 0; result && (i < rowsSize); ++i) {
+      result = (pChunk[i].cellType < uint32(CellType::Count)) && (pChunk[i].tileIndex < tilesetMappings_.size());
+    }
+  }
+
+  return result;
+}
+
+} // Tethys
@@ -0,0 +1,385 @@
+
+#pragma once
+
+#include "Tethys/Game/MapObject.h"
+#include "Tethys/Game/MapImpl.h"
+#include "Tethys/API/Location.h"
+#include <algorithm>
+#include <vector>
+
+namespace Tethys {
+
+/// Native bucketed spatial index over the map object array, used to accelerate area queries without walking the whole
+/// pixelY-sorted map object list (@see InRangeEnumerator, InRectEnumerator).
+///
+/// Buckets are square cells of (1 << Log2CellSize) tiles, laid out in 32-tile-wide column chunks the same way that
+/// MapImpl::GetTileArrayOffset() lays out tiles.  Each bucket is an intrusive doubly-linked list keyed by unit index, and
+/// positions are cached per unit, so queries cost O(k) in the number of candidate objects and never touch MapObjects.
+///
+/// The index only reads plain MapObject fields (index_, pixelX_, pixelY_, pNext_, flags_), so it can be populated from a
+/// synthetic AnyMapObj array without the game running.
+///
+/// @note  The game does not notify us when map objects are created, moved or removed.  Either call Insert(), Update() and
+///        Remove() from your own hooks, or call Sync() once per game cycle (a single linear pass over the array).
+/// @note  Maps that wrap around horizontally must have a power-of-2 tile width, as is the case for all real maps.
+class MapObjectIndex {
+public:
+  static constexpr int Log2CellSize   = 3;                  ///< Bucket cells are 8x8 tiles.
+  static constexpr int Log2ChunkCells = 5 - Log2CellSize;   ///< Number of cells (log2) per 32-tile column chunk.
+  static constexpr int ChunkCells     = 1 << Log2ChunkCells;
+
+  /// Resumable query state, used by enumerator iterators to pull one result at a time.
+  struct Query {
+    int    cellX;        ///< Current cell X (may exceed the grid width if the query wraps around a world map).
+    int    cellY;        ///< Current cell Y.
+    int    cellX1;       ///< First cell X of the query.
+    int    cellX2;       ///< Last cell X of the query (unwrapped).
+    int    cellY1;       ///< First cell Y of the query.
+    int    cellY2;       ///< Last cell Y of the query.
+    int    node;         ///< Next unit index to test in the current cell, or -1 to advance to the next cell.
+    bool   isRange;      ///< Range (circle) query if true, rect query if false.
+    int    x;            ///< [Range] Center pixel X.  [Rect] Left tile X.
+    int    y;            ///< [Range] Center pixel Y.  [Rect] Top tile Y.
+    int    width;        ///< [Rect] Tile width - 1.
+    int    height;       ///< [Rect] Tile height - 1.
+    uint64 sqDistance;   ///< [Range] Squared max pixel distance.
+  };
+
+  MapObjectIndex() = default;
+  MapObjectIndex(int tileWidth, int tileHeight, size_t maxNumUnits, bool wrapX = false)
+    { Init(tileWidth, tileHeight, maxNumUnits, wrapX); }
+  explicit MapObjectIndex(const MapImpl& map) { Init(map); }
+
+  /// Allocates buckets for a map of the given (padded) dimensions.  This clears the index.
+  void Init(int tileWidth, int tileHeight, size_t maxNumUnits, bool wrapX = false);
+  /// Allocates buckets for the given map.  World maps (no padding) wrap around horizontally.
+  void Init(const MapImpl& map)
+    { Init(map.tileWidth_, map.tileHeight_, map.MaxNumUnits(), (map.paddingOffsetTileX_ == 0)); }
+
+  /// Removes all map objects from the index.
+  void Clear();
+
+  ///@{ Adds, moves or removes a single map object.  Update() inserts the map object if it is not already indexed.
+  void Insert(const MapObject& mo) { Update(mo); }
+  void Update(const MapObject& mo) { Place(mo.index_, mo.pixelX_, mo.pixelY_); }
+  void Remove(int index);
+  ///@}
+
+  ///@{ Brings the index up to date with a map object array in one linear pass:  dead objects are removed, new objects are
+  ///   inserted, and objects whose position changed are moved.  Index 0 (the list head sentinel) is always skipped.
+  void Sync(const AnyMapObj* pMapObjArray, size_t count);
+  void Sync(const MapImpl& map) { Sync(map.pMapObjArray_, map.MaxNumUnits()); }
+  ///@}
+
+  ///@{ Clears and repopulates the index from a map object array.
+  void Rebuild(const AnyMapObj* pMapObjArray, size_t count) { Clear();  Sync(pMapObjArray, count); }
+  void Rebuild(const MapImpl& map)                          { Clear();  Sync(map);                 }
+  ///@}
+
+  bool   Contains(int index) const { return InBounds(index) && (cell_[index] >= 0); }  ///< Is unit index indexed?
+  size_t Size()              const { return size_;                                  }  ///< Number of indexed objects.
+  bool   IsInitialized()     const { return (cellsWide_ != 0);                      }  ///< Has Init() been called?
+
+  ///@{ Begins a query.  Call GetNext() repeatedly to get results.
+  /// Rect queries return objects whose tile is within the (inclusive, possibly wrapped) tile rect.
+  void BeginRect(Query* pQuery, const MapRect& rect) const;
+  /// Range queries return objects whose pixel position is within maxPixelDistance of the given pixel.
+  void BeginRange(Query* pQuery, int pixelX, int pixelY, int maxPixelDistance) const;
+  /// Range queries return objects whose pixel position is within maxTileDistance tiles of the center of the given tile.
+  void BeginRange(Query* pQuery, const Location& center, int maxTileDistance) const
+    { BeginRange(pQuery, center.GetPixelX(), center.GetPixelY(), maxTileDistance * 32); }
+  ///@}
+
+  /// Gets the unit index of the next query result, or returns -1 when there are no more results.
+  /// @note  Results are ordered by bucket, not by pixelY as with the game's map object list.
+  int GetNext(Query* pQuery) const;
+
+  /// Calls fn(int unitIndex) for each map object in the given tile rect.
+  template <typename Fn>  void ForEachInRect(const MapRect& rect, Fn&& fn) const
+    { Query q;  BeginRect(&q, rect);  for (int i; (i = GetNext(&q)) >= 0; fn(i)); }
+
+  /// Calls fn(int unitIndex) for each map object within maxTileDistance tiles of the given tile.
+  template <typename Fn>  void ForEachInRange(const Location& center, int maxTileDistance, Fn&& fn) const
+    { Query q;  BeginRange(&q, center, maxTileDistance);  for (int i; (i = GetNext(&q)) >= 0; fn(i)); }
+
+  /// Gets the index used by InRangeEnumerator and InRectEnumerator by default, or nullptr to use the game's functions.
+  static const MapObjectIndex* GetActive() { return pActive_; }
+  /// Sets the index used by InRangeEnumerator and InRectEnumerator by default.  Pass nullptr to restore game behavior.
+  /// The caller is responsible for keeping the index in sync with the map (@see Sync()).
+  static void SetActive(const MapObjectIndex* pIndex) { pActive_ = pIndex; }
+
+private:
+  bool InBounds(int index) const { return (index >= 0) && (size_t(index) < cell_.size()); }
+
+  /// Gets the bucket offset of the given cell, analogous to MapImpl::GetTileArrayOffset().
+  int GetCellOffset(int cellX, int cellY) const
+    { return ((cellX & (ChunkCells - 1)) + ((((cellX >> Log2ChunkCells) * cellsHigh_) + cellY) << Log2ChunkCells)); }
+
+  ///@{ Gets the cell coordinate containing the given pixel coordinate.  X wraps around on world maps, otherwise clamps.
+  int CellY(int pixelY) const { return (pixelY < 0) ? 0 : (std::min)((pixelY >> (Log2CellSize + 5)), cellsHigh_ - 1); }
+  int CellX(int pixelX) const {
+    return wrapX_ ? ((pixelX >> (Log2CellSize + 5)) & (cellsWide_ - 1))
+                  : ((pixelX < 0) ? 0 : (std::min)((pixelX >> (Log2CellSize + 5)), cellsWide_ - 1));
+  }
+  ///@}
+
+  void Place(int index, int pixelX, int pixelY);
+  void Unlink(int index);
+
+  static inline const MapObjectIndex* pActive_ = nullptr;
+
+  int  tileWidth_  = 0;
+  int  tileHeight_ = 0;
+  int  cellsWide_  = 0;
+  int  cellsHigh_  = 0;
+  bool wrapX_      = false;
+
+  size_t size_ = 0;
+
+  std::vector<int> head_;    ///< First unit index in each bucket, or -1.
+  std::vector<int> next_;    ///< Next unit index in bucket, or -1.
+  std::vector<int> prev_;    ///< Previous unit index in bucket, or -1.
+  std::vector<int> cell_;    ///< Bucket offset the unit is in, or -1 if the unit is not indexed.
+  std::vector<int> pixelX_;  ///< Cached unit pixel X.
+  std::vector<int> pixelY_;  ///< Cached unit pixel Y.
+};
+
+// =====================================================================================================================
+inline void MapObjectIndex::Init(
+  int     tileWidth,
+  int     tileHeight,
+  size_t  maxNumUnits,
+  bool    wrapX)
+{
+  constexpr int CellSize = 1 << Log2CellSize;
+
+  tileWidth_  = tileWidth;
+  tileHeight_ = tileHeight;
+  wrapX_      = wrapX;
+  // Round the width up to whole 32-tile column chunks so cell offsets mirror MapImpl::GetTileArrayOffset().
+  cellsWide_  = ((tileWidth + 31) / 32) * ChunkCells;
+  cellsHigh_  = (tileHeight + CellSize - 1) / CellSize;
+
+  head_.assign(size_t(cellsWide_) * cellsHigh_, -1);
+  next_.assign(maxNumUnits, -1);
+  prev_.assign(maxNumUnits, -1);
+  cell_.assign(maxNumUnits, -1);
+  pixelX_.assign(maxNumUnits, 0);
+  pixelY_.assign(maxNumUnits, 0);
+  size_ = 0;
+}
+
+// =====================================================================================================================
+inline void MapObjectIndex::Clear() {
+  std::fill(head_.begin(), head_.end(), -1);
+  std::fill(cell_.begin(), cell_.end(), -1);
+  size_ = 0;
+}
+
+// =====================================================================================================================
+inline void MapObjectIndex::Unlink(
+  int index)
+{
+  const int prev = prev_[index];
+  const int next = next_[index];
+
+  if (prev >= 0) {
+    next_[prev] = next;
+  }
+  else {
+    head_[cell_[index]] = next;
+  }
+
+  if (next >= 0) {
+    prev_[next] = prev;
+  }
+
+  cell_[index] = -1;
+}
+
+// =====================================================================================================================
+inline void MapObjectIndex::Place(
+  int  index,
+  int  pixelX,
+  int  pixelY)
+{
+  if (InBounds(index) && IsInitialized()) {
+    const int cell = GetCellOffset(CellX(pixelX), CellY(pixelY));
+    pixelX_[index] = pixelX;
+    pixelY_[index] = pixelY;
+
+    if (cell_[index] != cell) {
+      if (cell_[index] >= 0) {
+        Unlink(index);
+      }
+      else {
+        ++size_;
+      }
+
+      prev_[index] = -1;
+      next_[index] = head_[cell];
+      if (next_[index] >= 0) {
+        prev_[next_[index]] = index;
+      }
+      head_[cell]  = index;
+      cell_[index] = cell;
+    }
+  }
+}
+
+// =====================================================================================================================
+inline void MapObjectIndex::Remove(
+  int index)
+{
+  if (Contains(index)) {
+    Unlink(index);
+    --size_;
+  }
+}
+
+// =====================================================================================================================
+inline void MapObjectIndex::Sync(
+  const AnyMapObj*  pMapObjArray,
+  size_t            count)
+{
+  count = (std::min)(count, cell_.size());
+
+  for (size_t i = 1; i < count; ++i) {
+    const MapObject& mo    = pMapObjArray[i].object_;
+    const int        index = int(i);
+
+    if (mo.IsLive()) {
+      if ((cell_[i] < 0) || (pixelX_[i] != mo.pixelX_) || (pixelY_[i] != mo.pixelY_)) {
+        Place(index, mo.pixelX_, mo.pixelY_);
+      }
+    }
+    else {
+      Remove(index);
+    }
+  }
+}
+
+// =====================================================================================================================
+inline void MapObjectIndex::BeginRect(
+  Query*          pQuery,
+  const MapRect&  rect
+  ) const
+{
+  Query& q = *pQuery;
+  q.isRange = false;
+  q.node    = -1;
+
+  // Rects with x2 < x1 have wrapped around the map;  unwrap x2 so the cell range is contiguous.
+  const int  x2 = (rect.x2 < rect.x1) ? (rect.x2 + tileWidth_) : rect.x2;
+  const bool ok = IsInitialized() && (x2 >= rect.x1) && (rect.y2 >= rect.y1);
+
+  q.x      = rect.x1;
+  q.y      = rect.y1;
+  q.width  = x2 - rect.x1;
+  q.height = rect.y2 - rect.y1;
+
+  if (ok == false) {
+    q.cellX1 = q.cellY1 =  0;
+    q.cellX2 = q.cellY2 = -1;
+  }
+  else {
+    q.cellY1 = CellY(rect.y1 * 32);
+    q.cellY2 = CellY(rect.y2 * 32);
+    q.cellX1 = CellX(rect.x1 * 32);
+    q.cellX2 = wrapX_ ? (q.cellX1 + (std::min)((x2 >> Log2CellSize) - (rect.x1 >> Log2CellSize), cellsWide_ - 1))
+                      : CellX(x2 * 32);
+  }
+
+  q.cellX = q.cellX1;
+  q.cellY = q.cellY1 - 1;
+}
+
+// =====================================================================================================================
+inline void MapObjectIndex::BeginRange(
+  Query*  pQuery,
+  int     pixelX,
+  int     pixelY,
+  int     maxPixelDistance
+  ) const
+{
+  Query& q = *pQuery;
+  q.isRange    = true;
+  q.node       = -1;
+  q.x          = pixelX;
+  q.y          = pixelY;
+  q.width      = 0;
+  q.height     = 0;
+  q.sqDistance = uint64(int64(maxPixelDistance) * maxPixelDistance);
+
+  const bool ok = IsInitialized() && (maxPixelDistance >= 0);
+
+  if (ok == false) {
+    q.cellX1 = q.cellY1 =  0;
+    q.cellX2 = q.cellY2 = -1;
+  }
+  else {
+    const int first = (pixelX - maxPixelDistance) >> (Log2CellSize + 5);
+    const int last  = (pixelX + maxPixelDistance) >> (Log2CellSize + 5);
+    q.cellY1 = CellY(pixelY - maxPixelDistance);
+    q.cellY2 = CellY(pixelY + maxPixelDistance);
+    q.cellX1 = CellX(pixelX - maxPixelDistance);
+    q.cellX2 = wrapX_ ? (q.cellX1 + (std::min)(last - first, cellsWide_ - 1)) : CellX(pixelX + maxPixelDistance);
+  }
+
+  q.cellX = q.cellX1;
+  q.cellY = q.cellY1 - 1;
+}
+
+// =====================================================================================================================
+inline int MapObjectIndex::GetNext(
+  Query* pQuery
+  ) const
+{
+  Query&    q      = *pQuery;
+  const int wrapW  = tileWidth_ * 32;
+  int       result = -1;
+
+  while (result < 0) {
+    // Advance to the next non-empty cell if we've exhausted the current one.
+    while (q.node < 0) {
+      if (++q.cellY > q.cellY2) {
+        q.cellY = q.cellY1;
+        if (++q.cellX > q.cellX2) {
+          q.cellX = q.cellX2;  // Stay exhausted on subsequent calls.
+          q.cellY = q.cellY2;
+          return -1;
+        }
+      }
+      q.node = head_[GetCellOffset(wrapX_ ? (q.cellX & (cellsWide_ - 1)) : q.cellX, q.cellY)];
+    }
+
+    const int index = q.node;
+    q.node = next_[index];
+
+    if (q.isRange) {
+      int       dx = pixelX_[index] - q.x;
+      const int dy = pixelY_[index] - q.y;
+      if (wrapX_) {
+        dx = ((dx % wrapW) + wrapW) % wrapW;
+        dx = (std::min)(dx, wrapW - dx);
+      }
+      if ((uint64(int64(dx) * dx) + uint64(int64(dy) * dy)) <= q.sqDistance) {
+        result = index;
+      }
+    }
+    else {
+      int       dx = (pixelX_[index] / 32) - q.x;
+      const int dy = (pixelY_[index] / 32) - q.y;
+      if (wrapX_) {
+        dx = ((dx % tileWidth_) + tileWidth_) % tileWidth_;
+      }
+      if ((dx >= 0) && (dx <= q.width) && (dy >= 0) && (dy <= q.height)) {
+        result = index;
+      }
+    }
+  }
+
+  return result;
+}
+
+} // Tethys
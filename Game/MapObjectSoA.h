@@ -0,0 +1,300 @@
+
+#pragma once
+
+#include "Tethys/Game/MapObject.h"
+#include "Tethys/Game/MapObjectType.h"
+#include "Tethys/Game/MapImpl.h"
+#include "Tethys/Game/PlayerImpl.h"
+#include <initializer_list>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+namespace Tethys {
+
+/// Set of MapIDs that can be tested in constant time, used by MapObjectSoA filter kernels.
+class MapIDSet {
+public:
+  constexpr MapIDSet() : words_{ } { }
+  constexpr MapIDSet(std::initializer_list<MapID> types) : words_{ } { for (MapID type : types) { Set(type); } }
+
+  /// Returns a set containing every MapID.
+  static constexpr MapIDSet All() { MapIDSet set;  for (auto& word : set.words_) { word = ~0u; }  return set; }
+
+  constexpr void Set(MapID type, bool on = true) {
+    uint32&      word = words_[(uint32(type) >> 5) & 3];
+    const uint32 bit  = (1u << (uint32(type) & 31));
+    word = on ? (word | bit) : (word & ~bit);
+  }
+  constexpr bool Test(uint32 type) const { return ((words_[(type >> 5) & 3] >> (type & 31)) & 1) != 0; }
+
+private:
+  uint32 words_[4];  ///< 128 bits, enough for all MapIDs up to MaxObject.
+};
+
+/// Struct-of-arrays snapshot of the map object array, used for fast linear scans over all map objects.
+///
+/// Snapshot() copies the fields most scans need out of the 120-byte MapObject records into parallel arrays in one linear
+/// pass, so subsequent filters touch only the bytes they test rather than a whole cache line per unit.  Array slots are
+/// unit indices, i.e. slot i describes pMapObjArray_[i];  dead and unused slots have MoFlagDead set in flags_.
+///
+/// Filter kernels are written as branchless loops over the arrays with compaction of the output index list, which
+/// compilers readily auto-vectorize.  A selection is a list of unit indices;  Select() builds a selection from all slots
+/// in one fused pass, and the Filter*() functions refine an existing selection in place.
+///
+/// Example:  "all live enemy combat units below 50% HP within 20 tiles of a location"
+///   MapObjectSoA soa;
+///   soa.Snapshot(*MapImpl::GetInstance());
+///   MapObjectSoA::Criteria criteria;
+///   criteria.flagsAll  = MoFlagOffensive;
+///   criteria.ownerMask = GameImpl::GetInstance()->GetPlayer(me)->GetHostileTo();
+///   criteria.SetRange(where.GetPixelX(), where.GetPixelY(), 20 * 32);
+///   MapObjectSoA::IndexList hits;
+///   soa.Select(criteria, &hits);
+///   soa.FilterHpBelow(&hits, 50);
+class MapObjectSoA {
+public:
+  using IndexList = std::vector<uint16>;
+
+  /// Per-object type info returned by the callback passed to the generic Snapshot() overload.
+  struct TypeInfo {
+    MapID type;   ///< Map object type.
+    int   maxHp;  ///< Max hitpoints of the object's type for its creator.
+  };
+
+  /// Criteria for the fused Select() kernel.  Defaults select all live map objects.
+  struct Criteria {
+    /// Sets the range test to select objects within maxPixelDistance of the given pixel (not wrapped around world maps).
+    void SetRange(int pixelX, int pixelY, int maxPixelDistance)
+      { centerX = pixelX;  centerY = pixelY;  sqDistance = SqDistance(maxPixelDistance); }
+
+    /// Gets the squared range for maxPixelDistance.  Distances are clamped to [0, 65535], which already covers every
+    /// dx, dy < 0x8000 the range tests accept, so the square can't overflow or collide with the UINT32_MAX sentinel.
+    static uint32 SqDistance(int maxPixelDistance)
+      { const uint32 d = uint32((std::min)((std::max)(maxPixelDistance, 0), 0xFFFF));  return d * d; }
+
+    uint32   flagsAll   = 0;                 ///< MapObjectFlags that must all be set.
+    uint32   flagsNone  = MoFlagDead;        ///< MapObjectFlags that must all be clear.
+    uint32   ownerMask  = ~0u;               ///< Bitmask of owner player numbers to select.
+    MapIDSet types      = MapIDSet::All();   ///< Set of map object types to select.
+    int      centerX    = 0;                 ///< Range test center pixel X.
+    int      centerY    = 0;                 ///< Range test center pixel Y.
+    uint32   sqDistance = UINT32_MAX;        ///< Range test squared max pixel distance;  UINT32_MAX = no range test.
+  };
+
+  ///@{ Fills the arrays from a map object array in one linear pass.  Index 0 (the list head sentinel) is marked dead.
+  /// The generic overload gets type info via typeInfo(const MapObject&) -> TypeInfo, so it can be used on synthetic
+  /// arrays without the game;  the other overloads query each live object's MapObjectType.
+  template <typename Fn>  void Snapshot(const AnyMapObj* pMapObjArray, size_t count, Fn&& typeInfo);
+  void Snapshot(const AnyMapObj* pMapObjArray, size_t count) {
+    Snapshot(pMapObjArray, count, [](const MapObject& mo) {
+      const MapObjectType*const pType = mo.GetType();
+      return TypeInfo{ pType->type_, pType->playerStats_[mo.creatorNum_ % MaxPlayers].hp };
+    });
+  }
+  void Snapshot(const MapImpl& map) { Snapshot(map.pMapObjArray_, map.MaxNumUnits()); }
+  ///@}
+
+  size_t Size() const { return flags_.size(); }  ///< Gets the number of slots in the snapshot.
+
+  ///@{ Per-slot accessors.
+  int        PixelX(size_t i)  const { return pixelX_[i];                      }
+  int        PixelY(size_t i)  const { return pixelY_[i];                      }
+  int        Owner(size_t i)   const { return owner_[i];                       }
+  int        Creator(size_t i) const { return creator_[i];                     }
+  MapID      TypeID(size_t i)  const { return MapID(type_[i]);                 }
+  int        Damage(size_t i)  const { return damage_[i];                      }
+  int        MaxHp(size_t i)   const { return maxHp_[i];                       }
+  uint32     Flags(size_t i)   const { return flags_[i];                       }
+  ActionType Action(size_t i)  const { return ActionType(action_[i]);          }
+  bool       IsLive(size_t i)  const { return (flags_[i] & MoFlagDead) == 0;   }
+  ///@}
+
+  ///@{ Raw array access, e.g. for custom kernels.
+  const int32*  PixelXData() const { return pixelX_.data(); }
+  const int32*  PixelYData() const { return pixelY_.data(); }
+  const uint8*  OwnerData()  const { return owner_.data();  }
+  const uint8*  TypeData()   const { return type_.data();   }
+  const int16*  DamageData() const { return damage_.data(); }
+  const uint32* FlagsData()  const { return flags_.data();  }
+  const uint8*  ActionData() const { return action_.data(); }
+  ///@}
+
+  /// Replaces *pOut with the unit indices of all slots matching the criteria, in one fused pass.  Returns the count.
+  size_t Select(const Criteria& criteria, IndexList* pOut) const;
+
+  ///@{ Refines a selection in place, keeping only matching entries (order is preserved).  Returns the new count.
+  size_t FilterFlags(IndexList*   pSelection, uint32 flagsAll, uint32 flagsNone = 0)        const;
+  size_t FilterOwners(IndexList*  pSelection, uint32 ownerMask)                              const;
+  size_t FilterTypes(IndexList*   pSelection, const MapIDSet& types)                         const;
+  size_t FilterActions(IndexList* pSelection, ActionType action)                             const;
+  size_t FilterRange(IndexList*   pSelection, int pixelX, int pixelY, int maxPixelDistance)  const;
+  /// Keeps objects whose remaining HP is below the given percentage of their max HP.
+  size_t FilterHpBelow(IndexList* pSelection, int percent)                                   const;
+  ///@}
+
+  /// Refines a selection in place with a custom predicate pred(size_t slot) -> bool.  Returns the new count.
+  template <typename Pred>  size_t Filter(IndexList* pSelection, Pred&& pred) const {
+    size_t n = 0;
+    for (const uint16 i : *pSelection) {
+      (*pSelection)[n] = i;
+      n += pred(size_t(i)) ? 1 : 0;
+    }
+    pSelection->resize(n);
+    return n;
+  }
+
+private:
+  std::vector<int32>  pixelX_;
+  std::vector<int32>  pixelY_;
+  std::vector<uint8>  owner_;
+  std::vector<uint8>  creator_;
+  std::vector<uint8>  type_;
+  std::vector<uint8>  action_;
+  std::vector<int16>  damage_;
+  std::vector<int32>  maxHp_;
+  std::vector<uint32> flags_;
+};
+
+// =====================================================================================================================
+template <typename Fn>
+void MapObjectSoA::Snapshot(
+  const AnyMapObj*  pMapObjArray,
+  size_t            count,
+  Fn&&              typeInfo)
+{
+  count = (std::min)(count, size_t(UINT16_MAX) + 1);
+
+  pixelX_.resize(count);
+  pixelY_.resize(count);
+  owner_.resize(count);
+  creator_.resize(count);
+  type_.resize(count);
+  action_.resize(count);
+  damage_.resize(count);
+  maxHp_.resize(count);
+  flags_.resize(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    const MapObject& mo   = pMapObjArray[i].object_;
+    const bool       live = (i != 0) && mo.IsLive();
+
+    pixelX_[i]  = mo.pixelX_;
+    pixelY_[i]  = mo.pixelY_;
+    owner_[i]   = mo.ownerNum_;
+    creator_[i] = mo.creatorNum_;
+    action_[i]  = uint8(mo.action_);
+    damage_[i]  = mo.damage_;
+    flags_[i]   = live ? mo.flags_ : (mo.flags_ | MoFlagDead);
+
+    if (live) {
+      const TypeInfo info = typeInfo(mo);
+      type_[i]  = uint8(info.type);
+      maxHp_[i] = info.maxHp;
+    }
+    else {
+      type_[i]  = uint8(MapID::None);
+      maxHp_[i] = 0;
+    }
+  }
+}
+
+// =====================================================================================================================
+inline size_t MapObjectSoA::Select(
+  const Criteria&  criteria,
+  IndexList*       pOut
+  ) const
+{
+  const size_t count = Size();
+  pOut->resize(count);
+
+  uint16*const  pDst    = pOut->data();
+  const uint32  all     = criteria.flagsAll;
+  const uint32  none    = criteria.flagsNone;
+  const uint32  owners  = criteria.ownerMask;
+  const bool    inRange = (criteria.sqDistance != UINT32_MAX);
+  size_t        n       = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    const uint32 f  = flags_[i];
+    const uint32 dx = uint32(std::abs(pixelX_[i] - criteria.centerX));
+    const uint32 dy = uint32(std::abs(pixelY_[i] - criteria.centerY));
+
+    const uint32 near = (dx < 0x8000) & (dy < 0x8000) & (((dx * dx) + (dy * dy)) <= criteria.sqDistance);
+
+    uint32 keep = ((f & all) == all) & ((f & none) == 0) & ((owners >> (owner_[i] & 31)) & 1);
+    keep &= uint32(criteria.types.Test(type_[i])) & (uint32(inRange == false) | near);
+
+    pDst[n] = uint16(i);
+    n      += keep;
+  }
+
+  pOut->resize(n);
+  return n;
+}
+
+// =====================================================================================================================
+inline size_t MapObjectSoA::FilterFlags(
+  IndexList*  pSelection,
+  uint32      flagsAll,
+  uint32      flagsNone
+  ) const
+{
+  return Filter(pSelection, [this, flagsAll, flagsNone](size_t i)
+    { return ((flags_[i] & flagsAll) == flagsAll) & ((flags_[i] & flagsNone) == 0); });
+}
+
+// =====================================================================================================================
+inline size_t MapObjectSoA::FilterOwners(
+  IndexList*  pSelection,
+  uint32      ownerMask
+  ) const
+{
+  return Filter(pSelection, [this, ownerMask](size_t i) { return ((ownerMask >> (owner_[i] & 31)) & 1) != 0; });
+}
+
+// =====================================================================================================================
+inline size_t MapObjectSoA::FilterTypes(
+  IndexList*       pSelection,
+  const MapIDSet&  types
+  ) const
+{
+  return Filter(pSelection, [this, &types](size_t i) { return types.Test(type_[i]); });
+}
+
+// =====================================================================================================================
+inline size_t MapObjectSoA::FilterActions(
+  IndexList*  pSelection,
+  ActionType  action
+  ) const
+{
+  return Filter(pSelection, [this, action](size_t i) { return action_[i] == uint8(action); });
+}
+
+// =====================================================================================================================
+inline size_t MapObjectSoA::FilterRange(
+  IndexList*  pSelection,
+  int         pixelX,
+  int         pixelY,
+  int         maxPixelDistance
+  ) const
+{
+  const uint32 sqDistance = Criteria::SqDistance(maxPixelDistance);
+  return Filter(pSelection, [this, pixelX, pixelY, sqDistance](size_t i) {
+    const uint32 dx = uint32(std::abs(pixelX_[i] - pixelX));
+    const uint32 dy = uint32(std::abs(pixelY_[i] - pixelY));
+    return (dx < 0x8000) & (dy < 0x8000) & (((dx * dx) + (dy * dy)) <= sqDistance);
+  });
+}
+
+// =====================================================================================================================
+inline size_t MapObjectSoA::FilterHpBelow(
+  IndexList*  pSelection,
+  int         percent
+  ) const
+{
+  return Filter(pSelection, [this, percent](size_t i)
+    { return (int64(maxHp_[i] - damage_[i]) * 100) < (int64(maxHp_[i]) * percent); });
+}
+
+} // Tethys
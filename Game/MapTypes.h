@@ -0,0 +1,138 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+
+namespace Tethys {
+
+/// Enum specifying cell types (affects passability, vehicle speed, tube connections, direct weapon firing, etc.)
+enum class CellType : int {
+  FastPassible1 = 0,  ///< Rock vegetation
+  Impassible2,        ///< Meteor craters, cracks/crevases
+  SlowPassible1,      ///< Lava rock (dark)
+  SlowPassible2,      ///< Rippled dirt/Lava rock bumps
+  MediumPassible1,    ///< Dirt
+  MediumPassible2,    ///< Lava rock
+  Impassible1,        ///< Dirt/Rock/Lava rock mound/ice/volcano
+  FastPassible2,      ///< Rock
+  NorthCliffs,
+  CliffsHighSide,
+  CliffsLowSide,
+  VentsAndFumaroles,  ///< Fumaroles (passable by GeoCons)
+  ZPad12,
+  ZPad13,
+  ZPad14,
+  ZPad15,
+  ZPad16,
+  ZPad17,
+  ZPad18,
+  ZPad19,
+  ZPad20,
+  DozedArea,
+  Rubble,
+  NormalWall,
+  MicrobeWall,
+  LavaWall,
+  Tube0,              ///< Used for tubes and areas under buildings
+  Tube1,              ///< Unused
+  Tube2,              ///< Unused
+  Tube3,              ///< Unused
+  Tube4,              ///< Unused
+  Tube5,              ///< Unused
+  Count
+};
+
+inline bool operator==(CellType first, int      second) { return int(first) == second; }
+inline bool operator==(int      first, CellType second) { return first == int(second); }
+
+/// Data describing each map tile.
+union TileData {
+  struct {
+    uint32 cellType        :  5;  ///< Cell type of this tile.
+    uint32 tileIndex       : 11;  ///< Mapping index (tile graphics to use).
+    uint32 unitIndex       : 11;  ///< Index of MapUnit on this tile.
+    uint32 lava            :  1;  ///< True if lava is on this tile.
+    uint32 lavaPossible    :  1;  ///< True if lava can flow on this tile.
+    uint32 expand          :  1;  ///< True if lava / microbe is expanding to this tile.
+    uint32 microbe         :  1;  ///< True if microbe is on this tile.
+    uint32 wallOrBuilding  :  1;  ///< True if a wall or building is on this tile.
+  };
+  uint32 u32All;  ///< All TileData bits packed as a single unsigned integer.
+};
+
+/// Bit masks of TileData fields, for operating on TileData::u32All directly.
+enum TileDataMask : uint32 {
+  TileMaskCellType       = 0x0000001F,  ///< TileData::cellType
+  TileMaskTileIndex      = 0x0000FFE0,  ///< TileData::tileIndex
+  TileMaskUnitIndex      = 0x07FF0000,  ///< TileData::unitIndex
+  TileMaskLava           = (1u << 27),  ///< TileData::lava
+  TileMaskLavaPossible   = (1u << 28),  ///< TileData::lavaPossible
+  TileMaskExpand         = (1u << 29),  ///< TileData::expand
+  TileMaskMicrobe        = (1u << 30),  ///< TileData::microbe
+  TileMaskWallOrBuilding = (1u << 31),  ///< TileData::wallOrBuilding
+};
+
+/// Defines information about each tile type index.
+struct TilesetMapping {
+  uint16 tilesetIndex;    ///< Index of the tileset that contains this tile.
+  uint16 tileIndex;       ///< Index into the tileset of this tile.
+  uint16 numAnimation;    ///< Number of alternate tiles that can be displayed in place of this one (all consecutive).
+  uint16 animationDelay;  ///< Number of game cycles elapsed before the tile graphic is changed.
+};
+
+/// Defines tile index mappings for connectable tiles (walls, tubes).  Fields are named based on surrounding tiles.
+struct ConnectedTileMapping {
+  uint16 leftRight;
+  uint16 topBottom;
+  uint16 leftBottom;
+  uint16 rightBottom;
+  uint16 leftTop;
+  uint16 rightTop;
+  uint16 leftRightTop;
+  uint16 leftRightBottom;
+  uint16 leftRightTopBottom;
+  uint16 leftTopBottom;
+  uint16 rightTopBottom;
+  uint16 bottom;
+  uint16 top;
+  uint16 right;
+  uint16 left;
+  uint16 none;
+};
+
+/// Defines information about terrain types.
+struct TerrainType {
+  uint16 firstTile;     ///< First tile index in this terrain type.
+  uint16 lastTile;      ///< Last tile index in this terrain type.
+
+  uint16 bulldozed;     ///< Index of bulldozed tile for this terrain type.
+  uint16 rubbleStart;   ///< Start tile index of rubble.  4 common rubble tiles, followed by 4 rare rubble tiles.
+
+  uint16 playerTube[6]; ///< (Unused?) Index of legacy per-player tube tiles for this terrain type.
+
+  ConnectedTileMapping lavaWall;        ///< Lava wall tile indices.
+  ConnectedTileMapping microbeWall;     ///< Microbe wall tile indices.
+  ConnectedTileMapping wall;            ///< Normal wall tile indices.
+  ConnectedTileMapping wallLightDamage; ///< Lightly-damaged normal wall tile indices.
+  ConnectedTileMapping wallHeavyDamage; ///< Heavily-damaged normal wall tile indices.
+
+  uint16 lavaStart; ///< First lava tile index.
+
+  uint16 field_B6;
+  uint16 field_B8;
+  uint16 field_BA;
+
+  ConnectedTileMapping tube; ///< Tube tile indices.
+
+  struct {
+    uint16 tile;    ///< Index of scorch mark tile.
+    struct {
+      uint16 start; ///< First tile index this scorch tile can be applied to.
+      uint16 end;   ///< Last tile index this scorch tile can be applied to.
+    }  range[3];
+  }  scorched[1]; ///< Scorch tile indices and tiles they can be applied to.
+
+  int field_EA[7];  // ** TODO more scorched tiles?
+};
+static_assert(sizeof(TerrainType) == 0x108, "Incorrect TerrainType size.");
+
+} // Tethys
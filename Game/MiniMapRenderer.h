@@ -0,0 +1,224 @@
+#pragma once
+
+#include "Tethys/Game/MapTypes.h"
+#include "Tethys/Game/MapFile.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+# include <emmintrin.h>
+# define TETHYS_MINIMAP_SSE2  1
+#endif
+
+namespace Tethys {
+
+/// Native replacement for TerrainManager::CalcMiniMapColors() and the mini-map background draw.
+///
+/// Tile colors are the average color of each tile's pixels, computed per tileset in one pass over its pixel data (e.g.
+/// GFXTilesetBitmap::pPixelData_), then looked up per TilesetMapping.  Render() then draws one pixel per map tile in a
+/// single sweep over the swizzled tile array (MapImpl::pTileArray_ or MapFile::Tiles()).
+///
+/// Colors are 16-bit 5-5-5 (same layout as Rgb555).
+class MiniMapRenderer {
+public:
+  static constexpr int    TileSize       = 32;                     ///< Tile width and height in pixels.
+  static constexpr size_t PixelsPerTile  = TileSize * TileSize;
+  static constexpr int    Log2ChunkWidth = 5;
+
+  /// Computes the average color of each 8-bit tile.  pPalette holds 256 0x00RRGGBB (RGBQUAD) entries.
+  static void ComputeTileColors(
+    const uint8* pPixels, size_t numTiles, const uint32* pPalette, uint16* pOutColors,
+    size_t bytesPerTile = PixelsPerTile);
+
+  /// Computes the average color of each 16-bit 5-5-5 tile.  bytesPerTile is the stride between tiles.
+  static void ComputeTileColors(
+    const uint16* pPixels, size_t numTiles, uint16* pOutColors, size_t bytesPerTile = PixelsPerTile * sizeof(uint16));
+
+  /// Sets the color of a tileset's tiles, as computed by ComputeTileColors().  Call before BuildMappingColors().
+  void SetTilesetColors(size_t tilesetIndex, const uint16* pColors, size_t numTiles);
+
+  /// Builds the color of each tile mapping from the tileset colors.  Mappings that refer to missing tiles are black.
+  void BuildMappingColors(const TilesetMapping* pMappings, size_t numMappings);
+
+  /// Gets the color of each tile mapping (indexed by TileData::tileIndex).
+  const std::vector<uint16>& GetMappingColors() const { return mappingColors_; }
+
+  /// Renders one pixel per tile for the tile rect [x1, x1 + width) x [y1, y1 + height) of a swizzled tile array, into
+  /// pDst with a pitch in pixels.
+  void Render(const TileData* pTiles, int log2TileHeight, int x1, int y1, int width, int height,
+              uint16* pDst, ptrdiff_t pitch) const;
+
+  /// Renders the whole map into pDst, which must hold Width() * Height() pixels with the given pitch (0 = width).
+  void Render(const MapFile& map, uint16* pDst, ptrdiff_t pitch = 0) const {
+    Render(map.Tiles(), map.Log2Height(), 0, 0, map.Width(), map.Height(), pDst, (pitch != 0) ? pitch : map.Width());
+  }
+
+private:
+  /// Converts per-channel sums over a tile to the rounded average 5-5-5 color.
+  static uint16 SumsToColor(uint32 r, uint32 g, uint32 b, size_t numPixels);
+
+  std::vector<std::vector<uint16>> tilesetColors_;
+  std::vector<uint16>              mappingColors_;
+};
+
+// =====================================================================================================================
+inline uint16 MiniMapRenderer::SumsToColor(
+  uint32  r,
+  uint32  g,
+  uint32  b,
+  size_t  numPixels)
+{
+  const uint32 half = uint32(numPixels / 2);
+  return uint16((((r + half) / numPixels) << 10) | (((g + half) / numPixels) << 5) | ((b + half) / numPixels));
+}
+
+// =====================================================================================================================
+inline void MiniMapRenderer::ComputeTileColors(
+  const uint8*   pPixels,
+  size_t         numTiles,
+  const uint32*  pPalette,
+  uint16*        pOutColors,
+  size_t         bytesPerTile)
+{
+  // Expand the palette to 5-bit channels packed into 21-bit fields of a uint64, so each pixel is one lookup and one
+  // add.  A tile's sums are at most 1024 * 31, so the fields can't overflow into each other.
+  uint64 expanded[256];
+  for (int i = 0; i < 256; ++i) {
+    const uint32 c = pPalette[i];
+    expanded[i] = (uint64((c >> 19) & 0x1F) << 42) | (uint64((c >> 11) & 0x1F) << 21) | uint64((c >> 3) & 0x1F);
+  }
+
+  for (size_t tile = 0; tile < numTiles; ++tile) {
+    const uint8*const pTile = pPixels + (tile * bytesPerTile);
+
+    // Use 4 accumulators to break the dependency chain.
+    uint64 sums[4] = { };
+    for (size_t i = 0; i < PixelsPerTile; i += 4) {
+      sums[0] += expanded[pTile[i]];
+      sums[1] += expanded[pTile[i + 1]];
+      sums[2] += expanded[pTile[i + 2]];
+      sums[3] += expanded[pTile[i + 3]];
+    }
+
+    const uint64 sum = sums[0] + sums[1] + sums[2] + sums[3];
+    pOutColors[tile] =
+      SumsToColor(uint32(sum >> 42) & 0x1FFFFF, uint32(sum >> 21) & 0x1FFFFF, uint32(sum) & 0x1FFFFF, PixelsPerTile);
+  }
+}
+
+// =====================================================================================================================
+inline void MiniMapRenderer::ComputeTileColors(
+  const uint16*  pPixels,
+  size_t         numTiles,
+  uint16*        pOutColors,
+  size_t         bytesPerTile)
+{
+  for (size_t tile = 0; tile < numTiles; ++tile) {
+    const uint16*const pTile = reinterpret_cast<const uint16*>(reinterpret_cast<const uint8*>(pPixels) +
+                                                               (tile * bytesPerTile));
+    uint32 r = 0;
+    uint32 g = 0;
+    uint32 b = 0;
+
+#if TETHYS_MINIMAP_SSE2
+    // Split 8 pixels at a time into 16-bit channel lanes, and widen to 32-bit sums with pmaddwd.
+    const __m128i mask  = _mm_set1_epi16(0x1F);
+    const __m128i ones  = _mm_set1_epi16(1);
+    __m128i       sumR  = _mm_setzero_si128();
+    __m128i       sumG  = _mm_setzero_si128();
+    __m128i       sumB  = _mm_setzero_si128();
+    for (size_t i = 0; i < PixelsPerTile; i += 8) {
+      const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTile + i));
+      sumB = _mm_add_epi32(sumB, _mm_madd_epi16(_mm_and_si128(px, mask),                     ones));
+      sumG = _mm_add_epi32(sumG, _mm_madd_epi16(_mm_and_si128(_mm_srli_epi16(px, 5),  mask), ones));
+      sumR = _mm_add_epi32(sumR, _mm_madd_epi16(_mm_and_si128(_mm_srli_epi16(px, 10), mask), ones));
+    }
+
+    alignas(16) uint32 lanes[3][4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes[0]), sumR);
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes[1]), sumG);
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes[2]), sumB);
+    r = lanes[0][0] + lanes[0][1] + lanes[0][2] + lanes[0][3];
+    g = lanes[1][0] + lanes[1][1] + lanes[1][2] + lanes[1][3];
+    b = lanes[2][0] + lanes[2][1] + lanes[2][2] + lanes[2][3];
+#else
+    // Spread the 5-bit channels into 21-bit fields of a uint64, and sum all channels with one add per pixel.
+    uint64 sum = 0;
+    for (size_t i = 0; i < PixelsPerTile; ++i) {
+      const uint64 p = pTile[i];
+      sum += ((p & 0x7C00) << 32) | ((p & 0x3E0) << 16) | (p & 0x1F);
+    }
+    r = uint32(sum >> 42) & 0x1FFFFF;
+    g = uint32(sum >> 21) & 0x1FFFFF;
+    b = uint32(sum)       & 0x1FFFFF;
+#endif
+
+    pOutColors[tile] = SumsToColor(r, g, b, PixelsPerTile);
+  }
+}
+
+// =====================================================================================================================
+inline void MiniMapRenderer::SetTilesetColors(
+  size_t         tilesetIndex,
+  const uint16*  pColors,
+  size_t         numTiles)
+{
+  if (tilesetIndex >= tilesetColors_.size()) {
+    tilesetColors_.resize(tilesetIndex + 1);
+  }
+  tilesetColors_[tilesetIndex].assign(pColors, pColors + numTiles);
+}
+
+// =====================================================================================================================
+inline void MiniMapRenderer::BuildMappingColors(
+  const TilesetMapping*  pMappings,
+  size_t                 numMappings)
+{
+  mappingColors_.assign(size_t(1) << 11, 0);  // Covers all TileData::tileIndex values.
+
+  for (size_t i = 0; i < (std::min)(numMappings, mappingColors_.size()); ++i) {
+    const TilesetMapping& mapping = pMappings[i];
+    if (mapping.tilesetIndex < tilesetColors_.size()) {
+      const auto& colors = tilesetColors_[mapping.tilesetIndex];
+      mappingColors_[i]  = (mapping.tileIndex < colors.size()) ? colors[mapping.tileIndex] : 0;
+    }
+  }
+}
+
+// =====================================================================================================================
+inline void MiniMapRenderer::Render(
+  const TileData*  pTiles,
+  int              log2TileHeight,
+  int              x1,
+  int              y1,
+  int              width,
+  int              height,
+  uint16*          pDst,
+  ptrdiff_t        pitch
+  ) const
+{
+  const uint16*const pColors     = mappingColors_.data();
+  const size_t       chunkStride = size_t(1) << (log2TileHeight + Log2ChunkWidth);
+
+  if (mappingColors_.empty() == false) {
+    // Walk the tile array in memory order:  each column chunk's rows are contiguous runs of up to 32 tiles.
+    for (int x = x1; x < (x1 + width);) {
+      const int       runLength = (std::min)(TileSize - (x & (TileSize - 1)), (x1 + width) - x);
+      const TileData* pSrc      = pTiles + (size_t(x >> Log2ChunkWidth) * chunkStride) +
+                                  (size_t(y1) << Log2ChunkWidth) + (x & (TileSize - 1));
+      uint16*         pOut      = pDst + (x - x1);
+
+      for (int y = 0; y < height; ++y, pSrc += TileSize, pOut += pitch) {
+        for (int i = 0; i < runLength; ++i) {
+          pOut[i] = pColors[(pSrc[i].u32All & TileMaskTileIndex) >> 5];
+        }
+      }
+
+      x += runLength;
+    }
+  }
+}
+
+} // Tethys
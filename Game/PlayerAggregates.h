@@ -0,0 +1,248 @@
+#pragma once
+
+#include "Tethys/Game/MapObject.h"
+#include "Tethys/Game/MapObjectType.h"
+#include "Tethys/Game/MapImpl.h"
+#include "Tethys/Game/PlayerImpl.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace Tethys {
+
+/// Event-driven per-player unit count aggregates, with O(1) queries by MapID, ActionType, and building state.
+///
+/// Instead of walking each player's building/vehicle lists every tick, the cache keeps the last known state of each
+/// map object, and applies the difference when told that a unit changed:  call OnCreate()/OnTransfer()/Sync() from the
+/// OnCreateUnit()/OnTransferUnit() mission callbacks and after issuing idle/unidle or other state-changing commands,
+/// OnDestroy() from OnDestroyUnit(), and Sync() for units whose action or enabled state may have changed.
+/// Validate() cross-checks the cache against a full walk of the map object array, e.g. every tick in debug builds.
+class PlayerAggregates {
+public:
+  static constexpr size_t NumOwners      = 16;  ///< MapObject::ownerNum_ is 4 bits.
+  static constexpr size_t NumMapIDs      = size_t(MapID::MaxObject) + 1;
+  static constexpr size_t NumActionTypes = size_t(ActionType::Count);
+
+  /// Kinds of map objects.
+  enum class Kind : uint8 {
+    None = 0,  ///< Dead or untracked.
+    Building,
+    Vehicle,
+    Entity,
+    Count
+  };
+
+  /// Building states.  Exactly one applies to each building.
+  enum class BuildingState : uint8 {
+    None = 0,           ///< Not a building.
+    UnderConstruction,  ///< Being built or dismantled (ctMoDevelop, ctMoUnDevelop).
+    Idle,               ///< Idled.
+    Disabled,           ///< Active but disabled (e.g. insufficient power or workers).
+    Enabled,            ///< Active and enabled.
+    Count
+  };
+
+  /// Tracked state of one map object.
+  struct UnitState {
+    bool operator==(const UnitState& other) const {
+      return (kind   == other.kind)   && (owner         == other.owner)         && (type == other.type) &&
+             (action == other.action) && (buildingState == other.buildingState);
+    }
+    bool operator!=(const UnitState& other) const { return (*this == other) == false; }
+
+    Kind          kind;
+    uint8         owner;
+    MapID         type;
+    ActionType    action;
+    BuildingState buildingState;
+  };
+
+  /// Aggregate counts for one player.
+  struct Counts {
+    uint32 byKind[size_t(Kind::Count)];
+    uint32 byType[NumMapIDs];
+    uint32 byAction[NumActionTypes];
+    uint32 byBuildingState[size_t(BuildingState::Count)];
+  };
+
+  explicit PlayerAggregates(size_t maxUnits = 0) : units_(maxUnits, UnitState{ }), counts_{ } { }
+
+  /// Clears all tracked units.
+  void Clear() { std::fill(units_.begin(), units_.end(), UnitState{ });  memset(&counts_[0], 0, sizeof(counts_)); }
+
+  ///@{ Event handlers.  index is the map object's index (MapObject::index_).
+  void OnCreate(size_t index, const UnitState& state) { Set(index, state);        }
+  void OnDestroy(size_t index)                        { Set(index, UnitState{ }); }
+  void OnTransfer(size_t index, int newOwner)
+    { Modify(index, [newOwner](UnitState& s) { s.owner = uint8(newOwner); }); }
+  void OnActionChange(size_t index, ActionType action)
+    { Modify(index, [action](UnitState& s) { s.action = action; }); }
+  void OnBuildingStateChange(size_t index, BuildingState state) {
+    Modify(index, [state](UnitState& s)
+      { s.buildingState = (s.kind == Kind::Building) ? state : BuildingState::None; });
+  }
+  ///@}
+
+  /// Sets the tracked state of a map object, updating the aggregates by the difference from its previous state.
+  void Set(size_t index, const UnitState& state);
+
+  ///@{ Game integration:  reads a live map object's current state and applies it.
+  static UnitState GetState(const MapObject& mo, MapID type);
+  static UnitState GetState(const MapObject& mo) { return mo.IsLive() ? GetState(mo, mo.GetTypeID()) : UnitState{ }; }
+  void Sync(const MapObject& mo) { Set(size_t(mo.index_), GetState(mo)); }
+  ///@}
+
+  /// Rebuilds the cache with a full walk of a map object array.  The generic overload gets the state of each live map
+  /// object via getState(const MapObject&) -> UnitState, so it can be used on synthetic arrays without the game.
+  template <typename Fn>  void Rebuild(const AnyMapObj* pMapObjArray, size_t count, Fn&& getState);
+  void Rebuild(const MapImpl& map)
+    { Rebuild(map.pMapObjArray_, map.MaxNumUnits(), [](const MapObject& mo) { return GetState(mo); }); }
+
+  /// Debug cross-check:  returns true if the cache matches a full walk of a map object array.  If pMismatchIndex is
+  /// given, it receives the index of the first map object whose tracked state differs (or SIZE_MAX if none).
+  template <typename Fn>
+  bool Validate(const AnyMapObj* pMapObjArray, size_t count, Fn&& getState, size_t* pMismatchIndex = nullptr) const;
+  bool Validate(const MapImpl& map, size_t* pMismatchIndex = nullptr) const {
+    return Validate(
+      map.pMapObjArray_, map.MaxNumUnits(), [](const MapObject& mo) { return GetState(mo); }, pMismatchIndex);
+  }
+
+  ///@{ O(1) queries.  Return 0 for invalid players.
+  const Counts* GetCounts(int player) const
+    { return ((player >= 0) && (size_t(player) < NumOwners)) ? &counts_[player] : nullptr; }
+  uint32 Count(int player, MapID         type)   const { return Get(player, &Counts::byType,          size_t(type));   }
+  uint32 Count(int player, ActionType    action) const { return Get(player, &Counts::byAction,        size_t(action)); }
+  uint32 Count(int player, Kind          kind)   const { return Get(player, &Counts::byKind,          size_t(kind));   }
+  uint32 Count(int player, BuildingState state)  const { return Get(player, &Counts::byBuildingState, size_t(state));  }
+  uint32 NumBuildings(int player)                const { return Count(player, Kind::Building);                         }
+  uint32 NumVehicles(int player)                 const { return Count(player, Kind::Vehicle);                          }
+  uint32 NumEnabledBuildings(int player)         const { return Count(player, BuildingState::Enabled);                 }
+  uint32 NumDisabledBuildings(int player)        const { return Count(player, BuildingState::Disabled);                }
+  uint32 NumIdleBuildings(int player)            const { return Count(player, BuildingState::Idle);                    }
+  ///@}
+
+  /// Gets the tracked state of a map object.
+  UnitState GetTracked(size_t index) const { return (index < units_.size()) ? units_[index] : UnitState{ }; }
+
+private:
+  template <size_t N>
+  uint32 Get(int player, const uint32 (Counts::*pArray)[N], size_t i) const
+    { const Counts*const p = GetCounts(player);  return ((p != nullptr) && (i < N)) ? (p->*pArray)[i] : 0; }
+
+  template <typename Fn>
+  void Modify(size_t index, Fn&& fn) {
+    UnitState state = GetTracked(index);
+    if (state.kind != Kind::None) {
+      fn(state);
+      Set(index, state);
+    }
+  }
+
+  /// Adds delta to the aggregates of a state.
+  void Apply(const UnitState& state, uint32 delta);
+
+  std::vector<UnitState> units_;
+  Counts                 counts_[NumOwners];
+};
+
+// =====================================================================================================================
+inline void PlayerAggregates::Apply(
+  const UnitState&  state,
+  uint32            delta)
+{
+  if (state.kind != Kind::None) {
+    Counts& counts = counts_[state.owner % NumOwners];
+    counts.byKind[size_t(state.kind)]                      += delta;
+    counts.byType[size_t(state.type) % NumMapIDs]          += delta;
+    counts.byAction[size_t(state.action) % NumActionTypes] += delta;
+    counts.byBuildingState[size_t(state.buildingState)]    += delta;
+  }
+}
+
+// =====================================================================================================================
+inline void PlayerAggregates::Set(
+  size_t            index,
+  const UnitState&  state)
+{
+  if (index >= units_.size()) {
+    units_.resize(index + 1, UnitState{ });
+  }
+
+  UnitState& tracked = units_[index];
+  if (tracked != state) {
+    Apply(tracked, uint32(-1));
+    Apply(state,   1);
+    tracked = state;
+  }
+}
+
+// =====================================================================================================================
+inline PlayerAggregates::UnitState PlayerAggregates::GetState(
+  const MapObject&  mo,
+  MapID             type)
+{
+  UnitState state = { };
+  state.kind   = (mo.flags_ & MoFlagBuilding) ? Kind::Building :
+                 (mo.flags_ & MoFlagVehicle)  ? Kind::Vehicle  : Kind::Entity;
+  state.owner  = mo.ownerNum_;
+  state.type   = type;
+  state.action = mo.action_;
+
+  if (state.kind == Kind::Building) {
+    const auto command = CommandType(mo.command_);
+    state.buildingState =
+      ((command == CommandType::Develop) || (command == CommandType::UnDevelop)) ? BuildingState::UnderConstruction :
+      ((mo.flags_ & MoFlagBldActive) == 0)                                         ? BuildingState::Idle              :
+      static_cast<const Building&>(mo).IsEnabled()                                 ? BuildingState::Enabled           :
+                                                                                     BuildingState::Disabled;
+  }
+
+  return state;
+}
+
+// =====================================================================================================================
+template <typename Fn>
+void PlayerAggregates::Rebuild(
+  const AnyMapObj*  pMapObjArray,
+  size_t            count,
+  Fn&&              getState)
+{
+  units_.assign(count, UnitState{ });
+  memset(&counts_[0], 0, sizeof(counts_));
+
+  // Index 0 is the list head sentinel.
+  for (size_t i = 1; i < count; ++i) {
+    const MapObject& mo = pMapObjArray[i].object_;
+    if (mo.IsLive()) {
+      Set(i, getState(mo));
+    }
+  }
+}
+
+// =====================================================================================================================
+template <typename Fn>
+bool PlayerAggregates::Validate(
+  const AnyMapObj*  pMapObjArray,
+  size_t            count,
+  Fn&&              getState,
+  size_t*           pMismatchIndex
+  ) const
+{
+  PlayerAggregates reference;
+  reference.Rebuild(pMapObjArray, count, getState);
+
+  size_t mismatch = SIZE_MAX;
+  for (size_t i = 0; (mismatch == SIZE_MAX) && (i < (std::max)(units_.size(), count)); ++i) {
+    if (GetTracked(i) != reference.GetTracked(i)) {
+      mismatch = i;
+    }
+  }
+
+  if (pMismatchIndex != nullptr) {
+    *pMismatchIndex = mismatch;
+  }
+
+  return (mismatch == SIZE_MAX) && (memcmp(&counts_[0], &reference.counts_[0], sizeof(counts_)) == 0);
+}
+
+} // Tethys
@@ -0,0 +1,270 @@
+#pragma once
+
+#include "Tethys/Game/ReplayLog.h"
+#include "Tethys/Common/WorkStealingPool.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <filesystem>
+
+namespace Tethys {
+
+/// Offline batch analyzer for replay logs recorded with ReplayWriter.
+///
+/// Each game is analyzed by one task on a WorkStealingPool, reading its log through a memory mapping.  Results are
+/// returned in input order.
+///
+/// @code
+///   ReplayAnalyzer analyzer;
+///   for (const auto& game : analyzer.AnalyzeDirectory("replays")) {
+///     for (const auto& player : game.players) {
+///       printf("%d: %.1f APM\n", player.netID, player.ActionsPerMinute(game.GameTicks(), ticksPerMinute));
+///     }
+///   }
+/// @endcode
+class ReplayAnalyzer {
+public:
+  static constexpr size_t NumCommandTypes = size_t(CommandType::Count);
+
+  /// Per-player (net ID) command statistics.
+  struct PlayerStats {
+    /// Gets actions per 100-tick mark (see Game::Mark()) over the span of the game.
+    double ActionsPerMark(int32 gameTicks) const
+      { return (gameTicks > 0) ? ((double(numActions) * 100.0) / gameTicks) : 0.0; }
+
+    /// Gets actions per minute, for the given number of game ticks per minute of play (depends on game speed).
+    double ActionsPerMinute(int32 gameTicks, double ticksPerMinute) const
+      { return (gameTicks > 0) ? ((double(numActions) * ticksPerMinute) / gameTicks) : 0.0; }
+
+    int32  netID         = 0;
+    uint32 numPackets    = 0;  ///< All packets, including keep-alive Nop/InvalidCommand packets.
+    uint32 numActions    = 0;  ///< Packets other than Nop and InvalidCommand.
+    int32  firstTick     = 0;  ///< Tick of this player's first action.
+    int32  lastTick      = 0;  ///< Tick of this player's last action.
+    uint32 numUnitOrders = 0;  ///< Sum of the number of units in each action.
+    uint32 histogram[NumCommandTypes] = { };  ///< Number of packets of each CommandType.
+  };
+
+  /// Number of actions that referred to a unit ID.
+  struct UnitActivity {
+    uint16 unitID;
+    uint32 numActions;
+  };
+
+  /// Chat, ally, quit, and go-AI events.
+  struct TimelineEvent {
+    int32       tick;
+    int32       netID;
+    CommandType type;
+    int         param1;  ///< Chat: sender player ID;  Ally: from player ID;  Quit: QuitMethod.
+    int         param2;  ///< Chat: destination PlayerBitmask;  Ally: to player ID;  Quit: delay.
+    std::string text;    ///< Chat: message.
+  };
+
+  /// Results of analyzing one game.
+  struct GameStats {
+    int32 GameTicks() const { return (numPackets != 0) ? (lastTick - firstTick + 1) : 0; }
+
+    std::string                filename;
+    bool                       ok         = false;  ///< False if the log could not be opened or is corrupt.
+    uint64                     numPackets = 0;
+    int32                      firstTick  = 0;
+    int32                      lastTick   = 0;
+    uint32                     histogram[NumCommandTypes] = { };  ///< Number of packets of each CommandType.
+    std::vector<PlayerStats>   players;                           ///< In order of first packet.
+    std::vector<UnitActivity>  units;                             ///< Sorted by descending activity, then unit ID.
+    std::vector<TimelineEvent> timeline;                          ///< In tick order.
+  };
+
+  /// Analyzes the replay logs in the given files, with up to numThreads threads (0 = one per hardware thread).
+  std::vector<GameStats> AnalyzeFiles(const std::vector<std::string>& filenames, int numThreads = 0);
+
+  /// Analyzes all files in a directory with the given extension (case-sensitive;  empty = all files), sorted by name.
+  std::vector<GameStats> AnalyzeDirectory(const char* pPath, const char* pExtension = ".op2r", int numThreads = 0);
+
+  /// Analyzes one game from an open reader.  pUnitCounts is scratch space of 65536 entries that must be zero, and is
+  /// left zeroed;  if null, temporary space is allocated.
+  static bool AnalyzeGame(ReplayReader* pReader, GameStats* pOut, uint32* pUnitCounts = nullptr);
+
+private:
+  /// Adds the unit IDs referred to by a packet to the counts and list of touched units.  Returns the number of units.
+  static size_t CountUnits(
+    const CommandPacket& packet, uint32* pUnitCounts, std::vector<uint16>* pTouched);
+
+  std::vector<std::vector<uint32>> unitCounts_;  ///< Per-worker AnalyzeGame() scratch space.
+};
+
+// =====================================================================================================================
+inline size_t ReplayAnalyzer::CountUnits(
+  const CommandPacket&  packet,
+  uint32*               pUnitCounts,
+  std::vector<uint16>*  pTouched)
+{
+  const uint8*const pData    = &packet.data.buffer[0];
+  const size_t      length   = (std::min)(size_t(packet.dataLength), CommandPacketDataSize);
+  const auto        layout   = CmdPacketWriter::LayoutFor(packet.type);
+  size_t            numUnits = 0;
+  const uint8*      pUnitIDs = nullptr;
+
+  if ((layout == CmdPacketWriter::Layout::SingleUnit) && (length >= sizeof(uint16))) {
+    numUnits = 1;
+    pUnitIDs = pData;
+  }
+  else if ((length >= 1) &&
+           ((layout == CmdPacketWriter::Layout::Simple) || (layout == CmdPacketWriter::Layout::Move)))
+  {
+    numUnits = (std::min)(size_t(pData[0]), (length - 1) / sizeof(uint16));
+    pUnitIDs = pData + 1;
+  }
+
+  for (size_t i = 0; i < numUnits; ++i) {
+    uint16 unitID;
+    memcpy(&unitID, pUnitIDs + (sizeof(uint16) * i), sizeof(unitID));
+    if (pUnitCounts[unitID]++ == 0) {
+      pTouched->push_back(unitID);
+    }
+  }
+
+  return numUnits;
+}
+
+// =====================================================================================================================
+inline bool ReplayAnalyzer::AnalyzeGame(
+  ReplayReader*  pReader,
+  GameStats*     pOut,
+  uint32*        pUnitCounts)
+{
+  std::vector<uint32> localCounts((pUnitCounts == nullptr) ? (size_t(UINT16_MAX) + 1) : 0);
+  if (pUnitCounts == nullptr) {
+    pUnitCounts = localCounts.data();
+  }
+
+  std::vector<uint16> touched;
+  CommandPacket       packet;
+  PlayerStats*        pPlayer = nullptr;
+
+  for (pReader->Rewind(); pReader->Next(&packet);) {
+    const size_t type = size_t(packet.type);
+
+    if (pOut->numPackets++ == 0) {
+      pOut->firstTick = packet.timeStamp;
+    }
+    pOut->lastTick = packet.timeStamp;
+
+    // Packets from the same player tend to come in runs, so check the last one first.
+    if ((pPlayer == nullptr) || (pPlayer->netID != packet.netID)) {
+      auto it = std::find_if(pOut->players.begin(), pOut->players.end(),
+                             [&packet](const PlayerStats& player) { return player.netID == packet.netID; });
+      if (it == pOut->players.end()) {
+        pOut->players.emplace_back();
+        pOut->players.back().netID = packet.netID;
+        it = pOut->players.end() - 1;
+      }
+      pPlayer = &*it;
+    }
+
+    ++pPlayer->numPackets;
+    if (type < NumCommandTypes) {
+      ++pOut->histogram[type];
+      ++pPlayer->histogram[type];
+    }
+
+    if ((packet.type != CommandType::Nop) && (packet.type != CommandType::InvalidCommand)) {
+      if (pPlayer->numActions++ == 0) {
+        pPlayer->firstTick = packet.timeStamp;
+      }
+      pPlayer->lastTick       = packet.timeStamp;
+      pPlayer->numUnitOrders += uint32(CountUnits(packet, pUnitCounts, &touched));
+    }
+
+    const CommandPacketData& data = packet.data;
+    switch (packet.type) {
+    case CommandType::Chat: {
+      const size_t maxLength = (std::min)(sizeof(data.chat.message),
+                                          (packet.dataLength > 2) ? (packet.dataLength - size_t(2)) : size_t(0));
+      const size_t length    = std::find(&data.chat.message[0], &data.chat.message[maxLength], '\0') -
+                               &data.chat.message[0];
+      pOut->timeline.push_back({ packet.timeStamp, packet.netID, packet.type, data.chat.playerID,
+                                 data.chat.dstPlayerMask.mask, std::string(&data.chat.message[0], length) });
+      break;
+    }
+
+    case CommandType::Ally:
+      pOut->timeline.push_back(
+        { packet.timeStamp, packet.netID, packet.type, data.ally.fromPlayerID, data.ally.toPlayerID, std::string() });
+      break;
+
+    case CommandType::Quit:
+      pOut->timeline.push_back(
+        { packet.timeStamp, packet.netID, packet.type, int(data.quit.quitMethod), data.quit.delay, std::string() });
+      break;
+
+    case CommandType::GoAI:
+      pOut->timeline.push_back({ packet.timeStamp, packet.netID, packet.type, 0, 0, std::string() });
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  pOut->units.reserve(touched.size());
+  for (uint16 unitID : touched) {
+    pOut->units.push_back({ unitID, pUnitCounts[unitID] });
+    pUnitCounts[unitID] = 0;
+  }
+  std::sort(pOut->units.begin(), pOut->units.end(), [](const UnitActivity& a, const UnitActivity& b)
+    { return (a.numActions != b.numActions) ? (a.numActions > b.numActions) : (a.unitID < b.unitID); });
+
+  pOut->ok = (pReader->HasError() == false);
+  return pOut->ok;
+}
+
+// =====================================================================================================================
+inline std::vector<ReplayAnalyzer::GameStats> ReplayAnalyzer::AnalyzeFiles(
+  const std::vector<std::string>&  filenames,
+  int                              numThreads)
+{
+  std::vector<GameStats> results(filenames.size());
+
+  numThreads = WorkStealingPool::NumThreads(filenames.size(), numThreads);
+  unitCounts_.resize((std::max)(unitCounts_.size(), size_t(numThreads)));
+
+  WorkStealingPool::ParallelFor(filenames.size(), numThreads, [&](size_t i, int worker) {
+    std::vector<uint32>& unitCounts = unitCounts_[worker];
+    unitCounts.resize(size_t(UINT16_MAX) + 1);
+
+    ReplayReader reader;
+    results[i].filename = filenames[i];
+    if (reader.Open(filenames[i].c_str())) {
+      AnalyzeGame(&reader, &results[i], unitCounts.data());
+    }
+  });
+
+  return results;
+}
+
+// =====================================================================================================================
+inline std::vector<ReplayAnalyzer::GameStats> ReplayAnalyzer::AnalyzeDirectory(
+  const char*  pPath,
+  const char*  pExtension,
+  int          numThreads)
+{
+  namespace fs = std::filesystem;
+
+  std::vector<std::string> filenames;
+  std::error_code          error;
+  for (fs::directory_iterator it(pPath, error), end; (error.value() == 0) && (it != end); it.increment(error)) {
+    if (it->is_regular_file(error) &&
+        ((pExtension == nullptr) || (pExtension[0] == '\0') || (it->path().extension() == pExtension)))
+    {
+      filenames.push_back(it->path().string());
+    }
+  }
+
+  std::sort(filenames.begin(), filenames.end());
+  return AnalyzeFiles(filenames, numThreads);
+}
+
+} // Tethys
@@ -0,0 +1,545 @@
+#pragma once
+
+#include "Tethys/Game/CommandPacket.h"
+#include "Tethys/Common/FileMapping.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+namespace Tethys {
+
+BEGIN_PACKED
+
+/// Replay log file header.
+///
+/// The file is a sequence of independently decodable chunks (ReplayChunkHeader + packet data), followed by an index
+/// of ReplayIndexEntry (one per chunk) at indexOffset.  indexOffset is 0 if the recording was not closed, in which case
+/// the reader rebuilds the index from the chunk headers.
+///
+/// Each packet is encoded relative to the previous packet in its chunk:
+///   uint8  type | (netID changed ? 0x80 : 0)
+///   varint tick delta (ticks are non-decreasing)
+///   varint zigzag(netID)  (only if changed)
+///   varint dataLength, followed by dataLength bytes
+struct ReplayFileHeader {
+  uint32 tag;          ///< ReplayLog::FileTag
+  uint16 version;      ///< ReplayLog::Version
+  uint16 headerSize;   ///< sizeof(ReplayFileHeader)
+  uint32 numChunks;
+  uint32 reserved;
+  uint64 numPackets;
+  uint64 indexOffset;  ///< File offset of the chunk index, or 0 if not written.
+};
+static_assert(sizeof(ReplayFileHeader) == 32, "Incorrect ReplayFileHeader size.");
+
+/// Replay log chunk header, followed by dataSize bytes of encoded packets.
+struct ReplayChunkHeader {
+  int32  firstTick;
+  int32  lastTick;
+  uint32 numPackets;
+  uint32 dataSize;
+};
+static_assert(sizeof(ReplayChunkHeader) == 16, "Incorrect ReplayChunkHeader size.");
+
+/// Replay log chunk index entry.
+struct ReplayIndexEntry {
+  int32  firstTick;
+  int32  lastTick;
+  uint64 offset;       ///< File offset of the ReplayChunkHeader.
+  uint64 firstPacket;  ///< Index of the chunk's first packet in the whole log.
+};
+static_assert(sizeof(ReplayIndexEntry) == 24, "Incorrect ReplayIndexEntry size.");
+
+END_PACKED
+
+
+/// Shared definitions for ReplayWriter and ReplayReader.
+namespace ReplayLog {
+constexpr uint32 FileTag = 0x52325F4F;  ///< 'O_2R'
+constexpr uint16 Version = 1;
+
+/// Max encoded size of a packet (flags, 3 varints, data).
+constexpr size_t MaxEncodedPacketSize = 1 + 5 + 5 + 3 + CommandPacketDataSize;
+
+inline uint8* WriteVarint(uint8* p, uint32 value) {
+  for (; value >= 0x80; value >>= 7) {
+    *(p++) = uint8(value | 0x80);
+  }
+  *(p++) = uint8(value);
+  return p;
+}
+
+/// Reads a varint written by WriteVarint().  Returns nullptr if it is truncated, or longer than 5 bytes or overflows 32
+/// bits (i.e. corrupt).
+inline const uint8* ReadVarint(const uint8* p, const uint8* pEnd, uint32* pValue) {
+  uint32 value = 0;
+  for (int shift = 0; (p != pEnd) && (shift < 35); shift += 7) {
+    const uint8 byte = *(p++);
+    if ((shift == 28) && ((byte & 0xF0) != 0)) {
+      break;  // The 5th byte can only hold the top 4 bits, and must be the last.
+    }
+
+    value |= uint32(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *pValue = value;
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+inline uint32 ZigZag(int32 value)    { return (uint32(value) << 1) ^ uint32(value >> 31); }
+inline int32  UnZigZag(uint32 value) { return int32(value >> 1) ^ -int32(value & 1);      }
+} // ReplayLog
+
+
+/// Records CommandPackets to a compact, chunked replay log, either to a file or to memory.
+class ReplayWriter {
+public:
+  static constexpr size_t DefaultPacketsPerChunk = 4096;
+
+  explicit ReplayWriter(size_t packetsPerChunk = DefaultPacketsPerChunk)
+    : packetsPerChunk_((std::max)(packetsPerChunk, size_t(1))) { }
+  ~ReplayWriter() { Close(); }
+
+  ReplayWriter(const ReplayWriter&)            = delete;
+  ReplayWriter& operator=(const ReplayWriter&) = delete;
+
+  /// Starts recording to a file.  The header is rewritten with the index location on Close().
+  bool Open(const char* pFilename);
+
+  /// Starts recording to memory, see GetBuffer().
+  void OpenMemory();
+
+  /// Appends a packet.  Returns false if not open, the packet's data is invalid, or its tick is less than the previous.
+  bool Append(const CommandPacket& packet);
+
+  /// Writes the last chunk and the index, and closes the file.
+  bool Close();
+
+  bool   IsOpen()     const { return isOpen_;     }
+  uint64 NumPackets() const { return numPackets_; }
+
+  /// Gets the replay log written by OpenMemory() and Close().
+  const std::vector<uint8>& GetBuffer() const { return buffer_; }
+
+private:
+  void Start();
+  bool Emit(const void* pData, size_t size);
+  bool FlushChunk();
+
+  size_t                        packetsPerChunk_;
+  FILE*                         pFile_       = nullptr;
+  bool                          isOpen_      = false;
+  bool                          ok_          = true;
+  std::vector<uint8>            buffer_;      ///< Output if recording to memory.
+  uint64                        offset_      = 0;
+  uint64                        numPackets_  = 0;
+
+  std::vector<uint8>            chunk_;       ///< Encoded packets of the current chunk.
+  ReplayChunkHeader             chunkHeader_ = { };
+  int32                         lastTick_    = 0;
+  int32                         lastNetID_   = 0;
+  std::vector<ReplayIndexEntry> index_;
+};
+
+
+/// Reads a replay log written by ReplayWriter.  Seek() finds a tick by binary search over the chunk index.
+///
+/// @code
+///   ReplayReader    reader;
+///   CommandPacket   packet;
+///   CmdPacketWriter decoder;
+///   for (reader.Open("game.op2r") && reader.Seek(tick); reader.Next(&packet);) {
+///     AttackCommand attack;
+///     if ((packet.type == CommandType::Attack) && decoder.Decode<CommandType::Attack>(packet, &attack)) { ... }
+///   }
+/// @endcode
+class ReplayReader {
+public:
+  /// Opens a replay log file by memory mapping it.
+  bool Open(const char* pFilename);
+
+  /// Opens a replay log in memory.  The memory must outlive the reader.
+  bool OpenMemory(const void* pData, size_t size);
+
+  void Close();
+
+  bool   IsOpen()     const { return (pData_ != nullptr); }
+  uint64 NumPackets() const { return numPackets_;         }
+  size_t NumChunks()  const { return index_.size();       }
+  int32  FirstTick()  const { return index_.empty() ? 0 : index_.front().firstTick; }
+  int32  LastTick()   const { return index_.empty() ? 0 : index_.back().lastTick;   }
+
+  const std::vector<ReplayIndexEntry>& GetIndex() const { return index_; }
+
+  /// Positions the reader at the first packet with timeStamp >= tick.  Returns false if there is no such packet.
+  bool Seek(int32 tick);
+
+  /// Positions the reader at the start of the log.
+  void Rewind() { SeekChunk(0); }
+
+  /// Reads the next packet.  Returns false at the end of the log, or if the log is corrupt (see HasError()).
+  bool Next(CommandPacket* pPacket);
+
+  bool HasError() const { return error_; }
+
+private:
+  void Reset();  ///< Clears all state except the file mapping.
+  bool ParseIndex();
+  bool SeekChunk(size_t chunk);
+
+  FileMapping                   file_;
+  const uint8*                  pData_      = nullptr;
+  size_t                        size_       = 0;
+  uint64                        numPackets_ = 0;
+  std::vector<ReplayIndexEntry> index_;
+
+  size_t       chunk_     = 0;        ///< Index of the current chunk.
+  const uint8* p_         = nullptr;  ///< Read position in the current chunk.
+  const uint8* pEnd_      = nullptr;
+  uint32       numLeft_   = 0;        ///< Packets left in the current chunk.
+  int32        lastTick_  = 0;
+  int32        lastNetID_ = 0;
+  bool         error_     = false;
+};
+
+// =====================================================================================================================
+inline bool ReplayWriter::Open(
+  const char* pFilename)
+{
+  Close();
+  pFile_ = fopen(pFilename, "wb");
+
+  if (pFile_ != nullptr) {
+    Start();
+  }
+
+  return isOpen_;
+}
+
+// =====================================================================================================================
+inline void ReplayWriter::OpenMemory() {
+  Close();
+  Start();
+}
+
+// =====================================================================================================================
+inline void ReplayWriter::Start() {
+  isOpen_      = true;
+  ok_          = true;
+  offset_      = 0;
+  numPackets_  = 0;
+  chunkHeader_ = { };
+  chunk_.clear();
+  index_.clear();
+  buffer_.clear();
+
+  const ReplayFileHeader header =
+    { ReplayLog::FileTag, ReplayLog::Version, uint16(sizeof(ReplayFileHeader)), 0, 0, 0, 0 };
+  Emit(&header, sizeof(header));
+}
+
+// =====================================================================================================================
+inline bool ReplayWriter::Emit(
+  const void*  pData,
+  size_t       size)
+{
+  if (pFile_ != nullptr) {
+    ok_ = ok_ && (fwrite(pData, 1, size, pFile_) == size);
+  }
+  else {
+    buffer_.insert(buffer_.end(), static_cast<const uint8*>(pData), static_cast<const uint8*>(pData) + size);
+  }
+
+  offset_ += size;
+  return ok_;
+}
+
+// =====================================================================================================================
+inline bool ReplayWriter::Append(
+  const CommandPacket& packet)
+{
+  const bool result = isOpen_ && ok_ && (packet.dataLength <= CommandPacketDataSize) &&
+                      ((uint32(packet.type) & 0x7F) == uint32(packet.type)) &&
+                      ((numPackets_ == 0) || (packet.timeStamp >= lastTick_));
+
+  if (result) {
+    if (chunkHeader_.numPackets == 0) {
+      chunkHeader_.firstTick = packet.timeStamp;
+      lastTick_              = packet.timeStamp;
+      lastNetID_             = 0;
+    }
+
+    uint8  encoded[ReplayLog::MaxEncodedPacketSize];
+    uint8* p = &encoded[0];
+
+    const bool netIDChanged = (packet.netID != lastNetID_);
+    *(p++) = uint8(packet.type) | (netIDChanged ? 0x80 : 0);
+    p      = ReplayLog::WriteVarint(p, uint32(packet.timeStamp - lastTick_));
+    if (netIDChanged) {
+      p = ReplayLog::WriteVarint(p, ReplayLog::ZigZag(packet.netID));
+    }
+    p = ReplayLog::WriteVarint(p, packet.dataLength);
+    memcpy(p, &packet.data.buffer[0], packet.dataLength);
+    p += packet.dataLength;
+
+    chunk_.insert(chunk_.end(), &encoded[0], p);
+    lastTick_              = packet.timeStamp;
+    lastNetID_             = packet.netID;
+    chunkHeader_.lastTick  = packet.timeStamp;
+    ++chunkHeader_.numPackets;
+    ++numPackets_;
+
+    if (chunkHeader_.numPackets >= packetsPerChunk_) {
+      FlushChunk();
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool ReplayWriter::FlushChunk() {
+  if (chunkHeader_.numPackets != 0) {
+    index_.push_back({ chunkHeader_.firstTick, chunkHeader_.lastTick, offset_, numPackets_ - chunkHeader_.numPackets });
+
+    chunkHeader_.dataSize = uint32(chunk_.size());
+    Emit(&chunkHeader_, sizeof(chunkHeader_));
+    Emit(chunk_.data(), chunk_.size());
+
+    chunk_.clear();
+    chunkHeader_ = { };
+  }
+
+  return ok_;
+}
+
+// =====================================================================================================================
+inline bool ReplayWriter::Close() {
+  bool result = true;
+
+  if (isOpen_) {
+    FlushChunk();
+
+    const ReplayFileHeader header =
+      { ReplayLog::FileTag, ReplayLog::Version, uint16(sizeof(ReplayFileHeader)), uint32(index_.size()), 0,
+        numPackets_, offset_ };
+    Emit(index_.data(), sizeof(ReplayIndexEntry) * index_.size());
+
+    if (pFile_ != nullptr) {
+      ok_ = ok_ && (fseek(pFile_, 0, SEEK_SET) == 0) && (fwrite(&header, sizeof(header), 1, pFile_) == 1);
+      ok_ = (fclose(pFile_) == 0) && ok_;
+      pFile_ = nullptr;
+    }
+    else {
+      memcpy(buffer_.data(), &header, sizeof(header));
+    }
+
+    result  = ok_;
+    isOpen_ = false;
+    index_.clear();
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool ReplayReader::Open(
+  const char* pFilename)
+{
+  Close();
+  return file_.Open(pFilename) && OpenMemory(file_.Data(), file_.Size());
+}
+
+// =====================================================================================================================
+inline bool ReplayReader::OpenMemory(
+  const void*  pData,
+  size_t       size)
+{
+  Reset();
+  pData_ = static_cast<const uint8*>(pData);
+  size_  = size;
+
+  // A closed replay with no packets has an empty index;  it opens at the end of the log.
+  const bool result = ParseIndex() && (index_.empty() || SeekChunk(0));
+  if (result == false) {
+    Close();
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline void ReplayReader::Close() {
+  file_.Close();
+  Reset();
+}
+
+// =====================================================================================================================
+inline void ReplayReader::Reset() {
+  pData_      = nullptr;
+  size_       = 0;
+  numPackets_ = 0;
+  index_.clear();
+  chunk_      = 0;
+  p_          = nullptr;
+  pEnd_       = nullptr;
+  numLeft_    = 0;
+  lastTick_   = 0;
+  lastNetID_  = 0;
+  error_      = false;
+}
+
+// =====================================================================================================================
+inline bool ReplayReader::ParseIndex() {
+  ReplayFileHeader header = { };
+  bool result = (pData_ != nullptr) && (size_ >= sizeof(header));
+
+  if (result) {
+    memcpy(&header, pData_, sizeof(header));
+    result = (header.tag == ReplayLog::FileTag) && (header.version == ReplayLog::Version) &&
+             (header.headerSize >= sizeof(header)) && (header.headerSize <= size_);
+  }
+
+  if (result && (header.indexOffset != 0)) {
+    result = (header.indexOffset <= size_) &&
+             ((uint64(header.numChunks) * sizeof(ReplayIndexEntry)) <= (size_ - header.indexOffset));
+    if (result) {
+      index_.resize(header.numChunks);
+      if (index_.empty() == false) {
+        memcpy(index_.data(), pData_ + header.indexOffset, sizeof(ReplayIndexEntry) * index_.size());
+      }
+      numPackets_ = header.numPackets;
+    }
+  }
+  else if (result) {
+    // The recording was not closed;  rebuild the index from the chunk headers, ignoring a truncated last chunk.
+    uint64 numPackets = 0;
+    for (uint64 offset = header.headerSize; (size_ - offset) >= sizeof(ReplayChunkHeader);) {
+      ReplayChunkHeader chunk;
+      memcpy(&chunk, pData_ + offset, sizeof(chunk));
+      if (chunk.dataSize > (size_ - offset - sizeof(chunk))) {
+        break;
+      }
+      index_.push_back({ chunk.firstTick, chunk.lastTick, offset, numPackets });
+      numPackets += chunk.numPackets;
+      offset     += sizeof(chunk) + chunk.dataSize;
+    }
+    numPackets_ = numPackets;
+  }
+
+  for (size_t i = 0; result && (i < index_.size()); ++i) {
+    result = (index_[i].offset <= (size_ - sizeof(ReplayChunkHeader))) && (index_[i].firstTick <= index_[i].lastTick) &&
+             ((i == 0) || (index_[i - 1].lastTick <= index_[i].firstTick));
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool ReplayReader::SeekChunk(
+  size_t chunk)
+{
+  chunk_   = chunk;
+  p_       = nullptr;
+  pEnd_    = nullptr;
+  numLeft_ = 0;
+
+  const bool result = (chunk < index_.size());
+  if (result) {
+    ReplayChunkHeader header;
+    memcpy(&header, pData_ + index_[chunk].offset, sizeof(header));
+
+    const size_t dataOffset = size_t(index_[chunk].offset) + sizeof(header);
+    error_     = (header.dataSize > (size_ - dataOffset));
+    p_         = pData_ + dataOffset;
+    pEnd_      = error_ ? p_ : (p_ + header.dataSize);
+    numLeft_   = error_ ? 0  : header.numPackets;
+    lastTick_  = header.firstTick;
+    lastNetID_ = 0;
+  }
+
+  return result && (error_ == false);
+}
+
+// =====================================================================================================================
+inline bool ReplayReader::Seek(
+  int32 tick)
+{
+  // Find the first chunk that may hold tick.  Chunks are sorted, and only adjacent chunks can share a tick.
+  const auto it = std::lower_bound(index_.begin(), index_.end(), tick,
+                                   [](const ReplayIndexEntry& entry, int32 tick) { return entry.lastTick < tick; });
+  bool result = (it != index_.end()) && SeekChunk(size_t(it - index_.begin()));
+
+  // Skip earlier packets within the chunk.
+  while (result && (lastTick_ < tick)) {
+    const size_t      chunk     = chunk_;
+    const uint8*const p         = p_;
+    const uint32      numLeft   = numLeft_;
+    const int32       lastTick  = lastTick_;
+    const int32       lastNetID = lastNetID_;
+    CommandPacket     packet;
+    result = Next(&packet);
+
+    if (result && (packet.timeStamp >= tick)) {
+      // Rewind to this packet.  If Next() moved on to another chunk, this packet is that chunk's first.
+      if (chunk_ != chunk) {
+        SeekChunk(chunk_);
+      }
+      else {
+        p_         = p;
+        numLeft_   = numLeft;
+        lastTick_  = lastTick;
+        lastNetID_ = lastNetID;
+      }
+      break;
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool ReplayReader::Next(
+  CommandPacket* pPacket)
+{
+  while ((numLeft_ == 0) && (error_ == false) && SeekChunk(chunk_ + 1));
+
+  bool result = (numLeft_ != 0) && (error_ == false) && (p_ < pEnd_);
+
+  if (result) {
+    const uint8 flags = *(p_++);
+    uint32 tickDelta  = 0;
+    uint32 netID      = ReplayLog::ZigZag(lastNetID_);
+    uint32 dataLength = 0;
+
+    const uint8* p = ReplayLog::ReadVarint(p_, pEnd_, &tickDelta);
+    if ((p != nullptr) && (flags & 0x80)) {
+      p = ReplayLog::ReadVarint(p, pEnd_, &netID);
+    }
+    p = (p != nullptr) ? ReplayLog::ReadVarint(p, pEnd_, &dataLength) : nullptr;
+
+    result = (p != nullptr) && (dataLength <= CommandPacketDataSize) && (dataLength <= size_t(pEnd_ - p));
+    if (result) {
+      pPacket->type       = CommandType(flags & 0x7F);
+      pPacket->dataLength = uint16(dataLength);
+      pPacket->timeStamp  = lastTick_ + int32(tickDelta);
+      pPacket->netID      = ReplayLog::UnZigZag(netID);
+      memcpy(&pPacket->data.buffer[0], p, dataLength);
+
+      p_         = p + dataLength;
+      lastTick_  = pPacket->timeStamp;
+      lastNetID_ = pPacket->netID;
+      --numLeft_;
+    }
+
+    error_ = (result == false);
+  }
+
+  return result;
+}
+
+} // Tethys
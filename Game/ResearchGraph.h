@@ -0,0 +1,375 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+#include "Tethys/Common/Util.h"
+#include "Tethys/Resource/SheetReader.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace Tethys {
+
+/// Set of up to 256 tech numbers (Research::numTechs_ is at most 256).
+struct TechSet {
+  static constexpr size_t NumWords = 4;
+
+  bool Test(size_t techNum) const { return (techNum < 256) && ((words[techNum >> 6] >> (techNum & 63)) & 1); }
+  void Set(size_t techNum, bool on = true) {
+    if (techNum < 256) {
+      const uint64 bit = uint64(1) << (techNum & 63);
+      words[techNum >> 6] = on ? (words[techNum >> 6] | bit) : (words[techNum >> 6] & ~bit);
+    }
+  }
+
+  TechSet& operator|=(const TechSet& other)
+    { for (size_t i = 0; i < NumWords; ++i) { words[i] |= other.words[i]; }  return *this; }
+  TechSet& operator&=(const TechSet& other)
+    { for (size_t i = 0; i < NumWords; ++i) { words[i] &= other.words[i]; }  return *this; }
+  TechSet  operator| (const TechSet& other) const { TechSet out = *this;  return out |= other; }
+  TechSet  operator& (const TechSet& other) const { TechSet out = *this;  return out &= other; }
+  TechSet  operator~ () const { TechSet out = *this;  for (auto& word : out.words) { word = ~word; }  return out; }
+  bool     operator==(const TechSet& other) const
+    { return ((words[0] ^ other.words[0]) | (words[1] ^ other.words[1]) |
+              (words[2] ^ other.words[2]) | (words[3] ^ other.words[3])) == 0; }
+  bool     operator!=(const TechSet& other) const { return (*this == other) == false; }
+
+  /// Returns true if every tech in this set is also in other.
+  bool IsSubsetOf(const TechSet& other) const
+    { return ((words[0] & ~other.words[0]) | (words[1] & ~other.words[1]) |
+              (words[2] & ~other.words[2]) | (words[3] & ~other.words[3])) == 0; }
+
+  bool   Any()   const { return (words[0] | words[1] | words[2] | words[3]) != 0; }
+  size_t Count() const {
+    size_t count = 0;
+    for (uint64 word : words) {
+      count += TethysUtil::PopCount(uint32(word)) + TethysUtil::PopCount(uint32(word >> 32));
+    }
+    return count;
+  }
+
+  /// Calls fn(size_t techNum) for each tech in the set, in ascending order.
+  template <typename Fn>
+  void ForEach(Fn&& fn) const {
+    for (size_t i = 0; i < (NumWords * 2); ++i) {
+      uint32 mask = uint32(words[i >> 1] >> ((i & 1) * 32));
+      for (uint32 bit = 0; TethysUtil::GetNextBit(&bit, mask); mask &= (mask - 1)) {
+        fn((i * 32) + bit);
+      }
+    }
+  }
+
+  uint64 words[NumWords];
+};
+
+
+/// Precomputed research dependency graph, with 256-bit transitive closures for O(1) prerequisite and "can research"
+/// queries, and research cost queries for AI planning.
+///
+/// Techs are identified by tech number, i.e. their index in Research::ppTechInfos_ (sorted by tech ID), so TechSets
+/// line up with TechInfo::playerHasTechMask and ResearchState.  The graph is built once per techtree;  each player's
+/// researched techs are tracked in a TechSet, kept up to date with SyncPlayers() or OnResearchComplete().
+///
+/// @code
+///   ResearchGraph graph;
+///   graph.Build(*Research::GetInstance());
+///   graph.SyncPlayers(*Research::GetInstance());
+///   const int techNum = Research::GetInstance()->GetTechNum(targetID);
+///   const int cost    = graph.CostToResearch(player, techNum, isEden);  // All missing prerequisites + the tech.
+///   std::vector<int> path;
+///   graph.GetResearchPath(player, techNum, isEden, &path);              // In an order they can be researched in.
+/// @endcode
+class ResearchGraph {
+public:
+  static constexpr size_t MaxTechs   = 256;
+  static constexpr size_t NumPlayers = 8;  ///< Players tracked (bits of TechInfo::playerHasTechMask).
+
+  /// Cost and ID of one tech.
+  struct Tech {
+    int techID;
+    int cost[2];  ///< Plymouth, Eden.
+  };
+
+  /// Gets the number of techs.
+  size_t NumTechs() const { return techs_.size(); }
+
+  ///@{ Builds the graph.  Returns false if there are too many techs, a requirement can't be resolved, or there is a
+  ///   dependency cycle;  the graph is left empty in that case.
+  /// From a parsed techtree.  Techs are numbered by ascending tech ID, as the game does.
+  bool Build(const TechTreeReader& reader);
+  /// From the game's Research tables (or anything with the same numTechs_/ppTechInfos_ layout).
+  template <typename ResearchType>  bool Build(const ResearchType& research);
+  /// From a list of techs, where getTech(size_t techNum, Tech* pOut, std::vector<int>* pRequiredTechNums) fills in
+  /// each tech, and returns false on error.
+  template <typename Fn>  bool Build(size_t numTechs, Fn&& getTech);
+  ///@}
+
+  /// Finds a tech number by tech ID.  Returns -1 if there is none.
+  int GetTechNum(int techID) const;
+
+  const Tech& GetTech(size_t techNum) const { return techs_[techNum]; }
+
+  ///@{ Direct and transitive requirements and dependents of a tech (not including the tech itself).
+  const TechSet& GetRequirements(size_t techNum)  const { return requires_[techNum];   }
+  const TechSet& GetPrerequisites(size_t techNum) const { return closure_[techNum];    }
+  const TechSet& GetDependents(size_t techNum)    const { return dependents_[techNum]; }
+  ///@}
+
+  /// Gets tech numbers in an order where each comes after all of its requirements.
+  const std::vector<int>& GetTopologicalOrder() const { return order_; }
+
+  ///@{ Per-player researched techs.
+  const TechSet& GetPlayerTechs(int player) const { return has_[size_t(player) % NumPlayers]; }
+  void SetPlayerTechs(int player, const TechSet& techs) { has_[size_t(player) % NumPlayers] = techs; }
+  void OnResearchComplete(int player, int techNum) { has_[size_t(player) % NumPlayers].Set(size_t(techNum)); }
+  /// Reads every player's researched techs from TechInfo::playerHasTechMask.
+  template <typename ResearchType>  void SyncPlayers(const ResearchType& research);
+  ///@}
+
+  /// Returns true if the player has the tech.
+  bool HasTech(int player, int techNum) const { return GetPlayerTechs(player).Test(size_t(techNum)); }
+
+  /// Returns true if the player can research the tech now:  they don't have it, and have all of its requirements.
+  bool CanResearch(int player, int techNum) const {
+    const TechSet& has = GetPlayerTechs(player);
+    return (size_t(techNum) < techs_.size()) && (has.Test(size_t(techNum)) == false) &&
+           requires_[techNum].IsSubsetOf(has);
+  }
+
+  /// Gets the set of techs the player can research now.
+  TechSet GetResearchable(int player) const;
+
+  /// Gets the techs the player still needs to research to have the tech (including the tech itself).
+  TechSet GetMissing(int player, int techNum) const {
+    TechSet missing = { };
+    if (size_t(techNum) < techs_.size()) {
+      missing = closure_[techNum];
+      missing.Set(size_t(techNum));
+      missing &= ~GetPlayerTechs(player);
+    }
+    return missing;
+  }
+
+  /// Gets the total research cost for the player to get the tech, including all missing prerequisites.
+  int CostToResearch(int player, int techNum, bool isEden) const {
+    int cost = 0;
+    GetMissing(player, techNum).ForEach([this, isEden, &cost](size_t t) { cost += techs_[t].cost[isEden ? 1 : 0]; });
+    return cost;
+  }
+
+  /// Gets the techs the player still needs to research to have the tech, in an order they can be researched in.
+  /// Among techs that are researchable at the same point, cheaper ones come first.
+  void GetResearchPath(int player, int techNum, bool isEden, std::vector<int>* pPath) const;
+
+private:
+  /// Resolves closures and the topological order after techs_ and requires_ are filled in.
+  bool Finish();
+
+  /// Empties the graph, after a failed Build().
+  void Clear();
+
+  std::vector<Tech>    techs_;
+  std::vector<TechSet> requires_;
+  std::vector<TechSet> closure_;
+  std::vector<TechSet> dependents_;
+  std::vector<int>     order_;
+  TechSet              has_[NumPlayers] = { };
+};
+
+// =====================================================================================================================
+template <typename Fn>
+bool ResearchGraph::Build(
+  size_t  numTechs,
+  Fn&&    getTech)
+{
+  bool result = (numTechs <= MaxTechs);
+
+  if (result) {
+    techs_.assign(numTechs, Tech{ });
+    requires_.assign(numTechs, TechSet{ });
+  }
+
+  std::vector<int> required;
+  for (size_t i = 0; result && (i < numTechs); ++i) {
+    required.clear();
+    result = getTech(i, &techs_[i], &required);
+    for (size_t j = 0; result && (j < required.size()); ++j) {
+      result = (required[j] >= 0) && (size_t(required[j]) < numTechs);
+      if (result) {
+        requires_[i].Set(size_t(required[j]));
+      }
+    }
+  }
+
+  result = result && Finish();
+  if (result == false) {
+    Clear();
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool ResearchGraph::Build(
+  const TechTreeReader& reader)
+{
+  // Number techs by ascending tech ID.
+  std::vector<const TechRecord*> sorted;
+  sorted.reserve(reader.NumTechs());
+  for (const TechRecord& record : reader.GetTechs()) {
+    sorted.push_back(&record);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const TechRecord* a, const TechRecord* b) { return a->techID < b->techID; });
+
+  return Build(sorted.size(), [&sorted, &reader](size_t i, Tech* pTech, std::vector<int>* pRequired) {
+    const TechRecord& record = *sorted[i];
+    *pTech = { record.techID, { record.plymouthCost, record.edenCost } };
+
+    bool result = true;
+    for (int techID : reader.GetRequiredTechIDs(record)) {
+      const auto it = std::lower_bound(sorted.begin(), sorted.end(), techID,
+                                       [](const TechRecord* pRecord, int id) { return pRecord->techID < id; });
+      result &= (it != sorted.end()) && ((*it)->techID == techID);
+      pRequired->push_back(result ? int(it - sorted.begin()) : -1);
+    }
+    return result;
+  });
+}
+
+// =====================================================================================================================
+template <typename ResearchType>
+bool ResearchGraph::Build(
+  const ResearchType& research)
+{
+  const size_t numTechs = size_t((std::max)(research.numTechs_, 0));
+  return Build(numTechs, [&research](size_t i, Tech* pTech, std::vector<int>* pRequired) {
+    const auto& info = *research.ppTechInfos_[i];
+    *pTech = { info.techID, { info.plymouthCost, info.edenCost } };
+    pRequired->assign(info.pRequiredTechNum, info.pRequiredTechNum + (std::max)(info.numRequiredTechs, 0));
+    return true;
+  });
+}
+
+// =====================================================================================================================
+template <typename ResearchType>
+void ResearchGraph::SyncPlayers(
+  const ResearchType& research)
+{
+  for (auto& techs : has_) {
+    techs = { };
+  }
+
+  for (size_t i = 0; (i < techs_.size()) && (i < size_t((std::max)(research.numTechs_, 0))); ++i) {
+    const uint32 mask = research.ppTechInfos_[i]->playerHasTechMask;
+    for (size_t player = 0; player < NumPlayers; ++player) {
+      has_[player].Set(i, ((mask >> player) & 1) != 0);
+    }
+  }
+}
+
+// =====================================================================================================================
+inline bool ResearchGraph::Finish() {
+  const size_t numTechs = techs_.size();
+
+  // Kahn's algorithm;  closures are built in topological order, so each tech's requirements are complete first.
+  std::vector<int> numPending(numTechs);
+  order_.clear();
+  order_.reserve(numTechs);
+  for (size_t i = 0; i < numTechs; ++i) {
+    numPending[i] = int(requires_[i].Count());
+    if (numPending[i] == 0) {
+      order_.push_back(int(i));
+    }
+  }
+
+  dependents_.assign(numTechs, TechSet{ });
+  for (size_t i = 0; i < numTechs; ++i) {
+    requires_[i].ForEach([this, i](size_t r) { dependents_[r].Set(i); });
+  }
+
+  closure_.assign(numTechs, TechSet{ });
+  for (size_t head = 0; head < order_.size(); ++head) {
+    const size_t t = size_t(order_[head]);
+    requires_[t].ForEach([this, t](size_t r) { closure_[t].Set(r);  closure_[t] |= closure_[r]; });
+    dependents_[t].ForEach([this, &numPending](size_t d) {
+      if (--numPending[d] == 0) {
+        order_.push_back(int(d));
+      }
+    });
+  }
+
+  // Transitive dependents, in reverse topological order.
+  for (size_t i = order_.size(); i-- > 0;) {
+    const size_t t = size_t(order_[i]);
+    TechSet all = dependents_[t];
+    dependents_[t].ForEach([this, &all](size_t d) { all |= dependents_[d]; });
+    dependents_[t] = all;
+  }
+
+  return (order_.size() == numTechs);  // Otherwise, there is a cycle.
+}
+
+// =====================================================================================================================
+inline void ResearchGraph::Clear() {
+  techs_.clear();
+  requires_.clear();
+  closure_.clear();
+  dependents_.clear();
+  order_.clear();
+
+  for (auto& techs : has_) {
+    techs = { };
+  }
+}
+
+// =====================================================================================================================
+inline int ResearchGraph::GetTechNum(
+  int techID
+  ) const
+{
+  const auto it = std::lower_bound(techs_.begin(), techs_.end(), techID,
+                                   [](const Tech& tech, int id) { return tech.techID < id; });
+  return ((it != techs_.end()) && (it->techID == techID)) ? int(it - techs_.begin()) : -1;
+}
+
+// =====================================================================================================================
+inline TechSet ResearchGraph::GetResearchable(
+  int player
+  ) const
+{
+  TechSet result = { };
+  for (size_t i = 0; i < techs_.size(); ++i) {
+    result.Set(i, CanResearch(player, int(i)));
+  }
+  return result;
+}
+
+// =====================================================================================================================
+inline void ResearchGraph::GetResearchPath(
+  int                player,
+  int                techNum,
+  bool               isEden,
+  std::vector<int>*  pPath
+  ) const
+{
+  pPath->clear();
+
+  // Repeatedly take the cheapest missing tech whose requirements are all met.
+  TechSet       missing = GetMissing(player, techNum);
+  TechSet       has     = GetPlayerTechs(player);
+  const size_t  side    = isEden ? 1 : 0;
+  while (missing.Any()) {
+    int best = -1;
+    missing.ForEach([&](size_t t) {
+      if (requires_[t].IsSubsetOf(has) && ((best == -1) || (techs_[t].cost[side] < techs_[best].cost[side]))) {
+        best = int(t);
+      }
+    });
+
+    pPath->push_back(best);
+    missing.Set(size_t(best), false);
+    has.Set(size_t(best));
+  }
+}
+
+} // Tethys
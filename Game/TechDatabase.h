@@ -0,0 +1,417 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+#include "Tethys/Common/Util.h"
+#include "Tethys/Common/FileMapping.h"
+#include "Tethys/Resource/SheetReader.h"
+#include "Tethys/Game/ResearchGraph.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+namespace Tethys {
+
+BEGIN_PACKED
+
+/// Compiled techtree database file header.
+///
+/// The file holds the techs of one techtree sorted by tech ID (i.e. in tech number order), followed by flat arrays that
+/// the TechInfo pointers can point directly into:
+///   TechDbEntry[numTechs]        at techsOffset
+///   int32[numRequired]           at requiredOffset    Required tech numbers, ascending within each tech.
+///   int32[numDependents]         at dependentsOffset  Dependent tech numbers, ascending within each tech.
+///   TechDbUpgrade[numUpgrades]   at upgradesOffset
+///   char[stringsSize]            at stringsOffset     Null-terminated strings.
+/// All offsets are from the start of the file, and every section is 4-byte aligned.
+struct TechDbHeader {
+  uint32 tag;            ///< TechDb::FileTag
+  uint16 version;        ///< TechDb::Version
+  uint16 headerSize;     ///< sizeof(TechDbHeader)
+  uint32 fileSize;
+  uint32 checksum;       ///< FNV-1a hash of everything after the header.
+  uint32 numProperties;  ///< Number of upgrade properties the database was compiled against.
+  uint32 numTechs;
+  uint32 techsOffset;
+  uint32 numRequired;
+  uint32 requiredOffset;
+  uint32 numDependents;
+  uint32 dependentsOffset;
+  uint32 numUpgrades;
+  uint32 upgradesOffset;
+  uint32 stringsSize;
+  uint32 stringsOffset;
+  uint32 reserved;
+};
+static_assert(sizeof(TechDbHeader) == 64, "Incorrect TechDbHeader size.");
+
+/// Compiled tech.  Strings are offsets into the string section;  arrays are index ranges into the other sections.
+struct TechDbEntry {
+  int32  techID;
+  int32  category;
+  int32  techLevel;
+  int32  plymouthCost;
+  int32  edenCost;
+  int32  maxScientists;
+  int32  lab;
+  uint32 name;
+  uint32 description;
+  uint32 teaser;
+  uint32 improveDesc;
+  uint32 firstRequired;
+  uint32 numRequired;
+  uint32 firstDependent;
+  uint32 numDependents;
+  uint32 firstUpgrade;
+  uint32 numUpgrades;
+};
+static_assert(sizeof(TechDbEntry) == 68, "Incorrect TechDbEntry size.");
+
+/// Compiled tech upgrade.
+struct TechDbUpgrade {
+  uint32 property;  ///< Index into the upgrade property table (Research::TechPropertiesTable()).
+  int32  unitType;  ///< MapID for UNIT_PROP, otherwise 0.
+  int32  newValue;
+};
+static_assert(sizeof(TechDbUpgrade) == 12, "Incorrect TechDbUpgrade size.");
+
+END_PACKED
+
+
+/// Shared definitions for TechDbCompiler and TechDatabase.
+namespace TechDb {
+constexpr uint32 FileTag = 0x42445432;  ///< '2TDB'
+constexpr uint16 Version = 1;
+
+/// Name of an upgrade property (see TechProperty), which UNIT_PROP/PLAYER_PROP/FUNCTION_RESULT lines are resolved
+/// against.  type is the TechUpgradeType.
+struct PropertyName {
+  int              type;
+  std::string_view name;
+};
+
+/// Gets the TechUpgradeType of an upgrade keyword, or -1 if it isn't one.
+inline int GetUpgradeType(std::string_view keyword) {
+  return (keyword == "UNIT_PROP")       ? 0 :
+         (keyword == "PLAYER_PROP")     ? 1 :
+         (keyword == "FUNCTION_RESULT") ? 2 : -1;
+}
+} // TechDb
+
+
+/// Compiles techtree text into a TechDatabase file, and validates it on the way.
+///
+/// Upgrade lines are resolved to indices into a property name table, which in game is built from
+/// Research::TechPropertiesTable() (see TechInfoTable::GetPropertyNames()), and UNIT_PROP unit type codes are resolved
+/// with a callback (see TechInfoTable::ResolveUnitCode()).  The last argument of an upgrade line is its new value, the
+/// one before is the property name, and UNIT_PROP takes the unit type code first.
+///
+/// @code
+///   TechTreeReader reader;
+///   TechDbCompiler compiler;
+///   if ((reader.Open("multitek.txt") == false) ||
+///       (compiler.Compile(reader, propertyNames, resolveUnitCode) == false) ||
+///       (compiler.Save("multitek.tdb") == false))
+///   {
+///     printf("%s\n", (reader.GetError().empty() ? compiler.GetError() : reader.GetError()).c_str());
+///   }
+/// @endcode
+class TechDbCompiler {
+public:
+  /// Compiles a parsed techtree.  resolveUnit(std::string_view code) -> int returns the MapID for a unit type code, or
+  /// -1 if there is none.  Returns false on the first error, reported by GetError().
+  template <typename Fn>
+  bool Compile(const TechTreeReader& reader, const std::vector<TechDb::PropertyName>& properties, Fn&& resolveUnit);
+
+  /// Writes the compiled database to a file.
+  bool Save(const char* pFilename) const;
+
+  const std::vector<uint8>& GetBuffer() const { return buffer_; }
+  const std::string&        GetError()  const { return error_;  }
+
+private:
+  bool Fail(uint32 line, const char* pMessage, std::string_view token = std::string_view());
+
+  std::vector<uint8> buffer_;
+  std::string        error_;
+};
+
+// =====================================================================================================================
+inline bool TechDbCompiler::Fail(
+  uint32            line,
+  const char*       pMessage,
+  std::string_view  token)
+{
+  error_ = "Line " + std::to_string(line) + ": " + pMessage;
+  if (token.empty() == false) {
+    error_.append(" '").append(token.data(), token.size()).append("'");
+  }
+  buffer_.clear();
+  return false;
+}
+
+// =====================================================================================================================
+template <typename Fn>
+bool TechDbCompiler::Compile(
+  const TechTreeReader&                     reader,
+  const std::vector<TechDb::PropertyName>&  properties,
+  Fn&&                                      resolveUnit)
+{
+  buffer_.clear();
+  error_.clear();
+
+  // Validates requirements (unresolved IDs, cycles, > 256 techs), and gives tech numbers and dependents.
+  ResearchGraph graph;
+  if (graph.Build(reader) == false) {
+    // Find the first unresolved requirement for a more helpful message.
+    for (const TechRecord& tech : reader.GetTechs()) {
+      for (int techID : reader.GetRequiredTechIDs(tech)) {
+        if (reader.FindTech(techID) == nullptr) {
+          return Fail(tech.line, ("Unknown tech ID " + std::to_string(techID) + " required by").c_str(), tech.name);
+        }
+      }
+    }
+    return Fail(0, (reader.NumTechs() > ResearchGraph::MaxTechs) ? "Too many techs" : "Dependency cycle in techtree");
+  }
+
+  const size_t               numTechs = graph.NumTechs();
+  std::vector<TechDbEntry>   techs(numTechs);
+  std::vector<int32>         required;
+  std::vector<int32>         dependents;
+  std::vector<TechDbUpgrade> upgrades;
+  std::string                strings(1, '\0');  // Offset 0 is the empty string.
+
+  const auto AddString = [&strings](std::string_view text) {
+    const uint32 offset = text.empty() ? 0 : uint32(strings.size());
+    if (text.empty() == false) {
+      strings.append(text.data(), text.size()).push_back('\0');
+    }
+    return offset;
+  };
+
+  for (size_t t = 0; t < numTechs; ++t) {
+    const TechRecord& src = *reader.FindTech(graph.GetTech(t).techID);
+    TechDbEntry&      dst = techs[t];
+
+    dst.techID        = src.techID;
+    dst.category      = src.category;
+    dst.techLevel     = src.TechLevel();
+    dst.plymouthCost  = src.plymouthCost;
+    dst.edenCost      = src.edenCost;
+    dst.maxScientists = src.maxScientists;
+    dst.lab           = src.lab;
+    dst.name          = AddString(src.name);
+    dst.description   = AddString(src.description);
+    dst.teaser        = AddString(src.teaser);
+    dst.improveDesc   = AddString(src.improveDesc);
+
+    dst.firstRequired = uint32(required.size());
+    graph.GetRequirements(t).ForEach([&required](size_t r) { required.push_back(int32(r)); });
+    dst.numRequired   = uint32(required.size()) - dst.firstRequired;
+
+    dst.firstDependent = uint32(dependents.size());
+    for (size_t d = 0; d < numTechs; ++d) {
+      if (graph.GetRequirements(d).Test(t)) {
+        dependents.push_back(int32(d));
+      }
+    }
+    dst.numDependents  = uint32(dependents.size()) - dst.firstDependent;
+
+    dst.firstUpgrade = uint32(upgrades.size());
+    for (const TechUpgradeRecord& upgrade : reader.GetUpgrades(src)) {
+      const int              type     = TechDb::GetUpgradeType(upgrade.type);
+      const uint32           numArgs  = upgrade.numArgs;
+      const std::string_view propName = upgrade.args[(numArgs >= 2) ? (numArgs - 2) : 0];
+
+      TechDbUpgrade out = { };
+      if ((numArgs >= 2) && (SheetScan::ParseInt(upgrade.args[numArgs - 1], &out.newValue) == false)) {
+        return Fail(upgrade.line, "Expected an integer value, found", upgrade.args[numArgs - 1]);
+      }
+      if ((type == 0) && (numArgs != 3)) {
+        return Fail(upgrade.line, "Expected UNIT_PROP unitType property value, found", upgrade.type);
+      }
+      if ((type == 0) && ((out.unitType = resolveUnit(upgrade.args[0])) < 0)) {
+        return Fail(upgrade.line, "Unknown unit type", upgrade.args[0]);
+      }
+
+      const auto it = std::find_if(properties.begin(), properties.end(), [type, propName](const TechDb::PropertyName& p)
+        { return (p.type == type) && (p.name == propName); });
+      if (it == properties.end()) {
+        return Fail(upgrade.line, "Unknown upgrade property", propName);
+      }
+
+      out.property = uint32(it - properties.begin());
+      upgrades.push_back(out);
+    }
+    dst.numUpgrades = uint32(upgrades.size()) - dst.firstUpgrade;
+  }
+
+  // Lay out the file.
+  const auto Align = [](size_t offset) { return uint32((offset + 3) & ~size_t(3)); };
+
+  TechDbHeader header     = { };
+  header.tag              = TechDb::FileTag;
+  header.version          = TechDb::Version;
+  header.headerSize       = uint16(sizeof(TechDbHeader));
+  header.numProperties    = uint32(properties.size());
+  header.numTechs         = uint32(numTechs);
+  header.techsOffset      = uint32(sizeof(TechDbHeader));
+  header.numRequired      = uint32(required.size());
+  header.requiredOffset   = Align(header.techsOffset      + (techs.size()      * sizeof(TechDbEntry)));
+  header.numDependents    = uint32(dependents.size());
+  header.dependentsOffset = Align(header.requiredOffset   + (required.size()   * sizeof(int32)));
+  header.numUpgrades      = uint32(upgrades.size());
+  header.upgradesOffset   = Align(header.dependentsOffset + (dependents.size() * sizeof(int32)));
+  header.stringsSize      = uint32(strings.size());
+  header.stringsOffset    = Align(header.upgradesOffset   + (upgrades.size()   * sizeof(TechDbUpgrade)));
+  header.fileSize         = Align(header.stringsOffset    + strings.size());
+
+  buffer_.assign(header.fileSize, 0);
+  const auto Put = [this](uint32 offset, const void* pData, size_t size)
+    { if (size != 0) { memcpy(&buffer_[offset], pData, size); } };
+  Put(header.techsOffset,      techs.data(),      techs.size()      * sizeof(TechDbEntry));
+  Put(header.requiredOffset,   required.data(),   required.size()   * sizeof(int32));
+  Put(header.dependentsOffset, dependents.data(), dependents.size() * sizeof(int32));
+  Put(header.upgradesOffset,   upgrades.data(),   upgrades.size()   * sizeof(TechDbUpgrade));
+  Put(header.stringsOffset,    strings.data(),    strings.size());
+
+  header.checksum = TethysUtil::Fnv1a<uint32>(&buffer_[sizeof(header)], buffer_.size() - sizeof(header));
+  Put(0, &header, sizeof(header));
+
+  return true;
+}
+
+// =====================================================================================================================
+inline bool TechDbCompiler::Save(
+  const char* pFilename
+  ) const
+{
+  FILE*const pFile  = buffer_.empty() ? nullptr : fopen(pFilename, "wb");
+  bool       result = (pFile != nullptr) && (fwrite(buffer_.data(), 1, buffer_.size(), pFile) == buffer_.size());
+  if (pFile != nullptr) {
+    result = (fclose(pFile) == 0) && result;
+  }
+  return result;
+}
+
+
+/// Read-only view of a compiled techtree database, memory mapped from a file written by TechDbCompiler.
+///
+/// Open() validates the header, section bounds, checksum, and every index once;  after that, all accessors are
+/// direct array lookups into the mapping.  See TechInfoTable for building the game's TechInfo structs from it.
+class TechDatabase {
+public:
+  /// Maps and validates a database file.
+  bool Open(const char* pFilename);
+
+  /// Validates a database in memory, which must outlive this object and be 4-byte aligned.
+  bool OpenMemory(const void* pData, size_t size);
+
+  void Close() { file_.Close();  pHeader_ = nullptr; }
+
+  bool IsOpen() const { return pHeader_ != nullptr; }
+
+  const TechDbHeader& GetHeader() const { return *pHeader_;                  }
+  size_t              NumTechs()  const { return pHeader_->numTechs;         }
+
+  /// Gets the number of techs with tech IDs up to maxTechID (techs are sorted by ID).
+  size_t NumTechs(int maxTechID) const {
+    const TechDbEntry*const pTechs = Section<TechDbEntry>(pHeader_->techsOffset);
+    return size_t(std::upper_bound(pTechs, pTechs + NumTechs(), maxTechID,
+                                   [](int id, const TechDbEntry& tech) { return id < tech.techID; }) - pTechs);
+  }
+
+  const TechDbEntry&   GetTech(size_t techNum) const { return Section<TechDbEntry>(pHeader_->techsOffset)[techNum]; }
+  const int32*         GetRequired(const TechDbEntry& tech) const
+    { return Section<int32>(pHeader_->requiredOffset) + tech.firstRequired; }
+  const int32*         GetDependents(const TechDbEntry& tech) const
+    { return Section<int32>(pHeader_->dependentsOffset) + tech.firstDependent; }
+  const TechDbUpgrade* GetUpgrades(const TechDbEntry& tech) const
+    { return Section<TechDbUpgrade>(pHeader_->upgradesOffset) + tech.firstUpgrade; }
+  const char*          GetString(uint32 offset) const
+    { return Section<char>(pHeader_->stringsOffset) + offset; }
+
+  /// Finds a tech number by tech ID.  Returns -1 if there is none.
+  int GetTechNum(int techID) const {
+    const TechDbEntry*const pTechs = Section<TechDbEntry>(pHeader_->techsOffset);
+    const TechDbEntry*const pTech  = std::lower_bound(pTechs, pTechs + NumTechs(), techID,
+                                                     [](const TechDbEntry& tech, int id) { return tech.techID < id; });
+    return ((pTech != (pTechs + NumTechs())) && (pTech->techID == techID)) ? int(pTech - pTechs) : -1;
+  }
+
+private:
+  template <typename T>  const T* Section(uint32 offset) const
+    { return reinterpret_cast<const T*>(reinterpret_cast<const uint8*>(pHeader_) + offset); }
+
+  FileMapping         file_;
+  const TechDbHeader* pHeader_ = nullptr;
+};
+
+// =====================================================================================================================
+inline bool TechDatabase::Open(
+  const char* pFilename)
+{
+  Close();
+  const bool result = file_.Open(pFilename) && OpenMemory(file_.Data(), file_.Size());
+  if (result == false) {
+    Close();
+  }
+  return result;
+}
+
+// =====================================================================================================================
+inline bool TechDatabase::OpenMemory(
+  const void*  pData,
+  size_t       size)
+{
+  pHeader_ = nullptr;
+
+  const auto& header = *static_cast<const TechDbHeader*>(pData);
+  const auto  Fits   = [size](uint32 offset, uint64 count, size_t elementSize)
+    { return ((offset & 3) == 0) && ((offset + (count * elementSize)) <= size); };
+
+  bool result = (pData != nullptr) && ((reinterpret_cast<uintptr>(pData) & 3) == 0) && (size >= sizeof(TechDbHeader)) &&
+                (header.tag == TechDb::FileTag) && (header.version == TechDb::Version) &&
+                (header.headerSize == sizeof(TechDbHeader)) && (header.fileSize == size) &&
+                (header.numTechs <= ResearchGraph::MaxTechs) &&
+                Fits(header.techsOffset,      header.numTechs,      sizeof(TechDbEntry))   &&
+                Fits(header.requiredOffset,   header.numRequired,   sizeof(int32))         &&
+                Fits(header.dependentsOffset, header.numDependents, sizeof(int32))         &&
+                Fits(header.upgradesOffset,   header.numUpgrades,   sizeof(TechDbUpgrade)) &&
+                Fits(header.stringsOffset,    header.stringsSize,   1) && (header.stringsSize != 0) &&
+                (static_cast<const char*>(pData)[header.stringsOffset + header.stringsSize - 1] == '\0') &&
+                (header.checksum ==
+                 TethysUtil::Fnv1a<uint32>(static_cast<const uint8*>(pData) + sizeof(TechDbHeader),
+                                           size - sizeof(TechDbHeader)));
+
+  if (result) {
+    // Check every index once, so accessors and TechInfoTable don't need to.
+    pHeader_ = &header;
+    for (size_t t = 0; result && (t < header.numTechs); ++t) {
+      const TechDbEntry& tech = GetTech(t);
+      result = ((t == 0) || (GetTech(t - 1).techID < tech.techID)) &&
+               (uint64(tech.firstRequired)  + tech.numRequired   <= header.numRequired)   &&
+               (uint64(tech.firstDependent) + tech.numDependents <= header.numDependents) &&
+               (uint64(tech.firstUpgrade)   + tech.numUpgrades   <= header.numUpgrades)   &&
+               (tech.name < header.stringsSize) && (tech.description < header.stringsSize) &&
+               (tech.teaser < header.stringsSize) && (tech.improveDesc < header.stringsSize);
+    }
+
+    const int32* pRequired = Section<int32>(header.requiredOffset);
+    for (size_t i = 0; result && (i < header.numRequired); result = (uint32(pRequired[i++]) < header.numTechs));
+    const int32* pDependents = Section<int32>(header.dependentsOffset);
+    for (size_t i = 0; result && (i < header.numDependents); result = (uint32(pDependents[i++]) < header.numTechs));
+    const TechDbUpgrade* pUpgrades = Section<TechDbUpgrade>(header.upgradesOffset);
+    for (size_t i = 0; result && (i < header.numUpgrades); result = (pUpgrades[i++].property < header.numProperties));
+
+    if (result == false) {
+      pHeader_ = nullptr;
+    }
+  }
+
+  return result;
+}
+
+} // Tethys
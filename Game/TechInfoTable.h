@@ -0,0 +1,194 @@
+#pragma once
+
+#include "Tethys/Game/Research.h"
+#include "Tethys/Game/MapObjectType.h"
+#include "Tethys/Game/TechDatabase.h"
+
+#include <vector>
+
+namespace Tethys {
+
+/// Builds the game's TechInfo structs from a compiled TechDatabase, as a faster replacement for
+/// Research::LoadTechFile() at mission start.
+///
+/// No fields are parsed:  each TechInfo is copied from its TechDbEntry, and its string and tech number array pointers
+/// are pointed directly into the database mapping, which must stay open while the table is in use.  Only the upgrade
+/// array is built, to point TechUpgradeInfo::pType at Research::TechPropertiesTable().  Techs above the mission's max
+/// tech level are dropped, as LoadTechFile() does.
+///
+/// Install() swaps the table into Research;  Uninstall() must be called to restore the previous tables before
+/// Research::Deinit() or the table is destroyed, as the game does not own this memory.
+///
+/// @code
+///   TechDatabase  database;
+///   TechInfoTable table;
+///   if (database.Open("multitek.tdb") && table.Load(database, maxTechLevel)) {
+///     table.Install(Research::GetInstance());
+///   }
+/// @endcode
+class TechInfoTable {
+public:
+   TechInfoTable() = default;
+  ~TechInfoTable() { Uninstall(); }
+
+  TechInfoTable(const TechInfoTable&)            = delete;
+  TechInfoTable& operator=(const TechInfoTable&) = delete;
+
+  /// Builds TechInfos for the database's techs up to maxTechLevel.  Returns false if the database was compiled against
+  /// a different upgrade property table.
+  bool Load(const TechDatabase& database, int maxTechLevel = 12);
+
+  ///@{ Swaps the table into a Research object, or restores its previous tables.
+  bool Install(Research* pResearch);
+  void Uninstall();
+  ///@}
+
+  size_t     NumTechs()     const { return pointers_.size();                                 }
+  TechInfo** GetTechInfos()       { return pointers_.empty() ? nullptr : pointers_.data();  }
+
+  /// Gets the upgrade property names to compile techtrees against, from Research::TechPropertiesTable().
+  static std::vector<TechDb::PropertyName> GetPropertyNames();
+
+  /// Resolves a unit type code name (MapObjectType::GetCodeName()) to a MapID.  Returns -1 if there is none.
+  static int ResolveUnitCode(std::string_view code);
+
+private:
+  std::vector<TechInfo>        techs_;
+  std::vector<TechInfo*>       pointers_;
+  std::vector<TechUpgradeInfo> upgrades_;
+  int                          maxTechID_ = 0;
+
+  Research*  pInstalled_      = nullptr;
+  int        prevNumTechs_    = 0;
+  TechInfo** ppPrevTechInfos_ = nullptr;
+  int        prevMaxTechID_   = 0;
+};
+
+// =====================================================================================================================
+inline bool TechInfoTable::Load(
+  const TechDatabase&  database,
+  int                  maxTechLevel)
+{
+  Uninstall();
+  techs_.clear();
+  pointers_.clear();
+  upgrades_.clear();
+
+  TechProperty*const pProperties = Research::TechPropertiesTable();
+  const bool         result      = database.IsOpen() &&
+                                   (database.GetHeader().numProperties == Research::NumTechProperties());
+
+  if (result) {
+    maxTechID_ = (maxTechLevel * 1000) + 999;
+
+    // Techs are sorted by ID, so the techs within the tech level are a prefix, as are their tech numbers in each
+    // (ascending) required/dependent list.
+    const size_t numTechs  = database.NumTechs(maxTechID_);
+    const auto   CountKept = [numTechs](const int32* pList, uint32 count)
+      { return int(std::lower_bound(pList, pList + count, int32(numTechs)) - pList); };
+
+    size_t numUpgrades = 0;
+    for (size_t t = 0; t < numTechs; numUpgrades += database.GetTech(t++).numUpgrades);
+
+    techs_.resize(numTechs);
+    pointers_.resize(numTechs);
+    upgrades_.resize(numUpgrades);
+
+    TechUpgradeInfo* pUpgrade = upgrades_.data();
+    for (size_t t = 0; t < numTechs; ++t) {
+      const TechDbEntry& src = database.GetTech(t);
+      TechInfo&          dst = techs_[t];
+
+      dst.techID                 = src.techID;
+      dst.category               = TechCategory(src.category);
+      dst.techLevel              = src.techLevel;
+      dst.plymouthCost           = src.plymouthCost;
+      dst.edenCost               = src.edenCost;
+      dst.maxScientists          = src.maxScientists;
+      dst.lab                    = TechLabType(src.lab);
+      dst.playerHasTechMask.mask = 0;
+      dst.numUpgrades            = int(src.numUpgrades);
+      dst.pTechName              = const_cast<char*>(database.GetString(src.name));
+      dst.pDescription           = const_cast<char*>(database.GetString(src.description));
+      dst.pTeaser                = const_cast<char*>(database.GetString(src.teaser));
+      dst.pImproveDesc           = const_cast<char*>(database.GetString(src.improveDesc));
+      dst.pRequiredTechNum       = const_cast<int*>(reinterpret_cast<const int*>(database.GetRequired(src)));
+      dst.numRequiredTechs       = CountKept(database.GetRequired(src),   src.numRequired);
+      dst.pDependentTechNums     = const_cast<int*>(reinterpret_cast<const int*>(database.GetDependents(src)));
+      dst.numDependentTechs      = CountKept(database.GetDependents(src), src.numDependents);
+      dst.pUpgrades              = (src.numUpgrades != 0) ? pUpgrade : nullptr;
+
+      const TechDbUpgrade*const pSrcUpgrades = database.GetUpgrades(src);
+      for (uint32 i = 0; i < src.numUpgrades; ++i, ++pUpgrade) {
+        pUpgrade->pType    = &pProperties[pSrcUpgrades[i].property];
+        pUpgrade->unitType = MapID(pSrcUpgrades[i].unitType);
+        pUpgrade->newValue = pSrcUpgrades[i].newValue;
+      }
+
+      pointers_[t] = &dst;
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool TechInfoTable::Install(
+  Research* pResearch)
+{
+  Uninstall();
+
+  const bool result = (pResearch != nullptr) && (pointers_.empty() == false);
+  if (result) {
+    pInstalled_      = pResearch;
+    prevNumTechs_    = pResearch->numTechs_;
+    ppPrevTechInfos_ = pResearch->ppTechInfos_;
+    prevMaxTechID_   = pResearch->maxTechID_;
+
+    pResearch->numTechs_    = int(pointers_.size());
+    pResearch->ppTechInfos_ = pointers_.data();
+    pResearch->maxTechID_   = maxTechID_;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline void TechInfoTable::Uninstall() {
+  if (pInstalled_ != nullptr) {
+    pInstalled_->numTechs_    = prevNumTechs_;
+    pInstalled_->ppTechInfos_ = ppPrevTechInfos_;
+    pInstalled_->maxTechID_   = prevMaxTechID_;
+    pInstalled_ = nullptr;
+  }
+}
+
+// =====================================================================================================================
+inline std::vector<TechDb::PropertyName> TechInfoTable::GetPropertyNames() {
+  const TechProperty*const pProperties = Research::TechPropertiesTable();
+
+  std::vector<TechDb::PropertyName> names(Research::NumTechProperties());
+  for (size_t i = 0; i < names.size(); ++i) {
+    const char*const pName = pProperties[i].pUpgradeType;
+    names[i] = { int(pProperties[i].type), (pName != nullptr) ? pName : "" };
+  }
+
+  return names;
+}
+
+// =====================================================================================================================
+inline int TechInfoTable::ResolveUnitCode(
+  std::string_view code)
+{
+  int result = -1;
+  for (int mapID = 1; (result == -1) && (mapID <= int(MapID::MaxObject)); ++mapID) {
+    MapObjectType*const pType = MapObjectType::GetInstance(mapID);
+    const char*const    pName = (pType != nullptr) ? pType->GetCodeName() : nullptr;
+    if ((pName != nullptr) && (code == pName)) {
+      result = mapID;
+    }
+  }
+  return result;
+}
+
+} // Tethys
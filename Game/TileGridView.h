@@ -0,0 +1,258 @@
+#pragma once
+
+#include "Tethys/Game/MapImpl.h"
+#include "Tethys/API/Location.h"
+#include "Tethys/Common/Util.h"
+#include <algorithm>
+#include <utility>
+
+namespace Tethys {
+
+/// Native accessor over a swizzled tile array (@see MapImpl::pTileArray_), for passes that read or write many tiles.
+///
+/// The tile array is laid out in 32-tile-wide column chunks:  each chunk stores (1 << log2TileHeight) rows of 32
+/// contiguous tiles, and chunks are stored one after another.  MapImpl::Tile() recomputes that swizzle for every tile;
+/// the span and rect functions here compute it once per row span instead, so inner loops are plain pointer walks.
+///
+/// Rect functions visit tiles in memory order, i.e. column chunk by column chunk, then top to bottom within each chunk.
+/// Rects are clipped to the map.  On maps that wrap around horizontally, rects with x2 < x1 wrap around the map edge.
+///
+/// The view only needs a TileData pointer and the map dimensions, so it can also be used on tile arrays that are not
+/// owned by the game (e.g. loaded from a map file).
+///
+/// @note  The tile width must be a power of 2, as is the case for all real maps.
+class TileGridView {
+public:
+  static constexpr int Log2ChunkWidth = 5;
+  static constexpr int ChunkWidth     = 1 << Log2ChunkWidth;  ///< Width in tiles of a column chunk.
+
+  /// Per-flag tile counts returned by CountFlags().
+  struct FlagCounts {
+    size_t lava;
+    size_t microbe;
+    size_t wallOrBuilding;
+  };
+
+  TileGridView() = default;
+  TileGridView(TileData* pTileArray, int tileWidth, int tileHeight, bool wrapX = false)
+    : pTiles_(pTileArray), tileWidth_(tileWidth), tileHeight_(tileHeight), log2TileHeight_(0), wrapX_(wrapX)
+    { for (; (1 << log2TileHeight_) < tileHeight; ++log2TileHeight_); }
+  /// Creates a view of the given map's tile array.  World maps (no padding) wrap around horizontally.
+  explicit TileGridView(const MapImpl& map)
+    : pTiles_(map.pTileArray_), tileWidth_(map.tileWidth_), tileHeight_(map.tileHeight_),
+      log2TileHeight_(map.log2TileHeight_), wrapX_(map.paddingOffsetTileX_ == 0) { }
+
+  TileData* Data()            const { return pTiles_;                                            }
+  int       Width()           const { return tileWidth_;                                         }
+  int       Height()          const { return tileHeight_;                                        }
+  int       NumChunks()       const { return (tileWidth_ + ChunkWidth - 1) >> Log2ChunkWidth;    }
+  bool      WrapsX()          const { return wrapX_;                                             }
+  bool      IsInitialized()   const { return (pTiles_ != nullptr);                               }
+  /// Number of tiles between a chunk's first row and the next chunk's first row.
+  size_t    ChunkStride()     const { return size_t(1) << (log2TileHeight_ + Log2ChunkWidth);    }
+
+  /// Gets the offset of a tile in the tile array, equivalent to MapImpl::GetTileArrayOffset().
+  size_t GetOffset(int x, int y) const {
+    x &= (tileWidth_ - 1);
+    return (size_t(x >> Log2ChunkWidth) << (log2TileHeight_ + Log2ChunkWidth)) + (size_t(y) << Log2ChunkWidth) +
+           (x & (ChunkWidth - 1));
+  }
+
+  ///@{ Gets the tile data at the given location for read/write access.
+  TileData& Tile(int x, int y)          const { return pTiles_[GetOffset(x, y)]; }
+  TileData& Tile(const Location& where) const { return Tile(where.x, where.y);    }
+  ///@}
+
+  /// Gets the first row of a column chunk.  Row y of the chunk starts at (GetChunk(chunk) + (y * ChunkWidth)).
+  TileData* GetChunk(int chunk) const { return pTiles_ + (size_t(chunk) * ChunkStride()); }
+
+  /// Gets the contiguous run of tiles from (x, y) to the end of its column chunk (or the right edge of the map).
+  TileData* GetRowSpan(int x, int y, int* pLength) const {
+    x &= (tileWidth_ - 1);
+    *pLength = (std::min)(ChunkWidth - (x & (ChunkWidth - 1)), tileWidth_ - x);
+    return pTiles_ + GetOffset(x, y);
+  }
+
+  /// Clips a rect to the map.  On wrapping maps, x1 is normalized into the map and x2 is unwrapped so that x2 >= x1.
+  /// Returns false if the clipped rect is empty.
+  bool ClipRect(MapRect* pRect) const;
+
+  /// Calls fn(TileData* pSpan, int length, int x, int y) for each contiguous row span in the tile rect, where (x, y) is
+  /// the location of pSpan[0].
+  template <typename Fn>  void ForEachSpanInRect(const MapRect& rect, Fn&& fn) const {
+    ForEachClippedSpan(rect, [this, &fn](TileData* p, int length, int x, int y)
+      { fn(p, length, (x & (tileWidth_ - 1)), y); });
+  }
+
+  /// Calls fn(TileData& tile, int x, int y) for each tile in the tile rect.
+  template <typename Fn>  void ForEachInRect(const MapRect& rect, Fn&& fn) const {
+    ForEachSpanInRect(rect, [&fn](TileData* p, int length, int x, int y)
+      { for (int i = 0; i < length; fn(p[i], x + i, y), ++i); });
+  }
+
+  /// Calls fn(TileData& tile, int x, int y) for each tile from x1 to x2 (inclusive) in row y.
+  template <typename Fn>  void ForEachInRow(int y, int x1, int x2, Fn&& fn) const
+    { ForEachInRect(MapRect(x1, y, x2, y), std::forward<Fn>(fn)); }
+
+  /// Copies (u32All & mask) of each tile in the tile rect to pDst, in row-major order with a pitch of the clipped rect
+  /// width (@see ClipRect()).  pDst must be large enough to hold the clipped rect.  Returns the number of tiles copied.
+  size_t ExtractRect(const MapRect& rect, uint32* pDst, uint32 mask = ~0u) const;
+
+  /// Sets u32All = ((u32All & andMask) | orMask) for each tile in the tile rect.  @see TileDataMask.
+  void MaskRect(const MapRect& rect, uint32 andMask, uint32 orMask = 0) const;
+
+  /// Counts the bits set in (u32All & mask) over all tiles in the tile rect.  For a single flag (e.g. TileMaskLava),
+  /// this is the number of tiles that have the flag set.
+  size_t CountBits(const MapRect& rect, uint32 mask) const;
+
+  /// Counts lava, microbe and wallOrBuilding tiles in the tile rect in a single pass.
+  FlagCounts CountFlags(const MapRect& rect) const;
+
+private:
+  /// Calls fn(TileData* pSpan, int length, int x, int y) for each row span in the clipped rect, with x unwrapped.
+  template <typename Fn>  void ForEachClippedSpan(MapRect rect, Fn&& fn) const;
+
+  TileData* pTiles_         = nullptr;
+  int       tileWidth_      = 0;
+  int       tileHeight_     = 0;
+  int       log2TileHeight_ = 0;
+  bool      wrapX_          = false;
+};
+
+// =====================================================================================================================
+inline bool TileGridView::ClipRect(
+  MapRect* pRect
+  ) const
+{
+  MapRect& r = *pRect;
+
+  if (wrapX_) {
+    // Rects with x2 < x1 have wrapped around the map;  unwrap x2 so the rect is contiguous.
+    if (r.x2 < r.x1) {
+      r.x2 += tileWidth_;
+    }
+    const int x1 = r.x1 & (tileWidth_ - 1);
+    r.x2 = x1 + (std::min)(r.x2 - r.x1, tileWidth_ - 1);
+    r.x1 = x1;
+  }
+  else {
+    r.x1 = (std::max)(r.x1, 0);
+    r.x2 = (std::min)(r.x2, tileWidth_ - 1);
+  }
+
+  r.y1 = (std::max)(r.y1, 0);
+  r.y2 = (std::min)(r.y2, tileHeight_ - 1);
+
+  return IsInitialized() && (r.x2 >= r.x1) && (r.y2 >= r.y1);
+}
+
+// =====================================================================================================================
+template <typename Fn>
+void TileGridView::ForEachClippedSpan(
+  MapRect  rect,
+  Fn&&     fn
+  ) const
+{
+  if (ClipRect(&rect)) {
+    for (int x = rect.x1; x <= rect.x2;) {
+      const int wrappedX = x & (tileWidth_ - 1);
+      const int length   = (std::min)(ChunkWidth - (wrappedX & (ChunkWidth - 1)), rect.x2 - x + 1);
+
+      TileData* pSpan = pTiles_ + GetOffset(wrappedX, rect.y1);
+      for (int y = rect.y1; y <= rect.y2; ++y, pSpan += ChunkWidth) {
+        fn(pSpan, length, x, y);
+      }
+
+      x += length;
+    }
+  }
+}
+
+// =====================================================================================================================
+inline size_t TileGridView::ExtractRect(
+  const MapRect&  rect,
+  uint32*         pDst,
+  uint32          mask
+  ) const
+{
+  MapRect clipped = rect;
+  size_t  count   = 0;
+
+  if (ClipRect(&clipped)) {
+    const int pitch = clipped.x2 - clipped.x1 + 1;
+    ForEachClippedSpan(clipped, [&](TileData* p, int length, int x, int y) {
+      uint32*const pRow = pDst + (size_t(y - clipped.y1) * pitch) + (x - clipped.x1);
+      for (int i = 0; i < length; ++i) {
+        pRow[i] = p[i].u32All & mask;
+      }
+      count += length;
+    });
+  }
+
+  return count;
+}
+
+// =====================================================================================================================
+inline void TileGridView::MaskRect(
+  const MapRect&  rect,
+  uint32          andMask,
+  uint32          orMask
+  ) const
+{
+  ForEachClippedSpan(rect, [andMask, orMask](TileData* p, int length, int, int) {
+    for (int i = 0; i < length; ++i) {
+      p[i].u32All = (p[i].u32All & andMask) | orMask;
+    }
+  });
+}
+
+// =====================================================================================================================
+inline size_t TileGridView::CountBits(
+  const MapRect&  rect,
+  uint32          mask
+  ) const
+{
+  size_t count = 0;
+
+  ForEachClippedSpan(rect, [mask, &count](TileData* p, int length, int, int) {
+    for (int i = 0; i < length; ++i) {
+      count += TethysUtil::PopCount(p[i].u32All & mask);
+    }
+  });
+
+  return count;
+}
+
+// =====================================================================================================================
+inline TileGridView::FlagCounts TileGridView::CountFlags(
+  const MapRect& rect
+  ) const
+{
+  static_assert(TileMaskLava == (1u << 27) && TileMaskMicrobe == (1u << 30) && TileMaskWallOrBuilding == (1u << 31),
+                "TileData flag bit positions have changed.");
+
+  FlagCounts counts = { };
+
+  // Row spans are at most 32 tiles, so gather each flag from a span into one bit per tile of a packed word, then count
+  // the whole span with one popcount per flag.
+  ForEachClippedSpan(rect, [&counts](TileData* p, int length, int, int) {
+    uint32 lava    = 0;
+    uint32 microbe = 0;
+    uint32 wall    = 0;
+
+    for (int i = 0; i < length; ++i) {
+      const uint32 bits = p[i].u32All;
+      lava    |= ((bits >> 27) & 1) << i;
+      microbe |= ((bits >> 30) & 1) << i;
+      wall    |=  (bits >> 31)      << i;
+    }
+
+    counts.lava           += TethysUtil::PopCount(lava);
+    counts.microbe        += TethysUtil::PopCount(microbe);
+    counts.wallOrBuilding += TethysUtil::PopCount(wall);
+  });
+
+  return counts;
+}
+
+} // Tethys
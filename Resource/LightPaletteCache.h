@@ -0,0 +1,231 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+#include "Tethys/Common/Util.h"
+
+#include <unordered_map>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+# include <emmintrin.h>
+# define TETHYS_LIGHTPAL_SSE2  1
+#endif
+
+namespace Tethys {
+
+/// Light-adjusted RGB555 palettes for one source palette, with the same layout as
+/// GFXLightAdjustedBitmap::pLightLevelPal_ (uint16[256 * numLightLevels], darkest level first).  Shared read-only.
+struct LightPaletteTables {
+  static constexpr size_t NumLevels = 32;  ///< NumLightLevels
+
+  /// Source palette byte order.
+  enum class ColorOrder : uint8 {
+    Rgbx = 0,  ///< PALETTEENTRY
+    Bgrx,      ///< RGBQUAD
+  };
+
+  /// Per-level channel scale, 0..256 (256 = full brightness).  The default is linear:  (level + 1) * 8.
+  using Curve = uint16[NumLevels];
+
+  const uint16* GetLevel(size_t level) const { return &levels[level][0]; }
+  const uint16* Data()                 const { return &levels[0][0];     }
+
+  uint16 levels[NumLevels][256];
+  uint8  source[256][3];          ///< Source colors as R, G, B.
+  Curve  curve;
+  uint64 hash;
+};
+
+/// Content-hashed cache of LightPaletteTables, so bitmaps that share a source palette (as most tilesets and sprites do)
+/// share one set of 32 light-level tables instead of each building its own.
+///
+/// Tables are keyed by a 64-bit FNV-1a hash of the source colors and light curve, and the contents are compared on a
+/// hash match, so collisions can't return the wrong tables.  Get() is thread-safe;  returned tables stay valid while
+/// referenced, even after Clear() or Trim().
+///
+/// Each level maps an 8-bit channel c to (c * curve[level]) >> 11, which is 5-bit for curve values up to 256.  This
+/// builds the tables for offline rendering;  the game builds its own in GFXLightAdjustedBitmap::Load().
+class LightPaletteCache {
+public:
+  using Tables     = LightPaletteTables;
+  using ColorOrder = Tables::ColorOrder;
+  using TablesPtr  = std::shared_ptr<const Tables>;
+
+  /// Gets the tables for a 256-color source palette (4 bytes per color, in the given order), building them if needed.
+  /// pCurve can be nullptr to use the default linear curve.
+  TablesPtr Get(const void* pColors, ColorOrder order = ColorOrder::Rgbx, const uint16* pCurve = nullptr);
+
+  /// Builds tables without caching them.
+  static TablesPtr Build(const void* pColors, ColorOrder order = ColorOrder::Rgbx, const uint16* pCurve = nullptr);
+
+  /// Drops tables that are only referenced by the cache.  Returns the number dropped.
+  size_t Trim();
+
+  /// Drops all tables.
+  void Clear() { std::lock_guard<std::mutex> guard(lock_);  entries_.clear();  numEntries_ = 0; }
+
+  size_t NumEntries() const { std::lock_guard<std::mutex> guard(lock_);  return numEntries_; }
+  size_t NumHits()    const { std::lock_guard<std::mutex> guard(lock_);  return numHits_;    }
+  size_t NumMisses()  const { std::lock_guard<std::mutex> guard(lock_);  return numMisses_;  }
+
+  /// Gets the process-wide shared cache.
+  static LightPaletteCache* GetInstance() { static LightPaletteCache cache;  return &cache; }
+
+private:
+  /// Normalizes a source palette and curve into a key (the source and curve members of Tables).
+  static void MakeKey(const void* pColors, ColorOrder order, const uint16* pCurve, Tables* pKey);
+
+  /// Fills in pTables->levels from its source and curve.
+  static void Generate(Tables* pTables);
+
+  mutable std::mutex                                  lock_;
+  std::unordered_map<uint64, std::vector<TablesPtr>>  entries_;
+  size_t                                              numEntries_ = 0;
+  size_t                                              numHits_    = 0;
+  size_t                                              numMisses_  = 0;
+};
+
+// =====================================================================================================================
+inline void LightPaletteCache::MakeKey(
+  const void*    pColors,
+  ColorOrder     order,
+  const uint16*  pCurve,
+  Tables*        pKey)
+{
+  const uint8*const pSrc  = static_cast<const uint8*>(pColors);
+  const size_t      red   = (order == ColorOrder::Bgrx) ? 2 : 0;
+  const size_t      blue  = 2 - red;
+  for (size_t i = 0; i < 256; ++i) {
+    pKey->source[i][0] = pSrc[(i * 4) + red];
+    pKey->source[i][1] = pSrc[(i * 4) + 1];
+    pKey->source[i][2] = pSrc[(i * 4) + blue];
+  }
+
+  for (size_t level = 0; level < Tables::NumLevels; ++level) {
+    const uint16 scale = (pCurve != nullptr) ? pCurve[level] : uint16((level + 1) * 8);
+    pKey->curve[level] = (scale < 256) ? scale : 256;
+  }
+
+  const uint64 hash = TethysUtil::Fnv1a<uint64>(&pKey->source[0][0], sizeof(pKey->source));
+  pKey->hash = TethysUtil::Fnv1a<uint64>(&pKey->curve[0], sizeof(pKey->curve), hash);
+}
+
+// =====================================================================================================================
+inline void LightPaletteCache::Generate(
+  Tables* pTables)
+{
+  // Split channels into planes once, so each level is a multiply and shift per channel.
+  alignas(16) uint16 planes[3][256];
+  for (size_t i = 0; i < 256; ++i) {
+    planes[0][i] = pTables->source[i][0];
+    planes[1][i] = pTables->source[i][1];
+    planes[2][i] = pTables->source[i][2];
+  }
+
+  for (size_t level = 0; level < Tables::NumLevels; ++level) {
+    const uint32 scale = pTables->curve[level];
+    uint16*const pOut  = &pTables->levels[level][0];
+    size_t       i     = 0;
+
+#if TETHYS_LIGHTPAL_SSE2
+    // 255 * 256 fits in 16 bits, so 8 colors per multiply.
+    const __m128i vScale = _mm_set1_epi16(int16(scale));
+    for (; i < 256; i += 8) {
+      const auto Channel = [&](size_t plane, int shift) {
+        const __m128i c = _mm_load_si128(reinterpret_cast<const __m128i*>(&planes[plane][i]));
+        return _mm_slli_epi16(_mm_srli_epi16(_mm_mullo_epi16(c, vScale), 11), shift);
+      };
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + i), _mm_or_si128(_mm_or_si128(Channel(0, 10), Channel(1, 5)),
+                                                                          Channel(2, 0)));
+    }
+#endif
+
+    for (; i < 256; ++i) {
+      pOut[i] = uint16((((planes[0][i] * scale) >> 11) << 10) | (((planes[1][i] * scale) >> 11) << 5) |
+                        ((planes[2][i] * scale) >> 11));
+    }
+  }
+}
+
+// =====================================================================================================================
+inline LightPaletteCache::TablesPtr LightPaletteCache::Build(
+  const void*    pColors,
+  ColorOrder     order,
+  const uint16*  pCurve)
+{
+  auto tables = std::make_shared<Tables>();
+  MakeKey(pColors, order, pCurve, tables.get());
+  Generate(tables.get());
+  return tables;
+}
+
+// =====================================================================================================================
+inline LightPaletteCache::TablesPtr LightPaletteCache::Get(
+  const void*    pColors,
+  ColorOrder     order,
+  const uint16*  pCurve)
+{
+  Tables key;
+  MakeKey(pColors, order, pCurve, &key);
+
+  const auto Matches = [&key](const TablesPtr& tables) {
+    return (memcmp(tables->source, key.source, sizeof(key.source)) == 0) &&
+           (memcmp(tables->curve,  key.curve,  sizeof(key.curve))  == 0);
+  };
+
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = entries_.find(key.hash);
+    if (it != entries_.end()) {
+      for (const TablesPtr& tables : it->second) {
+        if (Matches(tables)) {
+          ++numHits_;
+          return tables;
+        }
+      }
+    }
+  }
+
+  // Generate outside of the lock.  If another thread added the same tables meanwhile, use its copy.
+  auto tables = std::make_shared<Tables>(key);
+  Generate(tables.get());
+
+  std::lock_guard<std::mutex> guard(lock_);
+  std::vector<TablesPtr>& bucket = entries_[key.hash];
+  for (const TablesPtr& existing : bucket) {
+    if (Matches(existing)) {
+      ++numHits_;
+      return existing;
+    }
+  }
+
+  ++numMisses_;
+  ++numEntries_;
+  bucket.push_back(tables);
+  return tables;
+}
+
+// =====================================================================================================================
+inline size_t LightPaletteCache::Trim() {
+  std::lock_guard<std::mutex> guard(lock_);
+
+  size_t numDropped = 0;
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    std::vector<TablesPtr>& bucket = it->second;
+    const size_t            size   = bucket.size();
+    bucket.erase(std::remove_if(bucket.begin(), bucket.end(), [](const TablesPtr& p) { return p.use_count() == 1; }),
+                 bucket.end());
+    numDropped += size - bucket.size();
+    it = bucket.empty() ? entries_.erase(it) : std::next(it);
+  }
+
+  numEntries_ -= numDropped;
+  return numDropped;
+}
+
+} // Tethys
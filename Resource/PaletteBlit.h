@@ -0,0 +1,440 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+# include <emmintrin.h>
+# define TETHYS_BLIT_SSE2  1
+#endif
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+# define TETHYS_BLIT_AVX2  1
+#endif
+
+namespace Tethys {
+
+/// Native 8-bit indexed to 16-bit (RGB555) scanline kernels, for rendering outside of the game.
+///
+/// Each kernel maps count 8-bit palette indices through uint16[256] palettes (as BitmapCopyInfo::pDarkPal16 and
+/// pLightPal16, or ScanlineCopyInfo::pPalette) into a 16-bit scanline:
+///   Expand                     DrawBackgroundMethod::_8Pal16
+///   ExpandTransparent0         DrawSpriteMethod::_8Pal16Transparent0  (index 0 leaves the destination pixel as-is)
+///   BlendDayNight              Approximates DrawBackgroundMethod::_8Pal16DayNightTransition
+///   BlendDayNightTransparent0  Approximates DrawSpriteMethod::_8Pal16DayNightTransitionTransparent0
+///
+/// The day/night kernels are approximations, not reproductions of the game's routines, and their output is not
+/// guaranteed to match the game's.  They mix the dark and light palette entries per RGB555 channel, as
+/// (dark * (32 - weight) + light * weight) / 32 with weight in [0, 32];  the alpha bit is taken from the dark entry.
+///
+/// Reference, SSE2 and AVX2 (gather) versions are in nested namespaces;  SSE2 and AVX2 are only compiled when the
+/// compiler targets them.  The functions directly in PaletteBlit pick the best compiled version, and all versions
+/// produce identical output.
+namespace PaletteBlit {
+
+/// Portable equivalent of BitmapCopyInfo for Blit().  Pitches are in bytes.
+struct BlitInfo {
+  const uint8*   pSrcImg;
+  uint16*        pDstImg;
+  int            srcWidth;
+  int            srcHeight;
+  int            srcPitch;
+  int            dstPitch;
+  const uint16*  pDarkPal16;      ///< Current light level (uint16[256])
+  const uint16*  pLightPal16;     ///< Full daylight (uint16[256]);  only used by the day/night methods.
+  uint32         dayNightWeight;  ///< 0 (dark) .. 32 (light);  only used by the day/night methods.
+};
+
+enum class Method : int {
+  Expand = 0,
+  ExpandTransparent0,
+  BlendDayNight,              ///< Approximation of the game's day/night transition, see above.
+  BlendDayNightTransparent0,  ///< Approximation of the game's day/night transition, see above.
+  Count
+};
+
+using ExpandFunc = void(const uint16* pPalette, const uint8* pSrc, uint16* pDst, size_t count);
+using BlendFunc  = void(const uint16* pDarkPal, const uint16* pLightPal, uint32 weight,
+                        const uint8* pSrc, uint16* pDst, size_t count);
+
+/// One version of all kernels.
+struct Kernels {
+  const char* pName;
+  ExpandFunc* pfnExpand;
+  ExpandFunc* pfnExpandTransparent0;
+  BlendFunc*  pfnBlendDayNight;
+  BlendFunc*  pfnBlendDayNightTransparent0;
+};
+
+/// Mixes two RGB555 colors per channel.  weight is in [0, 32].
+inline uint16 Lerp555(
+  uint32  dark,
+  uint32  light,
+  uint32  weight)
+{
+  const uint32 inverse = 32 - weight;
+  return uint16((dark & 0x8000) |
+                (((((dark >> 10) & 31) * inverse + ((light >> 10) & 31) * weight) >> 5) << 10) |
+                (((((dark >>  5) & 31) * inverse + ((light >>  5) & 31) * weight) >> 5) <<  5) |
+                  (((dark        & 31) * inverse +  (light        & 31) * weight) >> 5));
+}
+
+namespace Reference {
+
+inline void Expand(const uint16* pPalette, const uint8* pSrc, uint16* pDst, size_t count) {
+  for (size_t i = 0; i < count; pDst[i] = pPalette[pSrc[i]], ++i);
+}
+
+inline void ExpandTransparent0(const uint16* pPalette, const uint8* pSrc, uint16* pDst, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if (pSrc[i] != 0) {
+      pDst[i] = pPalette[pSrc[i]];
+    }
+  }
+}
+
+inline void BlendDayNight(
+  const uint16* pDarkPal, const uint16* pLightPal, uint32 weight, const uint8* pSrc, uint16* pDst, size_t count)
+{
+  for (size_t i = 0; i < count; pDst[i] = Lerp555(pDarkPal[pSrc[i]], pLightPal[pSrc[i]], weight), ++i);
+}
+
+inline void BlendDayNightTransparent0(
+  const uint16* pDarkPal, const uint16* pLightPal, uint32 weight, const uint8* pSrc, uint16* pDst, size_t count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    if (pSrc[i] != 0) {
+      pDst[i] = Lerp555(pDarkPal[pSrc[i]], pLightPal[pSrc[i]], weight);
+    }
+  }
+}
+
+} // Reference
+
+#if TETHYS_BLIT_SSE2
+namespace Sse2 {
+
+/// Looks up 8 pixels.  SSE2 has no gather, so indices are extracted from one 8-byte load and inserted per lane.
+inline __m128i Lookup8(
+  const uint16*  pPalette,
+  const uint8*   pSrc)
+{
+  uint32 indices[2];
+  memcpy(&indices[0], pSrc, sizeof(indices));
+
+  __m128i result = _mm_cvtsi32_si128(pPalette[indices[0] & 0xFF]);
+  result = _mm_insert_epi16(result, pPalette[(indices[0] >>  8) & 0xFF], 1);
+  result = _mm_insert_epi16(result, pPalette[(indices[0] >> 16) & 0xFF], 2);
+  result = _mm_insert_epi16(result, pPalette[(indices[0] >> 24)],        3);
+  result = _mm_insert_epi16(result, pPalette[indices[1] & 0xFF],         4);
+  result = _mm_insert_epi16(result, pPalette[(indices[1] >>  8) & 0xFF], 5);
+  result = _mm_insert_epi16(result, pPalette[(indices[1] >> 16) & 0xFF], 6);
+  result = _mm_insert_epi16(result, pPalette[(indices[1] >> 24)],        7);
+  return result;
+}
+
+/// Lerp555() on 8 pixels.
+inline __m128i Lerp555(
+  __m128i  dark,
+  __m128i  light,
+  __m128i  weight,
+  __m128i  inverse)
+{
+  const __m128i mask  = _mm_set1_epi16(31);
+  const auto    Mix   = [&](int shift) {
+    const __m128i d = _mm_and_si128(_mm_srli_epi16(dark,  shift), mask);
+    const __m128i l = _mm_and_si128(_mm_srli_epi16(light, shift), mask);
+    return _mm_slli_epi16(_mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(d, inverse), _mm_mullo_epi16(l, weight)), 5),
+                          shift);
+  };
+  return _mm_or_si128(_mm_or_si128(_mm_and_si128(dark, _mm_set1_epi16(int16(0x8000))), Mix(10)),
+                      _mm_or_si128(Mix(5), Mix(0)));
+}
+
+/// Writes 8 pixels, leaving pixels with index 0 as-is when Transparent0.
+template <bool Transparent0>
+void Store8(
+  uint16*        pDst,
+  const uint8*   pSrc,
+  __m128i        pixels)
+{
+  __m128i*const pOut = reinterpret_cast<__m128i*>(pDst);
+  if (Transparent0) {
+    const __m128i zero        = _mm_setzero_si128();
+    const __m128i transparent = _mm_cmpeq_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(
+                                                  reinterpret_cast<const __m128i*>(pSrc)), zero), zero);
+    pixels = _mm_or_si128(_mm_and_si128(transparent, _mm_loadu_si128(pOut)), _mm_andnot_si128(transparent, pixels));
+  }
+  _mm_storeu_si128(pOut, pixels);
+}
+
+///@{ Returns a mask of which of the next 16 or 8 pixels have index 0.
+inline uint32 TransparentMask16(const uint8* pSrc) {
+  const __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+  return uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(indices, _mm_setzero_si128())));
+}
+inline uint32 TransparentMask8(const uint8* pSrc) {
+  const __m128i indices = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pSrc));
+  return uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(indices, _mm_setzero_si128()))) & 0xFF;
+}
+///@}
+
+template <bool Transparent0>
+void ExpandImpl(
+  const uint16*  pPalette,
+  const uint8*   pSrc,
+  uint16*        pDst,
+  size_t         count)
+{
+  size_t i = 0;
+  for (; (count - i) >= 16; i += 16) {
+    // Skip fully transparent runs, and don't read the destination back for fully opaque ones.
+    const uint32 transparent = Transparent0 ? TransparentMask16(pSrc + i) : 0;
+    for (size_t half = 0; half < 16; half += 8) {
+      const uint32 halfMask = (transparent >> half) & 0xFF;
+      if (halfMask != 0xFF) {
+        const __m128i pixels = Lookup8(pPalette, pSrc + i + half);
+        (halfMask != 0) ? Store8<Transparent0>(pDst + i + half, pSrc + i + half, pixels) :
+                          Store8<false>(pDst + i + half,        pSrc + i + half, pixels);
+      }
+    }
+  }
+
+  Transparent0 ? Reference::ExpandTransparent0(pPalette, pSrc + i, pDst + i, count - i) :
+                 Reference::Expand(pPalette,             pSrc + i, pDst + i, count - i);
+}
+
+template <bool Transparent0>
+void BlendImpl(
+  const uint16*  pDarkPal,
+  const uint16*  pLightPal,
+  uint32         weight,
+  const uint8*   pSrc,
+  uint16*        pDst,
+  size_t         count)
+{
+  const __m128i vWeight  = _mm_set1_epi16(int16(weight));
+  const __m128i vInverse = _mm_set1_epi16(int16(32 - weight));
+
+  size_t i = 0;
+  for (; (count - i) >= 8; i += 8) {
+    const uint32 transparent = Transparent0 ? TransparentMask8(pSrc + i) : 0;
+    if (transparent != 0xFF) {
+      const __m128i pixels = Lerp555(Lookup8(pDarkPal, pSrc + i), Lookup8(pLightPal, pSrc + i), vWeight, vInverse);
+      (transparent != 0) ? Store8<Transparent0>(pDst + i, pSrc + i, pixels) : Store8<false>(pDst + i, pSrc + i, pixels);
+    }
+  }
+
+  Transparent0 ? Reference::BlendDayNightTransparent0(pDarkPal, pLightPal, weight, pSrc + i, pDst + i, count - i) :
+                 Reference::BlendDayNight(pDarkPal,             pLightPal, weight, pSrc + i, pDst + i, count - i);
+}
+
+inline void Expand(const uint16* pPalette, const uint8* pSrc, uint16* pDst, size_t count)
+  { ExpandImpl<false>(pPalette, pSrc, pDst, count); }
+inline void ExpandTransparent0(const uint16* pPalette, const uint8* pSrc, uint16* pDst, size_t count)
+  { ExpandImpl<true>(pPalette, pSrc, pDst, count); }
+inline void BlendDayNight(
+  const uint16* pDarkPal, const uint16* pLightPal, uint32 weight, const uint8* pSrc, uint16* pDst, size_t count)
+    { BlendImpl<false>(pDarkPal, pLightPal, weight, pSrc, pDst, count); }
+inline void BlendDayNightTransparent0(
+  const uint16* pDarkPal, const uint16* pLightPal, uint32 weight, const uint8* pSrc, uint16* pDst, size_t count)
+    { BlendImpl<true>(pDarkPal, pLightPal, weight, pSrc, pDst, count); }
+
+} // Sse2
+#endif
+
+#if TETHYS_BLIT_AVX2
+namespace Avx2 {
+
+/// Gathers 8 palette entries for 8 32-bit indices.  Each gather reads 4 bytes at &pPalette[index], so index 255 (which
+/// would read past the end of the palette) is masked out of the gather and filled in with a broadcast instead.
+inline __m256i Gather8(
+  const uint16*  pPalette,
+  __m256i        indices)
+{
+  const __m256i last    = _mm256_set1_epi32(255);
+  const __m256i inRange = _mm256_xor_si256(_mm256_cmpeq_epi32(indices, last), _mm256_set1_epi32(-1));
+  const __m256i result  = _mm256_mask_i32gather_epi32(
+    _mm256_set1_epi32(pPalette[255]), reinterpret_cast<const int*>(pPalette), indices, inRange, 2);
+  return _mm256_and_si256(result, _mm256_set1_epi32(0xFFFF));
+}
+
+/// Looks up 16 pixels.
+inline __m256i Lookup16(
+  const uint16*  pPalette,
+  const uint8*   pSrc)
+{
+  const __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+  const __m256i low     = Gather8(pPalette, _mm256_cvtepu8_epi32(indices));
+  const __m256i high    = Gather8(pPalette, _mm256_cvtepu8_epi32(_mm_srli_si128(indices, 8)));
+  // packus works within 128-bit lanes, so restore pixel order across lanes afterward.
+  return _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), 0xD8);
+}
+
+/// Lerp555() on 16 pixels.
+inline __m256i Lerp555(
+  __m256i  dark,
+  __m256i  light,
+  __m256i  weight,
+  __m256i  inverse)
+{
+  const __m256i mask = _mm256_set1_epi16(31);
+  const auto    Mix  = [&](int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m256i d     = _mm256_and_si256(_mm256_srl_epi16(dark,  count), mask);
+    const __m256i l     = _mm256_and_si256(_mm256_srl_epi16(light, count), mask);
+    return _mm256_sll_epi16(
+      _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(d, inverse), _mm256_mullo_epi16(l, weight)), 5), count);
+  };
+  return _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(dark, _mm256_set1_epi16(int16(0x8000))), Mix(10)),
+                         _mm256_or_si256(Mix(5), Mix(0)));
+}
+
+/// Writes 16 pixels, leaving pixels with index 0 as-is if any are transparent.
+inline void Store16(
+  uint16*        pDst,
+  const uint8*   pSrc,
+  __m256i        pixels,
+  bool           anyTransparent)
+{
+  __m256i*const pOut = reinterpret_cast<__m256i*>(pDst);
+  if (anyTransparent) {
+    const __m128i indices     = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+    const __m256i transparent = _mm256_cmpeq_epi16(_mm256_cvtepu8_epi16(indices), _mm256_setzero_si256());
+    pixels = _mm256_blendv_epi8(pixels, _mm256_loadu_si256(pOut), transparent);
+  }
+  _mm256_storeu_si256(pOut, pixels);
+}
+
+template <bool Transparent0>
+void ExpandImpl(
+  const uint16*  pPalette,
+  const uint8*   pSrc,
+  uint16*        pDst,
+  size_t         count)
+{
+  size_t i = 0;
+  for (; (count - i) >= 16; i += 16) {
+    const uint32 transparent = Transparent0 ? Sse2::TransparentMask16(pSrc + i) : 0;
+    if (transparent != 0xFFFF) {
+      Store16(pDst + i, pSrc + i, Lookup16(pPalette, pSrc + i), (transparent != 0));
+    }
+  }
+
+  Transparent0 ? Reference::ExpandTransparent0(pPalette, pSrc + i, pDst + i, count - i) :
+                 Reference::Expand(pPalette,             pSrc + i, pDst + i, count - i);
+}
+
+template <bool Transparent0>
+void BlendImpl(
+  const uint16*  pDarkPal,
+  const uint16*  pLightPal,
+  uint32         weight,
+  const uint8*   pSrc,
+  uint16*        pDst,
+  size_t         count)
+{
+  const __m256i vWeight  = _mm256_set1_epi16(int16(weight));
+  const __m256i vInverse = _mm256_set1_epi16(int16(32 - weight));
+
+  size_t i = 0;
+  for (; (count - i) >= 16; i += 16) {
+    const uint32 transparent = Transparent0 ? Sse2::TransparentMask16(pSrc + i) : 0;
+    if (transparent != 0xFFFF) {
+      const __m256i pixels =
+        Lerp555(Lookup16(pDarkPal, pSrc + i), Lookup16(pLightPal, pSrc + i), vWeight, vInverse);
+      Store16(pDst + i, pSrc + i, pixels, (transparent != 0));
+    }
+  }
+
+  Transparent0 ? Reference::BlendDayNightTransparent0(pDarkPal, pLightPal, weight, pSrc + i, pDst + i, count - i) :
+                 Reference::BlendDayNight(pDarkPal,             pLightPal, weight, pSrc + i, pDst + i, count - i);
+}
+
+inline void Expand(const uint16* pPalette, const uint8* pSrc, uint16* pDst, size_t count)
+  { ExpandImpl<false>(pPalette, pSrc, pDst, count); }
+inline void ExpandTransparent0(const uint16* pPalette, const uint8* pSrc, uint16* pDst, size_t count)
+  { ExpandImpl<true>(pPalette, pSrc, pDst, count); }
+inline void BlendDayNight(
+  const uint16* pDarkPal, const uint16* pLightPal, uint32 weight, const uint8* pSrc, uint16* pDst, size_t count)
+    { BlendImpl<false>(pDarkPal, pLightPal, weight, pSrc, pDst, count); }
+inline void BlendDayNightTransparent0(
+  const uint16* pDarkPal, const uint16* pLightPal, uint32 weight, const uint8* pSrc, uint16* pDst, size_t count)
+    { BlendImpl<true>(pDarkPal, pLightPal, weight, pSrc, pDst, count); }
+
+} // Avx2
+#endif
+
+/// Gets every compiled kernel version, from slowest to fastest.
+inline std::vector<Kernels> GetAllKernels() {
+  std::vector<Kernels> kernels;
+  kernels.push_back({ "Reference", &Reference::Expand, &Reference::ExpandTransparent0,
+                      &Reference::BlendDayNight, &Reference::BlendDayNightTransparent0 });
+#if TETHYS_BLIT_SSE2
+  kernels.push_back({ "SSE2", &Sse2::Expand, &Sse2::ExpandTransparent0,
+                      &Sse2::BlendDayNight, &Sse2::BlendDayNightTransparent0 });
+#endif
+#if TETHYS_BLIT_AVX2
+  kernels.push_back({ "AVX2", &Avx2::Expand, &Avx2::ExpandTransparent0,
+                      &Avx2::BlendDayNight, &Avx2::BlendDayNightTransparent0 });
+#endif
+  return kernels;
+}
+
+/// Gets the fastest compiled kernel version.
+inline const Kernels& GetKernels() {
+  static const Kernels kernels = GetAllKernels().back();
+  return kernels;
+}
+
+///@{ Scanline kernels, using the fastest compiled version.
+inline void Expand(const uint16* pPalette, const uint8* pSrc, uint16* pDst, size_t count)
+  { GetKernels().pfnExpand(pPalette, pSrc, pDst, count); }
+inline void ExpandTransparent0(const uint16* pPalette, const uint8* pSrc, uint16* pDst, size_t count)
+  { GetKernels().pfnExpandTransparent0(pPalette, pSrc, pDst, count); }
+inline void BlendDayNight(
+  const uint16* pDarkPal, const uint16* pLightPal, uint32 weight, const uint8* pSrc, uint16* pDst, size_t count)
+    { GetKernels().pfnBlendDayNight(pDarkPal, pLightPal, (weight < 32) ? weight : 32, pSrc, pDst, count); }
+inline void BlendDayNightTransparent0(
+  const uint16* pDarkPal, const uint16* pLightPal, uint32 weight, const uint8* pSrc, uint16* pDst, size_t count)
+    { GetKernels().pfnBlendDayNightTransparent0(pDarkPal, pLightPal, (weight < 32) ? weight : 32, pSrc, pDst, count); }
+///@}
+
+/// Draws a whole image with the given method and kernel version (the fastest compiled version by default).
+inline void Blit(
+  const BlitInfo&  info,
+  Method           method,
+  const Kernels&   kernels = GetKernels())
+{
+  const uint32 weight = (info.dayNightWeight < 32) ? info.dayNightWeight : 32;
+  const uint8* pSrc   = info.pSrcImg;
+  uint8*       pDst   = reinterpret_cast<uint8*>(info.pDstImg);
+
+  for (int y = 0; y < info.srcHeight; ++y, pSrc += info.srcPitch, pDst += info.dstPitch) {
+    uint16*const pDstRow = reinterpret_cast<uint16*>(pDst);
+    switch (method) {
+    case Method::Expand:
+      kernels.pfnExpand(info.pDarkPal16, pSrc, pDstRow, size_t(info.srcWidth));
+      break;
+    case Method::ExpandTransparent0:
+      kernels.pfnExpandTransparent0(info.pDarkPal16, pSrc, pDstRow, size_t(info.srcWidth));
+      break;
+    case Method::BlendDayNight:
+      kernels.pfnBlendDayNight(info.pDarkPal16, info.pLightPal16, weight, pSrc, pDstRow, size_t(info.srcWidth));
+      break;
+    case Method::BlendDayNightTransparent0:
+      kernels.pfnBlendDayNightTransparent0(
+        info.pDarkPal16, info.pLightPal16, weight, pSrc, pDstRow, size_t(info.srcWidth));
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+} // PaletteBlit
+} // Tethys
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Tethys/Resource/PaletteBlit.h"
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+namespace Tethys {
+namespace PaletteBlit {
+
+/// Microbenchmark result for one kernel version and method.
+struct BenchmarkResult {
+  const char* pKernel;
+  Method      method;
+  double      pixelsPerNs;
+  bool        matchesReference;  ///< Output is identical to the reference version's.
+};
+
+/// Times every compiled kernel version on every method, over a synthetic width x height image (a mix of opaque runs,
+/// transparent runs and isolated index 0 pixels, to exercise the transparency skipping).  Reports the best of
+/// numIterations runs.
+inline std::vector<BenchmarkResult> RunBenchmark(
+  int  width         = 1024,
+  int  height        = 1024,
+  int  numIterations = 10)
+{
+  using Clock = std::chrono::steady_clock;
+
+  const size_t numPixels = size_t(width) * height;
+  std::vector<uint8>  src(numPixels);
+  std::vector<uint16> palettes(512);
+  uint32 seed = 0x2F6B1D3;
+  const auto Next = [&seed] { seed = (seed * 1103515245) + 12345;  return seed >> 8; };
+
+  for (size_t i = 0; i < palettes.size(); palettes[i++] = uint16(Next()));
+  for (size_t i = 0; i < numPixels; i += 64) {
+    const uint32 kind = Next() % 4;  // Opaque, transparent, or opaque with isolated 0s.
+    for (size_t j = i; j < (std::min)(numPixels, i + 64); ++j) {
+      src[j] = (kind == 1) ? 0 : uint8((kind == 3) && ((Next() % 8) == 0) ? 0 : (1 + (Next() % 255)));
+    }
+  }
+
+  BlitInfo info = { src.data(), nullptr, width, height, width, int(width * sizeof(uint16)), &palettes[0],
+                    &palettes[256], 13 };
+
+  std::vector<BenchmarkResult>      results;
+  std::vector<std::vector<uint16>>  reference(size_t(Method::Count));
+  for (const Kernels& kernels : GetAllKernels()) {
+    for (int m = 0; m < int(Method::Count); ++m) {
+      std::vector<uint16> dst(numPixels, 0x1234);
+      info.pDstImg = dst.data();
+
+      double best = 0.0;
+      for (int i = 0; i < numIterations; ++i) {
+        std::fill(dst.begin(), dst.end(), uint16(0x1234));
+        const auto start = Clock::now();
+        Blit(info, Method(m), kernels);
+        const double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        best = (std::max)(best, double(numPixels) / ((ns > 0.0) ? ns : 1.0));
+      }
+
+      if (reference[m].empty()) {
+        reference[m] = dst;
+      }
+      results.push_back({ kernels.pName, Method(m), best, (dst == reference[m]) });
+    }
+  }
+
+  return results;
+}
+
+} // PaletteBlit
+} // Tethys
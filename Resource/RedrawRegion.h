@@ -0,0 +1,305 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+#include "Tethys/Common/Util.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+namespace Tethys {
+
+/// Native tile redraw tracker, equivalent to Viewport's redraw bit vectors (redrawBitVector_ etc.), for renderers that
+/// run outside of the game.
+///
+/// Tiles are one bit each, one row per tile row, in the same bit order as Viewport (bit (x % 8) of byte (x / 8)), so
+/// Viewport bit vectors can be loaded and stored directly.  Rows are held as whole 32-bit words, and all scans work a
+/// word at a time:  dirty runs are found with ctz (TethysUtil::GetNextBit()) on the row word and its complement, and
+/// dirty counts use popcount.
+///
+/// BuildBlitList() turns the dirty bits into a short list of rects:  each row is split into maximal runs, and runs with
+/// the same span on consecutive rows are joined into one rect.
+class RedrawRegion {
+public:
+  /// Tile rect.  right and bottom are exclusive.
+  struct Rect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+
+    int Width()  const { return right  - left; }
+    int Height() const { return bottom - top;  }
+  };
+
+  RedrawRegion() = default;
+  RedrawRegion(int width, int height) { Init(width, height); }
+
+  /// Resizes to width x height tiles, with nothing marked.
+  void Init(int width, int height);
+
+  int Width()  const { return width_;  }
+  int Height() const { return height_; }
+
+  ///@{ Marks tiles for redraw.  Coordinates are clipped.
+  void MarkTile(int x, int y) { MarkTileRow(y, x, x); }
+  void MarkTileRow(int y, int x1, int x2);  ///< x1 and x2 are inclusive, as Viewport::MarkTileRowForRedraw().
+  void MarkRect(const Rect& rect);
+  void MarkAll() { MarkRect({ 0, 0, width_, height_ }); }
+  ///@}
+
+  /// Clears all marks.
+  void Clear() { std::fill(bits_.begin(), bits_.end(), 0); }
+
+  /// Marks every tile that is marked in other, which must be the same size (e.g. to combine redraw and light planes).
+  void Merge(const RedrawRegion& other);
+
+  bool IsMarked(int x, int y) const
+    { return InBounds(x, y) && ((Row(y)[uint32(x) / 32] >> (uint32(x) % 32)) & 1); }
+
+  bool   Any()        const;
+  size_t CountDirty() const;
+
+  /// Shifts marks for a view that moved by (dx, dy) tiles:  the tile at (x, y) moves to (x - dx, y - dy).  Tiles that
+  /// scrolled into view are marked if markExposed.
+  void Scroll(int dx, int dy, bool markExposed = true);
+
+  /// Gets the dirty tiles as rects (appended to pRects).  Returns the number of rects added.
+  size_t BuildBlitList(std::vector<Rect>* pRects) const;
+
+  ///@{ Loads from or stores to a Viewport bit vector, with rows lineWidth bytes apart (redrawBitVectorLineWidth_).
+  void Load(const void* pBitVector, int lineWidth);
+  void Store(void* pBitVector, int lineWidth) const;
+  ///@}
+
+private:
+  bool InBounds(int x, int y) const { return (x >= 0) && (y >= 0) && (x < width_) && (y < height_); }
+
+  uint32*       Row(int y)       { return &bits_[size_t(y) * wordsPerRow_]; }
+  const uint32* Row(int y) const { return &bits_[size_t(y) * wordsPerRow_]; }
+
+  /// Sets bits [x1, x2) of a row.
+  static void SetRange(uint32* pRow, int x1, int x2);
+
+  /// Gets 32 bits of a row starting at bit position, which may be out of range (missing bits are 0).
+  uint32 ReadBits(const uint32* pRow, int position) const;
+
+  /// Mask of the valid bits in the last word of each row.
+  uint32 TailMask() const { return ((width_ % 32) == 0) ? 0xFFFFFFFF : ((1u << (width_ % 32)) - 1); }
+
+  int                 width_       = 0;
+  int                 height_      = 0;
+  int                 wordsPerRow_ = 0;
+  std::vector<uint32> bits_;
+};
+
+// =====================================================================================================================
+inline void RedrawRegion::Init(
+  int  width,
+  int  height)
+{
+  width_       = (std::max)(width,  0);
+  height_      = (std::max)(height, 0);
+  wordsPerRow_ = (width_ + 31) / 32;
+  bits_.assign(size_t(wordsPerRow_) * height_, 0);
+}
+
+// =====================================================================================================================
+inline void RedrawRegion::SetRange(
+  uint32*  pRow,
+  int      x1,
+  int      x2)
+{
+  for (int x = x1; x < x2;) {
+    const int    bit   = x % 32;
+    const int    count = (std::min)(32 - bit, x2 - x);
+    const uint32 mask  = (count == 32) ? 0xFFFFFFFF : (((1u << count) - 1) << bit);
+    pRow[x / 32] |= mask;
+    x += count;
+  }
+}
+
+// =====================================================================================================================
+inline void RedrawRegion::MarkTileRow(
+  int  y,
+  int  x1,
+  int  x2)
+{
+  x1 = (std::max)(x1, 0);
+  x2 = (std::min)(x2, width_ - 1);
+  if ((y >= 0) && (y < height_) && (x1 <= x2)) {
+    SetRange(Row(y), x1, x2 + 1);
+  }
+}
+
+// =====================================================================================================================
+inline void RedrawRegion::MarkRect(
+  const Rect& rect)
+{
+  const int left   = (std::max)(rect.left,   0);
+  const int right  = (std::min)(rect.right,  width_);
+  const int top    = (std::max)(rect.top,    0);
+  const int bottom = (std::min)(rect.bottom, height_);
+  for (int y = top; (left < right) && (y < bottom); SetRange(Row(y++), left, right));
+}
+
+// =====================================================================================================================
+inline void RedrawRegion::Merge(
+  const RedrawRegion& other)
+{
+  if ((other.width_ == width_) && (other.height_ == height_)) {
+    for (size_t i = 0; i < bits_.size(); bits_[i] |= other.bits_[i], ++i);
+  }
+}
+
+// =====================================================================================================================
+inline bool RedrawRegion::Any() const {
+  return std::any_of(bits_.begin(), bits_.end(), [](uint32 word) { return word != 0; });
+}
+
+// =====================================================================================================================
+inline size_t RedrawRegion::CountDirty() const {
+  size_t count = 0;
+  for (uint32 word : bits_) {
+    count += TethysUtil::PopCount(word);
+  }
+  return count;
+}
+
+// =====================================================================================================================
+inline uint32 RedrawRegion::ReadBits(
+  const uint32*  pRow,
+  int            position
+  ) const
+{
+  const auto Word = [this, pRow](int index) { return ((index >= 0) && (index < wordsPerRow_)) ? pRow[index] : 0; };
+
+  // Floor division, so negative positions read from word -1.
+  const int    index = (position >= 0) ? (position / 32) : -((31 - position) / 32);
+  const uint32 shift = uint32(position - (index * 32));
+  const uint32 low   = Word(index);
+  const uint32 high  = Word(index + 1);
+  return (shift == 0) ? low : ((low >> shift) | (high << (32 - shift)));
+}
+
+// =====================================================================================================================
+inline void RedrawRegion::Scroll(
+  int   dx,
+  int   dy,
+  bool  markExposed)
+{
+  if (((dx != 0) || (dy != 0)) && (wordsPerRow_ != 0)) {
+    std::vector<uint32> shifted(bits_.size(), 0);
+    const uint32        tailMask = TailMask();
+
+    for (int y = 0; y < height_; ++y) {
+      const int srcY = y + dy;
+      uint32*   pDst = &shifted[size_t(y) * wordsPerRow_];
+
+      if ((srcY >= 0) && (srcY < height_)) {
+        for (int w = 0; w < wordsPerRow_; ++w) {
+          pDst[w] = ReadBits(Row(srcY), (w * 32) + dx);
+        }
+        pDst[wordsPerRow_ - 1] &= tailMask;
+
+        if (markExposed && (dx > 0)) {
+          SetRange(pDst, (std::max)(width_ - dx, 0), width_);
+        }
+        else if (markExposed && (dx < 0)) {
+          SetRange(pDst, 0, (std::min)(-dx, width_));
+        }
+      }
+      else if (markExposed) {
+        SetRange(pDst, 0, width_);
+      }
+    }
+
+    bits_.swap(shifted);
+  }
+}
+
+// =====================================================================================================================
+inline size_t RedrawRegion::BuildBlitList(
+  std::vector<Rect>* pRects
+  ) const
+{
+  const size_t firstRect = pRects->size();
+
+  // Rects that reach the previous row, which may be extended down by an identical run on this row.
+  std::vector<size_t> open;
+  std::vector<size_t> nextOpen;
+
+  for (int y = 0; y < height_; ++y) {
+    const uint32* pRow    = Row(y);
+    size_t        openPos = 0;
+    nextOpen.clear();
+
+    // Find maximal runs a word at a time:  ctz on the row for the run start, then ctz on its complement for the end.
+    // Bits past width_ are always clear, so every run ends within the row.
+    for (int x = 0; x < width_;) {
+      int    w    = x / 32;
+      uint32 bit  = 0;
+      uint32 word = pRow[w] & (0xFFFFFFFF << (x % 32));
+      for (; (TethysUtil::GetNextBit(&bit, word) == false) && (++w < wordsPerRow_); word = pRow[w]);
+      if (w >= wordsPerRow_) {
+        break;
+      }
+      const int x1 = (w * 32) + int(bit);
+
+      word = ~pRow[w] & (0xFFFFFFFF << bit);
+      for (; (TethysUtil::GetNextBit(&bit, word) == false) && (++w < wordsPerRow_); word = ~pRow[w]);
+      const int x2 = (w < wordsPerRow_) ? (std::min)((w * 32) + int(bit), width_) : width_;
+
+      // Join with an open rect of the same span from the row above, if any.  Open rects are sorted by left edge.
+      for (; (openPos < open.size()) && ((*pRects)[open[openPos]].left < x1); ++openPos);
+      Rect*const pAbove = (openPos < open.size()) ? &(*pRects)[open[openPos]] : nullptr;
+      if ((pAbove != nullptr) && (pAbove->left == x1) && (pAbove->right == x2)) {
+        pAbove->bottom = y + 1;
+        nextOpen.push_back(open[openPos++]);
+      }
+      else {
+        nextOpen.push_back(pRects->size());
+        pRects->push_back({ x1, y, x2, y + 1 });
+      }
+
+      x = x2;
+    }
+
+    open.swap(nextOpen);
+  }
+
+  return pRects->size() - firstRect;
+}
+
+// =====================================================================================================================
+inline void RedrawRegion::Load(
+  const void*  pBitVector,
+  int          lineWidth)
+{
+  const size_t rowBytes = (std::min)(size_t((std::max)(lineWidth, 0)), size_t(wordsPerRow_) * 4);
+  const uint32 tailMask = TailMask();
+  for (int y = 0; y < height_; ++y) {
+    uint32*const pRow = Row(y);
+    std::fill(pRow, pRow + wordsPerRow_, 0);
+    memcpy(pRow, static_cast<const uint8*>(pBitVector) + (size_t(y) * lineWidth), rowBytes);
+    if (wordsPerRow_ != 0) {
+      pRow[wordsPerRow_ - 1] &= tailMask;
+    }
+  }
+}
+
+// =====================================================================================================================
+inline void RedrawRegion::Store(
+  void*  pBitVector,
+  int    lineWidth
+  ) const
+{
+  const size_t rowBytes = (std::min)(size_t((std::max)(lineWidth, 0)), size_t(wordsPerRow_) * 4);
+  for (int y = 0; y < height_; ++y) {
+    uint8*const pDst = static_cast<uint8*>(pBitVector) + (size_t(y) * lineWidth);
+    memset(pDst, 0, size_t(lineWidth));
+    memcpy(pDst, Row(y), rowBytes);
+  }
+}
+
+} // Tethys
@@ -0,0 +1,519 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+#include "Tethys/Common/Util.h"
+#include "Tethys/Common/FileMapping.h"
+
+#include <string_view>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <climits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+# include <emmintrin.h>
+# define TETHYS_SHEET_SSE2  1
+#endif
+
+namespace Tethys {
+
+namespace SheetScan {
+
+/// Finds the first byte in [p, pEnd) equal to a, b, or c.  Returns pEnd if there is none.
+inline const char* FindAny(const char* p, const char* pEnd, char a, char b, char c) {
+#if TETHYS_SHEET_SSE2
+  // Test 16 bytes at a time, and take the lowest set bit of the match mask.
+  const __m128i va = _mm_set1_epi8(a);
+  const __m128i vb = _mm_set1_epi8(b);
+  const __m128i vc = _mm_set1_epi8(c);
+  for (; (pEnd - p) >= 16; p += 16) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i match = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+                                       _mm_cmpeq_epi8(chunk, vc));
+    uint32 index = 0;
+    if (TethysUtil::GetNextBit(&index, uint32(_mm_movemask_epi8(match)))) {
+      return p + index;
+    }
+  }
+#endif
+
+  for (; (p != pEnd) && (*p != a) && (*p != b) && (*p != c); ++p);
+  return p;
+}
+
+/// Finds the next '\n' in [p, pEnd), or pEnd.
+inline const char* FindLineEnd(const char* p, const char* pEnd) { return FindAny(p, pEnd, '\n', '\n', '\n'); }
+
+/// Counts '\n' bytes in [p, pEnd).
+inline size_t CountLines(const char* p, const char* pEnd) {
+  size_t count = 0;
+#if TETHYS_SHEET_SSE2
+  const __m128i newline = _mm_set1_epi8('\n');
+  for (; (pEnd - p) >= 16; p += 16) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    count += TethysUtil::PopCount(uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline))));
+  }
+#endif
+  for (; p != pEnd; count += (*(p++) == '\n'));
+  return count;
+}
+
+/// Strips a trailing '\r' from a line or field.
+inline std::string_view TrimCR(std::string_view text)
+  { return ((text.empty() == false) && (text.back() == '\r')) ? text.substr(0, text.size() - 1) : text; }
+
+/// Parses a decimal integer with an optional sign, which must span the whole text (leading zeros are allowed).
+inline bool ParseInt(std::string_view text, int* pValue) {
+  const bool negative = (text.empty() == false) && (text[0] == '-');
+  text.remove_prefix(((text.empty() == false) && ((text[0] == '-') || (text[0] == '+'))) ? 1 : 0);
+
+  int64 value  = 0;
+  bool  result = (text.empty() == false) && (text.size() <= 10);
+  for (size_t i = 0; result && (i < text.size()); ++i) {
+    result = (text[i] >= '0') && (text[i] <= '9');
+    value  = (value * 10) + (text[i] - '0');
+  }
+
+  value  = negative ? -value : value;
+  result = result && (value >= INT_MIN) && (value <= INT_MAX);
+  if (result) {
+    *pValue = int(value);
+  }
+  return result;
+}
+
+} // SheetScan
+
+
+/// Native reader for sheet text files (tab- or comma-separated tables with a header row, as read by @ref SheetParser).
+///
+/// The file is memory mapped and split with vectorized delimiter scans into a columnar table of string_views that
+/// point into the mapping, so no field is copied.  Blank lines are skipped, '\r' is stripped from line endings, and
+/// fields enclosed in double quotes have the quotes removed (doubled quotes inside them are left as-is).  Rows with
+/// fewer fields than the header are padded with empty fields;  extra fields are ignored.
+class SheetTable {
+public:
+  static constexpr size_t NotFound = SIZE_MAX;
+
+  /// Maps and parses a file.  delimiter = 0 detects tab or comma from the header row.
+  bool Open(const char* pFilename, char delimiter = 0);
+
+  /// Parses a buffer, which must outlive the table.  delimiter = 0 detects tab or comma from the header row.
+  bool Parse(const char* pData, size_t size, char delimiter = 0);
+
+  void Clear() { header_.clear();  cells_.clear();  numRows_ = 0;  stride_ = 0; }
+
+  size_t NumRows()    const { return numRows_;       }  ///< Number of data rows, not counting the header.
+  size_t NumColumns() const { return header_.size(); }
+  char   Delimiter()  const { return delimiter_;     }
+
+  std::string_view GetColumnName(size_t column) const
+    { return (column < header_.size()) ? header_[column] : std::string_view(); }
+
+  /// Finds a column by its header name.  Returns NotFound if there is none.
+  size_t FindColumn(std::string_view name) const {
+    const auto it = std::find(header_.begin(), header_.end(), name);
+    return (it != header_.end()) ? size_t(it - header_.begin()) : NotFound;
+  }
+
+  /// Gets a column's NumRows() fields, which are contiguous.  Returns nullptr if column is out of range.
+  const std::string_view* GetColumn(size_t column) const
+    { return (column < header_.size()) ? &cells_[column * stride_] : nullptr; }
+
+  /// Gets a field.  Returns an empty view if row or column is out of range.
+  std::string_view Get(size_t row, size_t column) const
+    { return ((row < numRows_) && (column < header_.size())) ? cells_[(column * stride_) + row] : std::string_view(); }
+
+  /// Gets a field as an integer.  Returns false if it is out of range or not an integer.
+  bool GetInt(size_t row, size_t column, int* pValue) const { return SheetScan::ParseInt(Get(row, column), pValue); }
+
+  /// Finds the first row whose field in the given column equals value.  Returns NotFound if there is none.
+  size_t FindRow(size_t column, std::string_view value) const {
+    const std::string_view*const pColumn = GetColumn(column);
+    const size_t row = (pColumn != nullptr) ? size_t(std::find(pColumn, pColumn + numRows_, value) - pColumn) : 0;
+    return ((pColumn != nullptr) && (row < numRows_)) ? row : NotFound;
+  }
+
+private:
+  /// Splits one line into fields, calling fn(size_t column, std::string_view field) for each.  Returns the number of
+  /// fields.
+  template <typename Fn>  size_t SplitLine(const char* p, const char* pEnd, Fn&& fn) const;
+
+  FileMapping                   file_;
+  std::vector<std::string_view> header_;
+  std::vector<std::string_view> cells_;      ///< Column-major, stride_ entries per column.
+  size_t                        numRows_   = 0;
+  size_t                        stride_    = 0;
+  char                          delimiter_ = '\t';
+};
+
+// =====================================================================================================================
+inline bool SheetTable::Open(
+  const char*  pFilename,
+  char         delimiter)
+{
+  Clear();
+  return file_.Open(pFilename) && Parse(static_cast<const char*>(file_.Data()), file_.Size(), delimiter);
+}
+
+// =====================================================================================================================
+template <typename Fn>
+size_t SheetTable::SplitLine(
+  const char*  p,
+  const char*  pEnd,
+  Fn&&         fn
+  ) const
+{
+  size_t column = 0;
+  for (bool more = true; more; ++column) {
+    const char* pFieldEnd = nullptr;
+    const char* pNext     = nullptr;
+
+    if ((p != pEnd) && (*p == '"')) {
+      // Quoted field;  skip doubled quotes.
+      const char* q = p + 1;
+      for (q = SheetScan::FindAny(q, pEnd, '"', '"', '"'); ((pEnd - q) >= 2) && (q[1] == '"');
+           q = SheetScan::FindAny(q + 2, pEnd, '"', '"', '"'));
+      pFieldEnd = q;
+      pNext     = SheetScan::FindAny((q != pEnd) ? (q + 1) : q, pEnd, delimiter_, delimiter_, delimiter_);
+      ++p;
+    }
+    else {
+      pFieldEnd = pNext = SheetScan::FindAny(p, pEnd, delimiter_, delimiter_, delimiter_);
+    }
+
+    fn(column, std::string_view(p, size_t(pFieldEnd - p)));
+    more = (pNext != pEnd);
+    p    = more ? (pNext + 1) : pEnd;
+  }
+
+  return column;
+}
+
+// =====================================================================================================================
+inline bool SheetTable::Parse(
+  const char*  pData,
+  size_t       size,
+  char         delimiter)
+{
+  header_.clear();
+  cells_.clear();
+  numRows_ = 0;
+
+  const char*const pEnd = pData + size;
+  const char*      p    = pData;
+
+  // Header row:  the first non-blank line.
+  const char* pLineEnd = pEnd;
+  std::string_view line;
+  for (; (p != pEnd) && line.empty(); p = (pLineEnd != pEnd) ? (pLineEnd + 1) : pEnd) {
+    pLineEnd = SheetScan::FindLineEnd(p, pEnd);
+    line     = SheetScan::TrimCR(std::string_view(p, size_t(pLineEnd - p)));
+  }
+
+  const bool result = (line.empty() == false);
+  if (result) {
+    delimiter_ = (delimiter != 0)                            ? delimiter :
+                 (line.find('\t') != std::string_view::npos) ? '\t'      : ',';
+    SplitLine(line.data(), line.data() + line.size(), [this](size_t, std::string_view field)
+      { header_.push_back(field); });
+
+    // Every remaining line is at most one row, so size the columns for that many.
+    stride_ = SheetScan::CountLines(p, pEnd) + 1;
+    cells_.assign(header_.size() * stride_, std::string_view());
+
+    for (; p != pEnd; p = (pLineEnd != pEnd) ? (pLineEnd + 1) : pEnd) {
+      pLineEnd = SheetScan::FindLineEnd(p, pEnd);
+      line     = SheetScan::TrimCR(std::string_view(p, size_t(pLineEnd - p)));
+      if (line.empty() == false) {
+        std::string_view*const pRow       = &cells_[numRows_++];
+        const size_t           numColumns = header_.size();
+        const size_t           stride     = stride_;
+        SplitLine(line.data(), line.data() + line.size(),
+                  [pRow, numColumns, stride](size_t column, std::string_view field)
+                    { if (column < numColumns) { pRow[column * stride] = field; } });
+      }
+    }
+  }
+
+  return result;
+}
+
+
+/// Upgrade line of a tech in a techtree file ('UNIT_PROP', 'PLAYER_PROP', or 'FUNCTION_RESULT').
+struct TechUpgradeRecord {
+  static constexpr size_t MaxArgs = 3;
+
+  std::string_view type;           ///< Upgrade keyword, e.g. "UNIT_PROP" (see TechProperty).
+  std::string_view args[MaxArgs];  ///< UNIT_PROP:  unit type code, property name, new value.
+  uint32           numArgs;
+  uint32           line;
+};
+
+/// A tech parsed from a techtree file (as TechInfo::ParseTech()).
+struct TechRecord {
+  int TechLevel() const { return techID / 1000; }
+
+  std::string_view name;
+  std::string_view description;   ///< 'DESCRIPTION'
+  std::string_view teaser;        ///< 'TEASER'
+  std::string_view improveDesc;   ///< 'IMPROVE_DESC'
+  int              techID;
+  int              category;      ///< 'CATEGORY' (TechCategory)
+  int              plymouthCost;  ///< 'COST' or 'PLY_COST'
+  int              edenCost;      ///< 'COST' or 'EDEN_COST'
+  int              maxScientists; ///< 'MAX_SCIENTISTS'
+  int              lab;           ///< 'LAB' (TechLabType)
+  uint32           firstRequired; ///< Index into TechTreeReader::GetRequiredTechIDs().
+  uint32           numRequired;   ///< 'REQUIRES' lines.
+  uint32           firstUpgrade;  ///< Index into TechTreeReader::GetUpgrades().
+  uint32           numUpgrades;
+  uint32           line;          ///< Line number of 'BEGIN_TECH'.
+};
+
+/// Native reader for techtree text files, for the BEGIN_TECH ... END_TECH grammar parsed by TechInfo::ParseTech().
+///
+/// The file is memory mapped, and lines are found with vectorized scans;  strings are returned as views into the
+/// mapping.  Tokens are separated by whitespace, strings are enclosed in double quotes, and ';' starts a comment.
+/// Parsing stops at the first error, which is reported with its line number by GetError().
+///
+/// @code
+///   BEGIN_TECH "Agridome" 02101
+///     CATEGORY 5
+///     COST 300
+///     MAX_SCIENTISTS 4
+///     LAB 1
+///     DESCRIPTION "..."
+///     REQUIRES 02001
+///     UNIT_PROP Agridome Hit_Points 550
+///   END_TECH
+/// @endcode
+class TechTreeReader {
+public:
+  /// Maps and parses a file.  Techs with IDs above maxTechID are skipped (as Research::ParseTechFile()).
+  bool Open(const char* pFilename, int maxTechID = INT_MAX);
+
+  /// Parses a buffer, which must outlive the reader.
+  bool Parse(const char* pData, size_t size, int maxTechID = INT_MAX);
+
+  void Clear() { techs_.clear();  required_.clear();  upgrades_.clear();  sorted_.clear();  error_.clear(); }
+
+  size_t            NumTechs()        const { return techs_.size(); }
+  const TechRecord& GetTech(size_t i) const { return techs_[i];     }
+  const std::vector<TechRecord>& GetTechs() const { return techs_;  }  ///< In file order.
+
+  ///@{ Gets a tech's required tech IDs or upgrades.
+  TethysUtil::Span<int> GetRequiredTechIDs(const TechRecord& tech) const
+    { return TethysUtil::Span<int>(required_.data() + tech.firstRequired, tech.numRequired); }
+  TethysUtil::Span<TechUpgradeRecord> GetUpgrades(const TechRecord& tech) const
+    { return TethysUtil::Span<TechUpgradeRecord>(upgrades_.data() + tech.firstUpgrade, tech.numUpgrades); }
+  ///@}
+
+  /// Finds a tech by ID.  Returns nullptr if there is none.
+  const TechRecord* FindTech(int techID) const;
+
+  /// Gets the error message of the last parse, or an empty string if it succeeded.
+  const std::string& GetError() const { return error_; }
+
+private:
+  /// Splits a line into tokens (up to N).  Returns the number of tokens, or SIZE_MAX on an unterminated string.
+  template <size_t N>  static size_t Tokenize(std::string_view line, std::string_view (&tokens)[N]);
+
+  bool Fail(uint32 line, const char* pMessage, std::string_view token = std::string_view());
+
+  FileMapping                    file_;
+  std::vector<TechRecord>        techs_;
+  std::vector<int>               required_;
+  std::vector<TechUpgradeRecord> upgrades_;
+  std::vector<uint32>            sorted_;    ///< Indices of techs_, sorted by tech ID.
+  std::string                    error_;
+};
+
+// =====================================================================================================================
+inline bool TechTreeReader::Open(
+  const char*  pFilename,
+  int          maxTechID)
+{
+  Clear();
+  return file_.Open(pFilename) ? Parse(static_cast<const char*>(file_.Data()), file_.Size(), maxTechID) :
+                                 Fail(0, "Could not open file");
+}
+
+// =====================================================================================================================
+inline bool TechTreeReader::Fail(
+  uint32            line,
+  const char*       pMessage,
+  std::string_view  token)
+{
+  error_ = "Line " + std::to_string(line) + ": " + pMessage;
+  if (token.empty() == false) {
+    error_.append(" '").append(token.data(), token.size()).append("'");
+  }
+  return false;
+}
+
+// =====================================================================================================================
+template <size_t N>
+size_t TechTreeReader::Tokenize(
+  std::string_view  line,
+  std::string_view  (&tokens)[N])
+{
+  size_t count = 0;
+  for (size_t i = 0; i < line.size();) {
+    const char c = line[i];
+    if ((c == ' ') || (c == '\t') || (c == '\r')) {
+      ++i;
+    }
+    else if (c == ';') {
+      break;
+    }
+    else if (c == '"') {
+      const size_t close = line.find('"', i + 1);
+      if (close == std::string_view::npos) {
+        return SIZE_MAX;
+      }
+      if (count < N) {
+        tokens[count] = line.substr(i + 1, close - i - 1);
+      }
+      ++count;
+      i = close + 1;
+    }
+    else {
+      size_t end = i;
+      for (; (end < line.size()) && (line[end] != ' ') && (line[end] != '\t') && (line[end] != '\r'); ++end);
+      if (count < N) {
+        tokens[count] = line.substr(i, end - i);
+      }
+      ++count;
+      i = end;
+    }
+  }
+
+  return count;
+}
+
+// =====================================================================================================================
+inline bool TechTreeReader::Parse(
+  const char*  pData,
+  size_t       size,
+  int          maxTechID)
+{
+  techs_.clear();
+  required_.clear();
+  upgrades_.clear();
+  sorted_.clear();
+  error_.clear();
+
+  const auto IsKey = [](std::string_view token, const char* pKey) { return token == pKey; };
+
+  const char*const pEnd    = pData + size;
+  const char*      pLineEnd = pEnd;
+  TechRecord       tech     = { };
+  bool             inTech   = false;
+  bool             result   = true;
+  uint32           lineNum  = 0;
+
+  for (const char* p = pData; result && (p != pEnd); p = (pLineEnd != pEnd) ? (pLineEnd + 1) : pEnd) {
+    pLineEnd = SheetScan::FindLineEnd(p, pEnd);
+    ++lineNum;
+
+    std::string_view tokens[2 + TechUpgradeRecord::MaxArgs];
+    const size_t     numTokens = Tokenize(std::string_view(p, size_t(pLineEnd - p)), tokens);
+    const auto&      key       = tokens[0];
+    int              value     = 0;
+
+    if (numTokens == 0) {
+      continue;
+    }
+    else if (numTokens == SIZE_MAX) {
+      result = Fail(lineNum, "Unterminated string");
+    }
+    else if (inTech == false) {
+      if (IsKey(key, "BEGIN_TECH") && (numTokens == 3) && SheetScan::ParseInt(tokens[2], &value)) {
+        inTech             = true;
+        tech               = { };
+        tech.name          = tokens[1];
+        tech.techID        = value;
+        tech.line          = lineNum;
+        tech.firstRequired = uint32(required_.size());
+        tech.firstUpgrade  = uint32(upgrades_.size());
+      }
+      else {
+        result = Fail(lineNum, "Expected BEGIN_TECH \"name\" techID, found", key);
+      }
+    }
+    else if (IsKey(key, "END_TECH")) {
+      inTech = false;
+      if (tech.techID <= maxTechID) {
+        techs_.push_back(tech);
+      }
+      else {
+        required_.resize(tech.firstRequired);
+        upgrades_.resize(tech.firstUpgrade);
+      }
+    }
+    else if (IsKey(key, "UNIT_PROP") || IsKey(key, "PLAYER_PROP") || IsKey(key, "FUNCTION_RESULT")) {
+      if ((numTokens < 2) || (numTokens > (1 + TechUpgradeRecord::MaxArgs))) {
+        result = Fail(lineNum, "Wrong number of arguments to", key);
+      }
+      else {
+        TechUpgradeRecord upgrade = { };
+        upgrade.type    = key;
+        upgrade.numArgs = uint32(numTokens - 1);
+        upgrade.line    = lineNum;
+        std::copy(&tokens[1], &tokens[numTokens], &upgrade.args[0]);
+        upgrades_.push_back(upgrade);
+        ++tech.numUpgrades;
+      }
+    }
+    else if (IsKey(key, "DESCRIPTION") || IsKey(key, "TEASER") || IsKey(key, "IMPROVE_DESC")) {
+      std::string_view& text = IsKey(key, "DESCRIPTION") ? tech.description :
+                               IsKey(key, "TEASER")      ? tech.teaser      : tech.improveDesc;
+      text   = tokens[1];
+      result = (numTokens == 2) || Fail(lineNum, "Expected one string after", key);
+    }
+    else if ((numTokens != 2) || (SheetScan::ParseInt(tokens[1], &value) == false)) {
+      result = Fail(lineNum, "Expected one integer after", key);
+    }
+    else if (IsKey(key, "REQUIRES"))       { required_.push_back(value);  ++tech.numRequired;   }
+    else if (IsKey(key, "CATEGORY"))       { tech.category      = value;                        }
+    else if (IsKey(key, "COST"))           { tech.plymouthCost  = tech.edenCost = value;        }
+    else if (IsKey(key, "PLY_COST"))       { tech.plymouthCost  = value;                        }
+    else if (IsKey(key, "EDEN_COST"))      { tech.edenCost      = value;                        }
+    else if (IsKey(key, "MAX_SCIENTISTS")) { tech.maxScientists = value;                        }
+    else if (IsKey(key, "LAB"))            { tech.lab           = value;                        }
+    else {
+      result = Fail(lineNum, "Unknown keyword", key);
+    }
+  }
+
+  if (result && inTech) {
+    result = Fail(tech.line, "Missing END_TECH for", tech.name);
+  }
+
+  if (result) {
+    sorted_.resize(techs_.size());
+    for (uint32 i = 0; i < sorted_.size(); sorted_[i] = i, ++i);
+    std::stable_sort(sorted_.begin(), sorted_.end(),
+                     [this](uint32 a, uint32 b) { return techs_[a].techID < techs_[b].techID; });
+
+    for (size_t i = 1; result && (i < sorted_.size()); ++i) {
+      const TechRecord& cur = techs_[sorted_[i]];
+      result = (cur.techID != techs_[sorted_[i - 1]].techID) || Fail(cur.line, "Duplicate tech ID for", cur.name);
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline const TechRecord* TechTreeReader::FindTech(
+  int techID
+  ) const
+{
+  const auto it = std::lower_bound(sorted_.begin(), sorted_.end(), techID,
+                                   [this](uint32 index, int id) { return techs_[index].techID < id; });
+  return ((it != sorted_.end()) && (techs_[*it].techID == techID)) ? &techs_[*it] : nullptr;
+}
+
+} // Tethys
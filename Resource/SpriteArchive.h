@@ -0,0 +1,442 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+#include "Tethys/Common/Util.h"
+#include "Tethys/Common/FileMapping.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+
+namespace Tethys {
+
+BEGIN_PACKED
+
+/// Sprite rect in pixels, relative to the frame origin.  right and bottom are exclusive.
+struct SpriteRect {
+  int16 left;
+  int16 top;
+  int16 right;
+  int16 bottom;
+
+  bool IsEmpty() const { return (left >= right) || (top >= bottom); }
+};
+
+/// Palette color, as stored in the file (PALETTEENTRY order).
+struct SpritePaletteColor {
+  uint8 red;
+  uint8 green;
+  uint8 blue;
+  uint8 flags;
+};
+
+/// Image (bitmap) metadata, with the same layout as in the file and SpriteManager::imageInfo_[].  Pixel data is in
+/// op2_art.bmp, which this does not load.
+struct SpriteImage {
+  int32  scanlineByteWidth;
+  int32  dataOffset;
+  int32  height;
+  int32  width;
+  uint16 typeFlags;
+  uint16 paletteIndex;
+};
+static_assert(sizeof(SpriteImage) == 20, "Incorrect SpriteImage size.");
+
+/// Frame component (layer), with the same layout as in the file.  Equivalent to FrameComponentInfo.
+struct SpriteComponent {
+  uint16 imageIndex;
+  uint8  field_02;
+  uint8  frameIndex;
+  int16  pixelXOffset;
+  int16  pixelYOffset;
+};
+static_assert(sizeof(SpriteComponent) == 8, "Incorrect SpriteComponent size.");
+
+/// Animation frame.  Equivalent to FrameInfo, with FrameOptionalInfo inline and an index range into the component arena
+/// instead of a pointer.
+struct SpriteFrame {
+  SpriteRect bounds;          ///< Union of the component image rects (as FrameInfo::rect 0x7FFE = auto compute).
+  uint32     firstComponent;
+  uint8      numComponents;
+  uint8      field_01;        ///< Low 7 bits of the frame's second flags byte.
+  uint8      optionalMask;    ///< Bit 0 = offsetX/offsetY are present, bit 1 = offsetX2/offsetY2 are present.
+  int8       offsetX;
+  int8       offsetY;
+  int8       offsetX2;
+  int8       offsetY2;
+};
+
+/// Unknown per-animation record.
+struct SpriteAnimationUnknown {
+  uint32 field_00;
+  uint32 field_04;
+  uint32 field_08;
+  uint32 field_0C;
+};
+static_assert(sizeof(SpriteAnimationUnknown) == 16, "Incorrect SpriteAnimationUnknown size.");
+
+/// Animation.  Equivalent to AnimationInfo, with index ranges into the frame and unknown record arenas.
+struct SpriteAnimation {
+  int32      field_00;
+  int32      selectionLeft;
+  int32      selectionTop;
+  int32      selectionRight;
+  int32      selectionBottom;
+  int32      pixelXDisplacement;
+  int32      pixelYDisplacement;
+  int32      field_1C;
+  SpriteRect bounds;          ///< Union of the frame bounds.
+  uint32     firstFrame;
+  uint32     numFrames;
+  uint32     firstUnknown;
+  uint32     numUnknowns;
+};
+
+/// Position of an image in a texture atlas built by SpriteArchive::PackAtlas().
+struct SpriteAtlasSlot {
+  int32 x;
+  int32 y;
+};
+
+END_PACKED
+
+/// Native parser for the sprite and animation data file (op2_art.prt), for tools that run outside of the game.
+///
+/// The file is read in one pass into flat arenas:  all frames of all animations are in one array, as are all frame
+/// components, so enumerating every animation touches contiguous memory.  Each frame's bounding rect is precomputed
+/// from its components' image sizes, which the game does lazily for FrameInfo::rect = 0x7FFE.
+///
+/// File layout (little endian):
+///   "CPAL" uint32 numPalettes, then numPalettes RIFF palette chunks ("PPAL" containing "head" and a 1024-byte "data")
+///   uint32 numImages, SpriteImage[numImages]
+///   uint32 numAnimations, uint32 totalFrames, uint32 totalComponents, uint32 totalUnknowns, then per animation:
+///     int32 field_00, int32 selectionBox[4], int32 pixelDisplacement[2], int32 field_1C, uint32 numFrames
+///     per frame:  uint8 numComponents | 0x80 (has offsetX/Y), uint8 field_01 | 0x80 (has offsetX2/Y2),
+///                 int8 offsetX, offsetY (optional), int8 offsetX2, offsetY2 (optional), SpriteComponent[numComponents]
+///     uint32 numUnknowns, SpriteAnimationUnknown[numUnknowns]
+class SpriteArchive {
+public:
+  static constexpr uint32 TagPaletteList   = 0x4C415043;  ///< "CPAL"
+  static constexpr uint32 TagPalette       = 0x4C415050;  ///< "PPAL"
+  static constexpr uint32 TagPaletteData   = 0x61746164;  ///< "data"
+  static constexpr size_t MaxNumImages     = 5608;       ///< SpriteManager::MaxNumImages
+  static constexpr size_t MaxNumAnimations = 2176;       ///< SpriteManager::MaxNumAnimations
+
+  using Palette = SpritePaletteColor[256];
+
+  /// Maps and parses a file.  The mapping is released once parsing is done.
+  bool Open(const char* pFilename);
+
+  /// Parses a buffer.  Nothing points into the buffer afterwards.
+  bool Parse(const void* pData, size_t size);
+
+  void Clear() {
+    palettes_.clear();  images_.clear();  animations_.clear();  frames_.clear();  components_.clear();
+    unknowns_.clear();  error_.clear();
+  }
+
+  size_t NumPalettes()   const { return palettes_.size();   }
+  size_t NumImages()     const { return images_.size();     }
+  size_t NumAnimations() const { return animations_.size(); }
+  size_t NumFrames()     const { return frames_.size();     }  ///< Total over all animations.
+  size_t NumComponents() const { return components_.size(); }  ///< Total over all frames.
+
+  const Palette&         GetPalette(size_t i)   const { return palettes_[i].colors; }
+  const SpriteImage&     GetImage(size_t i)     const { return images_[i];          }
+  const SpriteAnimation& GetAnimation(size_t i) const { return animations_[i];      }
+
+  const std::vector<SpriteImage>&     GetImages()     const { return images_;     }
+  const std::vector<SpriteAnimation>& GetAnimations() const { return animations_; }
+  const std::vector<SpriteFrame>&     GetFrames()     const { return frames_;     }  ///< Frame arena.
+  const std::vector<SpriteComponent>& GetComponents() const { return components_; }  ///< Component arena.
+
+  ///@{ Gets the frames, components or unknown records of an animation or frame.
+  TethysUtil::Span<SpriteFrame> GetFrames(const SpriteAnimation& animation) const
+    { return TethysUtil::Span<SpriteFrame>(frames_.data() + animation.firstFrame, animation.numFrames); }
+  TethysUtil::Span<SpriteComponent> GetComponents(const SpriteFrame& frame) const
+    { return TethysUtil::Span<SpriteComponent>(components_.data() + frame.firstComponent, frame.numComponents); }
+  TethysUtil::Span<SpriteAnimationUnknown> GetUnknowns(const SpriteAnimation& animation) const
+    { return { unknowns_.data() + animation.firstUnknown, animation.numUnknowns }; }
+  ///@}
+
+  /// Lays out every image in a texture atlas of the given width, packed into shelves by descending height.  Fills
+  /// pSlots (indexed by image) and returns the atlas height, or -1 if an image is wider than the atlas.
+  int PackAtlas(int atlasWidth, std::vector<SpriteAtlasSlot>* pSlots) const;
+
+  /// Gets the error message of the last parse, or an empty string if it succeeded.
+  const std::string& GetError() const { return error_; }
+
+private:
+  struct PaletteStorage {
+    Palette colors;
+  };
+
+  /// Bounds-checked forward reader over the file buffer.
+  struct Cursor {
+    template <typename T>  bool Read(T* pOut, size_t count = 1) {
+      const bool result = (count <= (size_t(pEnd - p) / sizeof(T)));
+      if (result) {
+        memcpy(pOut, p, sizeof(T) * count);
+        p += sizeof(T) * count;
+      }
+      return result;
+    }
+
+    bool Skip(size_t size) { const bool result = (size <= size_t(pEnd - p));  p += result ? size : 0;  return result; }
+
+    const uint8* pBegin;
+    const uint8* p;
+    const uint8* pEnd;
+  };
+
+  bool ParsePalettes(Cursor* pCursor);
+  bool ParseAnimation(Cursor* pCursor, SpriteAnimation* pAnimation);
+
+  bool Fail(const Cursor& cursor, const char* pMessage);
+
+  std::vector<PaletteStorage>         palettes_;
+  std::vector<SpriteImage>            images_;
+  std::vector<SpriteAnimation>        animations_;
+  std::vector<SpriteFrame>            frames_;
+  std::vector<SpriteComponent>        components_;
+  std::vector<SpriteAnimationUnknown> unknowns_;
+  std::string                         error_;
+};
+
+// =====================================================================================================================
+inline bool SpriteArchive::Open(
+  const char* pFilename)
+{
+  Clear();
+
+  FileMapping  file;
+  const Cursor cursor = { };
+  return file.Open(pFilename) ? Parse(file.Data(), file.Size()) : Fail(cursor, "Could not open file");
+}
+
+// =====================================================================================================================
+inline bool SpriteArchive::Fail(
+  const Cursor&  cursor,
+  const char*    pMessage)
+{
+  error_ = "Offset " + std::to_string(cursor.p - cursor.pBegin) + ": " + pMessage;
+  return false;
+}
+
+// =====================================================================================================================
+inline bool SpriteArchive::Parse(
+  const void*  pData,
+  size_t       size)
+{
+  Clear();
+
+  const uint8*const pBegin = static_cast<const uint8*>(pData);
+  Cursor            cursor = { pBegin, pBegin, pBegin + ((pData != nullptr) ? size : 0) };
+
+  bool result = ParsePalettes(&cursor);
+
+  uint32 numImages = 0;
+  if (result && ((cursor.Read(&numImages) == false) || (numImages > MaxNumImages))) {
+    result = Fail(cursor, "Bad image count");
+  }
+  if (result) {
+    images_.resize(numImages);
+    result = cursor.Read(images_.data(), numImages) || Fail(cursor, "Truncated image table");
+  }
+
+  uint32 counts[4] = { };  // numAnimations, totalFrames, totalComponents, totalUnknowns
+  if (result && ((cursor.Read(counts, 4) == false) || (counts[0] > MaxNumAnimations))) {
+    result = Fail(cursor, "Bad animation count");
+  }
+
+  if (result) {
+    // The totals can't be larger than the remaining bytes allow (a frame is at least 2 bytes, the rest are fixed size),
+    // so reserving them up front is safe, and lets every arena be filled without reallocating.
+    const size_t remaining = size_t(cursor.pEnd - cursor.p);
+    animations_.reserve(counts[0]);
+    frames_.reserve(std::min<size_t>(counts[1],     remaining / 2));
+    components_.reserve(std::min<size_t>(counts[2], remaining / sizeof(SpriteComponent)));
+    unknowns_.reserve(std::min<size_t>(counts[3],   remaining / sizeof(SpriteAnimationUnknown)));
+
+    for (uint32 i = 0; result && (i < counts[0]); ++i) {
+      animations_.emplace_back();
+      result = ParseAnimation(&cursor, &animations_.back());
+    }
+  }
+
+  if (result && ((frames_.size() != counts[1]) || (components_.size() != counts[2]) || (unknowns_.size() != counts[3])))
+  {
+    result = Fail(cursor, "Animation totals do not match the header");
+  }
+
+  if (result == false) {
+    const std::string error = std::move(error_);
+    Clear();
+    error_ = std::move(error);
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool SpriteArchive::ParsePalettes(
+  Cursor* pCursor)
+{
+  uint32 header[2] = { };  // tag, numPalettes
+  bool   result    = (pCursor->Read(header, 2) && (header[0] == TagPaletteList) && (header[1] <= 256)) ||
+                     Fail(*pCursor, "Bad palette list header");
+
+  if (result) {
+    palettes_.resize(header[1]);
+  }
+
+  for (uint32 i = 0; result && (i < header[1]); ++i) {
+    // RIFF-style chunk:  "PPAL" size, then sub-chunks up to and including "data".
+    uint32 chunk[2] = { };
+    result = (pCursor->Read(chunk, 2) && (chunk[0] == TagPalette)) || Fail(*pCursor, "Bad palette chunk");
+
+    for (bool done = false; result && (done == false);) {
+      result = pCursor->Read(chunk, 2) || Fail(*pCursor, "Truncated palette chunk");
+      if (result && (chunk[0] == TagPaletteData)) {
+        result = ((chunk[1] == sizeof(Palette)) && pCursor->Read(&palettes_[i].colors[0], 256)) ||
+                 Fail(*pCursor, "Bad palette data");
+        done   = true;
+      }
+      else if (result) {
+        result = pCursor->Skip(chunk[1]) || Fail(*pCursor, "Truncated palette chunk");
+      }
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool SpriteArchive::ParseAnimation(
+  Cursor*           pCursor,
+  SpriteAnimation*  pAnimation)
+{
+  int32 fields[9] = { };
+  bool  result    = pCursor->Read(fields, 9) || Fail(*pCursor, "Truncated animation");
+
+  if (result) {
+    pAnimation->field_00           = fields[0];
+    pAnimation->selectionLeft      = fields[1];
+    pAnimation->selectionTop       = fields[2];
+    pAnimation->selectionRight     = fields[3];
+    pAnimation->selectionBottom    = fields[4];
+    pAnimation->pixelXDisplacement = fields[5];
+    pAnimation->pixelYDisplacement = fields[6];
+    pAnimation->field_1C           = fields[7];
+    pAnimation->bounds             = { };
+    pAnimation->firstFrame         = uint32(frames_.size());
+    pAnimation->numFrames          = uint32(fields[8]);
+    result = (pAnimation->numFrames <= size_t(pCursor->pEnd - pCursor->p) / 2) || Fail(*pCursor, "Bad frame count");
+  }
+
+  const size_t numImages = images_.size();
+  for (uint32 f = 0; result && (f < pAnimation->numFrames); ++f) {
+    uint8 flags[2] = { };
+    result = pCursor->Read(flags, 2) || Fail(*pCursor, "Truncated frame");
+
+    SpriteFrame frame    = { };
+    frame.numComponents  = flags[0] & 0x7F;
+    frame.field_01       = flags[1] & 0x7F;
+    frame.optionalMask   = ((flags[0] >> 7) & 1) | ((flags[1] >> 6) & 2);
+    frame.firstComponent = uint32(components_.size());
+
+    if (result && (frame.optionalMask & 1)) {
+      result = (pCursor->Read(&frame.offsetX) && pCursor->Read(&frame.offsetY)) || Fail(*pCursor, "Truncated frame");
+    }
+    if (result && (frame.optionalMask & 2)) {
+      result = (pCursor->Read(&frame.offsetX2) && pCursor->Read(&frame.offsetY2)) || Fail(*pCursor, "Truncated frame");
+    }
+
+    if (result) {
+      components_.resize(components_.size() + frame.numComponents);
+      result = pCursor->Read(components_.data() + frame.firstComponent, frame.numComponents) ||
+               Fail(*pCursor, "Truncated frame components");
+    }
+
+    // Precompute the bounding rect, as the game does on first use for FrameInfo::rect.left = 0x7FFE.
+    int left = INT16_MAX, top = INT16_MAX, right = INT16_MIN, bottom = INT16_MIN;
+    for (uint32 c = 0; result && (c < frame.numComponents); ++c) {
+      const SpriteComponent& component = components_[frame.firstComponent + c];
+      result = (component.imageIndex < numImages) || Fail(*pCursor, "Frame component image index out of range");
+
+      if (result) {
+        const SpriteImage& image = images_[component.imageIndex];
+        left   = (std::min)(left,   int(component.pixelXOffset));
+        top    = (std::min)(top,    int(component.pixelYOffset));
+        right  = (std::max)(right,  component.pixelXOffset + image.width);
+        bottom = (std::max)(bottom, component.pixelYOffset + image.height);
+      }
+    }
+
+    if (result && (frame.numComponents != 0)) {
+      const auto Clamp = [](int value) { return int16((std::min)((std::max)(value, INT16_MIN), INT16_MAX)); };
+      frame.bounds = { Clamp(left), Clamp(top), Clamp(right), Clamp(bottom) };
+
+      SpriteRect& bounds = pAnimation->bounds;
+      bounds = bounds.IsEmpty() ? frame.bounds :
+        SpriteRect{ (std::min)(bounds.left,  frame.bounds.left),  (std::min)(bounds.top,    frame.bounds.top),
+                    (std::max)(bounds.right, frame.bounds.right), (std::max)(bounds.bottom, frame.bounds.bottom) };
+    }
+
+    if (result) {
+      frames_.push_back(frame);
+    }
+  }
+
+  uint32 numUnknowns = 0;
+  if (result) {
+    result = (pCursor->Read(&numUnknowns) &&
+              (numUnknowns <= size_t(pCursor->pEnd - pCursor->p) / sizeof(SpriteAnimationUnknown))) ||
+             Fail(*pCursor, "Bad animation unknown record count");
+  }
+  if (result) {
+    pAnimation->firstUnknown = uint32(unknowns_.size());
+    pAnimation->numUnknowns  = numUnknowns;
+    unknowns_.resize(unknowns_.size() + numUnknowns);
+    pCursor->Read(unknowns_.data() + pAnimation->firstUnknown, numUnknowns);
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline int SpriteArchive::PackAtlas(
+  int                            atlasWidth,
+  std::vector<SpriteAtlasSlot>*  pSlots
+  ) const
+{
+  std::vector<uint32> order(images_.size());
+  for (uint32 i = 0; i < order.size(); order[i] = i, ++i);
+  std::stable_sort(order.begin(), order.end(),
+                   [this](uint32 a, uint32 b) { return images_[a].height > images_[b].height; });
+
+  pSlots->assign(images_.size(), SpriteAtlasSlot{ });
+
+  int x = 0, y = 0, shelfHeight = 0;
+  for (size_t i = 0; (y != -1) && (i < order.size()); ++i) {
+    const SpriteImage& image = images_[order[i]];
+    if ((image.width > atlasWidth) || (image.width < 0) || (image.height < 0)) {
+      y = -1;
+    }
+    else {
+      if ((x + image.width) > atlasWidth) {
+        x           = 0;
+        y          += shelfHeight;
+        shelfHeight = 0;
+      }
+      (*pSlots)[order[i]] = { x, y };
+      x          += image.width;
+      shelfHeight = (std::max)(shelfHeight, int(image.height));
+    }
+  }
+
+  return (y == -1) ? -1 : (y + shelfHeight);
+}
+
+} // Tethys
@@ -0,0 +1,368 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+#include "Tethys/Common/FileMapping.h"
+#include "Tethys/Common/WorkStealingPool.h"
+#include "Tethys/Resource/VolArchive.h"
+#include "Tethys/Resource/VolCodec.h"
+#include "Tethys/Resource/PaletteBlit.h"
+#include "Tethys/Resource/LightPaletteCache.h"
+
+#include <string_view>
+#include <string>
+#include <vector>
+#include <cstring>
+
+namespace Tethys {
+
+/// Native tileset (well*.bmp) loader, as a replacement for GFXTilesetBitmap::LoadAndFlatten() in offline renderers.
+///
+/// Reads 8-bit Windows BMPs and the game's packed "PBMP" tileset format, from disk or from a .vol archive (compressed
+/// entries are decoded with VolDecoder).  Pixels are flattened tile-major into one 64-byte aligned buffer:  tile t is
+/// TileSize x TileSize bytes at GetTile(t), rows top-down, as GFXTilesetBitmap::pPixelData_ (numTiles * bytesPerTile).
+/// Images wider than one tile are split into tiles left to right, then top to bottom.
+///
+/// PrecomputeLightLevels() optionally expands every tile to RGB555 for all 32 light levels in parallel, using shared
+/// LightPaletteCache tables and the PaletteBlit kernels.
+///
+/// PBMP layout (little endian), as chunks of uint32 tag, uint32 size:
+///   "PBMP" { "head" { uint32 field_00, uint32 width, int32 height, uint32 bitDepth, uint32 flags },
+///            "PPAL" { "head" { uint32 }, "data" { PALETTEENTRY[256] } },  "data" { uint8 pixels[], top-down rows } }
+class TilesetImage {
+public:
+  static constexpr int    TileSize      = 32;
+  static constexpr size_t BytesPerTile  = TileSize * TileSize;
+  static constexpr size_t Alignment     = 64;
+  static constexpr int    NumLevels     = int(LightPaletteTables::NumLevels);
+
+  static constexpr uint32 TagBitmap     = 0x504D4250;  ///< "PBMP"
+  static constexpr uint32 TagHead       = 0x64616568;  ///< "head"
+  static constexpr uint32 TagPalette    = 0x4C415050;  ///< "PPAL"
+  static constexpr uint32 TagData       = 0x61746164;  ///< "data"
+
+  using Palette = uint8[256][4];
+
+  TilesetImage() = default;
+  TilesetImage(const TilesetImage&)            = delete;
+  TilesetImage& operator=(const TilesetImage&) = delete;
+  TilesetImage(TilesetImage&&)                 = default;
+  TilesetImage& operator=(TilesetImage&&)      = default;
+
+  /// Loads a tileset file (.bmp or PBMP).
+  bool Open(const char* pFilename);
+
+  /// Loads a tileset from a .vol archive.
+  bool Open(const VolArchive& archive, std::string_view name);
+
+  /// Parses a tileset already in memory.  Nothing points into the buffer afterwards.
+  bool Parse(const void* pData, size_t size);
+
+  void Clear();
+
+  size_t NumTiles() const { return numTiles_; }
+  int    Width()    const { return width_;    }  ///< Source image width in pixels.
+  int    Height()   const { return height_;   }  ///< Source image height in pixels.
+
+  /// Gets the flattened pixel buffer (NumTiles() * BytesPerTile bytes), or a tile's pixels.
+  const uint8* GetPixels()       const { return pPixels_;                      }
+  const uint8* GetTile(size_t t) const { return pPixels_ + (t * BytesPerTile); }
+
+  /// Gets the palette, in PALETTEENTRY order (red, green, blue, flags).
+  const Palette& GetPalette() const { return palette_; }
+
+  /// Builds RGB555 pixels for every tile at every light level, across numThreads threads (0 = one per hardware thread).
+  /// Light tables are shared through pCache (or built uncached if it is nullptr).
+  void PrecomputeLightLevels(
+    int numThreads = 0, LightPaletteCache* pCache = LightPaletteCache::GetInstance(), const uint16* pCurve = nullptr);
+
+  bool HasLightLevels() const { return (pLitPixels_ != nullptr); }
+
+  /// Gets a tile's RGB555 pixels at a light level (0 = darkest).  Requires PrecomputeLightLevels().
+  const uint16* GetLitTile(int level, size_t t) const
+    { return pLitPixels_ + (((size_t(level) * numTiles_) + t) * BytesPerTile); }
+
+  /// Gets the light tables used by PrecomputeLightLevels().
+  const LightPaletteCache::TablesPtr& GetLightTables() const { return lightTables_; }
+
+  /// Gets the error message of the last load, or an empty string if it succeeded.
+  const std::string& GetError() const { return error_; }
+
+private:
+  bool ParseBmp(const uint8* pData, size_t size);
+  bool ParsePbmp(const uint8* pData, size_t size);
+
+  /// Copies an 8-bit image into the tile-major buffer.  pRow0 is the top row;  pitch may be negative (bottom-up).
+  bool Flatten(const uint8* pRow0, ptrdiff_t pitch, int width, int height);
+
+  /// Allocates size elements of T aligned to Alignment in storage.
+  template <typename T>  static T* Allocate(std::vector<uint8>* pStorage, size_t size);
+
+  bool Fail(const char* pMessage) { error_ = pMessage;  return false; }
+
+  std::vector<uint8>            pixelStorage_;
+  uint8*                        pPixels_    = nullptr;
+  size_t                        numTiles_   = 0;
+  int                           width_      = 0;
+  int                           height_     = 0;
+  Palette                       palette_    = { };
+  std::vector<uint8>            litStorage_;
+  uint16*                       pLitPixels_ = nullptr;
+  LightPaletteCache::TablesPtr  lightTables_;
+  std::string                   error_;
+};
+
+// =====================================================================================================================
+template <typename T>
+T* TilesetImage::Allocate(
+  std::vector<uint8>*  pStorage,
+  size_t               size)
+{
+  pStorage->assign((size * sizeof(T)) + Alignment, 0);
+  const uintptr address = reinterpret_cast<uintptr>(pStorage->data());
+  return reinterpret_cast<T*>(pStorage->data() + ((Alignment - (address % Alignment)) % Alignment));
+}
+
+// =====================================================================================================================
+inline void TilesetImage::Clear() {
+  pixelStorage_.clear();
+  litStorage_.clear();
+  pPixels_    = nullptr;
+  pLitPixels_ = nullptr;
+  numTiles_   = 0;
+  width_      = 0;
+  height_     = 0;
+  lightTables_.reset();
+  memset(&palette_[0][0], 0, sizeof(palette_));
+  error_.clear();
+}
+
+// =====================================================================================================================
+inline bool TilesetImage::Open(
+  const char* pFilename)
+{
+  Clear();
+  FileMapping file;
+  return file.Open(pFilename) ? Parse(file.Data(), file.Size()) : Fail("Could not open file");
+}
+
+// =====================================================================================================================
+inline bool TilesetImage::Open(
+  const VolArchive&  archive,
+  std::string_view   name)
+{
+  Clear();
+
+  const VolArchive::Entry*const pEntry = archive.Find(name);
+  bool result = (pEntry != nullptr) || Fail("File not found in archive");
+
+  if (result && pEntry->IsCompressed()) {
+    std::vector<uint8> decoded(pEntry->length);
+    result = VolDecoder::Decompress(
+               pEntry->compression, pEntry->data.data(), pEntry->data.size(), decoded.data(), decoded.size()) ||
+             Fail("Could not decompress archive entry");
+    result = result && Parse(decoded.data(), decoded.size());
+  }
+  else if (result) {
+    result = Parse(pEntry->data.data(), (std::min)(pEntry->data.size(), size_t(pEntry->length)));
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool TilesetImage::Parse(
+  const void*  pData,
+  size_t       size)
+{
+  Clear();
+
+  const uint8*const p   = static_cast<const uint8*>(pData);
+  uint32            tag = 0;
+  if ((p != nullptr) && (size >= 4)) {
+    memcpy(&tag, p, sizeof(tag));
+  }
+
+  const bool result = (tag == TagBitmap)                 ? ParsePbmp(p, size) :
+                      ((tag & 0xFFFF) == 0x4D42 /* BM */) ? ParseBmp(p, size)  : Fail("Unknown file format");
+
+  if (result == false) {
+    std::string error = std::move(error_);
+    Clear();
+    error_ = std::move(error);
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool TilesetImage::ParseBmp(
+  const uint8*  pData,
+  size_t        size)
+{
+  // BITMAPFILEHEADER (14 bytes), then BITMAPINFOHEADER or a later version (40+ bytes), then the color table.
+  const auto Get32 = [pData](size_t offset) { uint32 value;  memcpy(&value, pData + offset, 4);  return value; };
+  const auto Get16 = [pData](size_t offset) { uint16 value;  memcpy(&value, pData + offset, 2);  return value; };
+
+  bool result = (size >= 54) || Fail("Truncated bitmap header");
+
+  const uint32 pixelOffset = result ? Get32(10) : 0;
+  const uint32 infoSize    = result ? Get32(14) : 0;
+  const int32  width       = result ? int32(Get32(18)) : 0;
+  const int32  height      = result ? int32(Get32(22)) : 0;
+  const uint16 bitDepth    = result ? Get16(28) : 0;
+  const uint32 compression = result ? Get32(30) : 0;
+  const uint32 numColors   = result ? (Get32(46) ? Get32(46) : 256) : 0;  // 0 = 2^bitDepth
+
+  result = result && (((infoSize >= 40) && (bitDepth == 8) && (compression == 0)) ||
+                      Fail("Only uncompressed 8-bit bitmaps are supported"));
+  result = result && (((numColors <= 256) && ((14 + uint64(infoSize) + (uint64(numColors) * 4)) <= size)) ||
+                      Fail("Truncated bitmap color table"));
+
+  if (result) {
+    // RGBQUAD to PALETTEENTRY.
+    const uint8*const pColors = pData + 14 + infoSize;
+    for (uint32 i = 0; i < numColors; ++i) {
+      palette_[i][0] = pColors[(i * 4) + 2];
+      palette_[i][1] = pColors[(i * 4) + 1];
+      palette_[i][2] = pColors[(i * 4) + 0];
+      palette_[i][3] = 0;
+    }
+
+    const int    absHeight = (height < 0) ? -height : height;
+    const size_t pitch     = ((size_t(width) + 3) / 4) * 4;
+    result = ((width > 0) && (absHeight > 0) && (pixelOffset + (uint64(pitch) * absHeight) <= size)) ||
+             Fail("Truncated bitmap pixels");
+
+    if (result) {
+      // Positive height means bottom-up rows.
+      const uint8* pPixels = pData + pixelOffset;
+      result = (height > 0) ? Flatten(pPixels + (pitch * (absHeight - 1)), -ptrdiff_t(pitch), width, absHeight) :
+                              Flatten(pPixels,                              ptrdiff_t(pitch), width, absHeight);
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool TilesetImage::ParsePbmp(
+  const uint8*  pData,
+  size_t        size)
+{
+  const auto Get32 = [pData](size_t offset) { uint32 value;  memcpy(&value, pData + offset, 4);  return value; };
+
+  // Walks the chunks in [offset, end), calling fn(tag, dataOffset, dataSize) for each.
+  const auto ForEachChunk = [&](size_t offset, size_t end, auto&& fn) {
+    bool ok = true;
+    while (ok && ((offset + 8) <= end)) {
+      const uint32 tag       = Get32(offset);
+      const uint32 chunkSize = Get32(offset + 4);
+      ok = ((offset + 8 + uint64(chunkSize)) <= end) || Fail("Truncated PBMP chunk");
+      ok = ok && fn(tag, offset + 8, size_t(chunkSize));
+      offset += 8 + size_t(chunkSize);
+    }
+    return ok;
+  };
+
+  int32  width       = 0;
+  int32  height      = 0;
+  uint32 bitDepth    = 0;
+  bool   hasPalette  = false;
+  size_t pixelOffset = 0;
+  size_t pixelSize   = 0;
+
+  const auto ReadChunk = [&](uint32 tag, size_t offset, size_t chunkSize) {
+    bool ok = true;
+    if (tag == TagHead) {
+      ok = (chunkSize >= 16) || Fail("Bad PBMP head");
+      width    = ok ? int32(Get32(offset + 4))  : 0;
+      height   = ok ? int32(Get32(offset + 8))  : 0;
+      bitDepth = ok ? Get32(offset + 12)        : 0;
+    }
+    else if (tag == TagPalette) {
+      ok = ForEachChunk(offset, offset + chunkSize, [&](uint32 subTag, size_t subOffset, size_t subSize) {
+        if ((subTag == TagData) && (subSize == sizeof(palette_))) {
+          memcpy(&palette_[0][0], pData + subOffset, sizeof(palette_));
+          hasPalette = true;
+        }
+        return true;
+      });
+    }
+    else if (tag == TagData) {
+      pixelOffset = offset;
+      pixelSize   = chunkSize;
+    }
+    return ok;
+  };
+
+  const size_t end    = (size >= 8) ? (std::min)(size, size_t(8) + Get32(4)) : 0;
+  bool         result = ((end != 0) || Fail("Truncated PBMP header")) && ForEachChunk(8, end, ReadChunk);
+  result = result && (((bitDepth == 8) && (width > 0) && (height != 0)) ||
+                      Fail("Only 8-bit PBMP tilesets are supported"));
+  result = result && (hasPalette || Fail("PBMP has no palette"));
+
+  if (result) {
+    const int    absHeight = (height < 0) ? -height : height;
+    const size_t pitch     = ((size_t(width) + 3) / 4) * 4;
+    result = ((uint64(pitch) * absHeight) <= pixelSize) || Fail("Truncated PBMP pixels");
+    result = result && Flatten(pData + pixelOffset, ptrdiff_t(pitch), width, absHeight);
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool TilesetImage::Flatten(
+  const uint8*  pRow0,
+  ptrdiff_t     pitch,
+  int           width,
+  int           height)
+{
+  const bool result = (((width % TileSize) == 0) && ((height % TileSize) == 0)) ||
+                      Fail("Image size is not a multiple of the tile size");
+
+  if (result) {
+    const size_t tilesPerRow = size_t(width / TileSize);
+    width_    = width;
+    height_   = height;
+    numTiles_ = tilesPerRow * size_t(height / TileSize);
+    pPixels_  = Allocate<uint8>(&pixelStorage_, numTiles_ * BytesPerTile);
+
+    for (int y = 0; y < height; ++y) {
+      const uint8*const pSrc = pRow0 + (pitch * y);
+      const size_t      tile = (size_t(y / TileSize) * tilesPerRow);
+      for (size_t tx = 0; tx < tilesPerRow; ++tx) {
+        memcpy(pPixels_ + ((tile + tx) * BytesPerTile) + (size_t(y % TileSize) * TileSize), pSrc + (tx * TileSize),
+               TileSize);
+      }
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline void TilesetImage::PrecomputeLightLevels(
+  int                 numThreads,
+  LightPaletteCache*  pCache,
+  const uint16*       pCurve)
+{
+  lightTables_ = (pCache != nullptr) ? pCache->Get(&palette_[0][0], LightPaletteCache::ColorOrder::Rgbx, pCurve) :
+                                       LightPaletteCache::Build(&palette_[0][0], LightPaletteCache::ColorOrder::Rgbx,
+                                                                pCurve);
+  pLitPixels_  = Allocate<uint16>(&litStorage_, size_t(NumLevels) * numTiles_ * BytesPerTile);
+
+  // One task per light level and run of tiles, so each task writes a contiguous span.
+  static constexpr size_t TilesPerTask = 64;
+  const size_t tasksPerLevel = (numTiles_ + TilesPerTask - 1) / TilesPerTask;
+
+  WorkStealingPool::ParallelFor(size_t(NumLevels) * tasksPerLevel, numThreads, [this, tasksPerLevel](size_t i, int) {
+    const size_t level     = i / tasksPerLevel;
+    const size_t firstTile = (i % tasksPerLevel) * TilesPerTask;
+    const size_t numTiles  = (std::min)(TilesPerTask, numTiles_ - firstTile);
+    PaletteBlit::Expand(lightTables_->GetLevel(level), GetTile(firstTile),
+                        pLitPixels_ + (((level * numTiles_) + firstTile) * BytesPerTile), numTiles * BytesPerTile);
+  });
+}
+
+} // Tethys
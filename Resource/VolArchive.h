@@ -0,0 +1,282 @@
+#pragma once
+
+#include "Tethys/Resource/VolFormat.h"
+#include "Tethys/Common/FileMapping.h"
+
+#include <algorithm>
+#include <numeric>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <cstring>
+
+namespace Tethys {
+
+/// Standalone, read-only .vol archive reader that does not depend on the game's stream classes.
+///
+/// The archive is memory-mapped (or wraps a caller-owned buffer), and entries are handed back as views into the mapping
+/// without copying.  Name lookups are case-insensitive binary searches over an index sorted once when opening.
+///
+/// Entry data is the stored (possibly compressed) block contents;  for CompressionCode::Uncompressed entries, that is
+/// the file itself.  Views are valid until the archive is closed or destroyed (moving the archive keeps them valid).
+///
+/// @note  This is header-only and portable (@see FileMapping), so it can be used by offline tools.
+class VolArchive {
+public:
+  struct Entry {
+    std::string_view name;         ///< File name, as stored in the string table.
+    std::string_view data;         ///< Stored data of the VBLK block.
+    uint32           length;       ///< Length of the file data, from the index entry.
+    CompressionCode  compression;  ///< Compression used on the stored data.
+
+    bool IsCompressed() const { return (compression != CompressionCode::Uncompressed); }
+  };
+
+   VolArchive() = default;
+  ~VolArchive() { Close(); }
+
+  VolArchive(const VolArchive&)            = delete;
+  VolArchive& operator=(const VolArchive&) = delete;
+
+  VolArchive(VolArchive&& other) noexcept { *this = std::move(other); }
+  VolArchive& operator=(VolArchive&& other) noexcept;
+
+  /// Memory-maps and parses the given .vol file.  Returns false if the file can't be mapped or is malformed.
+  bool Open(const char* pFilename);
+
+  /// Parses a .vol image already in memory.  The buffer is not copied, and must outlive the archive.
+  bool OpenMemory(const void* pData, size_t size);
+
+  /// Unmaps the file and clears all entries.
+  void Close();
+
+  bool   IsOpen()     const { return (pData_ != nullptr);  }
+  size_t NumEntries() const { return entries_.size();      }
+
+  /// Gets the raw archive image.
+  const void* Data() const { return pData_; }
+  size_t      Size() const { return size_;  }
+
+  /// Gets an entry by its position in the archive's index table.
+  const Entry& GetEntry(size_t index) const { return entries_[index]; }
+
+  ///@{ Iterates over entries in index table order.
+  const Entry* begin() const { return entries_.data();                   }
+  const Entry* end()   const { return entries_.data() + entries_.size(); }
+  ///@}
+
+  /// Finds an entry by name (case-insensitive).  Returns nullptr if not found.
+  const Entry* Find(std::string_view name) const;
+
+  /// Gets the contents of an uncompressed file by name.  Returns an empty view if not found or if compressed.
+  std::string_view GetData(std::string_view name) const {
+    const Entry*const pEntry = Find(name);
+    return ((pEntry != nullptr) && (pEntry->IsCompressed() == false)) ? pEntry->data : std::string_view();
+  }
+
+  /// Compares file names the way the archive index is sorted (ASCII case-insensitive).
+  static int CompareNames(std::string_view a, std::string_view b);
+
+private:
+  bool Parse();
+
+  /// Reads a section header at offset, and validates that its data fits in [offset, end).
+  bool ReadSection(size_t offset, size_t end, uint32 tag, VBlkHeader* pHeader) const;
+
+  static size_t PaddedSize(const VBlkHeader& header)
+    { return header.alignment ? ((size_t(header.size) + 3) & ~size_t(3)) : ((size_t(header.size) + 1) & ~size_t(1)); }
+
+  static char ToLower(char c) { return ((c >= 'A') && (c <= 'Z')) ? char(c - 'A' + 'a') : c; }
+
+  FileMapping         file_;     ///< Mapping of the archive file, if opened with Open().
+  const char*         pData_ = nullptr;
+  size_t              size_  = 0;
+  std::vector<Entry>  entries_;
+  std::vector<uint32> sorted_;   ///< Entry indices sorted by name.
+};
+
+// =====================================================================================================================
+inline VolArchive& VolArchive::operator=(
+  VolArchive&& other
+  ) noexcept
+{
+  if (this != &other) {
+    Close();
+    file_    = std::move(other.file_);
+    pData_   = other.pData_;
+    size_    = other.size_;
+    entries_ = std::move(other.entries_);
+    sorted_  = std::move(other.sorted_);
+    other.Close();
+  }
+
+  return *this;
+}
+
+// =====================================================================================================================
+inline bool VolArchive::Open(
+  const char* pFilename)
+{
+  Close();
+
+  if (file_.Open(pFilename)) {
+    pData_ = static_cast<const char*>(file_.Data());
+    size_  = file_.Size();
+    if (Parse() == false) {
+      Close();
+    }
+  }
+
+  return IsOpen();
+}
+
+// =====================================================================================================================
+inline bool VolArchive::OpenMemory(
+  const void*  pData,
+  size_t       size)
+{
+  Close();
+
+  if (pData != nullptr) {
+    pData_ = static_cast<const char*>(pData);
+    size_  = size;
+    if (Parse() == false) {
+      Close();
+    }
+  }
+
+  return IsOpen();
+}
+
+// =====================================================================================================================
+inline void VolArchive::Close() {
+  file_.Close();
+  pData_ = nullptr;
+  size_  = 0;
+  entries_.clear();
+  sorted_.clear();
+}
+
+// =====================================================================================================================
+inline bool VolArchive::ReadSection(
+  size_t       offset,
+  size_t       end,
+  uint32       tag,
+  VBlkHeader*  pHeader
+  ) const
+{
+  bool result = false;
+
+  if ((end <= size_) && (offset <= end) && ((end - offset) >= sizeof(VBlkHeader))) {
+    memcpy(pHeader, pData_ + offset, sizeof(VBlkHeader));
+    result = (pHeader->tag == tag) && (pHeader->size <= (end - offset - sizeof(VBlkHeader)));
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool VolArchive::Parse() {
+  VBlkHeader header;
+  if (ReadSection(0, size_, VolTagVol, &header) == false) {
+    return false;
+  }
+
+  // The 'VOL ' section contains the volh, vols and voli sections, in that order.
+  const size_t volEnd = sizeof(VBlkHeader) + header.size;
+  size_t       offset = sizeof(VBlkHeader);
+
+  if (ReadSection(offset, volEnd, VolTagHeader, &header) == false) {
+    return false;
+  }
+  offset += sizeof(VBlkHeader) + PaddedSize(header);
+
+  if (ReadSection(offset, volEnd, VolTagNames, &header) == false) {
+    return false;
+  }
+
+  // The string table starts with its actual length (excluding padding), followed by null-terminated names.
+  std::string_view names;
+  if (header.size >= sizeof(uint32)) {
+    uint32 namesLength = 0;
+    memcpy(&namesLength, pData_ + offset + sizeof(VBlkHeader), sizeof(namesLength));
+    names = std::string_view(pData_ + offset + sizeof(VBlkHeader) + sizeof(uint32),
+                             (std::min)(size_t(namesLength), size_t(header.size) - sizeof(uint32)));
+  }
+  offset += sizeof(VBlkHeader) + PaddedSize(header);
+
+  if (ReadSection(offset, volEnd, VolTagIndex, &header) == false) {
+    return false;
+  }
+
+  const char*const pIndex     = pData_ + offset + sizeof(VBlkHeader);
+  const size_t     numEntries = header.size / sizeof(VolIndexEntry);
+  entries_.reserve(numEntries);
+
+  for (size_t i = 0; i < numEntries; ++i) {
+    VolIndexEntry indexEntry;
+    memcpy(&indexEntry, pIndex + (i * sizeof(VolIndexEntry)), sizeof(indexEntry));
+
+    // Unused entries only occur at the end of the table.
+    if (indexEntry.bUsed != 1) {
+      break;
+    }
+
+    VBlkHeader block;
+    if ((indexEntry.fileNameOffset >= names.size()) ||
+        (ReadSection(indexEntry.dataOffset, size_, VolTagBlock, &block) == false))
+    {
+      return false;
+    }
+
+    Entry entry;
+    entry.name        = names.substr(indexEntry.fileNameOffset);
+    entry.name        = entry.name.substr(0, entry.name.find('\0'));
+    entry.data        = std::string_view(pData_ + indexEntry.dataOffset + sizeof(VBlkHeader), block.size);
+    entry.length      = indexEntry.dataLength;
+    entry.compression = indexEntry.compressionCode;
+    entries_.push_back(entry);
+  }
+
+  // The game binary searches the index, so archives are normally already sorted;  only sort if they are not.
+  auto less = [this](uint32 a, uint32 b) { return CompareNames(entries_[a].name, entries_[b].name) < 0; };
+
+  sorted_.resize(entries_.size());
+  std::iota(sorted_.begin(), sorted_.end(), 0);
+  if (std::is_sorted(sorted_.begin(), sorted_.end(), less) == false) {
+    std::stable_sort(sorted_.begin(), sorted_.end(), less);
+  }
+
+  return true;
+}
+
+// =====================================================================================================================
+inline const VolArchive::Entry* VolArchive::Find(
+  std::string_view name
+  ) const
+{
+  auto less = [this](uint32 index, std::string_view key) { return CompareNames(entries_[index].name, key) < 0; };
+  auto it   = std::lower_bound(sorted_.begin(), sorted_.end(), name, less);
+
+  return ((it != sorted_.end()) && (CompareNames(entries_[*it].name, name) == 0)) ? &entries_[*it] : nullptr;
+}
+
+// =====================================================================================================================
+inline int VolArchive::CompareNames(
+  std::string_view a,
+  std::string_view b)
+{
+  const size_t length = (std::min)(a.size(), b.size());
+
+  for (size_t i = 0; i < length; ++i) {
+    const char ca = ToLower(a[i]);
+    const char cb = ToLower(b[i]);
+    if (ca != cb) {
+      return (uint8(ca) < uint8(cb)) ? -1 : 1;
+    }
+  }
+
+  return (a.size() < b.size()) ? -1 : ((a.size() > b.size()) ? 1 : 0);
+}
+
+} // Tethys
@@ -0,0 +1,956 @@
+#pragma once
+
+#include "Tethys/Resource/VolFormat.h"
+
+#include <algorithm>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace Tethys {
+
+/// MSB-first bit reader over a memory buffer, used by the VOL decoders.  Reads past the end of input return 0 bits.
+class VolBitReader {
+public:
+  static constexpr int MaxPeekBits = 57;  ///< Number of bits guaranteed to be buffered after Refill().
+
+  void Reset(const void* pSrc, size_t size) {
+    pSrc_ = static_cast<const uint8*>(pSrc);  pEnd_ = pSrc_ + size;  bits_ = 0;  numBits_ = 0;
+    bitsLeft_ = int64_t(size) * 8;
+  }
+
+  /// Buffers at least MaxPeekBits bits.
+  void Refill() {
+    for (; numBits_ < MaxPeekBits; numBits_ += 8) {
+      bits_ |= uint64((pSrc_ < pEnd_) ? *(pSrc_++) : 0) << (56 - numBits_);
+    }
+  }
+
+  /// Gets the next numBits (1-32) buffered bits without consuming them.
+  uint32 Peek(int numBits) const { return uint32(bits_ >> (64 - numBits)); }
+
+  void Consume(int numBits) { bits_ <<= numBits;  numBits_ -= numBits;  bitsLeft_ -= numBits; }
+
+  /// Reads numBits (1-32) bits.  Refill() must have been called since buffering enough bits.
+  uint32 Get(int numBits) { const uint32 result = Peek(numBits);  Consume(numBits);  return result; }
+
+  /// Returns true if more bits have been consumed than the input contains.
+  bool IsOverrun() const { return (bitsLeft_ < 0); }
+
+  /// Gets the number of input bits left to consume.
+  int64_t BitsLeft() const { return bitsLeft_; }
+
+private:
+  const uint8* pSrc_     = nullptr;
+  const uint8* pEnd_     = nullptr;
+  uint64       bits_     = 0;
+  int          numBits_  = 0;
+  int64_t      bitsLeft_ = 0;
+};
+
+
+/// Native decoder for CompressionCode::LZH data (@see LZHRStream).
+///
+/// The format is LZSS over a 4096-byte window (initially filled with spaces), with literals and match lengths coded by
+/// an adaptive Huffman tree of 314 codes:  codes 0-255 are literals, and codes 256+ are matches of (code - 253) bytes.
+/// Match distances are coded as 6 upper bits with a fixed variable-length prefix code, followed by 6 raw lower bits.
+///
+/// The decoder is pull-based:  Read() decodes directly into the caller's buffer, and can be called with any chunk size.
+class LzhDecoder {
+public:
+  static constexpr int    WindowBits = 12;
+  static constexpr size_t WindowSize = size_t(1) << WindowBits;
+  static constexpr int    MinMatch   = 3;
+  static constexpr int    MaxMatch   = 60;
+  static constexpr int    NumCodes   = 256 - MinMatch + 1 + MaxMatch;  ///< 314 leaves in the Huffman tree.
+  static constexpr int    TreeSize   = (NumCodes * 2) - 1;             ///< Number of nodes in the Huffman tree.
+  static constexpr int    Root       = TreeSize - 1;
+  static constexpr uint16 MaxFreq    = 0x8000;                         ///< Root frequency that triggers a rebuild.
+
+  /// Starts decoding pSrc.  length is the decoded size (VolIndexEntry::dataLength), if known;  otherwise, decoding
+  /// stops at the end of input, which may produce trailing garbage from the final byte's padding bits.
+  void Reset(const void* pSrc, size_t srcSize, size_t length = SIZE_MAX);
+
+  /// Decodes up to size bytes into pDst.  Returns the number of bytes decoded;  less than size only once done.
+  size_t Read(void* pDst, size_t size);
+
+  /// Returns true once length bytes have been decoded, or input has run out.
+  bool IsDone() const { return (remaining_ == 0) || (inputDone_ && (matchLeft_ == 0)); }
+
+  /// Returns true if input ran out before length bytes were decoded.
+  bool HasError() const { return inputDone_ && (remaining_ != 0) && (remaining_ != SIZE_MAX) && (matchLeft_ == 0); }
+
+  /// Fixed prefix code table for the upper 6 bits of match distances.
+  struct DistanceTable {
+    uint8 code[256];    ///< Upper 6 bits of the distance, indexed by the next 8 input bits.
+    uint8 length[256];  ///< Total length in bits of the upper 6 bits' code, indexed by the next 8 input bits.
+  };
+  static const DistanceTable& GetDistanceTable();
+
+  /// Adaptive Huffman tree shared with the LZH encoder.
+  class Tree {
+  public:
+    void Init();
+    void Update(int code);
+
+    uint16 freq_[TreeSize + 1];           ///< Node frequencies in increasing order;  freq_[TreeSize] is a sentinel.
+    uint16 son_[TreeSize];                ///< Left child of each node (right child is +1), or leaf code + TreeSize.
+    uint16 parent_[TreeSize + NumCodes];  ///< Parent of each node, followed by the node of each leaf code.
+
+  private:
+    void Rebuild();
+  };
+
+private:
+  /// Decodes the next code, and for matches, its distance into matchIndex_ and matchLeft_.  Returns -1 at the end of
+  /// input.
+  int DecodeNext();
+
+  VolBitReader reader_;
+  Tree         tree_;
+  uint8        window_[WindowSize];
+  size_t       writeIndex_;
+  size_t       matchIndex_;  ///< Window index of the next byte of the current match.
+  size_t       matchLeft_;   ///< Bytes left to copy of the current match.
+  size_t       remaining_;   ///< Bytes left to decode, or SIZE_MAX if unknown.
+  bool         inputDone_;
+};
+
+
+/// Native decoder for CompressionCode::LZ data (@see LZRStream).
+///
+/// The format is bit-packed LZSS over a 4096-byte window (initially zeroed, writes start at index 1):  a 1 bit is
+/// followed by an 8-bit literal, and a 0 bit by a 12-bit absolute window position and 4-bit length, copying
+/// (length + 2) bytes.  Position 0 marks the end of the stream.
+class LzDecoder {
+public:
+  static constexpr int    WindowBits = 12;
+  static constexpr size_t WindowSize = size_t(1) << WindowBits;
+  static constexpr int    LengthBits = 4;
+  static constexpr int    MinMatch   = 2;
+
+  void   Reset(const void* pSrc, size_t srcSize, size_t length = SIZE_MAX);
+  size_t Read(void* pDst, size_t size);  ///< @see LzhDecoder::Read()
+
+  bool IsDone()   const { return (remaining_ == 0) || (inputDone_ && (matchLeft_ == 0)); }
+  bool HasError() const { return inputDone_ && (remaining_ != 0) && (remaining_ != SIZE_MAX) && (matchLeft_ == 0); }
+
+private:
+  int DecodeNext();  ///< @see LzhDecoder::DecodeNext()
+
+  VolBitReader reader_;
+  uint8        window_[WindowSize];
+  size_t       writeIndex_;
+  size_t       matchIndex_;
+  size_t       matchLeft_;
+  size_t       remaining_;
+  bool         inputDone_;
+};
+
+
+/// Native decoder for CompressionCode::RLE data (@see RLERStream).
+///
+/// Each packet starts with a control byte n:  if bit 7 is clear, (n + 1) literal bytes follow;  otherwise, the next
+/// byte is repeated ((n & 0x7F) + 1) times.
+///
+/// @note  The game's archives do not use RLE, so this layout has not been checked against game-written data.
+class RleDecoder {
+public:
+  void   Reset(const void* pSrc, size_t srcSize, size_t length = SIZE_MAX);
+  size_t Read(void* pDst, size_t size);  ///< @see LzhDecoder::Read()
+
+  bool IsDone()   const { return (remaining_ == 0) || ((pSrc_ == pEnd_) && (runLeft_ == 0) && (copyLeft_ == 0)); }
+  bool HasError() const
+    { return (pSrc_ == pEnd_) && (runLeft_ == 0) && (copyLeft_ == 0) && (remaining_ != 0) && (remaining_ != SIZE_MAX); }
+
+private:
+  const uint8* pSrc_      = nullptr;
+  const uint8* pEnd_      = nullptr;
+  size_t       runLeft_   = 0;  ///< Repeats left of runByte_.
+  size_t       copyLeft_  = 0;  ///< Literal bytes left to copy.
+  uint8        runByte_   = 0;
+  size_t       remaining_ = 0;
+};
+
+
+/// Streaming decoder for any VOL CompressionCode.  Dispatches once per Read() call rather than once per byte.
+class VolDecoder {
+public:
+  /// Starts decoding pSrc.  Returns false if the compression code is unknown.  @see LzhDecoder::Reset()
+  bool Reset(CompressionCode code, const void* pSrc, size_t srcSize, size_t length = SIZE_MAX);
+  bool Reset(CompressionCode code, std::string_view src, size_t length = SIZE_MAX)
+    { return Reset(code, src.data(), src.size(), length); }
+
+  /// Decodes up to size bytes into pDst.  Returns the number of bytes decoded;  less than size only once done.
+  size_t Read(void* pDst, size_t size);
+
+  bool IsDone()   const;
+  bool HasError() const;
+
+  /// Decodes all of pSrc into pDst, which must hold length bytes.  Returns false if the data is malformed.
+  static bool Decompress(CompressionCode code, const void* pSrc, size_t srcSize, void* pDst, size_t length);
+
+private:
+  CompressionCode code_    = CompressionCode::Uncompressed;
+  const uint8*    pRaw_    = nullptr;  ///< Uncompressed input.
+  size_t          rawLeft_ = 0;
+  LzhDecoder      lzh_;
+  LzDecoder       lz_;
+  RleDecoder      rle_;
+};
+
+
+/// MSB-first bit writer that appends to a byte vector, used by the VOL encoders.
+class VolBitWriter {
+public:
+  explicit VolBitWriter(std::vector<uint8>* pOut) : pOut_(pOut) { }
+
+  /// Writes the low numBits (1-32) bits of bits.
+  void Put(uint32 bits, int numBits) {
+    bits_     = (bits_ << numBits) | (uint64(bits) & ((uint64(1) << numBits) - 1));
+    numBits_ += numBits;
+    for (; numBits_ >= 8; numBits_ -= 8) {
+      pOut_->push_back(uint8(bits_ >> (numBits_ - 8)));
+    }
+  }
+
+  /// Writes any partial byte, padded with 0 bits.
+  void Flush() {
+    if (numBits_ > 0) {
+      pOut_->push_back(uint8(bits_ << (8 - numBits_)));
+      numBits_ = 0;
+    }
+  }
+
+private:
+  std::vector<uint8>* pOut_;
+  uint64              bits_    = 0;
+  int                 numBits_ = 0;
+};
+
+
+/// Hash chain match finder over a sliding window, used by the LZ and LZH encoders.
+class VolMatchFinder {
+public:
+  static constexpr int MinMatch = 3;  ///< Matches are found by hashing this many bytes.
+
+  /// Starts matching over pData.  Matches are at most windowSize bytes back, searching up to maxChain candidates.
+  void Reset(const uint8* pData, size_t size, size_t windowSize, int maxChain);
+
+  /// Adds pos to the hash chains, and returns the length of the longest match there (0 if less than MinMatch).
+  /// Positions must be inserted in order.
+  int FindAndInsert(size_t pos, int maxLength, size_t* pDistance);
+
+  /// Adds pos to the hash chains without searching.
+  void Insert(size_t pos);
+
+private:
+  static constexpr int HashBits = 15;
+
+  uint32 Hash(size_t pos) const
+    { return ((pData_[pos] << 16 | pData_[pos + 1] << 8 | pData_[pos + 2]) * 2654435761u) >> (32 - HashBits); }
+
+  const uint8*         pData_      = nullptr;
+  size_t               size_       = 0;
+  size_t               windowSize_ = 0;
+  int                  maxChain_   = 0;
+  std::vector<int64_t> head_;  ///< Last position with each hash, or -1.
+  std::vector<int64_t> prev_;  ///< Previous position with the same hash, indexed by (position % windowSize), or -1.
+};
+
+
+/// Native encoders for the VOL compression codes, producing data readable by VolDecoder (and the game's streams).
+class VolEncoder {
+public:
+  static constexpr int DefaultMaxChain = 64;  ///< Default match search depth;  higher compresses better but slower.
+
+  /// Compresses pSrc, appending the result to pOut.  Returns false if the compression code is unknown.
+  static bool Compress(
+    CompressionCode code, const void* pSrc, size_t size, std::vector<uint8>* pOut, int maxChain = DefaultMaxChain);
+
+  static void CompressLzh(const void* pSrc, size_t size, std::vector<uint8>* pOut, int maxChain = DefaultMaxChain);
+  static void CompressLz(const void*  pSrc, size_t size, std::vector<uint8>* pOut, int maxChain = DefaultMaxChain);
+  static void CompressRle(const void* pSrc, size_t size, std::vector<uint8>* pOut);
+};
+
+// =====================================================================================================================
+inline const LzhDecoder::DistanceTable& LzhDecoder::GetDistanceTable() {
+  static const DistanceTable table = [] {
+    // Number of distance codes (upper 6 bits) that use each code length from 3 to 8 bits.
+    static constexpr int CodesPerLength[] = { 1, 3, 8, 12, 24, 16 };
+
+    DistanceTable result = { };
+    int           index  = 0;
+    int           code   = 0;
+    for (int length = 3; length <= 8; ++length) {
+      for (int i = 0; i < CodesPerLength[length - 3]; ++i, ++code) {
+        for (int j = 0; j < (256 >> length); ++j, ++index) {
+          result.code[index]   = uint8(code);
+          result.length[index] = uint8(length);
+        }
+      }
+    }
+    return result;
+  }();
+
+  return table;
+}
+
+// =====================================================================================================================
+inline void LzhDecoder::Tree::Init() {
+  for (int i = 0; i < NumCodes; ++i) {
+    freq_[i]              = 1;
+    son_[i]               = uint16(i + TreeSize);
+    parent_[i + TreeSize] = uint16(i);
+  }
+
+  for (int i = 0, j = NumCodes; j <= Root; i += 2, ++j) {
+    freq_[j]   = freq_[i] + freq_[i + 1];
+    son_[j]    = uint16(i);
+    parent_[i] = parent_[i + 1] = uint16(j);
+  }
+
+  freq_[TreeSize] = 0xFFFF;
+  parent_[Root]   = 0;
+}
+
+// =====================================================================================================================
+inline void LzhDecoder::Tree::Rebuild() {
+  // Collect the leaves in the first half of the table, halving their frequencies.
+  for (int i = 0, j = 0; i < TreeSize; ++i) {
+    if (son_[i] >= TreeSize) {
+      freq_[j] = uint16((freq_[i] + 1) / 2);
+      son_[j]  = son_[i];
+      ++j;
+    }
+  }
+
+  // Connect sons, keeping nodes sorted by frequency.
+  for (int i = 0, j = NumCodes; j < TreeSize; i += 2, ++j) {
+    const uint16 f = uint16(freq_[i] + freq_[i + 1]);
+    int          k = j - 1;
+    for (; f < freq_[k]; --k);
+    ++k;
+
+    std::copy_backward(&freq_[k], &freq_[j], &freq_[j + 1]);
+    std::copy_backward(&son_[k],  &son_[j],  &son_[j + 1]);
+    freq_[k] = f;
+    son_[k]  = uint16(i);
+  }
+
+  // Connect parents.
+  for (int i = 0; i < TreeSize; ++i) {
+    const int k = son_[i];
+    parent_[k] = uint16(i);
+    if (k < TreeSize) {
+      parent_[k + 1] = uint16(i);
+    }
+  }
+}
+
+// =====================================================================================================================
+inline void LzhDecoder::Tree::Update(
+  int code)
+{
+  if (freq_[Root] == MaxFreq) {
+    Rebuild();
+  }
+
+  int c = parent_[code + TreeSize];
+  do {
+    const uint16 k = ++freq_[c];
+
+    // If the increment breaks frequency order, swap this node with the last node of lower frequency.
+    int l = c + 1;
+    if (k > freq_[l]) {
+      for (; k > freq_[l + 1]; ++l);
+      freq_[c] = freq_[l];
+      freq_[l] = k;
+
+      const int i = son_[c];
+      parent_[i] = uint16(l);
+      if (i < TreeSize) {
+        parent_[i + 1] = uint16(l);
+      }
+
+      const int j = son_[l];
+      son_[l]    = uint16(i);
+      parent_[j] = uint16(c);
+      if (j < TreeSize) {
+        parent_[j + 1] = uint16(c);
+      }
+      son_[c] = uint16(j);
+
+      c = l;
+    }
+  } while ((c = parent_[c]) != 0);
+}
+
+// =====================================================================================================================
+inline void LzhDecoder::Reset(
+  const void*  pSrc,
+  size_t       srcSize,
+  size_t       length)
+{
+  reader_.Reset(pSrc, srcSize);
+  tree_.Init();
+  memset(&window_[0], ' ', sizeof(window_));
+  writeIndex_ = 0;
+  matchIndex_ = 0;
+  matchLeft_  = 0;
+  remaining_  = length;
+  inputDone_  = false;
+}
+
+// =====================================================================================================================
+inline int LzhDecoder::DecodeNext() {
+  if (inputDone_ || (reader_.BitsLeft() <= 0)) {
+    inputDone_ = true;
+    return -1;
+  }
+
+  // Tree depth is bounded by MaxFreq (~23 levels) and distances take at most 14 bits, so one refill covers the code.
+  reader_.Refill();
+
+  int node = tree_.son_[Root];
+  while (node < TreeSize) {
+    node = tree_.son_[node + int(reader_.Get(1))];
+  }
+  const int code = node - TreeSize;
+  tree_.Update(code);
+
+  if (code >= 256) {
+    const DistanceTable& table    = GetDistanceTable();
+    const uint32         next8    = reader_.Peek(8);
+    const size_t         distance = (size_t(table.code[next8]) << 6) | (reader_.Get(table.length[next8] + 6) & 0x3F);
+
+    matchIndex_ = (writeIndex_ - distance - 1) & (WindowSize - 1);
+    matchLeft_  = size_t(code) - 256 + MinMatch;
+  }
+
+  if (reader_.IsOverrun()) {
+    inputDone_ = true;
+    matchLeft_ = 0;
+  }
+
+  return inputDone_ ? -1 : code;
+}
+
+// =====================================================================================================================
+inline size_t LzhDecoder::Read(
+  void*   pDst,
+  size_t  size)
+{
+  uint8*const  pOut  = static_cast<uint8*>(pDst);
+  const size_t count = (std::min)(size, remaining_);
+  size_t       out   = 0;
+
+  while (out < count) {
+    if (matchLeft_ != 0) {
+      const size_t length = (std::min)(matchLeft_, count - out);
+      for (size_t i = 0; i < length; ++i) {
+        const uint8 c = window_[matchIndex_];
+        window_[writeIndex_] = c;
+        pOut[out++]          = c;
+        matchIndex_          = (matchIndex_ + 1) & (WindowSize - 1);
+        writeIndex_          = (writeIndex_ + 1) & (WindowSize - 1);
+      }
+      matchLeft_ -= length;
+    }
+    else {
+      const int code = DecodeNext();
+      if (code < 0) {
+        break;
+      }
+      else if (code < 256) {
+        window_[writeIndex_] = uint8(code);
+        pOut[out++]          = uint8(code);
+        writeIndex_          = (writeIndex_ + 1) & (WindowSize - 1);
+      }
+    }
+  }
+
+  if (remaining_ != SIZE_MAX) {
+    remaining_ -= out;
+  }
+
+  return out;
+}
+
+// =====================================================================================================================
+inline void LzDecoder::Reset(
+  const void*  pSrc,
+  size_t       srcSize,
+  size_t       length)
+{
+  reader_.Reset(pSrc, srcSize);
+  memset(&window_[0], 0, sizeof(window_));
+  writeIndex_ = 1;
+  matchIndex_ = 0;
+  matchLeft_  = 0;
+  remaining_  = length;
+  inputDone_  = false;
+}
+
+// =====================================================================================================================
+inline int LzDecoder::DecodeNext() {
+  if (inputDone_ || (reader_.BitsLeft() <= 0)) {
+    inputDone_ = true;
+    return -1;
+  }
+
+  reader_.Refill();
+
+  int code = -1;
+  if (reader_.Get(1)) {
+    code = int(reader_.Get(8));
+  }
+  else {
+    const uint32 position = reader_.Get(WindowBits);
+    if (position == 0) {
+      inputDone_ = true;  // End of stream marker
+    }
+    else {
+      matchIndex_ = position;
+      matchLeft_  = size_t(reader_.Get(LengthBits)) + MinMatch;
+      code        = 256;
+    }
+  }
+
+  if (reader_.IsOverrun()) {
+    inputDone_ = true;
+    matchLeft_ = 0;
+  }
+
+  return inputDone_ ? -1 : code;
+}
+
+// =====================================================================================================================
+inline size_t LzDecoder::Read(
+  void*   pDst,
+  size_t  size)
+{
+  uint8*const  pOut  = static_cast<uint8*>(pDst);
+  const size_t count = (std::min)(size, remaining_);
+  size_t       out   = 0;
+
+  while (out < count) {
+    if (matchLeft_ != 0) {
+      const size_t length = (std::min)(matchLeft_, count - out);
+      for (size_t i = 0; i < length; ++i) {
+        const uint8 c = window_[matchIndex_];
+        window_[writeIndex_] = c;
+        pOut[out++]          = c;
+        matchIndex_          = (matchIndex_ + 1) & (WindowSize - 1);
+        writeIndex_          = (writeIndex_ + 1) & (WindowSize - 1);
+      }
+      matchLeft_ -= length;
+    }
+    else {
+      const int code = DecodeNext();
+      if (code < 0) {
+        break;
+      }
+      else if (code < 256) {
+        window_[writeIndex_] = uint8(code);
+        pOut[out++]          = uint8(code);
+        writeIndex_          = (writeIndex_ + 1) & (WindowSize - 1);
+      }
+    }
+  }
+
+  if (remaining_ != SIZE_MAX) {
+    remaining_ -= out;
+  }
+
+  return out;
+}
+
+// =====================================================================================================================
+inline void RleDecoder::Reset(
+  const void*  pSrc,
+  size_t       srcSize,
+  size_t       length)
+{
+  pSrc_      = static_cast<const uint8*>(pSrc);
+  pEnd_      = pSrc_ + srcSize;
+  runLeft_   = 0;
+  copyLeft_  = 0;
+  runByte_   = 0;
+  remaining_ = length;
+}
+
+// =====================================================================================================================
+inline size_t RleDecoder::Read(
+  void*   pDst,
+  size_t  size)
+{
+  uint8*const  pOut  = static_cast<uint8*>(pDst);
+  const size_t count = (std::min)(size, remaining_);
+  size_t       out   = 0;
+
+  while (out < count) {
+    if (runLeft_ != 0) {
+      const size_t length = (std::min)(runLeft_, count - out);
+      memset(pOut + out, runByte_, length);
+      runLeft_ -= length;
+      out      += length;
+    }
+    else if (copyLeft_ != 0) {
+      const size_t length = (std::min)({ copyLeft_, count - out, size_t(pEnd_ - pSrc_) });
+      memcpy(pOut + out, pSrc_, length);
+      pSrc_    += length;
+      copyLeft_ = (pSrc_ == pEnd_) ? 0 : (copyLeft_ - length);
+      out      += length;
+    }
+    else if (pSrc_ != pEnd_) {
+      const uint8 control = *(pSrc_++);
+      if ((control & 0x80) == 0) {
+        copyLeft_ = size_t(control) + 1;
+      }
+      else if (pSrc_ != pEnd_) {
+        runByte_ = *(pSrc_++);
+        runLeft_ = size_t(control & 0x7F) + 1;
+      }
+    }
+    else {
+      break;
+    }
+  }
+
+  if (remaining_ != SIZE_MAX) {
+    remaining_ -= out;
+  }
+
+  return out;
+}
+
+// =====================================================================================================================
+inline bool VolDecoder::Reset(
+  CompressionCode  code,
+  const void*      pSrc,
+  size_t           srcSize,
+  size_t           length)
+{
+  bool result = true;
+  code_ = code;
+
+  switch (code) {
+  case CompressionCode::Uncompressed:
+    pRaw_    = static_cast<const uint8*>(pSrc);
+    rawLeft_ = (std::min)(srcSize, length);
+    break;
+  case CompressionCode::RLE:  rle_.Reset(pSrc, srcSize, length);  break;
+  case CompressionCode::LZ:   lz_.Reset(pSrc, srcSize, length);   break;
+  case CompressionCode::LZH:  lzh_.Reset(pSrc, srcSize, length);  break;
+  default:
+    pRaw_    = nullptr;
+    rawLeft_ = 0;
+    result   = false;
+    break;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline size_t VolDecoder::Read(
+  void*   pDst,
+  size_t  size)
+{
+  size_t result = 0;
+
+  switch (code_) {
+  case CompressionCode::Uncompressed:
+    result = (std::min)(size, rawLeft_);
+    if (result != 0) {
+      memcpy(pDst, pRaw_, result);
+    }
+    pRaw_    += result;
+    rawLeft_ -= result;
+    break;
+  case CompressionCode::RLE:  result = rle_.Read(pDst, size);  break;
+  case CompressionCode::LZ:   result = lz_.Read(pDst, size);   break;
+  case CompressionCode::LZH:  result = lzh_.Read(pDst, size);  break;
+  default:                                                     break;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool VolDecoder::IsDone() const {
+  switch (code_) {
+  case CompressionCode::RLE:  return rle_.IsDone();
+  case CompressionCode::LZ:   return lz_.IsDone();
+  case CompressionCode::LZH:  return lzh_.IsDone();
+  default:                    return (rawLeft_ == 0);
+  }
+}
+
+// =====================================================================================================================
+inline bool VolDecoder::HasError() const {
+  switch (code_) {
+  case CompressionCode::Uncompressed:  return false;
+  case CompressionCode::RLE:           return rle_.HasError();
+  case CompressionCode::LZ:            return lz_.HasError();
+  case CompressionCode::LZH:           return lzh_.HasError();
+  default:                             return true;
+  }
+}
+
+// =====================================================================================================================
+inline bool VolDecoder::Decompress(
+  CompressionCode  code,
+  const void*      pSrc,
+  size_t           srcSize,
+  void*            pDst,
+  size_t           length)
+{
+  // The LZH state (window and tree) is ~10 KB, so keep it off the stack.
+  static thread_local VolDecoder decoder;
+  return decoder.Reset(code, pSrc, srcSize, length) && (decoder.Read(pDst, length) == length);
+}
+
+// =====================================================================================================================
+inline void VolMatchFinder::Reset(
+  const uint8*  pData,
+  size_t        size,
+  size_t        windowSize,
+  int           maxChain)
+{
+  pData_      = pData;
+  size_       = size;
+  windowSize_ = windowSize;
+  maxChain_   = maxChain;
+  head_.assign(size_t(1) << HashBits, -1);
+  prev_.assign(windowSize, -1);
+}
+
+// =====================================================================================================================
+inline void VolMatchFinder::Insert(
+  size_t pos)
+{
+  if ((pos + MinMatch) <= size_) {
+    const uint32 hash = Hash(pos);
+    prev_[pos % windowSize_] = head_[hash];
+    head_[hash]              = int64_t(pos);
+  }
+}
+
+// =====================================================================================================================
+inline int VolMatchFinder::FindAndInsert(
+  size_t   pos,
+  int      maxLength,
+  size_t*  pDistance)
+{
+  int bestLength = 0;
+
+  if ((pos + MinMatch) <= size_) {
+    maxLength = int((std::min)(size_t(maxLength), size_ - pos));
+
+    const uint8*const pCur      = pData_ + pos;
+    int64_t           candidate = head_[Hash(pos)];
+
+    for (int chain = 0; (candidate >= 0) && (chain < maxChain_); ++chain) {
+      const size_t distance = pos - size_t(candidate);
+      if (distance > windowSize_) {
+        break;
+      }
+
+      // Check the byte that would extend the best match first, since most candidates fail there.
+      const uint8*const pCandidate = pData_ + candidate;
+      if (pCandidate[bestLength] == pCur[bestLength]) {
+        int length = 0;
+        for (; (length < maxLength) && (pCandidate[length] == pCur[length]); ++length);
+        if (length > bestLength) {
+          bestLength = length;
+          *pDistance = distance;
+          if (length >= maxLength) {
+            break;
+          }
+        }
+      }
+
+      const int64_t next = prev_[size_t(candidate) % windowSize_];
+      candidate = (next < candidate) ? next : -1;  // Stop at stale entries that have been overwritten.
+    }
+
+    Insert(pos);
+  }
+
+  return (bestLength >= MinMatch) ? bestLength : 0;
+}
+
+// =====================================================================================================================
+inline bool VolEncoder::Compress(
+  CompressionCode      code,
+  const void*          pSrc,
+  size_t               size,
+  std::vector<uint8>*  pOut,
+  int                  maxChain)
+{
+  bool result = true;
+
+  switch (code) {
+  case CompressionCode::Uncompressed:
+    pOut->insert(pOut->end(), static_cast<const uint8*>(pSrc), static_cast<const uint8*>(pSrc) + size);
+    break;
+  case CompressionCode::RLE:  CompressRle(pSrc, size, pOut);            break;
+  case CompressionCode::LZ:   CompressLz(pSrc,  size, pOut, maxChain);  break;
+  case CompressionCode::LZH:  CompressLzh(pSrc, size, pOut, maxChain);  break;
+  default:                    result = false;                           break;
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline void VolEncoder::CompressLzh(
+  const void*          pSrc,
+  size_t               size,
+  std::vector<uint8>*  pOut,
+  int                  maxChain)
+{
+  using Dec = LzhDecoder;
+
+  const uint8*const pData = static_cast<const uint8*>(pSrc);
+  VolBitWriter      writer(pOut);
+  VolMatchFinder    finder;
+  Dec::Tree         tree;
+  tree.Init();
+  finder.Reset(pData, size, Dec::WindowSize, maxChain);
+
+  // Build the inverse of the decoder's distance table:  the prefix code and its length for each upper 6 bits.
+  const Dec::DistanceTable& table = Dec::GetDistanceTable();
+  uint8 distanceCode[64];
+  uint8 distanceBits[64];
+  for (int i = 255; i >= 0; --i) {
+    distanceBits[table.code[i]] = table.length[i];
+    distanceCode[table.code[i]] = uint8(i >> (8 - table.length[i]));
+  }
+
+  auto putCode = [&writer, &tree](int code) {
+    // Walk from the leaf up to the root;  each node's parity is the bit that selects it.
+    uint32 bits    = 0;
+    int    numBits = 0;
+    for (int node = tree.parent_[code + Dec::TreeSize]; node != Dec::Root; node = tree.parent_[node], ++numBits) {
+      bits |= uint32(node & 1) << numBits;
+    }
+    writer.Put(bits, numBits);
+    tree.Update(code);
+  };
+
+  size_t distance = 0;
+  int    length   = finder.FindAndInsert(0, Dec::MaxMatch, &distance);
+
+  for (size_t pos = 0; pos < size;) {
+    // Lazy matching:  emit a literal instead if the next position has a longer match.
+    size_t nextDistance = 0;
+    const int nextLength = (length != 0) ? finder.FindAndInsert(pos + 1, Dec::MaxMatch, &nextDistance) : 0;
+
+    if ((length != 0) && (nextLength <= length)) {
+      const size_t d = distance - 1;
+      putCode(256 + length - Dec::MinMatch);
+      writer.Put(distanceCode[d >> 6], distanceBits[d >> 6]);
+      writer.Put(uint32(d & 0x3F), 6);
+
+      for (size_t i = pos + 2; i < (pos + length); finder.Insert(i++));
+      pos   += length;
+      length = (pos < size) ? finder.FindAndInsert(pos, Dec::MaxMatch, &distance) : 0;
+    }
+    else {
+      putCode(pData[pos]);
+      ++pos;
+      if (length != 0) {
+        length   = nextLength;
+        distance = nextDistance;
+      }
+      else {
+        length = (pos < size) ? finder.FindAndInsert(pos, Dec::MaxMatch, &distance) : 0;
+      }
+    }
+  }
+
+  writer.Flush();
+}
+
+// =====================================================================================================================
+inline void VolEncoder::CompressLz(
+  const void*          pSrc,
+  size_t               size,
+  std::vector<uint8>*  pOut,
+  int                  maxChain)
+{
+  using Dec = LzDecoder;
+
+  static constexpr int MaxMatch = (1 << Dec::LengthBits) + Dec::MinMatch - 1;
+
+  const uint8*const pData = static_cast<const uint8*>(pSrc);
+  VolBitWriter      writer(pOut);
+  VolMatchFinder    finder;
+  finder.Reset(pData, size, Dec::WindowSize, maxChain);
+
+  for (size_t pos = 0; pos < size;) {
+    size_t distance = 0;
+    int    length   = finder.FindAndInsert(pos, MaxMatch, &distance);
+
+    // Matches are coded by absolute window position, where the decoder's writes start at 1.  Position 0 is the end of
+    // stream marker, so matches starting there must be coded as literals.
+    const uint32 position = uint32(pos - distance + 1) & (Dec::WindowSize - 1);
+    if ((length != 0) && (position != 0)) {
+      writer.Put(0, 1);
+      writer.Put(position, Dec::WindowBits);
+      writer.Put(uint32(length - Dec::MinMatch), Dec::LengthBits);
+      for (size_t i = pos + 1; i < (pos + length); finder.Insert(i++));
+      pos += length;
+    }
+    else {
+      writer.Put(0x100 | pData[pos], 9);
+      ++pos;
+    }
+  }
+
+  writer.Put(0, 1 + Dec::WindowBits);
+  writer.Flush();
+}
+
+// =====================================================================================================================
+inline void VolEncoder::CompressRle(
+  const void*          pSrc,
+  size_t               size,
+  std::vector<uint8>*  pOut)
+{
+  static constexpr size_t MaxPacket = 128;
+  static constexpr size_t MinRun    = 3;  ///< Shorter runs are cheaper to code as literals.
+
+  const uint8*const pData = static_cast<const uint8*>(pSrc);
+
+  auto runLength = [pData, size](size_t pos) {
+    size_t length = 1;
+    for (; ((pos + length) < size) && (length < MaxPacket) && (pData[pos + length] == pData[pos]); ++length);
+    return length;
+  };
+
+  for (size_t pos = 0; pos < size;) {
+    const size_t run = runLength(pos);
+    if (run >= MinRun) {
+      pOut->push_back(uint8(0x80 | (run - 1)));
+      pOut->push_back(pData[pos]);
+      pos += run;
+    }
+    else {
+      // Gather literals up to the next run worth coding.
+      size_t end = pos + run;
+      for (; (end < size) && ((end - pos) < MaxPacket) && (runLength(end) < MinRun); ++end);
+      end = (std::min)(end, pos + MaxPacket);
+
+      pOut->push_back(uint8(end - pos - 1));
+      pOut->insert(pOut->end(), pData + pos, pData + end);
+      pos = end;
+    }
+  }
+}
+
+} // Tethys
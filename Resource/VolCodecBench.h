@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Tethys/Resource/VolCodec.h"
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace Tethys {
+
+/// VolDecoder throughput benchmark result for one compression code.
+struct VolCodecBenchmarkResult {
+  CompressionCode code;
+  size_t          rawSize;
+  size_t          compressedSize;
+  double          encodeMBps;        ///< Uncompressed MB/s of VolEncoder.
+  double          decodeMBps;        ///< Uncompressed MB/s of VolDecoder, best of numIterations.
+  bool            matchesInput;      ///< Decoded output is identical to the input.
+};
+
+/// Generates synthetic data resembling a VOL archive's contents:  sheet-like CSV text, followed by map-like tile data
+/// (32-bit tile words with runs of repeated terrain).
+inline std::vector<uint8> MakeVolCodecBenchmarkData(
+  size_t size = size_t(4) << 20)
+{
+  std::vector<uint8> data;
+  data.reserve(size + 256);
+
+  uint32 seed = 0x0F2A11CE;
+  const auto Next = [&seed](uint32 range) { seed = (seed * 1103515245) + 12345;  return (seed >> 8) % range; };
+
+  for (int row = 0; data.size() < (size / 4); ++row) {
+    static constexpr uint32 Ranges[] = { 64, 5000, 300, 16, 4, 100 };
+    uint32 fields[6];
+    for (size_t i = 0; i < 6; fields[i] = Next(Ranges[i]), ++i);
+
+    char line[128];
+    const int length = snprintf(line, sizeof(line), "%d,Unit%u,%u,%u,%u,%u,%u\r\n",
+                                row, fields[0], fields[1], fields[2], fields[3] * 25, fields[4], fields[5]);
+    data.insert(data.end(), &line[0], &line[length]);
+  }
+
+  for (uint32 tile = 0; data.size() < size;) {
+    if (Next(8) == 0) {
+      // New terrain run.
+      const uint32 tileIndex = Next(2048);
+      tile = (tileIndex << 5) | Next(12);
+    }
+    for (int i = 0; i < 4; data.push_back(uint8(tile >> (i++ * 8))));
+  }
+
+  data.resize(size);
+  return data;
+}
+
+/// Encodes the data with each compression code, then times decoding it with VolDecoder::Read() in chunkSize byte
+/// reads.  Pass nullptr to use MakeVolCodecBenchmarkData(), or e.g. the contents of a real archive's files.
+inline std::vector<VolCodecBenchmarkResult> RunVolCodecBenchmark(
+  const void*  pData         = nullptr,
+  size_t       size          = 0,
+  size_t       chunkSize     = 4096,
+  int          numIterations = 5)
+{
+  using Clock = std::chrono::steady_clock;
+
+  std::vector<uint8> synthetic;
+  if (pData == nullptr) {
+    synthetic = MakeVolCodecBenchmarkData();
+    pData     = synthetic.data();
+    size      = synthetic.size();
+  }
+
+  const auto   MBps   = [size](double ns) { return (double(size) * 1e9) / (((ns > 0.0) ? ns : 1.0) * (1 << 20)); };
+  const uint8* pBytes = static_cast<const uint8*>(pData);
+
+  std::vector<VolCodecBenchmarkResult> results;
+  std::vector<uint8>                   compressed;
+  std::vector<uint8>                   decoded(size);
+  VolDecoder                           decoder;
+
+  for (const CompressionCode code : { CompressionCode::RLE, CompressionCode::LZ, CompressionCode::LZH }) {
+    compressed.clear();
+    auto start = Clock::now();
+    VolEncoder::Compress(code, pData, size, &compressed);
+    const double encodeNs = double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+
+    double best    = 0.0;
+    bool   matches = true;
+    for (int i = 0; i < numIterations; ++i) {
+      std::fill(decoded.begin(), decoded.end(), uint8(0));
+      start = Clock::now();
+      decoder.Reset(code, compressed.data(), compressed.size(), size);
+      for (size_t pos = 0; pos < size;) {
+        const size_t read = decoder.Read(&decoded[pos], (std::min)(chunkSize, size - pos));
+        pos = (read != 0) ? (pos + read) : size;
+      }
+      const double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+
+      best    = (std::max)(best, MBps(ns));
+      matches = matches && (std::equal(decoded.begin(), decoded.end(), pBytes)) && (decoder.HasError() == false);
+    }
+
+    results.push_back({ code, size, compressed.size(), MBps(encodeNs), best, matches });
+  }
+
+  return results;
+}
+
+} // Tethys
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Tethys/Common/Types.h"
+
+namespace Tethys {
+
+/// Makes a VOL section tag from a 4-character string, e.g. MakeVolTag("VBLK").
+constexpr uint32 MakeVolTag(const char (&tag)[5]) {
+  return uint32(uint8(tag[0]))         | (uint32(uint8(tag[1])) << 8) |
+        (uint32(uint8(tag[2])) << 16) | (uint32(uint8(tag[3])) << 24);
+}
+
+///@{ VOL section tags.
+constexpr uint32 VolTagVol    = MakeVolTag("VOL ");  ///< Archive header, containing the volh, vols and voli sections.
+constexpr uint32 VolTagHeader = MakeVolTag("volh");  ///< (Empty) header info.
+constexpr uint32 VolTagNames  = MakeVolTag("vols");  ///< File name string table.
+constexpr uint32 VolTagIndex  = MakeVolTag("voli");  ///< VolIndexEntry table.
+constexpr uint32 VolTagBlock  = MakeVolTag("VBLK");  ///< File data block.
+///@}
+
+enum class CompressionCode : uint8 {
+  Uncompressed = 0,
+  RLE,
+  LZ,
+  LZH,
+};
+
+BEGIN_PACKED
+
+struct VolIndexEntry {
+  uint32          fileNameOffset;   ///< Offset in string table
+  uint32          dataOffset;       ///< Offset to the data in the Vol file
+  uint32          dataLength;       ///< Length of the internal file data
+  CompressionCode compressionCode;  ///< Compression used on file data
+  uint8           bUsed;            ///< Indicates index entry is valid (Not quite bool? Tested against 1)
+                                    ///  [Unused entries must only occur at the end of the table (binary searched)]
+};
+static_assert(sizeof(VolIndexEntry) == 14, "Incorrect VolIndexEntry size.");
+
+/// Header of each VOL section.  Sections are padded to the alignment, and the 'VOL ' section contains the volh, vols
+/// and voli sections.
+struct VBlkHeader {
+  uint32 tag;             ///< 'VBLK'
+  uint32 size      : 31;  ///< Size of the section data following the header (excluding padding)
+  uint32 alignment :  1;  ///< 0 = 16 bit, 1 = 32 bit
+};
+static_assert(sizeof(VBlkHeader) == 8, "Incorrect VBlkHeader size.");
+
+END_PACKED
+
+} // Tethys
@@ -0,0 +1,358 @@
+#pragma once
+
+#include "Tethys/Common/Util.h"
+#include "Tethys/Common/WorkStealingPool.h"
+#include "Tethys/Resource/VolArchive.h"
+#include "Tethys/Resource/VolCodec.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <cstdio>
+
+namespace Tethys {
+
+/// Native .vol archive writer that compresses entries in parallel.
+///
+/// Files are added by name with their contents or a path to load them from, then Write() loads, hashes and compresses
+/// every entry on a WorkStealingPool, and writes the archive in one pass:  header, name table and index sorted by name
+/// (@see VolArchive::CompareNames()), then the data blocks.
+///
+/// Archives registered with AddReuseSource() are indexed by content hash, and entries whose contents match an existing
+/// blob (with the same compression code) reuse its stored data instead of being compressed again, so incremental
+/// repacks only pay for files that changed.  Hash matches are confirmed by comparing the contents.
+///
+/// @note  Names must be unique (case-insensitive);  if a name is added more than once, the last one added is kept.
+class VolPacker {
+public:
+  struct Stats {
+    size_t numFiles;       ///< Entries written.
+    size_t numCompressed;  ///< Entries compressed in this pack.
+    size_t numReused;      ///< Entries whose stored data was reused from a reuse source.
+    uint64 inputBytes;     ///< Total uncompressed size of all entries.
+    uint64 outputBytes;    ///< Total size of the archive written.
+  };
+
+  /// If storeSmaller is set, entries that do not shrink when compressed are stored uncompressed.
+  explicit VolPacker(bool storeSmaller = true, int maxChain = VolEncoder::DefaultMaxChain)
+    : storeSmaller_(storeSmaller), maxChain_(maxChain) { }
+
+  /// Adds a file from memory.  The data is copied.
+  void Add(std::string name, std::string_view data, CompressionCode code = CompressionCode::LZH)
+    { items_.push_back({ std::move(name), std::string(), std::string(data), code }); }
+
+  /// Adds a file to be loaded from disk when packing.
+  void AddFile(std::string name, std::string path, CompressionCode code = CompressionCode::LZH)
+    { items_.push_back({ std::move(name), std::move(path), std::string(), code }); }
+
+  /// Registers an archive (e.g. the previous build) whose stored blobs may be reused.  The archive must stay open until
+  /// Write() returns, so the new archive must be written to a different file.
+  void AddReuseSource(const VolArchive& archive) { reuseSources_.push_back(&archive); }
+
+  /// Removes all added files and reuse sources.
+  void Clear() { items_.clear();  reuseSources_.clear(); }
+
+  size_t NumFiles() const { return items_.size(); }
+
+  /// Packs all added files and writes the archive to pFilename.  numThreads = 0 uses all hardware threads.
+  /// Returns false if a file can't be loaded, the archive exceeds the format's size limits, or writing fails.
+  bool Write(const char* pFilename, int numThreads = 0);
+
+  /// Packs all added files and writes the archive to pOut.  @see Write()
+  bool WriteToMemory(std::vector<uint8>* pOut, int numThreads = 0);
+
+  /// Gets statistics of the last Write().
+  const Stats& GetStats() const { return stats_; }
+
+  /// 64-bit FNV-1a hash of file contents, used to match entries with reusable blobs.
+  static uint64 HashContents(const void* pData, size_t size) { return TethysUtil::Fnv1a<uint64>(pData, size); }
+
+private:
+  struct Item {
+    std::string        name;
+    std::string        path;      ///< If not empty, data is loaded from here.
+    std::string        data;
+    CompressionCode    code;
+
+    std::string_view   stored     = { };  ///< Data to write;  views compressed or into a reuse source.
+    CompressionCode    storedCode = CompressionCode::Uncompressed;
+    std::vector<uint8> compressed = { };
+    uint64             hash       = 0;
+    bool               reused     = false;
+    bool               ok         = false;
+  };
+
+  struct Blob {
+    std::string_view stored;
+    uint32           length;
+    CompressionCode  code;
+  };
+
+  /// Loads, hashes and compresses all items.  Returns false if any item fails.
+  bool Build(int numThreads);
+
+  /// Returns true if a blob decodes to exactly data.  Used to confirm hash matches before reusing a blob.
+  static bool SameContents(const Blob& blob, std::string_view data);
+
+  /// Writes the archive through write(const void* pData, size_t size), which returns false on failure.
+  template <typename WriteFn>  bool Emit(WriteFn&& write);
+
+  static size_t Pad4(size_t size) { return (size + 3) & ~size_t(3); }
+
+  bool                           storeSmaller_;
+  int                            maxChain_;
+  std::vector<Item>              items_;
+  std::vector<const VolArchive*> reuseSources_;
+  std::vector<size_t>            order_;  ///< Indices of the items to write, sorted by name.
+  Stats                          stats_ = { };
+};
+
+// =====================================================================================================================
+inline bool VolPacker::SameContents(
+  const Blob&       blob,
+  std::string_view  data)
+{
+  bool result = (blob.length == data.size());
+
+  if (result && (blob.code == CompressionCode::Uncompressed)) {
+    result = (blob.stored == data);
+  }
+  else if (result) {
+    // Decode in chunks, stopping at the first difference.
+    VolDecoder decoder;
+    result = decoder.Reset(blob.code, blob.stored, blob.length);
+
+    uint8 buffer[4096];
+    for (size_t pos = 0; result && (pos < data.size());) {
+      const size_t size = decoder.Read(buffer, (std::min)(sizeof(buffer), data.size() - pos));
+      result = (size != 0) && (memcmp(buffer, data.data() + pos, size) == 0);
+      pos   += size;
+    }
+
+    result = result && (decoder.HasError() == false);
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool VolPacker::Build(
+  int numThreads)
+{
+  stats_ = { };
+
+  // Sort by name, keeping the last of any duplicates.
+  order_.resize(items_.size());
+  for (size_t i = 0; i < order_.size(); order_[i] = i, ++i);
+  std::stable_sort(order_.begin(), order_.end(),
+                   [this](size_t a, size_t b) { return VolArchive::CompareNames(items_[a].name, items_[b].name) < 0; });
+
+  size_t numUnique = 0;
+  for (size_t i = 0; i < order_.size(); ++i) {
+    const bool isLast = ((i + 1) == order_.size()) ||
+                        (VolArchive::CompareNames(items_[order_[i]].name, items_[order_[i + 1]].name) != 0);
+    if (isLast) {
+      order_[numUnique++] = order_[i];
+    }
+  }
+  order_.resize(numUnique);
+
+  // Index the reuse sources' blobs by the hash of their decoded contents.
+  std::vector<const VolArchive::Entry*> sourceEntries;
+  for (const VolArchive* pArchive : reuseSources_) {
+    for (const VolArchive::Entry& entry : *pArchive) {
+      sourceEntries.push_back(&entry);
+    }
+  }
+
+  std::vector<uint64> sourceHashes(sourceEntries.size());
+  std::vector<char>   sourceValid(sourceEntries.size());
+  WorkStealingPool::ParallelFor(sourceEntries.size(), numThreads, [&](size_t i, int) {
+    const VolArchive::Entry& entry = *sourceEntries[i];
+    if (entry.IsCompressed() == false) {
+      sourceHashes[i] = HashContents(entry.data.data(), entry.data.size());
+      sourceValid[i]  = (entry.data.size() == entry.length);
+    }
+    else {
+      std::vector<uint8> decoded(entry.length);
+      sourceValid[i]  = VolDecoder::Decompress(entry.compression, entry.data.data(), entry.data.size(),
+                                               decoded.data(), decoded.size());
+      sourceHashes[i] = HashContents(decoded.data(), decoded.size());
+    }
+  });
+
+  std::unordered_map<uint64, std::vector<Blob>> blobs;
+  for (size_t i = 0; i < sourceEntries.size(); ++i) {
+    if (sourceValid[i]) {
+      const VolArchive::Entry& entry = *sourceEntries[i];
+      blobs[sourceHashes[i]].push_back({ entry.data, entry.length, entry.compression });
+    }
+  }
+
+  // Load, hash and compress entries.
+  WorkStealingPool::ParallelFor(order_.size(), numThreads, [&](size_t i, int) {
+    Item& item = items_[order_[i]];
+    item.ok    = true;
+
+    if (item.path.empty() == false) {
+      item.data.clear();
+      FILE*const pFile = fopen(item.path.c_str(), "rb");
+      item.ok = (pFile != nullptr);
+      if (item.ok) {
+        char buffer[65536];
+        for (size_t n; (n = fread(buffer, 1, sizeof(buffer), pFile)) != 0; item.data.append(buffer, n));
+        item.ok = (ferror(pFile) == 0);
+        fclose(pFile);
+      }
+    }
+
+    item.ok = item.ok && (item.data.size() <= 0x7FFFFFFF);
+    if (item.ok) {
+      item.hash   = HashContents(item.data.data(), item.data.size());
+      item.reused = false;
+
+      // Reuse a blob with the same contents that was stored with the requested code (or stored uncompressed because
+      // that code did not shrink it).
+      auto it = blobs.find(item.hash);
+      if (it != blobs.end()) {
+        for (const Blob& blob : it->second) {
+          if ((blob.length == item.data.size()) &&
+              ((blob.code == item.code) || (storeSmaller_ && (blob.code == CompressionCode::Uncompressed))) &&
+              SameContents(blob, item.data))
+          {
+            item.stored     = blob.stored;
+            item.storedCode = blob.code;
+            item.reused     = true;
+            break;
+          }
+        }
+      }
+
+      if (item.reused == false) {
+        item.compressed.clear();
+        item.ok = VolEncoder::Compress(item.code, item.data.data(), item.data.size(), &item.compressed, maxChain_);
+
+        const bool grew = (item.code != CompressionCode::Uncompressed) && (item.compressed.size() >= item.data.size());
+        if (storeSmaller_ && grew) {
+          item.stored     = item.data;
+          item.storedCode = CompressionCode::Uncompressed;
+        }
+        else {
+          item.stored     = { reinterpret_cast<const char*>(item.compressed.data()), item.compressed.size() };
+          item.storedCode = item.code;
+        }
+      }
+    }
+  });
+
+  bool result = true;
+  for (size_t index : order_) {
+    const Item& item = items_[index];
+    result = result && item.ok;
+    stats_.inputBytes    += item.data.size();
+    stats_.numReused     += item.reused ? 1 : 0;
+    stats_.numCompressed += ((item.reused == false) && (item.storedCode != CompressionCode::Uncompressed)) ? 1 : 0;
+  }
+  stats_.numFiles = order_.size();
+
+  return result;
+}
+
+// =====================================================================================================================
+template <typename WriteFn>
+bool VolPacker::Emit(
+  WriteFn&& write)
+{
+  static constexpr uint8 Padding[4] = { };
+
+  auto writeSection = [&write](uint32 tag, size_t size) {
+    VBlkHeader header;
+    header.tag       = tag;
+    header.size      = uint32(size);
+    header.alignment = 1;
+    return write(&header, sizeof(header));
+  };
+  auto writePadding = [&write](size_t size) { return (Pad4(size) == size) || write(Padding, Pad4(size) - size); };
+
+  // Lay out the name table, index and data blocks.
+  std::string names;
+  for (size_t index : order_) {
+    names += items_[index].name;
+    names += '\0';
+  }
+
+  const size_t namesSize  = sizeof(uint32) + names.size();
+  const size_t indexSize  = order_.size() * sizeof(VolIndexEntry);
+  const size_t headerSize = sizeof(VBlkHeader) + (sizeof(VBlkHeader) + Pad4(namesSize)) +
+                            (sizeof(VBlkHeader) + Pad4(indexSize));
+
+  std::vector<VolIndexEntry> index;
+  index.reserve(order_.size());
+  size_t nameOffset = 0;
+  size_t dataOffset = sizeof(VBlkHeader) + headerSize;
+  for (size_t i : order_) {
+    const Item& item = items_[i];
+    index.push_back({ uint32(nameOffset), uint32(dataOffset), uint32(item.data.size()), item.storedCode, 1 });
+    nameOffset += item.name.size() + 1;
+    dataOffset += sizeof(VBlkHeader) + Pad4(item.stored.size());
+  }
+
+  bool result = (dataOffset <= 0x7FFFFFFF);
+
+  if (result) {
+    const uint32 namesLength = uint32(names.size());
+    result = writeSection(VolTagVol, headerSize)                                   &&
+             writeSection(VolTagHeader, 0)                                         &&
+             writeSection(VolTagNames, namesSize)                                  &&
+             write(&namesLength, sizeof(namesLength))                              &&
+             write(names.data(), names.size())    && writePadding(namesSize)       &&
+             writeSection(VolTagIndex, indexSize)                                  &&
+             write(index.data(), indexSize)       && writePadding(indexSize);
+
+    for (size_t i = 0; result && (i < order_.size()); ++i) {
+      const std::string_view stored = items_[order_[i]].stored;
+      result = writeSection(VolTagBlock, stored.size()) && write(stored.data(), stored.size()) &&
+               writePadding(stored.size());
+    }
+  }
+
+  stats_.outputBytes = result ? dataOffset : 0;
+  return result;
+}
+
+// =====================================================================================================================
+inline bool VolPacker::Write(
+  const char*  pFilename,
+  int          numThreads)
+{
+  bool result = Build(numThreads);
+
+  if (result) {
+    FILE*const pFile = fopen(pFilename, "wb");
+    result = (pFile != nullptr) &&
+             Emit([pFile](const void* pData, size_t size) { return fwrite(pData, 1, size, pFile) == size; });
+    if (pFile != nullptr) {
+      result = (fclose(pFile) == 0) && result;
+    }
+  }
+
+  return result;
+}
+
+// =====================================================================================================================
+inline bool VolPacker::WriteToMemory(
+  std::vector<uint8>*  pOut,
+  int                  numThreads)
+{
+  pOut->clear();
+
+  return Build(numThreads) && Emit([pOut](const void* pData, size_t size) {
+    pOut->insert(pOut->end(), static_cast<const uint8*>(pData), static_cast<const uint8*>(pData) + size);
+    return true;
+  });
+}
+
+} // Tethys
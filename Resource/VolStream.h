@@ -2,34 +2,12 @@
 #pragma once
 
 #include "Tethys/Resource/CodecStream.h"
+#include "Tethys/Resource/VolFormat.h"
 
 namespace Tethys {
 
-enum class CompressionCode : uint8 {
-  Uncompressed = 0,
-  RLE,
-  LZ,
-  LZH,
-};
-
 BEGIN_PACKED
 
-struct VolIndexEntry {
-  uint32          fileNameOffset;   ///< Offset in string table
-  uint32          dataOffset;       ///< Offset to the data in the Vol file
-  uint32          dataLength;       ///< Length of the internal file data
-  CompressionCode compressionCode;  ///< Compression used on file data
-  uint8           bUsed;            ///< Indicates index entry is valid (Not quite bool? Tested against 1)
-                                    ///  [Unused entries must only occur at the end of the table (binary searched)]
-};
-
-struct VBlkHeader {
-  uint32 tag;             ///< 'VBLK'
-  uint32 size      : 31;  ///< Size, including header
-  uint32 alignment :  1;  ///< 0 = 16 bit, 1 = 32 bit
-};
-
-
 /// Base Vol VBLK read/write stream.
 class BaseVBlkRWStream : public StreamIO {
 public: